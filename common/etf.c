@@ -0,0 +1,659 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "etf.h"
+#include "cee-utils.h"
+
+#define ETF_MAX_DEPTH 256 ///< deepest nesting accepted when skipping/transcoding
+
+enum etf_tag {
+  NEW_FLOAT_EXT       = 70,
+  SMALL_INTEGER_EXT   = 97,
+  INTEGER_EXT         = 98,
+  FLOAT_EXT           = 99,
+  ATOM_EXT            = 100,
+  SMALL_TUPLE_EXT     = 104,
+  LARGE_TUPLE_EXT     = 105,
+  NIL_EXT             = 106,
+  STRING_EXT          = 107,
+  LIST_EXT            = 108,
+  BINARY_EXT          = 109,
+  SMALL_BIG_EXT       = 110,
+  LARGE_BIG_EXT       = 111,
+  SMALL_ATOM_EXT      = 115,
+  MAP_EXT             = 116,
+  ATOM_UTF8_EXT       = 118,
+  SMALL_ATOM_UTF8_EXT = 119
+};
+
+static uint32_t
+read_be(const char *p, int nbytes)
+{
+  uint32_t value=0;
+  for (int i=0; i < nbytes; ++i)
+    value = (value << 8) | (uint8_t)p[i];
+  return value;
+}
+
+bool
+etf_reader_init(struct etf_reader *reader, const char buf[], size_t len)
+{
+  *reader = (struct etf_reader){ .buf = buf, .len = len };
+  if (!len || ETF_VERSION != (uint8_t)buf[0])
+    return false;
+  reader->pos = 1;
+  return true;
+}
+
+/* 'nil', 'true' and 'false' atoms are decoded to their JSON equivalents */
+static void
+atom_eval(struct etf_term *term)
+{
+  if (etf_term_eq(term, "nil")) {
+    term->type = ETF_NULL;
+  }
+  else if (etf_term_eq(term, "true")) {
+    term->type = ETF_BOOLEAN;
+    term->value.boolean = true;
+  }
+  else if (etf_term_eq(term, "false")) {
+    term->type = ETF_BOOLEAN;
+    term->value.boolean = false;
+  }
+}
+
+bool
+etf_read(struct etf_reader *reader, struct etf_term *term)
+{
+  memset(term, 0, sizeof *term);
+
+  const char *p = reader->buf + reader->pos;
+  size_t left = reader->len - reader->pos;
+  if (!left) return false; /* EARLY RETURN */
+
+#define NEED(n) if (left < (size_t)(n)) return false
+  size_t used;
+  switch ((uint8_t)*p) {
+  case SMALL_INTEGER_EXT:
+      NEED(2);
+      term->type = ETF_INTEGER;
+      term->value.integer = (uint8_t)p[1];
+      used = 2;
+      break;
+  case INTEGER_EXT:
+      NEED(5);
+      term->type = ETF_INTEGER;
+      term->value.integer = (int32_t)read_be(p + 1, 4);
+      used = 5;
+      break;
+  case SMALL_BIG_EXT:
+  case LARGE_BIG_EXT: {
+      int hlen = (SMALL_BIG_EXT == (uint8_t)*p) ? 1 : 4;
+      NEED(2 + hlen);
+      size_t n = read_be(p + 1, hlen);
+      NEED(2 + hlen + n);
+      const uint8_t *digits = (const uint8_t*)p + 2 + hlen;
+      if (n > 8) {
+        for (size_t i=8; i < n; ++i) // doesn't fit unless zero-padded
+          if (digits[i]) return false;
+        n = 8;
+      }
+      term->type = ETF_BIG;
+      term->is_negative = (0 != p[1 + hlen]);
+      for (size_t i=n; i > 0; --i) // little-endian
+        term->big = (term->big << 8) | digits[i-1];
+      if (!term->is_negative && term->big <= INT64_MAX)
+        term->value.integer = (int64_t)term->big;
+      else if (term->is_negative && term->big && term->big - 1 <= INT64_MAX)
+        term->value.integer = -(int64_t)(term->big - 1) - 1; // down to INT64_MIN
+      else
+        term->value.integer = 0; // doesn't fit, only 'big' holds it
+      used = 2 + hlen + read_be(p + 1, hlen);
+      break; }
+  case NEW_FLOAT_EXT: {
+      NEED(9);
+      uint64_t bits = ((uint64_t)read_be(p + 1, 4) << 32) | read_be(p + 5, 4);
+      term->type = ETF_FLOAT;
+      memcpy(&term->value.real, &bits, sizeof(double));
+      used = 9;
+      break; }
+  case FLOAT_EXT: {
+      NEED(32);
+      char tmp[32];
+      memcpy(tmp, p + 1, 31);
+      tmp[31] = '\0';
+      term->type = ETF_FLOAT;
+      term->value.real = strtod(tmp, NULL);
+      used = 32;
+      break; }
+  case ATOM_EXT:
+  case ATOM_UTF8_EXT:
+  case STRING_EXT:
+      NEED(3);
+      term->value.str.size = read_be(p + 1, 2);
+      NEED(3 + term->value.str.size);
+      term->value.str.start = p + 3;
+      term->type = (STRING_EXT == (uint8_t)*p) ? ETF_STRING : ETF_ATOM;
+      used = 3 + term->value.str.size;
+      if (ETF_ATOM == term->type) atom_eval(term);
+      break;
+  case SMALL_ATOM_EXT:
+  case SMALL_ATOM_UTF8_EXT:
+      NEED(2);
+      term->value.str.size = (uint8_t)p[1];
+      NEED(2 + term->value.str.size);
+      term->value.str.start = p + 2;
+      term->type = ETF_ATOM;
+      used = 2 + term->value.str.size;
+      atom_eval(term);
+      break;
+  case BINARY_EXT:
+      NEED(5);
+      term->value.str.size = read_be(p + 1, 4);
+      NEED(5 + term->value.str.size);
+      term->value.str.start = p + 5;
+      term->type = ETF_STRING;
+      used = 5 + term->value.str.size;
+      break;
+  case NIL_EXT: // the empty list
+      term->type = ETF_LIST;
+      used = 1;
+      break;
+  case LIST_EXT:
+      NEED(5);
+      term->type = ETF_LIST;
+      term->value.amt = read_be(p + 1, 4);
+      used = 5;
+      break;
+  case SMALL_TUPLE_EXT:
+      NEED(2);
+      term->type = ETF_TUPLE;
+      term->value.amt = (uint8_t)p[1];
+      used = 2;
+      break;
+  case LARGE_TUPLE_EXT:
+  case MAP_EXT:
+      NEED(5);
+      term->type = (MAP_EXT == (uint8_t)*p) ? ETF_MAP : ETF_TUPLE;
+      term->value.amt = read_be(p + 1, 4);
+      used = 5;
+      break;
+  default:
+      return false;
+  }
+#undef NEED
+
+  reader->pos += used;
+  return true;
+}
+
+static bool skip(struct etf_reader *reader, int depth);
+
+/* an improper list's tail counts toward the nesting of its list */
+static bool
+read_tail(struct etf_reader *reader, int depth)
+{
+  if (reader->pos < reader->len && NIL_EXT == (uint8_t)reader->buf[reader->pos]) {
+    ++reader->pos; // proper list
+    return true;
+  }
+  return skip(reader, depth);
+}
+
+bool
+etf_read_tail(struct etf_reader *reader) {
+  return read_tail(reader, 0);
+}
+
+static bool
+skip(struct etf_reader *reader, int depth)
+{
+  if (depth > ETF_MAX_DEPTH) return false; /* EARLY RETURN */
+
+  bool is_list = (reader->pos < reader->len && LIST_EXT == (uint8_t)reader->buf[reader->pos]);
+  struct etf_term term;
+  if (!etf_read(reader, &term)) return false; /* EARLY RETURN */
+
+  size_t amt;
+  switch (term.type) {
+  case ETF_LIST:
+  case ETF_TUPLE: amt = term.value.amt; break;
+  case ETF_MAP:   amt = 2 * term.value.amt; break;
+  default:        return true;
+  }
+  for (size_t i=0; i < amt; ++i)
+    if (!skip(reader, depth + 1)) return false;
+  return is_list ? read_tail(reader, depth + 1) : true;
+}
+
+bool
+etf_skip(struct etf_reader *reader) {
+  return skip(reader, 0);
+}
+
+uint64_t
+etf_term_u64(const struct etf_term *term)
+{
+  switch (term->type) {
+  case ETF_INTEGER: return (uint64_t)term->value.integer;
+  case ETF_BIG:     return term->is_negative ? 0 : term->big;
+  case ETF_STRING: {
+      uint64_t value=0;
+      for (size_t i=0; i < term->value.str.size; ++i) {
+        char c = term->value.str.start[i];
+        if (c < '0' || c > '9') return 0;
+        value = 10 * value + (c - '0');
+      }
+      return value; }
+  default:
+      return 0;
+  }
+}
+
+bool
+etf_map_find(struct etf_reader *reader, const char key[])
+{
+  struct etf_reader tmp = *reader;
+  struct etf_term term;
+  if (!etf_read(&tmp, &term) || ETF_MAP != term.type) 
+    return false;
+
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term k;
+    if (!etf_read(&tmp, &k)) return false;
+    if (etf_term_eq(&k, key)) {
+      *reader = tmp;
+      return true;
+    }
+    if (!etf_skip(&tmp)) return false;
+  }
+  return false;
+}
+
+bool
+etf_term_eq(const struct etf_term *term, const char str[])
+{
+  if (ETF_STRING != term->type && ETF_ATOM != term->type)
+    return false;
+  size_t len = strlen(str);
+  return len == term->value.str.size && 0 == memcmp(term->value.str.start, str, len);
+}
+
+/* growable output buffer */
+struct out_buf {
+  char **p_buf;
+  size_t *p_bufsize;
+  size_t len;
+};
+
+static void
+out_reserve(struct out_buf *out, size_t n)
+{
+  if (out->len + n + 1 <= *out->p_bufsize) return; /* EARLY RETURN */
+
+  size_t new_size = *out->p_bufsize ? *out->p_bufsize : 1024;
+  while (out->len + n + 1 > new_size)
+    new_size *= 2;
+  char *tmp = realloc(*out->p_buf, new_size);
+  ASSERT_S(NULL != tmp, "Couldn't increase output buffer");
+  *out->p_buf = tmp;
+  *out->p_bufsize = new_size;
+}
+
+static void
+out_append(struct out_buf *out, const char *str, size_t len)
+{
+  out_reserve(out, len);
+  memcpy(*out->p_buf + out->len, str, len);
+  out->len += len;
+}
+
+static void
+out_string(struct out_buf *out, const char *str, size_t len)
+{
+  out_reserve(out, 2 + len);
+  (*out->p_buf)[out->len++] = '"';
+  size_t run=0; // start of the slice that needs no escaping
+  for (size_t i=0; i < len; ++i) {
+    unsigned char c = str[i];
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+    out_append(out, str + run, i - run);
+    char esc[8];
+    switch (c) {
+    case '"':  out_append(out, "\\\"", 2); break;
+    case '\\': out_append(out, "\\\\", 2); break;
+    case '\n': out_append(out, "\\n", 2); break;
+    case '\r': out_append(out, "\\r", 2); break;
+    case '\t': out_append(out, "\\t", 2); break;
+    default:
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        out_append(out, esc, 6);
+        break;
+    }
+    run = i + 1;
+  }
+  out_append(out, str + run, len - run);
+  out_append(out, "\"", 1);
+}
+
+static bool
+to_json(struct etf_reader *reader, struct out_buf *out, int depth)
+{
+  if (depth > ETF_MAX_DEPTH) return false; /* EARLY RETURN */
+
+  bool is_list = (reader->pos < reader->len && LIST_EXT == (uint8_t)reader->buf[reader->pos]);
+  struct etf_term term;
+  if (!etf_read(reader, &term)) return false; /* EARLY RETURN */
+
+  char num[64];
+  int ret;
+  switch (term.type) {
+  case ETF_NULL:
+      out_append(out, "null", 4);
+      return true;
+  case ETF_BOOLEAN:
+      if (term.value.boolean) out_append(out, "true", 4);
+      else                    out_append(out, "false", 5);
+      return true;
+  case ETF_INTEGER:
+      ret = snprintf(num, sizeof(num), "%"PRId64, term.value.integer);
+      out_append(out, num, ret);
+      return true;
+  case ETF_BIG:
+      ret = snprintf(num, sizeof(num), "\"%s%"PRIu64"\"", term.is_negative ? "-" : "", term.big);
+      out_append(out, num, ret);
+      return true;
+  case ETF_FLOAT:
+      ret = snprintf(num, sizeof(num), "%.17g", term.value.real);
+      out_append(out, num, ret);
+      return true;
+  case ETF_STRING:
+  case ETF_ATOM:
+      out_string(out, term.value.str.start, term.value.str.size);
+      return true;
+  case ETF_LIST:
+  case ETF_TUPLE:
+      out_append(out, "[", 1);
+      for (size_t i=0; i < term.value.amt; ++i) {
+        if (i) out_append(out, ",", 1);
+        if (!to_json(reader, out, depth + 1)) return false;
+      }
+      out_append(out, "]", 1);
+      return is_list ? read_tail(reader, depth + 1) : true;
+  case ETF_MAP:
+      out_append(out, "{", 1);
+      for (size_t i=0; i < term.value.amt; ++i) {
+        if (i) out_append(out, ",", 1);
+
+        struct etf_term key;
+        if (!etf_read(reader, &key)) return false;
+        switch (key.type) {
+        case ETF_STRING:
+        case ETF_ATOM:
+            out_string(out, key.value.str.start, key.value.str.size);
+            break;
+        case ETF_INTEGER:
+        case ETF_BIG:
+            ret = snprintf(num, sizeof(num), "\"%"PRIu64"\"", etf_term_u64(&key));
+            out_append(out, num, ret);
+            break;
+        default:
+            return false;
+        }
+        out_append(out, ":", 1);
+        if (!to_json(reader, out, depth + 1)) return false;
+      }
+      out_append(out, "}", 1);
+      return true;
+  default:
+      return false;
+  }
+}
+
+size_t
+etf_to_json(struct etf_reader *reader, char **p_buf, size_t *p_bufsize)
+{
+  struct out_buf out = { .p_buf = p_buf, .p_bufsize = p_bufsize };
+  if (!to_json(reader, &out, 0)) return 0; /* EARLY RETURN */
+  out_reserve(&out, 0);
+  (*p_buf)[out.len] = '\0';
+  return out.len;
+}
+
+static void
+out_byte(struct out_buf *out, uint8_t byte) {
+  out_append(out, (char*)&byte, 1);
+}
+
+static void
+out_be32(struct out_buf *out, uint32_t value)
+{
+  char be[4] = { value >> 24, value >> 16, value >> 8, value };
+  out_append(out, be, 4);
+}
+
+static void
+out_atom(struct out_buf *out, const char atom[])
+{
+  out_byte(out, SMALL_ATOM_UTF8_EXT);
+  out_byte(out, (uint8_t)strlen(atom));
+  out_append(out, atom, strlen(atom));
+}
+
+static const char*
+skip_blank(const char *p, const char *end)
+{
+  while (p < end && (' ' == *p || '\n' == *p || '\r' == *p || '\t' == *p))
+    ++p;
+  return p;
+}
+
+static void
+out_utf8(struct out_buf *out, uint32_t cp)
+{
+  char utf8[4];
+  int n;
+  if (cp < 0x80) {
+    utf8[0] = cp; n = 1;
+  }
+  else if (cp < 0x800) {
+    utf8[0] = 0xC0 | (cp >> 6); utf8[1] = 0x80 | (cp & 0x3F); n = 2;
+  }
+  else if (cp < 0x10000) {
+    utf8[0] = 0xE0 | (cp >> 12); utf8[1] = 0x80 | ((cp >> 6) & 0x3F); 
+    utf8[2] = 0x80 | (cp & 0x3F); n = 3;
+  }
+  else {
+    utf8[0] = 0xF0 | (cp >> 18); utf8[1] = 0x80 | ((cp >> 12) & 0x3F);
+    utf8[2] = 0x80 | ((cp >> 6) & 0x3F); utf8[3] = 0x80 | (cp & 0x3F); n = 4;
+  }
+  out_append(out, utf8, n);
+}
+
+/* decode a JSON string (p points past the opening quote) to a binary, 
+ *  return the position past the closing quote */
+static const char*
+from_json_string(const char *p, const char *end, struct out_buf *out)
+{
+  out_byte(out, BINARY_EXT);
+  size_t hdr = out->len;
+  out_be32(out, 0); // size, filled once the string is decoded
+
+  while (p < end && '"' != *p) {
+    const char *run = p;
+    while (p < end && '"' != *p && '\\' != *p) 
+      ++p;
+    out_append(out, run, p - run);
+    if (p == end || '"' == *p) break;
+
+    if (++p == end) return NULL; // skip '\\'
+    switch (*p++) {
+    case '"':  out_byte(out, '"'); break;
+    case '\\': out_byte(out, '\\'); break;
+    case '/':  out_byte(out, '/'); break;
+    case 'b':  out_byte(out, '\b'); break;
+    case 'f':  out_byte(out, '\f'); break;
+    case 'n':  out_byte(out, '\n'); break;
+    case 'r':  out_byte(out, '\r'); break;
+    case 't':  out_byte(out, '\t'); break;
+    case 'u': {
+        char hex[5]={0};
+        if (end - p < 4) return NULL;
+        memcpy(hex, p, 4);
+        p += 4;
+        uint32_t cp = strtoul(hex, NULL, 16);
+        if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && '\\' == p[0] && 'u' == p[1]) {
+          memcpy(hex, p + 2, 4); // surrogate pair
+          uint32_t low = strtoul(hex, NULL, 16);
+          if (low >= 0xDC00 && low < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+          }
+        }
+        out_utf8(out, cp);
+        break; }
+    default:
+        return NULL;
+    }
+  }
+  if (p == end) return NULL;
+
+  uint32_t size = out->len - hdr - 4;
+  char be[4] = { size >> 24, size >> 16, size >> 8, size };
+  memcpy(*out->p_buf + hdr, be, 4);
+  return p + 1;
+}
+
+static void
+from_json_integer(int64_t value, struct out_buf *out)
+{
+  if (value >= 0 && value <= 255) {
+    out_byte(out, SMALL_INTEGER_EXT);
+    out_byte(out, (uint8_t)value);
+  }
+  else if (value >= INT32_MIN && value <= INT32_MAX) {
+    out_byte(out, INTEGER_EXT);
+    out_be32(out, (uint32_t)(int32_t)value);
+  }
+  else {
+    uint64_t mag = (value < 0) ? -(uint64_t)value : (uint64_t)value;
+    out_byte(out, SMALL_BIG_EXT);
+    out_byte(out, 8);
+    out_byte(out, value < 0);
+    for (int i=0; i < 8; ++i, mag >>= 8) // little-endian
+      out_byte(out, mag & 0xFF);
+  }
+}
+
+/* return the position past the JSON value, or NULL if malformed */
+static const char*
+from_json(const char *p, const char *end, struct out_buf *out, int depth)
+{
+  if (depth > ETF_MAX_DEPTH) return NULL; /* EARLY RETURN */
+
+  p = skip_blank(p, end);
+  if (p == end) return NULL; /* EARLY RETURN */
+
+  switch (*p) {
+  case '{': {
+      out_byte(out, MAP_EXT);
+      size_t hdr = out->len;
+      out_be32(out, 0); // arity, filled once the pairs are counted
+
+      uint32_t amt=0;
+      p = skip_blank(p + 1, end);
+      if (p < end && '}' == *p) 
+        return p + 1; /* EARLY RETURN */
+      while (1) {
+        p = skip_blank(p, end);
+        if (p == end || '"' != *p) return NULL;
+        if (!(p = from_json_string(p + 1, end, out))) return NULL;
+        p = skip_blank(p, end);
+        if (p == end || ':' != *p) return NULL;
+        if (!(p = from_json(p + 1, end, out, depth + 1))) return NULL;
+        ++amt;
+        p = skip_blank(p, end);
+        if (p == end) return NULL;
+        if ('}' == *p) break;
+        if (',' != *p++) return NULL;
+      }
+      char be[4] = { amt >> 24, amt >> 16, amt >> 8, amt };
+      memcpy(*out->p_buf + hdr, be, 4);
+      return p + 1; }
+  case '[': {
+      p = skip_blank(p + 1, end);
+      if (p < end && ']' == *p) { // empty list
+        out_byte(out, NIL_EXT);
+        return p + 1; /* EARLY RETURN */
+      }
+      out_byte(out, LIST_EXT);
+      size_t hdr = out->len;
+      out_be32(out, 0); // length, filled once the elements are counted
+
+      uint32_t amt=0;
+      while (1) {
+        if (!(p = from_json(p, end, out, depth + 1))) return NULL;
+        ++amt;
+        p = skip_blank(p, end);
+        if (p == end) return NULL;
+        if (']' == *p) break;
+        if (',' != *p++) return NULL;
+      }
+      out_byte(out, NIL_EXT); // proper list tail
+      char be[4] = { amt >> 24, amt >> 16, amt >> 8, amt };
+      memcpy(*out->p_buf + hdr, be, 4);
+      return p + 1; }
+  case '"':
+      return from_json_string(p + 1, end, out);
+  case 't':
+      if (end - p < 4 || strncmp(p, "true", 4)) return NULL;
+      out_atom(out, "true");
+      return p + 4;
+  case 'f':
+      if (end - p < 5 || strncmp(p, "false", 5)) return NULL;
+      out_atom(out, "false");
+      return p + 5;
+  case 'n':
+      if (end - p < 4 || strncmp(p, "null", 4)) return NULL;
+      out_atom(out, "nil");
+      return p + 4;
+  default: {
+      char num[64];
+      size_t len=0;
+      bool is_float=false;
+      while (p + len < end && len < sizeof(num) - 1 && strchr("+-0123456789.eE", p[len])) {
+        if (strchr(".eE", p[len])) is_float = true;
+        num[len] = p[len];
+        ++len;
+      }
+      num[len] = '\0';
+      if (!len) return NULL;
+
+      char *num_end;
+      if (is_float) {
+        double value = strtod(num, &num_end);
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(double));
+        out_byte(out, NEW_FLOAT_EXT);
+        out_be32(out, (uint32_t)(bits >> 32));
+        out_be32(out, (uint32_t)bits);
+      }
+      else {
+        from_json_integer(strtoll(num, &num_end, 10), out);
+      }
+      if (num_end != num + len) return NULL;
+      return p + len; }
+  }
+}
+
+size_t
+etf_from_json(const char json[], size_t len, char **p_buf, size_t *p_bufsize)
+{
+  struct out_buf out = { .p_buf = p_buf, .p_bufsize = p_bufsize };
+  out_byte(&out, ETF_VERSION);
+  if (!from_json(json, json + len, &out, 0)) return 0; /* EARLY RETURN */
+  return out.len;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file etf.h
+ * @brief Decoder for Erlang's External Term Format, and transcoding 
+ *        from/to JSON
+ *
+ * Terms are read in place, without allocations: a container term
+ *  (map, list or tuple) is followed by its children, which are read
+ *  one after the other with the same reader.
+ * @see https://erlang.org/doc/apps/erts/erl_ext_dist.html
+ */
+
+#ifndef ETF_H
+#define ETF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+#define ETF_VERSION 131 ///< the leading byte of an encoded term
+
+/**
+ * @brief The type of a decoded term
+ */
+enum etf_type {
+  ETF_UNDEFINED = 0, ///< malformed or unsupported term
+  ETF_NULL,          ///< the 'nil' atom
+  ETF_BOOLEAN,       ///< the 'true' or 'false' atoms
+  ETF_INTEGER,
+  ETF_BIG,           ///< an integer encoded as a bignum (ex: snowflakes)
+  ETF_FLOAT,
+  ETF_STRING,        ///< a binary, or a string of bytes
+  ETF_ATOM,
+  ETF_LIST,
+  ETF_TUPLE,
+  ETF_MAP
+};
+
+/**
+ * @brief A decoded term
+ */
+struct etf_term {
+  enum etf_type type;
+  union {
+    bool boolean;
+    int64_t integer; ///< ETF_INTEGER, and ETF_BIG that fit (0 otherwise)
+    double real;
+    struct {
+      const char *start;
+      size_t size;
+    } str;           ///< ETF_STRING and ETF_ATOM (not NULL terminated)
+    size_t amt;      ///< ETF_LIST and ETF_TUPLE elements, ETF_MAP key/value pairs
+  } value;
+  bool is_negative;  ///< ETF_BIG sign
+  uint64_t big;      ///< ETF_BIG magnitude (if it fits 64 bits)
+};
+
+/**
+ * @brief Reads terms sequentially from an encoded buffer
+ */
+struct etf_reader {
+  const char *buf;
+  size_t len;
+  size_t pos; ///< offset of the next term
+};
+
+/**
+ * @brief Start reading a buffer that begins with the version byte
+ *
+ * @param reader the reader to initialize
+ * @param buf the encoded buffer
+ * @param len the buffer length
+ * @return true if the version byte matches ETF_VERSION
+ */
+bool etf_reader_init(struct etf_reader *reader, const char buf[], size_t len);
+
+/**
+ * @brief Read the next term
+ *
+ * For ETF_LIST, ETF_TUPLE and ETF_MAP terms the reader is left at
+ *        the container's first child, otherwise past the term
+ * @param reader the reader
+ * @param term receives the decoded term
+ * @return false if the term is malformed or unsupported
+ * @note a non-empty list is followed by a tail after its last element,
+ *        to be read with etf_read_tail()
+ */
+bool etf_read(struct etf_reader *reader, struct etf_term *term);
+
+/**
+ * @brief Skip the next term, its children included
+ *
+ * @param reader the reader
+ * @return false if the term is malformed or unsupported
+ */
+bool etf_skip(struct etf_reader *reader);
+
+/**
+ * @brief Read the tail that ends a list, after its last element
+ *
+ * @param reader the reader
+ * @return false if the tail is malformed
+ */
+bool etf_read_tail(struct etf_reader *reader);
+
+/**
+ * @brief Get a term as an unsigned 64 bits integer, accepting the
+ *        integer, bignum and decimal string encodings of snowflakes
+ *
+ * @param term the decoded term
+ * @return the integer, or 0 if the term isn't one
+ */
+uint64_t etf_term_u64(const struct etf_term *term);
+
+/**
+ * @brief Position the reader at the value of a map's key
+ *
+ * @param reader the reader, at a map term
+ * @param key the key to look for
+ * @return true if found, otherwise false and the reader is unchanged
+ */
+bool etf_map_find(struct etf_reader *reader, const char key[]);
+
+/**
+ * @brief Check if a string or atom term equals @a str
+ *
+ * @param term the decoded term
+ * @param str NULL terminated string
+ * @return true if equal
+ */
+bool etf_term_eq(const struct etf_term *term, const char str[]);
+
+/**
+ * @brief Transcode the next term to JSON
+ *
+ * Bignums are transcoded to JSON strings (the encoding of snowflakes
+ *        in Discord's JSON), 'nil' to null and other atoms to strings
+ * @param reader the reader
+ * @param p_buf the JSON buffer, grown with realloc() as needed (may
+ *        point to NULL)
+ * @param p_bufsize the JSON buffer size
+ * @return the JSON length (NULL terminated), or 0 if the term is
+ *        malformed or unsupported
+ */
+size_t etf_to_json(struct etf_reader *reader, char **p_buf, size_t *p_bufsize);
+
+/**
+ * @brief Encode a JSON value, prefixed by the version byte
+ *
+ * Objects are encoded to maps with binary keys, strings to binaries,
+ *        and null to the 'nil' atom
+ * @param json the JSON value
+ * @param len the JSON length
+ * @param p_buf the ETF buffer, grown with realloc() as needed (may
+ *        point to NULL)
+ * @param p_bufsize the ETF buffer size
+ * @return the ETF length, or 0 if the JSON is malformed
+ */
+size_t etf_from_json(const char json[], size_t len, char **p_buf, size_t *p_bufsize);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // ETF_H
@@ -30,6 +30,13 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+
+#if defined(__linux__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+#define CWS_HAVE_GETRANDOM
+#include <sys/random.h>
+#endif
 
 #ifdef BEARSSL
 #include <bearssl_hash.h>
@@ -158,6 +165,20 @@ _cws_get_random(void *buffer, size_t len)
 {
     uint8_t *bytes = buffer;
     uint8_t *bytes_end = bytes + len;
+#ifdef CWS_HAVE_GETRANDOM
+    /* no file descriptor needed, blocks only until the pool is seeded */
+    while (bytes < bytes_end) {
+        ssize_t r = getrandom(bytes, bytes_end - bytes, 0);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        bytes += r;
+    }
+    if (bytes == bytes_end)
+        return;
+#endif
     int fd = open("/dev/urandom", O_RDONLY);
     if (fd >= 0) {
         do {
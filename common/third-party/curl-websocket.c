@@ -33,15 +33,30 @@
 #include <ctype.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
+#include <zlib.h>
 
 #include "curl-websocket-utils.c"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define STR_OR_EMPTY(p) (p != NULL ? p : "")
 
-/* Temporary buffer size to use during WebSocket masking.
- * stack-allocated
+/* Initial size of the send ring buffer, in the order of a socket's
+ * send buffer. It is allocated on the first send, grows (by powers
+ * of 2) only when a frame doesn't fit, and is kept until cws_free().
+ */
+#define CWS_SEND_BUFFER_SIZE 16384
+
+/* Random bytes fetched at once for masking keys, 4 bytes per frame. */
+#define CWS_RANDOM_POOL_SIZE 256
+
+/* With permessage-deflate, smaller messages are sent uncompressed as
+ * the deflate block overhead outweighs the savings.
  */
-#define CWS_MASK_TMPBUF_SIZE 4096
+#define CWS_DEFLATE_MIN_SIZE 64
 
 enum cws_opcode {
     CWS_OPCODE_CONTINUATION = 0x0,
@@ -128,7 +143,9 @@ cws_close_reason_is_valid(enum cws_close_reason r)
 struct cws_frame_header {
     /* first byte: fin + opcode */
     uint8_t opcode : 4;
-    uint8_t _reserved : 3;
+    uint8_t rsv3 : 1;
+    uint8_t rsv2 : 1;
+    uint8_t rsv1 : 1; /* compressed message, with permessage-deflate */
     uint8_t fin : 1;
 
     /* second byte: mask + payload length */
@@ -150,27 +167,53 @@ struct cws_data {
     char accept_key[29];
     struct {
         struct {
-            uint8_t *payload;
             uint64_t used;
             uint64_t total;
             enum cws_opcode opcode;
             bool fin;
-        } current;
+        } current; /* the frame being received */
         struct {
-            uint8_t *payload;
-            uint64_t used;
-            uint64_t total;
-            enum cws_opcode opcode;
-        } fragmented;
+            uint64_t used; /* of arena, by the previous frames */
+            enum cws_opcode opcode; /* 0 if no data message is being received */
+            bool compressed; /* RSV1 was set on the message's first frame */
+            bool streaming; /* reported to on_text_partial() as it's received */
+        } message;
+        struct {
+            uint8_t *buffer; /* kept between messages, grown as needed */
+            size_t size;
+        } arena; /* the data message, then the control frame being received */
 
         uint8_t tmpbuf[sizeof(struct cws_frame_header) + sizeof(uint64_t)];
         uint8_t done; /* of tmpbuf, for header */
         uint8_t needed; /* of tmpbuf, for header */
     } recv;
     struct {
-        uint8_t *buffer;
-        size_t len;
+        uint8_t *buffer; /* ring buffer, size is a power of 2 */
+        size_t size;
+        size_t head; /* offset of the first byte not yet handed to curl */
+        size_t len; /* amount of bytes queued from head */
     } send;
+    struct {
+        uint8_t pool[CWS_RANDOM_POOL_SIZE];
+        size_t left; /* unused bytes at the end of pool */
+    } random;
+    struct {
+        bool offered; /* cws_set_deflate() was called */
+        bool enabled; /* the server accepted the offer */
+        bool can_deflate; /* false if the server requires a window zlib can't do */
+        bool client_no_context_takeover;
+        bool server_no_context_takeover;
+        int client_max_window_bits;
+        bool inflater_init;
+        bool deflater_init;
+        z_stream inflater;
+        z_stream deflater;
+        struct {
+            uint8_t *buffer;
+            size_t size;
+        } in, out; /* inflated messages, deflated messages */
+        struct cws_deflate_stats stats;
+    } deflate;
     uint8_t dispatching;
     uint8_t pause_flags;
     bool accepted;
@@ -180,25 +223,37 @@ struct cws_data {
     bool deleted;
 };
 
+/*
+ * Make room for len more bytes in the send ring buffer. The queued
+ * bytes are moved to the start of a bigger buffer if they don't fit.
+ */
 static bool
-_cws_write(struct cws_data *priv, const void *buffer, size_t len)
+_cws_send_reserve(struct cws_data *priv, size_t len)
 {
-    /* optimization note: we could grow by some rounded amount (ie:
-     * next power-of-2, 4096/pagesize...) and if using
-     * priv->send.position, do the memmove() here to free up some
-     * extra space without realloc() (see _cws_send_data()).
-     */
-    //_cws_debug("WRITE", buffer, len);
-    uint8_t *tmp = realloc(priv->send.buffer, priv->send.len + len);
+    size_t size = priv->send.size ? priv->send.size : CWS_SEND_BUFFER_SIZE;
+    uint8_t *tmp;
+
+    if (priv->send.buffer && priv->send.len + len <= priv->send.size)
+        return true;
+
+    while (priv->send.len + len > size)
+        size *= 2;
+
+    tmp = malloc(size);
     if (!tmp)
         return false;
-    memcpy(tmp + priv->send.len, buffer, len);
-    priv->send.buffer = tmp;
-    priv->send.len += len;
-    if (priv->pause_flags & CURLPAUSE_SEND) {
-        priv->pause_flags &= ~CURLPAUSE_SEND;
-        curl_easy_pause(priv->easy, priv->pause_flags);
+
+    if (priv->send.len) {
+        size_t first = priv->send.size - priv->send.head;
+        if (first > priv->send.len)
+            first = priv->send.len;
+        memcpy(tmp, priv->send.buffer + priv->send.head, first);
+        memcpy(tmp + first, priv->send.buffer, priv->send.len - first);
     }
+    free(priv->send.buffer);
+    priv->send.buffer = tmp;
+    priv->send.size = size;
+    priv->send.head = 0;
     return true;
 }
 
@@ -206,69 +261,313 @@ _cws_write(struct cws_data *priv, const void *buffer, size_t len)
  * Mask is:
  *
  *     for i in len:
- *         output[i] = input[i] ^ mask[i % 4]
+ *         output[i] = input[i] ^ mask[(phase + i) % 4]
  *
- * Here a temporary buffer is used to reduce number of "write" calls
- * and pointer arithmetic to avoid counters.
+ * The mask is repeated over a word (or a SSE2 register) and XORed a
+ * word at a time, since 4 divides the word size the mask stays
+ * aligned with the input between words.
+ */
+static inline void
+_cws_mask(uint8_t *out, const uint8_t *in, size_t len, const uint8_t mask[static 4], size_t phase)
+{
+    uint8_t rot[4] = {
+        mask[phase & 0x3], mask[(phase + 1) & 0x3],
+        mask[(phase + 2) & 0x3], mask[(phase + 3) & 0x3],
+    };
+    uint32_t mask32;
+    uint64_t mask64;
+    size_t i = 0;
+
+    memcpy(&mask32, rot, sizeof(mask32));
+    mask64 = ((uint64_t)mask32 << 32) | mask32;
+
+#if defined(__SSE2__)
+    {
+        const __m128i mask128 = _mm_set1_epi32((int)mask32);
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(v, mask128));
+        }
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, in + i, sizeof(v));
+        v ^= mask64;
+        memcpy(out + i, &v, sizeof(v));
+    }
+    for (; i < len; i++)
+        out[i] = in[i] ^ rot[i & 0x3];
+}
+
+/*
+ * Queue len bytes at the end of the send ring buffer, masked if mask
+ * isn't NULL.
+ */
+static bool
+_cws_write(struct cws_data *priv, const uint8_t *mask, const void *buffer, size_t len)
+{
+    const uint8_t *in = buffer;
+    size_t tail, first;
+
+    //_cws_debug("WRITE", buffer, len);
+    if (!_cws_send_reserve(priv, len))
+        return false;
+
+    tail = (priv->send.head + priv->send.len) & (priv->send.size - 1);
+    first = priv->send.size - tail;
+    if (first > len)
+        first = len;
+
+    if (mask) {
+        _cws_mask(priv->send.buffer + tail, in, first, mask, 0);
+        _cws_mask(priv->send.buffer, in + first, len - first, mask, first);
+    } else {
+        memcpy(priv->send.buffer + tail, in, first);
+        memcpy(priv->send.buffer, in + first, len - first);
+    }
+    priv->send.len += len;
+    return true;
+}
+
+/*
+ * Masking keys must be unpredictable, they are taken from a pool of
+ * random bytes that is refilled once every CWS_RANDOM_POOL_SIZE / 4
+ * frames, instead of reading the system's source on every frame.
+ */
+static void
+_cws_get_mask(struct cws_data *priv, uint8_t mask[static 4])
+{
+    if (priv->random.left < 4) {
+        _cws_get_random(priv->random.pool, sizeof(priv->random.pool));
+        priv->random.left = sizeof(priv->random.pool);
+    }
+    memcpy(mask, priv->random.pool + sizeof(priv->random.pool) - priv->random.left, 4);
+    priv->random.left -= 4;
+}
+
+static uint64_t
+_cws_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Grow a buffer to hold at least size bytes, doubling its size so
+ * that it settles after a few messages.
+ */
+static bool
+_cws_buffer_reserve(uint8_t **p_buffer, size_t *p_size, size_t size)
+{
+    size_t new_size = *p_size ? *p_size : 4096;
+    uint8_t *tmp;
+
+    if (size <= *p_size)
+        return true;
+    if (size > SIZE_MAX / 2) {
+        fprintf(stderr,"%s", "could not allocate memory");
+        return false;
+    }
+    while (new_size < size)
+        new_size *= 2;
+    tmp = realloc(*p_buffer, new_size);
+    if (!tmp) {
+        fprintf(stderr,"%s", "could not allocate memory");
+        return false;
+    }
+    *p_buffer = tmp;
+    *p_size = new_size;
+    return true;
+}
+
+/*
+ * Compress a message to priv->deflate.out: a raw deflate stream
+ * flushed with Z_SYNC_FLUSH, without its trailing 0x00 0x00 0xff 0xff
+ * (RFC 7692 section 7.2.1).
  */
 static bool
-_cws_write_masked(struct cws_data *priv, const uint8_t mask[static 4], const void *buffer, size_t len)
+_cws_deflate(struct cws_data *priv, const void *msg, size_t msglen, size_t *p_outlen)
 {
-    const uint8_t *itr_begin = buffer;
-    const uint8_t *itr = itr_begin;
-    const uint8_t *itr_end = itr + len;
-    uint8_t tmpbuf[CWS_MASK_TMPBUF_SIZE];
+    z_stream *zs = &priv->deflate.deflater;
+    uint64_t start = _cws_now_ns();
+    size_t used = 0;
+    int ret;
+
+    if (!priv->deflate.deflater_init) {
+        if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         -priv->deflate.client_max_window_bits, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr,"%s", "could not initialize deflate");
+            return false;
+        }
+        priv->deflate.deflater_init = true;
+    }
 
-    while (itr < itr_end) {
-        uint8_t *o = tmpbuf, *o_end = tmpbuf + sizeof(tmpbuf);
-        for (; o < o_end && itr < itr_end; o++, itr++) {
-            *o = *itr ^ mask[(itr - itr_begin) & 0x3];
+    zs->next_in = (Bytef *)msg;
+    zs->avail_in = msglen;
+    do {
+        if (!_cws_buffer_reserve(&priv->deflate.out.buffer, &priv->deflate.out.size,
+                                  used + deflateBound(zs, zs->avail_in) + 16))
+            return false;
+        zs->next_out = priv->deflate.out.buffer + used;
+        zs->avail_out = priv->deflate.out.size - used;
+        ret = deflate(zs, Z_SYNC_FLUSH);
+        used = priv->deflate.out.size - zs->avail_out;
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            fprintf(stderr,"deflate failed: %d", ret);
+            return false;
         }
-        if (!_cws_write(priv, tmpbuf, o - tmpbuf))
+    } while (zs->avail_in > 0 || zs->avail_out == 0);
+
+    if (used >= 4 && memcmp(priv->deflate.out.buffer + used - 4, "\x00\x00\xff\xff", 4) == 0)
+        used -= 4;
+    if (priv->deflate.client_no_context_takeover)
+        deflateReset(zs);
+
+    priv->deflate.stats.msgs_deflated++;
+    priv->deflate.stats.bytes_out += msglen;
+    priv->deflate.stats.bytes_out_wire += used;
+    priv->deflate.stats.deflate_ns += _cws_now_ns() - start;
+
+    *p_outlen = used;
+    return true;
+}
+
+/*
+ * Decompress a message, or the next chunk of a message, to
+ * priv->deflate.in (NULL terminated). After the last chunk the
+ * trailing 0x00 0x00 0xff 0xff removed by the sender is fed back.
+ */
+static bool
+_cws_inflate(struct cws_data *priv, const void *msg, size_t msglen, bool fin, size_t *p_outlen)
+{
+    static const uint8_t tail[4] = { 0x00, 0x00, 0xff, 0xff };
+    z_stream *zs = &priv->deflate.inflater;
+    uint64_t start = _cws_now_ns();
+    size_t used = 0;
+    bool stream_end = false;
+    int i, ret;
+
+    if (!priv->deflate.inflater_init) {
+        /* the largest window, as the server's may only be smaller */
+        if (inflateInit2(zs, -15) != Z_OK) {
+            fprintf(stderr,"%s", "could not initialize inflate");
             return false;
+        }
+        priv->deflate.inflater_init = true;
     }
 
+    for (i = 0; i < (fin ? 2 : 1) && !stream_end; i++) {
+        zs->next_in = (Bytef *)(i == 0 ? msg : tail);
+        zs->avail_in = i == 0 ? msglen : sizeof(tail);
+        do {
+            /* keep room for the NULL terminator */
+            if (!_cws_buffer_reserve(&priv->deflate.in.buffer, &priv->deflate.in.size,
+                                      used + 2 * zs->avail_in + 1024))
+                return false;
+            zs->next_out = priv->deflate.in.buffer + used;
+            zs->avail_out = priv->deflate.in.size - used - 1;
+            ret = inflate(zs, Z_SYNC_FLUSH);
+            used = priv->deflate.in.size - 1 - zs->avail_out;
+            if (ret == Z_STREAM_END) { /* the server ended its stream (BFINAL) */
+                stream_end = true;
+                inflateReset(zs);
+                break;
+            }
+            if (ret == Z_BUF_ERROR && zs->avail_out > 0)
+                break; /* everything was inflated */
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                fprintf(stderr,"inflate failed: %d %s", ret, zs->msg ? zs->msg : "");
+                return false;
+            }
+        } while (zs->avail_in > 0 || zs->avail_out == 0);
+    }
+    priv->deflate.in.buffer[used] = '\0';
+
+    if (fin && priv->deflate.server_no_context_takeover && !stream_end)
+        inflateReset(zs);
+
+    if (fin)
+        priv->deflate.stats.msgs_inflated++;
+    priv->deflate.stats.bytes_in_wire += msglen;
+    priv->deflate.stats.bytes_in += used;
+    priv->deflate.stats.inflate_ns += _cws_now_ns() - start;
+
+    *p_outlen = used;
     return true;
 }
 
 static bool
-_cws_send(struct cws_data *priv, enum cws_opcode opcode, const void *msg, size_t msglen)
+_cws_send_frame(struct cws_data *priv, enum cws_opcode opcode, bool compressed, const void *msg, size_t msglen)
 {
     struct cws_frame_header fh = {
         .fin = 1, /* TODO review if should fragment over some boundary */
+        .rsv1 = compressed,
         .opcode = opcode,
         .mask = 1,
         .payload_len = ((msglen > UINT16_MAX) ? 127 :
                         (msglen > 125) ? 126 : msglen),
     };
+    /* frame header + extended payload length + masking key */
+    uint8_t header[sizeof(fh) + sizeof(uint64_t) + 4];
+    size_t header_len = 0;
     uint8_t mask[4];
 
-    if (priv->closed) {
-        fprintf(stderr,"cannot send data to closed WebSocket connection %p", priv->easy);
-        return false;
-    }
-
-    _cws_get_random(mask, sizeof(mask));
+    _cws_get_mask(priv, mask);
 
-    if (!_cws_write(priv, &fh, sizeof(fh)))
-        return false;
+    memcpy(header, &fh, sizeof(fh));
+    header_len += sizeof(fh);
 
     if (fh.payload_len == 127) {
         uint64_t payload_len = msglen;
         _cws_hton(&payload_len, sizeof(payload_len));
-        if (!_cws_write(priv, &payload_len, sizeof(payload_len)))
-            return false;
+        memcpy(header + header_len, &payload_len, sizeof(payload_len));
+        header_len += sizeof(payload_len);
     } else if (fh.payload_len == 126) {
         uint16_t payload_len = msglen;
         _cws_hton(&payload_len, sizeof(payload_len));
-        if (!_cws_write(priv, &payload_len, sizeof(payload_len)))
-            return false;
+        memcpy(header + header_len, &payload_len, sizeof(payload_len));
+        header_len += sizeof(payload_len);
     }
 
-    if (!_cws_write(priv, mask, sizeof(mask)))
+    memcpy(header + header_len, mask, sizeof(mask));
+    header_len += sizeof(mask);
+
+    if (!_cws_send_reserve(priv, header_len + msglen))
+        return false;
+    if (!_cws_write(priv, NULL, header, header_len))
+        return false;
+    if (!_cws_write(priv, mask, msg, msglen))
         return false;
 
-    return _cws_write_masked(priv, mask, msg, msglen);
+    /* the whole frame is queued, let curl send it */
+    if (priv->pause_flags & CURLPAUSE_SEND) {
+        priv->pause_flags &= ~CURLPAUSE_SEND;
+        curl_easy_pause(priv->easy, priv->pause_flags);
+    }
+    return true;
+}
+
+static bool
+_cws_send(struct cws_data *priv, enum cws_opcode opcode, const void *msg, size_t msglen)
+{
+    size_t outlen;
+
+    if (priv->closed) {
+        fprintf(stderr,"cannot send data to closed WebSocket connection %p", priv->easy);
+        return false;
+    }
+
+    if (priv->deflate.enabled && priv->deflate.can_deflate &&
+        !cws_opcode_is_control(opcode) && msglen >= CWS_DEFLATE_MIN_SIZE) {
+        /* the compressor's context now has the message, it must be sent compressed */
+        if (!_cws_deflate(priv, msg, msglen, &outlen))
+            return false;
+        return _cws_send_frame(priv, opcode, true, priv->deflate.out.buffer, outlen);
+    }
+    return _cws_send_frame(priv, opcode, false, msg, msglen);
 }
 
 bool
@@ -288,6 +587,65 @@ cws_send(CURL *easy, bool text, const void *msg, size_t msglen)
                      msg, msglen);
 }
 
+bool
+cws_set_deflate(CURL *easy, const struct cws_deflate_config *config)
+{
+    struct cws_data *priv;
+    char header[256];
+    int len;
+    char *p = NULL;
+
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, &p); /* checks for char* */
+    if (!p) {
+        fprintf(stderr,"not CWS (no CURLINFO_PRIVATE): %p", easy);
+        return false;
+    }
+    priv = (struct cws_data *)p;
+
+    if (priv->deflate.offered)
+        return false;
+    if ((config->client_max_window_bits && (config->client_max_window_bits < 9 || config->client_max_window_bits > 15)) ||
+        (config->server_max_window_bits && (config->server_max_window_bits < 9 || config->server_max_window_bits > 15))) {
+        fprintf(stderr,"%s", "permessage-deflate window bits should be in the 9..15 range");
+        return false;
+    }
+
+    /* client_max_window_bits is always offered, so the server may pick
+     * the compressor's window */
+    len = snprintf(header, sizeof(header), "Sec-WebSocket-Extensions: permessage-deflate%s%s; client_max_window_bits",
+                   config->client_no_context_takeover ? "; client_no_context_takeover" : "",
+                   config->server_no_context_takeover ? "; server_no_context_takeover" : "");
+    if (config->client_max_window_bits)
+        len += snprintf(header + len, sizeof(header) - len, "=%d", config->client_max_window_bits);
+    if (config->server_max_window_bits)
+        len += snprintf(header + len, sizeof(header) - len, "; server_max_window_bits=%d", config->server_max_window_bits);
+
+    priv->headers = curl_slist_append(priv->headers, header);
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, priv->headers);
+
+    priv->deflate.offered = true;
+    priv->deflate.client_no_context_takeover = config->client_no_context_takeover;
+    priv->deflate.client_max_window_bits = config->client_max_window_bits ? config->client_max_window_bits : 15;
+    return true;
+}
+
+bool
+cws_get_deflate_stats(CURL *easy, struct cws_deflate_stats *stats)
+{
+    struct cws_data *priv;
+    char *p = NULL;
+
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, &p); /* checks for char* */
+    if (!p) {
+        memset(stats, 0, sizeof(*stats));
+        return false;
+    }
+    priv = (struct cws_data *)p;
+
+    *stats = priv->deflate.stats;
+    return priv->deflate.enabled;
+}
+
 bool
 cws_ping(CURL *easy, const char *reason, size_t len)
 {
@@ -352,8 +710,13 @@ _cws_cleanup(struct cws_data *priv)
     free(priv->websocket_protocols.requested);
     free(priv->websocket_protocols.received);
     free(priv->send.buffer);
-    free(priv->recv.current.payload);
-    free(priv->recv.fragmented.payload);
+    free(priv->recv.arena.buffer);
+    if (priv->deflate.inflater_init)
+        inflateEnd(&priv->deflate.inflater);
+    if (priv->deflate.deflater_init)
+        deflateEnd(&priv->deflate.deflater);
+    free(priv->deflate.in.buffer);
+    free(priv->deflate.out.buffer);
     free(priv);
 
     curl_easy_cleanup(easy);
@@ -435,6 +798,82 @@ _cws_check_protocol(struct cws_data *priv, const char *buffer, size_t len)
     priv->websocket_protocols.received = strndup(buffer, len);
 }
 
+/*
+ * The server accepts permessage-deflate by answering with it, and the
+ * parameters it settled on (RFC 7692 section 7.1).
+ */
+static void
+_cws_check_extensions(struct cws_data *priv, const char *buffer, size_t len)
+{
+    const char *end = buffer + len;
+
+    if (!priv->deflate.offered)
+        return;
+
+    while (buffer < end) {
+        const char *ext_end = memchr(buffer, ',', end - buffer);
+        const char *param, *param_end;
+        size_t param_len;
+        bool first = true;
+
+        if (!ext_end)
+            ext_end = end;
+
+        for (param = buffer; param < ext_end; param = param_end + 1) {
+            const char *value;
+            size_t value_len = 0;
+
+            param_end = memchr(param, ';', ext_end - param);
+            if (!param_end)
+                param_end = ext_end;
+            param_len = param_end - param;
+            _cws_trim(&param, &param_len);
+
+            value = memchr(param, '=', param_len);
+            if (value) {
+                value_len = param + param_len - (value + 1);
+                param_len = value - param;
+                value++;
+                _cws_trim(&param, &param_len);
+                _cws_trim(&value, &value_len);
+                if (value_len >= 2 && value[0] == '"' && value[value_len - 1] == '"') {
+                    value++;
+                    value_len -= 2;
+                }
+            }
+
+            if (first) {
+                first = false;
+                if (param_len != strlen("permessage-deflate") ||
+                    strncasecmp(param, "permessage-deflate", param_len) != 0)
+                    break; /* some other extension */
+                priv->deflate.enabled = true;
+                priv->deflate.can_deflate = true;
+            } else if (param_len == strlen("server_no_context_takeover") &&
+                       strncasecmp(param, "server_no_context_takeover", param_len) == 0) {
+                priv->deflate.server_no_context_takeover = true;
+            } else if (param_len == strlen("client_no_context_takeover") &&
+                       strncasecmp(param, "client_no_context_takeover", param_len) == 0) {
+                priv->deflate.client_no_context_takeover = true;
+            } else if (param_len == strlen("client_max_window_bits") &&
+                       strncasecmp(param, "client_max_window_bits", param_len) == 0) {
+                int bits = value ? (int)strtol(value, NULL, 10) : 0;
+                if (bits && bits < priv->deflate.client_max_window_bits)
+                    priv->deflate.client_max_window_bits = bits;
+                /* zlib can't compress with a 256 bytes window, send uncompressed */
+                if (priv->deflate.client_max_window_bits < 9)
+                    priv->deflate.can_deflate = false;
+            } else if (param_len == strlen("server_max_window_bits") &&
+                       strncasecmp(param, "server_max_window_bits", param_len) == 0) {
+                /* nothing to do, messages are inflated with the largest window */
+            } else {
+                fprintf(stderr,"unexpected permessage-deflate parameter '%.*s'", (int)param_len, param);
+            }
+        }
+        buffer = ext_end + 1;
+    }
+}
+
 static void
 _cws_check_upgrade(struct cws_data *priv, const char *buffer, size_t len)
 {
@@ -476,6 +915,7 @@ _cws_receive_header(const char *buffer, size_t count, size_t nitems, void *data)
     } *itr, header_checkers[] = {
         {"Sec-WebSocket-Accept:", _cws_check_accept},
         {"Sec-WebSocket-Protocol:", _cws_check_protocol},
+        {"Sec-WebSocket-Extensions:", _cws_check_extensions},
         {"Connection:", _cws_check_connection},
         {"Upgrade:", _cws_check_upgrade},
         {NULL, NULL}
@@ -514,6 +954,7 @@ _cws_receive_header(const char *buffer, size_t count, size_t nitems, void *data)
         priv->accepted = false;
         priv->upgraded = false;
         priv->connection_websocket = false;
+        priv->deflate.enabled = false;
         if (priv->websocket_protocols.received) {
             free(priv->websocket_protocols.received);
             priv->websocket_protocols.received = NULL;
@@ -534,6 +975,24 @@ _cws_receive_header(const char *buffer, size_t count, size_t nitems, void *data)
     return len;
 }
 
+static bool
+_cws_opcode_is_data(enum cws_opcode opcode)
+{
+    return opcode == CWS_OPCODE_CONTINUATION ||
+        opcode == CWS_OPCODE_TEXT ||
+        opcode == CWS_OPCODE_BINARY;
+}
+
+/*
+ * Whether the current frame is handed to on_text_partial() as it's
+ * received, rather than copied to the arena.
+ */
+static bool
+_cws_frame_is_streamed(struct cws_data *priv)
+{
+    return priv->recv.message.streaming && _cws_opcode_is_data(priv->recv.current.opcode);
+}
+
 static bool
 _cws_dispatch_validate(struct cws_data *priv)
 {
@@ -543,7 +1002,7 @@ _cws_dispatch_validate(struct cws_data *priv)
     if (!priv->recv.current.fin && cws_opcode_is_control(priv->recv.current.opcode))
         fprintf(stderr,"server sent forbidden fragmented control frame opcode=%#x.",
             priv->recv.current.opcode);
-    else if (priv->recv.current.opcode == CWS_OPCODE_CONTINUATION && priv->recv.fragmented.opcode == 0)
+    else if (priv->recv.current.opcode == CWS_OPCODE_CONTINUATION && priv->recv.message.opcode == 0)
         fprintf(stderr,"%s", "server sent continuation frame after non-fragmentable frame");
     else
         return true;
@@ -552,92 +1011,115 @@ _cws_dispatch_validate(struct cws_data *priv)
     return false;
 }
 
+/*
+ * Report the next chunk of a streamed text message, inflated first if
+ * the message is compressed.
+ */
 static void
-_cws_dispatch(struct cws_data *priv)
+_cws_dispatch_partial(struct cws_data *priv, const void *chunk, size_t len, bool fin)
 {
-    if (!_cws_dispatch_validate(priv))
+    const char *str = chunk;
+
+    if (priv->closed)
         return;
 
-    switch (priv->recv.current.opcode) {
-    case CWS_OPCODE_CONTINUATION:
-        if (priv->recv.current.fin) {
-            if (priv->recv.fragmented.opcode == CWS_OPCODE_TEXT) {
-                const char *str = (const char *)priv->recv.current.payload;
-                if (priv->recv.current.used == 0)
-                    str = "";
-                if (priv->cbs.on_text)
-                    priv->cbs.on_text((void *)priv->cbs.data, priv->easy, str, priv->recv.current.used);
-            } else if (priv->recv.fragmented.opcode == CWS_OPCODE_BINARY) {
-                if (priv->cbs.on_binary)
-                    priv->cbs.on_binary((void *)priv->cbs.data, priv->easy, priv->recv.current.payload, priv->recv.current.used);
-            }
-            memset(&priv->recv.fragmented, 0, sizeof(priv->recv.fragmented));
-        } else {
-            priv->recv.fragmented.payload = priv->recv.current.payload;
-            priv->recv.fragmented.used = priv->recv.current.used;
-            priv->recv.fragmented.total = priv->recv.current.total;
-            priv->recv.current.payload = NULL;
-            priv->recv.current.used = 0;
-            priv->recv.current.total = 0;
+    if (priv->recv.message.compressed) {
+        if (!_cws_inflate(priv, chunk, len, fin, &len)) {
+            cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "invalid compressed message", SIZE_MAX);
+            return;
         }
-        break;
+        str = (const char *)priv->deflate.in.buffer;
+    }
 
-    case CWS_OPCODE_TEXT:
-        if (priv->recv.current.fin) {
-            const char *str = (const char *)priv->recv.current.payload;
-            if (priv->recv.current.used == 0)
-                str = "";
-            if (priv->cbs.on_text)
-                priv->cbs.on_text((void *)priv->cbs.data, priv->easy, str, priv->recv.current.used);
-        } else {
-            priv->recv.fragmented.payload = priv->recv.current.payload;
-            priv->recv.fragmented.used = priv->recv.current.used;
-            priv->recv.fragmented.total = priv->recv.current.total;
-            priv->recv.fragmented.opcode = priv->recv.current.opcode;
-
-            priv->recv.current.payload = NULL;
-            priv->recv.current.used = 0;
-            priv->recv.current.total = 0;
-            priv->recv.current.opcode = 0;
-            priv->recv.current.fin = 0;
-        }
-        break;
+    if (len == 0 && !fin)
+        return;
+    if (len == 0)
+        str = "";
+    priv->cbs.on_text_partial((void *)priv->cbs.data, priv->easy, str, len, fin);
+}
 
-    case CWS_OPCODE_BINARY:
-        if (priv->recv.current.fin) {
-            if (priv->cbs.on_binary)
-                priv->cbs.on_binary((void *)priv->cbs.data, priv->easy, priv->recv.current.payload, priv->recv.current.used);
-        } else {
-            priv->recv.fragmented.payload = priv->recv.current.payload;
-            priv->recv.fragmented.used = priv->recv.current.used;
-            priv->recv.fragmented.total = priv->recv.current.total;
-            priv->recv.fragmented.opcode = priv->recv.current.opcode;
-
-            priv->recv.current.payload = NULL;
-            priv->recv.current.used = 0;
-            priv->recv.current.total = 0;
-            priv->recv.current.opcode = 0;
-            priv->recv.current.fin = 0;
+/*
+ * Report a complete text or binary message, inflated first if it was
+ * compressed.
+ */
+static void
+_cws_dispatch_message(struct cws_data *priv, enum cws_opcode opcode)
+{
+    const uint8_t *payload = priv->recv.arena.buffer;
+    size_t len = priv->recv.message.used;
+
+    if (priv->recv.message.streaming) {
+        /* the chunks were reported as received, unless the last frame is empty */
+        if (priv->recv.current.total == 0)
+            _cws_dispatch_partial(priv, "", 0, true);
+        return;
+    }
+
+    if (priv->recv.message.compressed) {
+        if (!_cws_inflate(priv, payload, len, true, &len)) {
+            cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "invalid compressed message", SIZE_MAX);
+            return;
         }
-        break;
+        payload = priv->deflate.in.buffer;
+    } else {
+        priv->recv.arena.buffer[len] = '\0';
+    }
+
+    if (opcode == CWS_OPCODE_TEXT) {
+        const char *str = (const char *)payload;
+        if (len == 0)
+            str = "";
+        if (priv->cbs.on_text)
+            priv->cbs.on_text((void *)priv->cbs.data, priv->easy, str, len);
+    } else if (opcode == CWS_OPCODE_BINARY) {
+        if (priv->cbs.on_binary)
+            priv->cbs.on_binary((void *)priv->cbs.data, priv->easy, payload, len);
+    }
+}
 
+static void
+_cws_dispatch(struct cws_data *priv)
+{
+    uint8_t *payload;
+    size_t len = priv->recv.current.total;
+
+    if (_cws_opcode_is_data(priv->recv.current.opcode)) {
+        if (!priv->recv.message.streaming)
+            priv->recv.message.used += len;
+        if (!priv->recv.current.fin)
+            return;
+
+        if (_cws_dispatch_validate(priv))
+            _cws_dispatch_message(priv, priv->recv.message.opcode);
+        /* the arena is kept for the next message */
+        memset(&priv->recv.message, 0, sizeof(priv->recv.message));
+        return;
+    }
+
+    if (!_cws_dispatch_validate(priv))
+        return;
+
+    /* control frames are received past the fragments of a data message */
+    payload = priv->recv.arena.buffer + priv->recv.message.used;
+    payload[len] = '\0';
+
+    switch (priv->recv.current.opcode) {
     case CWS_OPCODE_CLOSE: {
         enum cws_close_reason reason = CWS_CLOSE_REASON_NO_REASON;
         const char *str = "";
-        size_t len = priv->recv.current.used;
 
-        if (priv->recv.current.used >= sizeof(uint16_t)) {
+        if (len >= sizeof(uint16_t)) {
             uint16_t r;
-            memcpy(&r, priv->recv.current.payload, sizeof(uint16_t));
+            memcpy(&r, payload, sizeof(uint16_t));
             _cws_ntoh(&r, sizeof(r));
             if (!cws_close_reason_is_valid(r)) {
                 cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "invalid close reason", SIZE_MAX);
                 r = CWS_CLOSE_REASON_PROTOCOL_ERROR;
             }
             reason = r;
-            str = (const char *)priv->recv.current.payload + sizeof(uint16_t);
-            len = priv->recv.current.used - 2;
-        } else if (priv->recv.current.used > 0 && priv->recv.current.used < sizeof(uint16_t)) {
+            str = (const char *)payload + sizeof(uint16_t);
+            len -= 2;
+        } else if (len > 0 && len < sizeof(uint16_t)) {
             cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "invalid close payload length", SIZE_MAX);
         }
 
@@ -653,22 +1135,18 @@ _cws_dispatch(struct cws_data *priv)
     }
 
     case CWS_OPCODE_PING: {
-        const char *str = (const char *)priv->recv.current.payload;
-        if (priv->recv.current.used == 0)
-            str = "";
+        const char *str = (const char *)payload;
         if (priv->cbs.on_ping)
-            priv->cbs.on_ping((void *)priv->cbs.data, priv->easy, str, priv->recv.current.used);
+            priv->cbs.on_ping((void *)priv->cbs.data, priv->easy, str, len);
         else
-            cws_pong(priv->easy, str, priv->recv.current.used);
+            cws_pong(priv->easy, str, len);
         break;
     }
 
     case CWS_OPCODE_PONG: {
-        const char *str = (const char *)priv->recv.current.payload;
-        if (priv->recv.current.used == 0)
-            str = "";
+        const char *str = (const char *)payload;
         if (priv->cbs.on_pong)
-            priv->cbs.on_pong((void *)priv->cbs.data, priv->easy, str, priv->recv.current.used);
+            priv->cbs.on_pong((void *)priv->cbs.data, priv->easy, str, len);
         break;
     }
 
@@ -707,9 +1185,27 @@ _cws_process_frame(struct cws_data *priv, const char *buffer, size_t len)
             priv->recv.current.opcode = fh.opcode;
             priv->recv.current.fin = fh.fin;
 
-            if (fh._reserved || fh.mask)
+            if (fh.rsv2 || fh.rsv3 || fh.mask)
+                cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, NULL, 0);
+
+            /* RSV1 marks a compressed message, on its first frame only */
+            if (fh.rsv1 && (!priv->deflate.enabled || cws_opcode_is_control(fh.opcode) ||
+                            fh.opcode == CWS_OPCODE_CONTINUATION))
                 cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, NULL, 0);
 
+            if (fh.opcode == CWS_OPCODE_CONTINUATION) {
+                if (priv->recv.message.opcode == 0)
+                    cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "nothing to continue", SIZE_MAX);
+            } else if (fh.opcode == CWS_OPCODE_TEXT || fh.opcode == CWS_OPCODE_BINARY) {
+                if (priv->recv.message.opcode != 0)
+                    cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "expected continuation or control frames", SIZE_MAX);
+                priv->recv.message.used = 0;
+                priv->recv.message.opcode = fh.opcode;
+                priv->recv.message.compressed = fh.rsv1;
+                priv->recv.message.streaming = (fh.opcode == CWS_OPCODE_TEXT &&
+                                                priv->cbs.on_text_partial);
+            }
+
             if (fh.payload_len == 126) {
                 if (cws_opcode_is_control(fh.opcode))
                     cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, NULL, 0);
@@ -742,59 +1238,48 @@ _cws_process_frame(struct cws_data *priv, const char *buffer, size_t len)
             abort();
         }
 
-        if (priv->recv.current.opcode == CWS_OPCODE_CONTINUATION) {
-            if (priv->recv.fragmented.opcode == 0)
-                cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "nothing to continue", SIZE_MAX);
-            if (priv->recv.current.payload)
-                free(priv->recv.current.payload);
-
-            priv->recv.current.payload = priv->recv.fragmented.payload;
-            priv->recv.current.used = priv->recv.fragmented.used;
-            priv->recv.current.total = priv->recv.fragmented.total;
-            priv->recv.fragmented.payload = NULL;
-            priv->recv.fragmented.used = 0;
-            priv->recv.fragmented.total = 0;
-        } else if (!cws_opcode_is_control(priv->recv.current.opcode) && priv->recv.fragmented.opcode != 0) {
-            cws_close(priv->easy, CWS_CLOSE_REASON_PROTOCOL_ERROR, "expected continuation or control frames", SIZE_MAX);
-        }
-
-        if (frame_len > 0) {
-            void *tmp;
-
-            tmp = realloc(priv->recv.current.payload,
-                          priv->recv.current.total + frame_len + 1);
-            if (!tmp) {
-                cws_close(priv->easy, CWS_CLOSE_REASON_TOO_BIG, NULL, 0);
-                fprintf(stderr,"%s", "could not allocate memory");
-                return CURL_READFUNC_ABORT;
-            }
-            priv->recv.current.payload = tmp;
-            priv->recv.current.total += frame_len;
+        priv->recv.current.used = 0;
+        priv->recv.current.total = frame_len;
+
+        /* the frame is appended to the message received so far */
+        if (!_cws_frame_is_streamed(priv) &&
+            (frame_len >= SIZE_MAX - priv->recv.message.used ||
+             !_cws_buffer_reserve(&priv->recv.arena.buffer, &priv->recv.arena.size,
+                                  priv->recv.message.used + frame_len + 1))) {
+            cws_close(priv->easy, CWS_CLOSE_REASON_TOO_BIG, NULL, 0);
+            fprintf(stderr,"%s", "could not allocate memory");
+            return CURL_READFUNC_ABORT;
         }
     }
 
     if (len == 0 && priv->recv.done < priv->recv.needed)
         return used;
 
+    priv->dispatching++;
+
     /* fill payload */
     while (len > 0 && priv->recv.current.used < priv->recv.current.total) {
         size_t todo = priv->recv.current.total - priv->recv.current.used;
         if (todo > len)
             todo = len;
-        memcpy(priv->recv.current.payload + priv->recv.current.used, buffer, todo);
+        if (_cws_frame_is_streamed(priv))
+            _cws_dispatch_partial(priv, buffer, todo,
+                                  priv->recv.current.fin &&
+                                  priv->recv.current.used + todo == priv->recv.current.total);
+        else
+            memcpy(priv->recv.arena.buffer + priv->recv.message.used + priv->recv.current.used,
+                   buffer, todo);
         priv->recv.current.used += todo;
         used += todo;
         buffer += todo;
         len -= todo;
     }
 
-    if (priv->recv.current.payload)
-        priv->recv.current.payload[priv->recv.current.used] = '\0';
-
-    if (len == 0 && priv->recv.current.used < priv->recv.current.total)
+    if (len == 0 && priv->recv.current.used < priv->recv.current.total) {
+        priv->dispatching--;
+        _cws_cleanup(priv);
         return used;
-
-    priv->dispatching++;
+    }
 
     _cws_dispatch(priv);
 
@@ -816,6 +1301,8 @@ _cws_receive_data(const char *buffer, size_t count, size_t nitems, void *data)
     size_t len = count * nitems;
     while (len > 0) {
         size_t used = _cws_process_frame(priv, buffer, len);
+        if (used == CURL_READFUNC_ABORT)
+            return 0; /* aborts the transfer */
         len -= used;
         buffer += used;
     }
@@ -829,6 +1316,7 @@ _cws_send_data(char *buffer, size_t count, size_t nitems, void *data)
     struct cws_data *priv = data;
     size_t len = count * nitems;
     size_t todo = priv->send.len;
+    size_t first;
 
     if (todo == 0) {
         priv->pause_flags |= CURLPAUSE_SEND;
@@ -837,23 +1325,18 @@ _cws_send_data(char *buffer, size_t count, size_t nitems, void *data)
     if (todo > len)
         todo = len;
 
-    memcpy(buffer, priv->send.buffer, todo);
-    if (todo < priv->send.len) {
-        /* optimization note: we could avoid memmove() by keeping a
-         * priv->send.position, then we just increment that offset.
-         *
-         * on next _cws_write(), check if priv->send.position > 0 and
-         * memmove() to make some space without realloc().
-         */
-        memmove(priv->send.buffer,
-                priv->send.buffer + todo,
-                priv->send.len - todo);
-    } else {
-        free(priv->send.buffer);
-        priv->send.buffer = NULL;
-    }
+    /* the queued bytes may wrap around the end of the ring buffer */
+    first = priv->send.size - priv->send.head;
+    if (first > todo)
+        first = todo;
+    memcpy(buffer, priv->send.buffer + priv->send.head, first);
+    memcpy(buffer + first, priv->send.buffer, todo - first);
 
     priv->send.len -= todo;
+    if (priv->send.len == 0)
+        priv->send.head = 0; /* keep the next frame contiguous */
+    else
+        priv->send.head = (priv->send.head + todo) & (priv->send.size - 1);
     return todo;
 }
 
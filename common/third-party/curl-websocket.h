@@ -28,6 +28,7 @@
 
 #include <curl/curl.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #ifdef __cplusplus
@@ -69,6 +70,17 @@ struct cws_callbacks {
      * with #CWS_CLOSE_REASON_INCONSISTENT_DATA.
      */
     void (*on_text)(void *data, CURL *easy, const char *text, size_t len);
+    /**
+     * reports UTF-8 text messages in chunks, as they're received. If
+     * provided, on_text() is not called and text messages are not
+     * buffered, so a streaming parser can start before the frame is
+     * complete.
+     *
+     * @note chunks are not NULL (\0) terminated and may split UTF-8
+     * sequences. is_final is set on the message's last chunk, which
+     * may be empty. Compressed messages are inflated chunk by chunk.
+     */
+    void (*on_text_partial)(void *data, CURL *easy, const char *chunk, size_t len, bool is_final);
     /**
      * reports binary data.
      */
@@ -94,6 +106,35 @@ struct cws_callbacks {
     const void *data;
 };
 
+/**
+ * permessage-deflate (RFC 7692) offer, see cws_set_deflate().
+ */
+struct cws_deflate_config {
+    /* hint the server that our compressor is reset after every
+     * message: less memory, worse ratio */
+    bool client_no_context_takeover;
+    /* ask the server to reset its compressor after every message */
+    bool server_no_context_takeover;
+    /* our compressor's LZ77 window (9..15), 0 for 15 */
+    int client_max_window_bits;
+    /* ask the server for a smaller window (9..15), 0 to leave it to the server */
+    int server_max_window_bits;
+};
+
+/**
+ * permessage-deflate counters, see cws_get_deflate_stats().
+ */
+struct cws_deflate_stats {
+    uint64_t msgs_inflated;
+    uint64_t bytes_in_wire;  /* received, compressed */
+    uint64_t bytes_in;       /* received, once inflated */
+    uint64_t inflate_ns;     /* time spent inflating */
+    uint64_t msgs_deflated;
+    uint64_t bytes_out;      /* sent, before deflating */
+    uint64_t bytes_out_wire; /* sent, compressed */
+    uint64_t deflate_ns;     /* time spent deflating */
+};
+
 /**
  * Create a new CURL-based WebSocket handle.
  *
@@ -125,6 +166,29 @@ CURL *cws_new(const char *url, const char *websocket_protocols, const struct cws
  */
 void cws_free(CURL *easy);
 
+/**
+ * Offer the permessage-deflate extension (RFC 7692), must be called
+ * before the transfer starts.
+ *
+ * If the server accepts, messages of at least 64 bytes are sent
+ * compressed, and compressed messages are inflated before being
+ * reported. Otherwise messages are exchanged uncompressed.
+ *
+ * @param easy the CURL easy handle created with cws_new()
+ * @param config the offered parameters
+ * @return #true if offered, #false on errors.
+ */
+bool cws_set_deflate(CURL *easy, const struct cws_deflate_config *config);
+
+/**
+ * Get the permessage-deflate counters.
+ *
+ * @param easy the CURL easy handle created with cws_new()
+ * @param stats receives the counters
+ * @return #true if the extension was negotiated with the server.
+ */
+bool cws_get_deflate_stats(CURL *easy, struct cws_deflate_stats *stats);
+
 /**
  * Send a text or binary message of given size.
  *
@@ -3,15 +3,41 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <inttypes.h>
 #include <ctype.h> /* isspace() */
 #include <string.h>
 #include <strings.h>
 #include <pthread.h>
+#include <unistd.h> /* pread() */
+#include <fcntl.h>
+#include <sys/stat.h>
 //#include <curl/curl.h> /* implicit */
 
 #include "user-agent.h"
 #include "cee-utils.h"
-
+#include "json-actor-boxed.h" /* ja_str */
+
+
+/* idle conns are evicted from the pool after this long */
+#define UA_DEFAULT_IDLE_TTL_MS 60000
+/* amount of buckets of the response cache hashtable */
+#define UA_CACHE_BUCKETS 256
+/* max amount of idle buffers kept for reuse */
+#define UA_MAX_BUFPOOL 32
+/* histogram sub-buckets per power of two (as bits), for a ~12.5% 
+ *  worst relative error */
+#define UA_HIST_SUB_BITS 3
+/* histogram values are clamped below 2^UA_HIST_MAX_EXP microseconds */
+#define UA_HIST_MAX_EXP 40
+#define UA_HIST_AMT ((UA_HIST_MAX_EXP - UA_HIST_SUB_BITS + 1) << UA_HIST_SUB_BITS)
+/* length kept of the url and response body of a request log ring entry */
+#define UA_LOG_RING_URL_LEN 256
+#define UA_LOG_RING_BODY_LEN 256
+
+/* whether the logconf HTTP sink is active, and the module isn't listed
+ *  in "disable_modules", nothing should be formatted for it otherwise */
+#define HTTP_LOG_ACTIVE(conf) \
+  ((conf)->http && (conf)->http->f && !module_is_disabled(conf))
 
 #define CURLE_CHECK(conn, ecode)                           \
   VASSERT_S(CURLE_OK == ecode, "[%s] (CURLE code: %d) %s", \
@@ -21,6 +47,17 @@
         ? curl_easy_strerror(ecode)                        \
         : conn->errbuf)
 
+/* check if the module id is listed in logconf's "disable_modules" */
+static bool
+module_is_disabled(struct logconf *conf)
+{
+  for (size_t i=0; conf->disable_modules && conf->disable_modules[i]; ++i) {
+    if (0 == strcmp(conf->id, conf->disable_modules[i]->value))
+      return true; /* EARLY RETURN */
+  }
+  return false;
+}
+
 struct user_agent {
   /**
    * whether this is the original user agent or a clone
@@ -36,8 +73,14 @@ struct user_agent {
    *        each active conn is responsible for a HTTP request
    */
   struct {
-    struct _ua_conn **pool;
+    struct _ua_conn **pool; ///< every conn alive, busy or idle
     size_t amt; ///< amount of connections node in pool
+    struct _ua_conn *idle; ///< stack of idle conns, most recently released on top
+    size_t amt_idle; ///< amount of conns in 'idle'
+    size_t max; ///< max amount of conns alive at once, 0 for unlimited
+    uint64_t idle_ttl_ms; ///< idle conns older than this are evicted, 0 to never evict
+    pthread_cond_t cond; ///< signaled when a conn is released
+    struct ua_pool_stats stats;
   } *conn;
   /** 
    * the base_url for every conn
@@ -45,12 +88,92 @@ struct user_agent {
   struct sized_buffer base_url;
   /**
    * synchronize conn pool and shared ratelimiting
+   * @note the lock is never held while a transfer is being performed,
+   *        so that conns from the pool may run concurrently
    */
   struct {
     uint64_t        blockuntil_tstamp; ///< lock every active conn from conn_pool until timestamp
     pthread_mutex_t lock;
+    /**
+     * optional cache of GET responses that carry a validator (ETag or
+     *        Last-Modified), revalidated with conditional requests
+     * @note set once, under the lock
+     * @see ua_set_cache()
+     */
+    struct _ua_cache *cache;
+    /**
+     * optional per-route latency histograms
+     * @note set once, under the lock
+     * @see ua_set_metrics()
+     */
+    struct _ua_metrics *metrics;
+    bool is_metrics; ///< whether timings are being recorded to 'metrics'
+    /**
+     * optional request logging sampling and ring of last requests
+     * @note set once, under the lock
+     * @see ua_set_log_sampling() and ua_set_log_ring()
+     */
+    struct _ua_log *log;
+    /**
+     * optional transport that records responses to a file, or replays
+     *        them instead of reaching the network
+     * @note swapped under the lock, and freed by the original ua only
+     * @see ua_set_record() and ua_set_replay()
+     */
+    struct _ua_tape *tape;
+    /**
+     * optional DNS/TLS session cache shared with other user agents
+     * @see ua_set_share()
+     */
+    struct ua_share *share;
+    /**
+     * whether HTTP/2 should be negotiated for HTTPS transfers, so that
+     *        asynchronous transfers to the same host are multiplexed
+     *        over a single connection
+     * @see ua_set_http2()
+     */
+    bool is_http2;
+    /**
+     * whether identical GET requests performed with ua_run() should be 
+     *        coalesced
+     * @note guarded by the lock
+     * @see ua_set_coalescing()
+     */
+    bool is_coalescing;
   } *shared;
+  /**
+   * asynchronous transfers driven by a curl multi handle
+   * @note the multi handle is only ever touched by the thread
+   *        calling ua_async_perform(), other threads may only
+   *        enqueue transfers to 'pending' (guarded by shared->lock)
+   * @see ua_run_async()
+   */
+  struct {
+    CURLM *mhandle;
+    struct _ua_conn *pending; ///< transfers waiting to be added to mhandle
+    struct _ua_deferred *deferred; ///< requests waiting for a conn (pool exhausted)
+    int running; ///< amount of transfers added to mhandle
+  } *async;
 
+  /**
+   * buffers lent to ua_info and given back with ua_info_recycle(),
+   *        so that conns don't need to reallocate them from scratch
+   * @note guarded by shared->lock
+   */
+  struct {
+    struct sized_buffer bufs[UA_MAX_BUFPOOL];
+    size_t amt; ///< amount of idle buffers
+  } *bufpool;
+  /**
+   * requests in flight that identical ones may wait on, rather than
+   *        performing a transfer of their own
+   * @note guarded by shared->lock
+   * @see ua_flight_begin()
+   */
+  struct {
+    struct ua_flight *list;
+    size_t amt_coalesced; ///< requests served by an identical one in flight
+  } *flights;
   struct logconf conf; ///< used for logging
 
   /**
@@ -67,10 +190,26 @@ struct user_agent {
    * @see ua_curl_mime_setopt()
    */
   void       *data2;
-  curl_mime  *mime; 
   curl_mime* (*mime_cb)(CURL *ehandle, void *data2);
 };
 
+struct ua_share {
+  CURLSH *shandle;
+  /**
+   * one lock per shared data type, so that e.g. DNS lookups don't
+   *        wait on TLS session access
+   */
+  pthread_mutex_t lock[CURL_LOCK_DATA_LAST];
+};
+
+/* state of a response body streamed element-wise */
+enum _ua_stream_state {
+  UA_STREAM_UNDECIDED = 0, ///< waiting for the first non-blank character
+  UA_STREAM_ARRAY,         ///< streaming the top-level array elements
+  UA_STREAM_DONE,          ///< top-level array has been closed
+  UA_STREAM_FALLBACK       ///< not a JSON array or not a 2xx, buffer body as usual
+};
+
 struct _ua_conn {
   struct logconf *conf; // ptr to struct user_agent conf
   struct ua_info info;
@@ -82,6 +221,74 @@ struct _ua_conn {
    * true if current conn is performing a request
    */
   bool is_busy;
+  /**
+   * timestamp of when the conn was last released to the pool
+   */
+  uint64_t idle_tstamp;
+  /**
+   * next conn in the pool's idle stack
+   */
+  struct _ua_conn *next;
+  /**
+   * request specific header (ua->req_header + extra fields), NULL
+   *        if ua->req_header is used as is
+   */
+  struct curl_slist *req_header;
+  /**
+   * whether the response may be stored in the response cache
+   */
+  bool is_cacheable;
+  /**
+   * the route its timings are aggregated into
+   * @see ua_set_metrics()
+   */
+  char route[256];
+  /**
+   * the request method
+   */
+  enum http_method http_method;
+  /**
+   * whether this request is written to the HTTP log
+   * @see ua_set_log_sampling()
+   */
+  bool is_logged;
+  size_t log_counter; ///< the request number, for the log ring
+  /**
+   * the response replayed instead of performing the transfer
+   * @see ua_set_replay()
+   */
+  struct _ua_tape_entry *replayed;
+  /**
+   * response body streamed element-wise
+   * @see ua_resp_handle.elem_cb
+   */
+  struct {
+    load_obj_cb *elem_cb; ///< NULL if the response body isn't streamed
+    void *elem_obj;
+    enum _ua_stream_state state;
+    int depth; ///< JSON nesting depth
+    bool in_str; ///< within a JSON string
+    bool is_escaped; ///< last character within a JSON string was '\\'
+    bool is_kept; ///< raw body is also kept, for ua_set_record()
+    struct ua_resp_body elem; ///< the element being received
+  } stream;
+  /**
+   * the MIME data of the request being performed (if any)
+   * @note kept per-conn so concurrent MIMEPOSTs don't clash
+   */
+  curl_mime *mime;
+  /**
+   * context of an asynchronous transfer
+   * @see ua_run_async()
+   */
+  struct {
+    struct ua_resp_handle resp_handle;
+    bool has_resp_handle;
+    ua_async_cb *done_cb;
+    void *data; ///< user arbitrary data passed to done_cb
+    struct _ua_conn *next; ///< next transfer in the pending queue
+    uint64_t enqueue_tstamp; ///< when it was added to the pending queue
+  } async;
   /** 
    * capture curl error messages
    * @note should only be accessed after a error code returns
@@ -90,6 +297,127 @@ struct _ua_conn {
   char errbuf[CURL_ERROR_SIZE];
 };
 
+/* a cached response, entries are linked both to their hashtable bucket 
+ *  and to the LRU list */
+struct _ua_cache_entry {
+  char *url;
+  char *etag; ///< NULL if missing
+  char *last_modified; ///< NULL if missing
+  struct sized_buffer body;
+  size_t size; ///< memory accounted for this entry
+  struct _ua_cache_entry *hnext; ///< next entry in the same bucket
+  struct _ua_cache_entry *prev, *next; ///< LRU list, most recently used first
+};
+
+struct _ua_cache {
+  struct _ua_cache_entry *buckets[UA_CACHE_BUCKETS];
+  struct _ua_cache_entry *head, *tail; ///< LRU list ends
+  size_t size; ///< memory used by the entries
+  size_t max_size; ///< memory cap, LRU entries are evicted past it
+  struct ua_cache_stats stats;
+  pthread_mutex_t lock;
+};
+
+/* log-linear latency histogram, in microseconds */
+struct _ua_histogram {
+  uint64_t counts[UA_HIST_AMT];
+  uint64_t count, sum, min, max;
+};
+
+struct _ua_route_metrics {
+  char route[256]; ///< HTTP method followed by the endpoint format string
+  struct _ua_histogram hists[UA_METRIC_AMT];
+  struct _ua_route_metrics *next;
+};
+
+struct _ua_metrics {
+  struct _ua_route_metrics *routes;
+  pthread_mutex_t lock;
+};
+
+/* summary of a completed request, kept for post-mortem */
+struct _ua_log_entry {
+  size_t counter; ///< request number
+  uint64_t tstamp; ///< when the response was received
+  enum http_method http_method;
+  int httpcode;
+  uint64_t total_us; ///< transfer duration
+  char url[UA_LOG_RING_URL_LEN];
+  size_t body_len; ///< the whole response body length
+  char body[UA_LOG_RING_BODY_LEN]; ///< the response body beginning
+};
+
+/* a recorded response */
+struct _ua_tape_entry {
+  enum http_method http_method;
+  char url[4096];
+  int httpcode;
+  uint64_t total_us; ///< recorded transfer duration
+  struct sized_buffer header; ///< raw 'Field: value\r\n' lines
+  struct sized_buffer body;
+  size_t amt_served; ///< times it has been replayed
+};
+
+struct _ua_tape {
+  FILE *f; ///< file being recorded to, NULL if replaying
+  char *contents; ///< contents of the file being replayed
+  struct _ua_tape_entry *entries; ///< replayed responses
+  size_t amt;
+  double speed; ///< replay speed factor, 0 for no delays
+  pthread_mutex_t lock;
+};
+
+struct _ua_log {
+  unsigned sampling; ///< log 1 in 'sampling' requests, 0 or 1 for all
+  size_t amt_requests; ///< requests seen so far
+  struct _ua_log_entry *ring; ///< last requests, oldest is overwritten
+  size_t ring_size;
+  pthread_mutex_t lock;
+};
+
+/* a request in flight shared by identical ones */
+struct ua_flight {
+  char *key; ///< identifies the request, such as its URL
+  int amt_followers; ///< amount of identical requests waiting on this one
+  bool is_done;
+  ORCAcode code; ///< the leader's request ORCAcode
+  struct ua_info info; ///< copy of the leader's ua_info, for the followers
+  pthread_cond_t cond; ///< signaled once the leader's request is done
+  struct ua_flight *next;
+};
+
+/* asynchronous request waiting for a conn to be available */
+struct _ua_deferred {
+  enum http_method http_method;
+  char *endpoint; ///< the formatted endpoint
+  char route[256]; ///< the route its timings are aggregated into
+  struct sized_buffer req_body; ///< copy of the request payload
+  struct ua_multipart multipart; ///< deep copy of a UA_MULTIPART_BODY() payload
+  struct ua_resp_handle resp_handle;
+  bool has_resp_handle;
+  ua_async_cb *done_cb;
+  void *data;
+  struct _ua_deferred *next;
+};
+
+static void
+deferred_cleanup(struct _ua_deferred *req)
+{
+  free(req->endpoint);
+  if (HTTP_MIMEPOST == req->http_method) {
+    for (size_t i=0; i < req->multipart.amt; ++i) {
+      free((char*)req->multipart.parts[i].name);
+      free((char*)req->multipart.parts[i].filename);
+      free((char*)req->multipart.parts[i].type);
+    }
+    ua_multipart_cleanup(&req->multipart);
+  }
+  else {
+    free(req->req_body.start);
+  }
+  free(req);
+}
+
 const char*
 http_code_print(int httpcode)
 {
@@ -276,6 +604,139 @@ ua_reqheader_str(struct user_agent *ua, char *buf, size_t bufsize)
   return buf;
 }
 
+/* set a field of the conn's request specific header, which is a copy of 
+ *  ua->req_header made on first use, so that it's left untouched 
+ * @note a NULL value removes the field */
+static void
+conn_reqheader_set(struct user_agent *ua, struct _ua_conn *conn, const char field[], const char value[])
+{
+  if (!conn->req_header) {
+    for (struct curl_slist *node = ua->req_header; node; node = node->next)
+      conn->req_header = curl_slist_append(conn->req_header, node->data);
+  }
+
+  // remove existing fields
+  size_t field_len = strlen(field);
+  struct curl_slist **p_node = &conn->req_header;
+  while (*p_node) {
+    struct curl_slist *node = *p_node;
+    char *ptr = strchr(node->data, ':');
+    if (ptr 
+        && field_len == ptr - node->data 
+        && 0 == strncasecmp(node->data, field, field_len)) 
+    {
+      *p_node = node->next;
+      node->next = NULL;
+      curl_slist_free_all(node);
+      continue;
+    }
+    p_node = &node->next;
+  }
+
+  if (value) {
+    char buf[4096];
+    size_t ret = snprintf(buf, sizeof(buf), "%s: %s", field, value);
+    ASSERT_S(ret < sizeof(buf), "Out of bounds write attempt");
+    conn->req_header = curl_slist_append(conn->req_header, buf);
+  }
+}
+
+/* case-insensitive FNV-1a hash of a header field */
+static unsigned
+respheader_hash(const char field[], size_t len)
+{
+  unsigned hash = 2166136261u;
+  for (size_t i=0; i < len; ++i) {
+    hash ^= (unsigned char)tolower((unsigned char)field[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/* returns the 'pairs' position of field, or -1 if missing */
+static int
+respheader_find(struct ua_resp_header *header, const char field[], size_t len)
+{
+  if (header->size <= UA_HEADER_INDEX_SIZE * 3/4) { // all fields are indexed
+    unsigned slot = respheader_hash(field, len) & (UA_HEADER_INDEX_SIZE-1);
+    while (header->index[slot]) {
+      int i = header->index[slot] - 1;
+      if (len == header->pairs[i].field.size 
+          && 0 == strncasecmp(field, header->buf + header->pairs[i].field.idx, len))
+      {
+        return i;
+      }
+      slot = (slot + 1) & (UA_HEADER_INDEX_SIZE-1);
+    }
+    return -1;
+  }
+
+  for (int i=0; i < header->size; ++i) {
+    if (len == header->pairs[i].field.size 
+        && 0 == strncasecmp(field, header->buf + header->pairs[i].field.idx, len))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* add the latest pair to the index, only the first occurrence of a field is kept */
+static void
+respheader_index(struct ua_resp_header *header, const char field[], size_t len)
+{
+  if (header->size > UA_HEADER_INDEX_SIZE * 3/4) return; /* EARLY RETURN (index is full) */
+
+  unsigned slot = respheader_hash(field, len) & (UA_HEADER_INDEX_SIZE-1);
+  while (header->index[slot]) {
+    int i = header->index[slot] - 1;
+    if (len == header->pairs[i].field.size 
+        && 0 == strncasecmp(field, header->buf + header->pairs[i].field.idx, len))
+    {
+      return; /* EARLY RETURN (duplicate field) */
+    }
+    slot = (slot + 1) & (UA_HEADER_INDEX_SIZE-1);
+  }
+  header->index[slot] = header->size; // latest pair position + 1
+}
+
+/* pre-parse well-known fields into their typed counterparts */
+static void
+respheader_parse_known(struct ua_resp_header *header, const char field[], size_t len, const char value[])
+{
+#define FIELD_EQ(str) (sizeof(str)-1 == len && 0 == strncasecmp(str, field, len))
+  if (len > sizeof("x-ratelimit-")-1 && 0 == strncasecmp("x-ratelimit-", field, sizeof("x-ratelimit-")-1)) 
+  {
+    if (FIELD_EQ("x-ratelimit-remaining"))
+      header->known.ratelimit_remaining = (int)strtol(value, NULL, 10);
+    else if (FIELD_EQ("x-ratelimit-reset"))
+      header->known.ratelimit_reset = strtod(value, NULL);
+    else if (FIELD_EQ("x-ratelimit-reset-after"))
+      header->known.ratelimit_reset_after = strtod(value, NULL);
+    else if (FIELD_EQ("x-ratelimit-bucket"))
+      header->known.ratelimit_bucket = header->size - 1;
+  }
+  else if (FIELD_EQ("retry-after"))
+    header->known.retry_after = strtod(value, NULL);
+  else if (FIELD_EQ("etag"))
+    header->known.etag = header->size - 1;
+#undef FIELD_EQ
+}
+
+static void
+respheader_reset(struct ua_resp_header *header)
+{
+  header->length = 0;
+  header->size = 0;
+  memset(header->index, 0, sizeof(header->index));
+  header->known.ratelimit_remaining = -1;
+  header->known.ratelimit_reset = -1;
+  header->known.ratelimit_reset_after = -1;
+  header->known.retry_after = -1;
+  header->known.ratelimit_bucket = -1;
+  header->known.etag = -1;
+}
+
 /**
  * get http response header by lines
  * @see: https://curl.se/libcurl/c/CURLOPT_HEADERFUNCTION.html 
@@ -296,11 +757,20 @@ conn_respheader_cb(char *buf, size_t size, size_t nmemb, void *p_userdata)
     return bufsize;
   }
 
+  // increase memory block sizes geometrically, only if necessary
   if (header->bufsize < (header->length + bufsize + 1)) {
-    header->bufsize = header->length + bufsize + 1;
-    header->buf = realloc(header->buf, header->bufsize);
+    size_t new_size = header->bufsize ? header->bufsize : 512;
+    while (new_size < (header->length + bufsize + 1))
+      new_size *= 2;
+    header->buf = realloc(header->buf, new_size);
+    header->bufsize = new_size;
+  }
+  if (header->size == header->capacity) {
+    header->capacity = header->capacity ? 2 * header->capacity : 32;
+    header->pairs = realloc(header->pairs, header->capacity * sizeof *header->pairs);
   }
   memcpy(&header->buf[header->length], buf, bufsize);
+  header->buf[header->length + bufsize] = '\0';
 
   // get the field part of the string
   header->pairs[header->size].field.idx = header->length;
@@ -321,7 +791,9 @@ conn_respheader_cb(char *buf, size_t size, size_t nmemb, void *p_userdata)
   header->length += bufsize;
 
   ++header->size; // update header amount of field/value header
-  ASSERT_S(header->size < UA_MAX_HEADER_SIZE, "Out of bounds write attempt");
+
+  respheader_index(header, buf, delim_idx);
+  respheader_parse_known(header, buf, delim_idx, buf + delim_idx + bufoffset);
 
   return bufsize;
 }
@@ -336,10 +808,13 @@ conn_respbody_cb(char *buf, size_t size, size_t nmemb, void *p_userdata)
   size_t bufchunk_size = size * nmemb;
   struct ua_resp_body *body = p_userdata;
 
-  //increase response body memory block size only if necessary
+  //increase response body memory block size geometrically, only if necessary
   if (body->bufsize < (body->length + bufchunk_size + 1)) {
-    body->bufsize = body->length + bufchunk_size + 1;
-    body->buf = realloc(body->buf, body->bufsize);
+    size_t new_size = body->bufsize ? body->bufsize : 1024;
+    while (new_size < (body->length + bufchunk_size + 1))
+      new_size *= 2;
+    body->buf = realloc(body->buf, new_size);
+    body->bufsize = new_size;
   }
   memcpy(&body->buf[body->length], buf, bufchunk_size);
   body->length += bufchunk_size;
@@ -347,6 +822,169 @@ conn_respbody_cb(char *buf, size_t size, size_t nmemb, void *p_userdata)
   return bufchunk_size;
 }
 
+/* give the current element to the user callback */
+static void
+stream_elem_flush(struct _ua_conn *conn)
+{
+  struct ua_resp_body *elem = &conn->stream.elem;
+
+  size_t offset=0; // skip surrounding blank characters
+  while (offset < elem->length && isspace(elem->buf[offset])) 
+    ++offset;
+  while (elem->length > offset && isspace(elem->buf[elem->length-1])) 
+    --elem->length;
+
+  if (elem->length > offset) {
+    elem->buf[elem->length] = '\0';
+    (*conn->stream.elem_cb)(elem->buf + offset, elem->length - offset, conn->stream.elem_obj);
+  }
+  elem->length = 0;
+}
+
+/**
+ * get http response body in chunks, and split the elements of its 
+ *        top-level JSON array as they arrive
+ * @see: https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
+ */
+static size_t
+conn_respbody_stream_cb(char *buf, size_t size, size_t nmemb, void *p_conn)
+{
+  size_t bufchunk_size = size * nmemb;
+  struct _ua_conn *conn = p_conn;
+
+  if (conn->stream.is_kept)
+    conn_respbody_cb(buf, 1, bufchunk_size, &conn->info.resp_body);
+
+  size_t i=0;
+  if (UA_STREAM_UNDECIDED == conn->stream.state) {
+    long httpcode=0;
+    if (conn->replayed)
+      httpcode = conn->replayed->httpcode;
+    else
+      curl_easy_getinfo(conn->ehandle, CURLINFO_RESPONSE_CODE, &httpcode);
+    if (httpcode < 200 || httpcode >= 300) {
+      conn->stream.state = UA_STREAM_FALLBACK;
+    }
+    else {
+      while (i < bufchunk_size && isspace(buf[i])) 
+        ++i;
+      if (i == bufchunk_size) return bufchunk_size; /* EARLY RETURN (blank chunk) */
+
+      if ('[' == buf[i]) {
+        conn->stream.state = UA_STREAM_ARRAY;
+        conn->stream.depth = 1;
+        ++i;
+      }
+      else {
+        conn->stream.state = UA_STREAM_FALLBACK;
+      }
+    }
+  }
+
+  switch (conn->stream.state) {
+  case UA_STREAM_FALLBACK:
+      if (conn->stream.is_kept) return bufchunk_size; /* EARLY RETURN */
+      return conn_respbody_cb(buf, 1, bufchunk_size, &conn->info.resp_body);
+  case UA_STREAM_DONE:
+      return bufchunk_size; // ignore trailing data
+  default:
+      break;
+  }
+
+  size_t run=i; // start of the chunk slice belonging to the current element
+  for (; i < bufchunk_size; ++i) {
+    if (conn->stream.in_str) {
+      if (conn->stream.is_escaped)
+        conn->stream.is_escaped = false;
+      else if ('\\' == buf[i])
+        conn->stream.is_escaped = true;
+      else if ('"' == buf[i])
+        conn->stream.in_str = false;
+      continue;
+    }
+
+    switch (buf[i]) {
+    case '"':
+        conn->stream.in_str = true;
+        break;
+    case '{': case '[':
+        ++conn->stream.depth;
+        break;
+    case '}': case ']':
+        if (--conn->stream.depth) break;
+        // end of top-level array
+        conn_respbody_cb(buf + run, 1, i - run, &conn->stream.elem);
+        stream_elem_flush(conn);
+        conn->stream.state = UA_STREAM_DONE;
+        return bufchunk_size; /* EARLY RETURN */
+    case ',':
+        if (1 != conn->stream.depth) break;
+        // end of top-level element
+        conn_respbody_cb(buf + run, 1, i - run, &conn->stream.elem);
+        stream_elem_flush(conn);
+        run = i + 1;
+        break;
+    default:
+        break;
+    }
+  }
+  conn_respbody_cb(buf + run, 1, bufchunk_size - run, &conn->stream.elem);
+
+  return bufchunk_size;
+}
+
+static struct _ua_tape*
+tape_get(struct user_agent *ua)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_tape *tape = ua->shared->tape;
+  pthread_mutex_unlock(&ua->shared->lock);
+  return tape;
+}
+
+/* whether responses are replayed instead of reaching the network */
+static bool
+tape_is_replaying(struct user_agent *ua)
+{
+  struct _ua_tape *tape = tape_get(ua);
+  return tape && !tape->f;
+}
+
+/* stream the response body element-wise if requested by resp_handle */
+static void
+stream_setup(struct user_agent *ua, struct _ua_conn *conn, struct ua_resp_handle *resp_handle)
+{
+  if (!resp_handle || !resp_handle->elem_cb) return; /* EARLY RETURN */
+
+  conn->stream.elem_cb = resp_handle->elem_cb;
+  conn->stream.elem_obj = resp_handle->elem_obj;
+  struct _ua_tape *tape = tape_get(ua);
+  conn->stream.is_kept = (tape && tape->f);
+
+  CURLcode ecode;
+  ecode = curl_easy_setopt(conn->ehandle, CURLOPT_WRITEFUNCTION, &conn_respbody_stream_cb);
+  CURLE_CHECK(conn, ecode);
+  ecode = curl_easy_setopt(conn->ehandle, CURLOPT_WRITEDATA, conn);
+  CURLE_CHECK(conn, ecode);
+}
+
+/* the response callbacks to be triggered once the transfer is done, if
+ *  the body has been streamed to elem_cb then ok_cb is skipped */
+static struct ua_resp_handle*
+stream_resp_handle(struct _ua_conn *conn, struct ua_resp_handle *resp_handle, struct ua_resp_handle *tmp)
+{
+  if (!resp_handle 
+      || !conn->stream.elem_cb 
+      || UA_STREAM_FALLBACK == conn->stream.state) 
+  {
+    return resp_handle;
+  }
+  *tmp = *resp_handle;
+  tmp->ok_cb = NULL;
+  tmp->cxt_ok_cb = NULL;
+  return tmp;
+}
+
 void
 ua_curl_easy_setopt(struct user_agent *ua, void *data, void (setopt_cb)(CURL *ehandle, void *data)) 
 {
@@ -361,104 +999,1328 @@ ua_curl_mime_setopt(struct user_agent *ua, void *data, curl_mime* (mime_cb)(CURL
   ua->data2 = data;
 }
 
-static struct _ua_conn*
-conn_init(struct user_agent *ua)
+static struct ua_multipart_part*
+multipart_add(struct ua_multipart *multipart, const char name[], const char filename[], const char type[])
 {
-  struct _ua_conn *new_conn = calloc(1, sizeof(struct _ua_conn));
-  new_conn->conf = &ua->conf;
-
-  CURL *new_ehandle = curl_easy_init(); // will be assigned to new_conn
-
-  CURLcode ecode;
-  //set error buffer for capturing CURL error descriptions
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_ERRORBUFFER, new_conn->errbuf);
-  CURLE_CHECK(new_conn, ecode);
-  //set ptr to request header we will be using for API communication
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_HTTPHEADER, ua->req_header);
-  CURLE_CHECK(new_conn, ecode);
+  void *tmp = realloc(multipart->parts, (1 + multipart->amt) * sizeof *multipart->parts);
+  ASSERT_S(NULL != tmp, "Couldn't increase multipart parts");
+  multipart->parts = tmp;
+
+  struct ua_multipart_part *part = &multipart->parts[multipart->amt++];
+  *part = (struct ua_multipart_part){ 
+    .name = name, 
+    .filename = filename, 
+    .type = type, 
+    .fd = -1 
+  };
+  return part;
+}
 
-  //enable follow redirections
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_FOLLOWLOCATION, 1L);
-  CURLE_CHECK(new_conn, ecode);
+void
+ua_multipart_add_data(struct ua_multipart *multipart, const char name[], const char filename[], const char type[], const char *data, size_t size)
+{
+  struct ua_multipart_part *part = multipart_add(multipart, name, filename, type);
+  part->data = data;
+  part->size = size;
+}
 
-  //set response body callback
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_WRITEFUNCTION, &conn_respbody_cb);
-  CURLE_CHECK(new_conn, ecode);
+void
+ua_multipart_add_fd(struct ua_multipart *multipart, const char name[], const char filename[], const char type[], int fd, off_t offset, size_t size)
+{
+  struct ua_multipart_part *part = multipart_add(multipart, name, filename, type);
+  part->fd = fd;
+  part->offset = offset;
+  part->size = size;
+}
 
-  //set ptr to response body to be filled at callback
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_WRITEDATA, &new_conn->info.resp_body);
-  CURLE_CHECK(new_conn, ecode);
+ORCAcode
+ua_multipart_add_file(struct ua_multipart *multipart, const char name[], const char type[], const char path[])
+{
+  if (!name || !path) {
+    log_error("Missing multipart %s", name ? "'path'" : "'name'");
+    return ORCA_BAD_PARAMETER;
+  }
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    log_error("Couldn't open '%s'", path);
+    return ORCA_BAD_PARAMETER;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    log_error("'%s' isn't a regular file", path);
+    close(fd);
+    return ORCA_BAD_PARAMETER;
+  }
 
-  //set response header callback
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_HEADERFUNCTION, &conn_respheader_cb);
-  CURLE_CHECK(new_conn, ecode);
+  const char *filename = strrchr(path, '/');
+  filename = filename ? filename + 1 : path;
 
-  //set ptr to response header to be filled at callback
-  ecode = curl_easy_setopt(new_ehandle, CURLOPT_HEADERDATA, &new_conn->info.resp_header);
-  CURLE_CHECK(new_conn, ecode);
+  ua_multipart_add_fd(multipart, name, filename, type, fd, 0, (size_t)st.st_size);
+  multipart->parts[multipart->amt-1].is_fd_owned = true;
+  return ORCA_OK;
+}
 
-  // execute user-defined curl_easy_setopts
-  if (ua->setopt_cb) {
-    (*ua->setopt_cb)(new_ehandle, ua->data);
+void
+ua_multipart_cleanup(struct ua_multipart *multipart)
+{
+  for (size_t i=0; i < multipart->amt; ++i) {
+    if (multipart->parts[i].is_fd_owned)
+      close(multipart->parts[i].fd);
   }
-
-  new_conn->ehandle = new_ehandle;
-
-  return new_conn;
+  if (multipart->parts)
+    free(multipart->parts);
+  memset(multipart, 0, sizeof *multipart);
 }
 
-static void
-conn_cleanup(struct _ua_conn *conn)
+/* check that a HTTP_MIMEPOST payload is a UA_MULTIPART_BODY() whose
+ *  parts all have a name and a content to read from, or is empty (the
+ *  deprecated ua_curl_mime_setopt() callback) */
+static ORCAcode
+multipart_validate(struct sized_buffer *req_body)
 {
-  curl_easy_cleanup(conn->ehandle);
-  ua_info_cleanup(&conn->info);
-  free(conn);
+  if (!req_body->size) return ORCA_OK; /* EARLY RETURN */
+
+  if (UA_MULTIPART_SIZE != req_body->size) {
+    log_error("Expect a UA_MULTIPART_BODY() payload");
+    return ORCA_BAD_PARAMETER;
+  }
+  struct ua_multipart *multipart = (struct ua_multipart*)req_body->start;
+  for (size_t i=0; i < multipart->amt; ++i) {
+    struct ua_multipart_part *part = &multipart->parts[i];
+    if (!part->name || (!part->data && part->fd < 0)) {
+      log_error("Multipart part #%zu is missing its %s", 
+          i, part->name ? "content" : "name");
+      return ORCA_BAD_PARAMETER;
+    }
+  }
+  return ORCA_OK;
 }
 
+/* deep copy a multipart body, its fds are dup()'d and owned by the copy */
 static void
-conn_reset(struct _ua_conn *conn)
+multipart_dup(struct ua_multipart *dest, struct ua_multipart *src)
 {
-  conn->is_busy = false;
-  conn->info.httpcode = 0;
-  conn->info.req_tstamp = 0;
-  conn->info.resp_body.length = 0;
-  conn->info.resp_header.length = 0;
-  conn->info.resp_header.size = 0;
-  *conn->errbuf = '\0';
+  dest->parts = calloc(src->amt, sizeof *dest->parts);
+  dest->amt = src->amt;
+  for (size_t i=0; i < src->amt; ++i) {
+    struct ua_multipart_part *part = &dest->parts[i];
+    *part = src->parts[i];
+    part->name = part->name ? strdup(part->name) : NULL;
+    part->filename = part->filename ? strdup(part->filename) : NULL;
+    part->type = part->type ? strdup(part->type) : NULL;
+    if (!part->data) {
+      part->fd = fcntl(src->parts[i].fd, F_DUPFD_CLOEXEC, 0);
+      VASSERT_S(part->fd >= 0, "Couldn't duplicate multipart '%s' fd", src->parts[i].name);
+      part->is_fd_owned = true;
+    }
+  }
 }
 
-static struct _ua_conn*
-get_conn(struct user_agent *ua)
+/* read position of a multipart part, one per transfer so that the same
+ *  part may be sent concurrently, the part is copied (and its fd dup()'d)
+ *  so that the caller's body may be freed before an async transfer runs */
+struct _ua_mime_cursor {
+  struct ua_multipart_part part;
+  size_t pos;
+};
+
+static size_t
+mime_read_cb(char *buf, size_t size, size_t nitems, void *p_cursor)
 {
-  pthread_mutex_lock(&ua->shared->lock);
-  struct _ua_conn *ret_conn=NULL;
+  struct _ua_mime_cursor *cursor = p_cursor;
+  struct ua_multipart_part *part = &cursor->part;
 
-  size_t i=0;
-  while (i < ua->conn->amt) {
-    if (!ua->conn->pool[i]->is_busy) {
-      ret_conn = ua->conn->pool[i];
-      break; /* EARLY BREAK */
+  size_t len = size * nitems;
+  if (len > part->size - cursor->pos)
+    len = part->size - cursor->pos;
+  if (!len) return 0; /* EARLY RETURN (end of content) */
+
+  if (part->data) {
+    memcpy(buf, part->data + cursor->pos, len);
+  }
+  else {
+    ssize_t ret = pread(part->fd, buf, len, part->offset + (off_t)cursor->pos);
+    if (ret <= 0) {
+      log_error("Couldn't read multipart content");
+      return CURL_READFUNC_ABORT;
+    }
+    len = (size_t)ret;
+  }
+  cursor->pos += len;
+  return len;
+}
+
+static int
+mime_seek_cb(void *p_cursor, curl_off_t offset, int origin)
+{
+  struct _ua_mime_cursor *cursor = p_cursor;
+
+  switch (origin) {
+  case SEEK_SET: break;
+  case SEEK_CUR: offset += cursor->pos; break;
+  case SEEK_END: offset += cursor->part.size; break;
+  default: return CURL_SEEKFUNC_FAIL;
+  }
+  if (offset < 0 || (size_t)offset > cursor->part.size)
+    return CURL_SEEKFUNC_FAIL;
+
+  cursor->pos = (size_t)offset;
+  return CURL_SEEKFUNC_OK;
+}
+
+static void
+mime_free_cb(void *p_cursor)
+{
+  struct _ua_mime_cursor *cursor = p_cursor;
+  if (cursor->part.fd >= 0)
+    close(cursor->part.fd);
+  free(cursor);
+}
+
+/* build the conn's MIME tree from the request's multipart body */
+static void
+conn_set_multipart(struct user_agent *ua, struct _ua_conn *conn, struct ua_multipart *multipart)
+{
+  conn->mime = curl_mime_init(conn->ehandle);
+  for (size_t i=0; i < multipart->amt; ++i) {
+    struct ua_multipart_part *part = &multipart->parts[i];
+    curl_mimepart *mimepart = curl_mime_addpart(conn->mime);
+
+    struct _ua_mime_cursor *cursor = calloc(1, sizeof *cursor);
+    cursor->part = *part;
+    // copied by libcurl, the part's strings may not outlive the transfer
+    cursor->part.name = cursor->part.filename = cursor->part.type = NULL;
+    if (!part->data) {
+      cursor->part.fd = fcntl(part->fd, F_DUPFD_CLOEXEC, 0);
+      VASSERT_S(cursor->part.fd >= 0, "Couldn't duplicate multipart '%s' fd", part->name);
     }
-    ++i;
+    curl_mime_data_cb(mimepart, (curl_off_t)part->size, 
+        &mime_read_cb, &mime_seek_cb, &mime_free_cb, cursor);
+    curl_mime_name(mimepart, part->name);
+    if (part->filename) 
+      curl_mime_filename(mimepart, part->filename);
+    if (part->type) 
+      curl_mime_type(mimepart, part->type);
   }
-  if (!ret_conn) { // no available conn, create new
+
+  CURLcode ecode = curl_easy_setopt(conn->ehandle, CURLOPT_MIMEPOST, conn->mime);
+  CURLE_CHECK(conn, ecode);
+
+  // ua->req_header's Content-Type would take over the multipart one (and its boundary)
+  conn_reqheader_set(ua, conn, "Content-Type", NULL);
+}
+
+static void
+conn_set_http2(struct _ua_conn *conn, CURL *ehandle, bool enable)
+{
+  CURLcode ecode;
+  ecode = curl_easy_setopt(ehandle, CURLOPT_HTTP_VERSION, 
+            enable ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_NONE);
+  CURLE_CHECK(conn, ecode);
+  // wait for a connection to be multiplexed rather than opening a new one
+  ecode = curl_easy_setopt(ehandle, CURLOPT_PIPEWAIT, enable ? 1L : 0L);
+  CURLE_CHECK(conn, ecode);
+}
+
+static struct _ua_conn*
+conn_init(struct user_agent *ua)
+{
+  struct _ua_conn *new_conn = calloc(1, sizeof(struct _ua_conn));
+  new_conn->conf = &ua->conf;
+
+  CURL *new_ehandle = curl_easy_init(); // will be assigned to new_conn
+
+  CURLcode ecode;
+  //set error buffer for capturing CURL error descriptions
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_ERRORBUFFER, new_conn->errbuf);
+  CURLE_CHECK(new_conn, ecode);
+  //set ptr to request header we will be using for API communication
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_HTTPHEADER, ua->req_header);
+  CURLE_CHECK(new_conn, ecode);
+
+  //enable follow redirections
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_FOLLOWLOCATION, 1L);
+  CURLE_CHECK(new_conn, ecode);
+
+  //set response body callback
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_WRITEFUNCTION, &conn_respbody_cb);
+  CURLE_CHECK(new_conn, ecode);
+
+  //set ptr to response body to be filled at callback
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_WRITEDATA, &new_conn->info.resp_body);
+  CURLE_CHECK(new_conn, ecode);
+
+  //set response header callback
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_HEADERFUNCTION, &conn_respheader_cb);
+  CURLE_CHECK(new_conn, ecode);
+
+  //set ptr to response header to be filled at callback
+  ecode = curl_easy_setopt(new_ehandle, CURLOPT_HEADERDATA, &new_conn->info.resp_header);
+  CURLE_CHECK(new_conn, ecode);
+  respheader_reset(&new_conn->info.resp_header);
+
+  if (ua->shared->share) {
+    ecode = curl_easy_setopt(new_ehandle, CURLOPT_SHARE, ua->shared->share->shandle);
+    CURLE_CHECK(new_conn, ecode);
+  }
+  if (ua->shared->is_http2) {
+    conn_set_http2(new_conn, new_ehandle, true);
+  }
+
+  // execute user-defined curl_easy_setopts
+  if (ua->setopt_cb) {
+    (*ua->setopt_cb)(new_ehandle, ua->data);
+  }
+
+  new_conn->ehandle = new_ehandle;
+
+  return new_conn;
+}
+
+static void
+conn_cleanup(struct _ua_conn *conn)
+{
+  curl_easy_cleanup(conn->ehandle);
+  ua_info_cleanup(&conn->info);
+  if (conn->stream.elem.buf)
+    free(conn->stream.elem.buf);
+  free(conn);
+}
+
+static void
+conn_reset(struct _ua_conn *conn)
+{
+  conn->info.httpcode = 0;
+  conn->info.req_tstamp = 0;
+  conn->info.resp_body.length = 0;
+  memset(&conn->info.timings, 0, sizeof(struct ua_timings));
+  memset(&conn->info.loginfo, 0, sizeof(struct loginfo));
+  conn->replayed = NULL;
+  respheader_reset(&conn->info.resp_header);
+  *conn->errbuf = '\0';
+  if (conn->mime) {
+    curl_easy_setopt(conn->ehandle, CURLOPT_MIMEPOST, NULL);
+    curl_mime_free(conn->mime);
+    conn->mime = NULL;
+  }
+  memset(&conn->async, 0, sizeof(conn->async));
+}
+
+/* fetch a idle conn from the pool or create a new one, if the pool is
+ *  exhausted wait for a conn to be released when 'is_blocking' is set, 
+ *  otherwise return NULL */
+static struct _ua_conn*
+get_conn(struct user_agent *ua, bool is_blocking)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_conn *ret_conn=NULL;
+
+  // wait while the max amount of busy conns has been reached
+  while (ua->conn->max && (ua->conn->amt - ua->conn->amt_idle) >= ua->conn->max) {
+    if (!is_blocking) {
+      pthread_mutex_unlock(&ua->shared->lock);
+      return NULL; /* EARLY RETURN */
+    }
+    ++ua->conn->stats.waits;
+    pthread_cond_wait(&ua->conn->cond, &ua->shared->lock);
+  }
+
+  if (ua->conn->idle) { // pop most recently used conn
+    ret_conn = ua->conn->idle;
+    ua->conn->idle = ret_conn->next;
+    ret_conn->next = NULL;
+    --ua->conn->amt_idle;
+    ++ua->conn->stats.hits;
+  }
+  else { // no available conn, create new
     ++ua->conn->amt;
     ua->conn->pool = realloc(ua->conn->pool, \
                         ua->conn->amt * sizeof *ua->conn->pool);
     ret_conn = ua->conn->pool[ua->conn->amt-1] = conn_init(ua);
+    ++ua->conn->stats.misses;
   }
   VASSERT_S(NULL != ret_conn, "[%s] (Internal error) Couldn't fetch conn", ua->conf.id);
   ret_conn->is_busy = true;
+  // the pool is shared by clones, the conn may come from one that's gone by now
+  ret_conn->conf = &ua->conf;
+  curl_easy_setopt(ret_conn->ehandle, CURLOPT_HTTPHEADER, ua->req_header);
   pthread_mutex_unlock(&ua->shared->lock);
   return ret_conn;
 }
 
+/* remove conn from the pool array, must be called with the lock held */
+static void
+remove_conn(struct user_agent *ua, struct _ua_conn *conn)
+{
+  for (size_t i=0; i < ua->conn->amt; ++i) {
+    if (ua->conn->pool[i] == conn) { // swap with last
+      ua->conn->pool[i] = ua->conn->pool[--ua->conn->amt];
+      return; /* EARLY RETURN */
+    }
+  }
+}
+
+/* detach idle conns past the TTL from the pool, must be called with 
+ *  the lock held
+ * @return the list of evicted conns, to be freed once the lock is released */
+static struct _ua_conn*
+evict_conns(struct user_agent *ua, uint64_t now)
+{
+  if (!ua->conn->idle_ttl_ms) return NULL; /* EARLY RETURN */
+
+  // the idle stack is sorted from newest to oldest, cut at the first expired conn
+  struct _ua_conn **p_conn = &ua->conn->idle;
+  while (*p_conn && (now - (*p_conn)->idle_tstamp) <= ua->conn->idle_ttl_ms)
+    p_conn = &(*p_conn)->next;
+
+  struct _ua_conn *evicted = *p_conn;
+  *p_conn = NULL;
+
+  for (struct _ua_conn *conn = evicted; conn; conn = conn->next) {
+    remove_conn(ua, conn);
+    --ua->conn->amt_idle;
+    ++ua->conn->stats.evictions;
+  }
+  return evicted;
+}
+
+/* get a idle buffer from the buffer pool, must be called with the lock held */
+static void
+bufpool_get(struct user_agent *ua, char **p_buf, size_t *p_bufsize)
+{
+  if (*p_buf || !ua->bufpool->amt) return; /* EARLY RETURN */
+
+  struct sized_buffer *buf = &ua->bufpool->bufs[--ua->bufpool->amt];
+  *p_buf = buf->start;
+  *p_bufsize = buf->size;
+}
+
+/* give a buffer back to the buffer pool, must be called with the lock held */
+static void
+bufpool_put(struct user_agent *ua, char *buf, size_t bufsize)
+{
+  if (!buf) return; /* EARLY RETURN */
+
+  if (ua->bufpool->amt == UA_MAX_BUFPOOL) { // pool is full
+    free(buf);
+    return; /* EARLY RETURN */
+  }
+  ua->bufpool->bufs[ua->bufpool->amt++] = (struct sized_buffer){ buf, bufsize };
+}
+
+/* give conn back to the pool so that it may be reused */
+static void
+release_conn(struct user_agent *ua, struct _ua_conn *conn)
+{
+  if (conn->req_header) { // back to the default header
+    curl_easy_setopt(conn->ehandle, CURLOPT_HTTPHEADER, ua->req_header);
+    curl_slist_free_all(conn->req_header);
+    conn->req_header = NULL;
+  }
+  if (conn->stream.elem_cb) { // back to buffering the response body
+    curl_easy_setopt(conn->ehandle, CURLOPT_WRITEFUNCTION, &conn_respbody_cb);
+    curl_easy_setopt(conn->ehandle, CURLOPT_WRITEDATA, &conn->info.resp_body);
+    conn->stream.elem_cb = NULL;
+    conn->stream.elem_obj = NULL;
+    conn->stream.state = UA_STREAM_UNDECIDED;
+    conn->stream.depth = 0;
+    conn->stream.in_str = false;
+    conn->stream.is_escaped = false;
+    conn->stream.is_kept = false;
+    conn->stream.elem.length = 0;
+  }
+  conn->is_cacheable = false;
+  *conn->route = '\0';
+  conn_reset(conn);
+  pthread_mutex_lock(&ua->shared->lock);
+  // replace buffers that have been lent to a ua_info (reverse order of ua_info_recycle())
+  if (!conn->info.resp_header.pairs) {
+    char *pairs=NULL;
+    size_t bufsize=0;
+    bufpool_get(ua, &pairs, &bufsize);
+    conn->info.resp_header.pairs = (void*)pairs;
+    conn->info.resp_header.capacity = bufsize / sizeof(struct ua_resp_header_pair);
+  }
+  bufpool_get(ua, &conn->info.resp_header.buf, &conn->info.resp_header.bufsize);
+  bufpool_get(ua, &conn->info.resp_body.buf, &conn->info.resp_body.bufsize);
+  bufpool_get(ua, &conn->info.req_url.start, &conn->info.req_url.size);
+  conn->is_busy = false;
+
+  // push to the idle stack
+  conn->idle_tstamp = cee_timestamp_ms();
+  conn->next = ua->conn->idle;
+  ua->conn->idle = conn;
+  ++ua->conn->amt_idle;
+
+  struct _ua_conn *evicted = evict_conns(ua, conn->idle_tstamp);
+  if (ua->conn->max && ua->conn->amt > ua->conn->max) { // shrink to a lowered max
+    ua->conn->idle = conn->next;
+    --ua->conn->amt_idle;
+    remove_conn(ua, conn);
+    ++ua->conn->stats.evictions;
+    conn->next = evicted;
+    evicted = conn;
+  }
+  pthread_cond_signal(&ua->conn->cond);
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  struct _ua_conn *next;
+  for (; evicted; evicted = next) {
+    next = evicted->next;
+    conn_cleanup(evicted);
+  }
+}
+
+void
+ua_set_conn_limits(struct user_agent *ua, size_t max, uint64_t idle_ttl_ms)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  ua->conn->max = max;
+  ua->conn->idle_ttl_ms = idle_ttl_ms;
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+void
+ua_get_pool_stats(struct user_agent *ua, struct ua_pool_stats *stats)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  *stats = ua->conn->stats;
+  stats->amt = ua->conn->amt;
+  stats->amt_idle = ua->conn->amt_idle;
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+static unsigned
+cache_hash(const char url[])
+{
+  unsigned hash = 2166136261u;
+  for (; *url; ++url) {
+    hash ^= (unsigned char)*url;
+    hash *= 16777619u;
+  }
+  return hash & (UA_CACHE_BUCKETS-1);
+}
+
+/* must be called with the cache lock held */
+static struct _ua_cache_entry*
+cache_find(struct _ua_cache *cache, const char url[])
+{
+  struct _ua_cache_entry *entry = cache->buckets[cache_hash(url)];
+  while (entry && strcmp(entry->url, url))
+    entry = entry->hnext;
+  return entry;
+}
+
+/* must be called with the cache lock held */
+static void
+cache_lru_unlink(struct _ua_cache *cache, struct _ua_cache_entry *entry)
+{
+  if (entry->prev) entry->prev->next = entry->next;
+  else cache->head = entry->next;
+  if (entry->next) entry->next->prev = entry->prev;
+  else cache->tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+/* must be called with the cache lock held */
+static void
+cache_lru_push(struct _ua_cache *cache, struct _ua_cache_entry *entry)
+{
+  entry->next = cache->head;
+  if (cache->head) cache->head->prev = entry;
+  cache->head = entry;
+  if (!cache->tail) cache->tail = entry;
+}
+
+static void
+cache_entry_cleanup(struct _ua_cache_entry *entry)
+{
+  free(entry->url);
+  if (entry->etag) free(entry->etag);
+  if (entry->last_modified) free(entry->last_modified);
+  free(entry->body.start);
+  free(entry);
+}
+
+/* must be called with the cache lock held */
+static void
+cache_remove(struct _ua_cache *cache, struct _ua_cache_entry *entry)
+{
+  struct _ua_cache_entry **p_entry = &cache->buckets[cache_hash(entry->url)];
+  while (*p_entry != entry)
+    p_entry = &(*p_entry)->hnext;
+  *p_entry = entry->hnext;
+  cache_lru_unlink(cache, entry);
+  cache->size -= entry->size;
+  cache_entry_cleanup(entry);
+}
+
+/* the cache shared by the ua and its clones, NULL if not enabled */
+static struct _ua_cache*
+cache_get(struct user_agent *ua)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_cache *cache = ua->shared->cache;
+  pthread_mutex_unlock(&ua->shared->lock);
+  return cache;
+}
+
+void
+ua_set_cache(struct user_agent *ua, size_t max_size)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_cache *cache = ua->shared->cache;
+  if (!cache && max_size) {
+    cache = ua->shared->cache = calloc(1, sizeof *cache);
+    if (pthread_mutex_init(&cache->lock, NULL))
+      ERR("Couldn't initialize mutex");
+  }
+  pthread_mutex_unlock(&ua->shared->lock);
+  if (!cache) return; /* EARLY RETURN */
+
+  pthread_mutex_lock(&cache->lock);
+  cache->max_size = max_size;
+  while (cache->size > max_size) {
+    cache_remove(cache, cache->tail);
+    ++cache->stats.evictions;
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void
+ua_get_cache_stats(struct user_agent *ua, struct ua_cache_stats *stats)
+{
+  struct _ua_cache *cache = cache_get(ua);
+  if (!cache) {
+    memset(stats, 0, sizeof *stats);
+    return; /* EARLY RETURN */
+  }
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  stats->size = cache->size;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static void
+cache_cleanup(struct _ua_cache *cache)
+{
+  while (cache->head)
+    cache_remove(cache, cache->head);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+/* make the request conditional if a validator for its URL is cached */
+static void
+cache_prepare(struct user_agent *ua, struct _ua_conn *conn, struct _ua_cache *cache)
+{
+  conn->is_cacheable = true;
+
+  pthread_mutex_lock(&cache->lock);
+  struct _ua_cache_entry *entry = cache_find(cache, conn->info.req_url.start);
+  if (entry) {
+    if (entry->etag)
+      conn_reqheader_set(ua, conn, "If-None-Match", entry->etag);
+    if (entry->last_modified)
+      conn_reqheader_set(ua, conn, "If-Modified-Since", entry->last_modified);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/* serve the cached body on a 304 response, or store a new response 
+ *  that carries validators */
+static void
+cache_update(struct user_agent *ua, struct _ua_conn *conn)
+{
+  if (!conn->is_cacheable) return; /* EARLY RETURN */
+
+  struct _ua_cache *cache = ua->shared->cache; // set before the conn was made cacheable
+  const char *url = conn->info.req_url.start;
+
+  if (HTTP_NOT_MODIFIED == conn->info.httpcode) {
+    pthread_mutex_lock(&cache->lock);
+    struct _ua_cache_entry *entry = cache_find(cache, url);
+    if (entry) {
+      cache_lru_unlink(cache, entry);
+      cache_lru_push(cache, entry);
+      ++cache->stats.hits;
+
+      conn->info.resp_body.length = 0;
+      conn_respbody_cb(entry->body.start, 1, entry->body.size, &conn->info.resp_body);
+      conn->info.httpcode = HTTP_OK; // the cached response is still valid
+      logconf_trace(conn->conf, "Serving cached response for: %s", url);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return; /* EARLY RETURN */
+  }
+  if (HTTP_OK != conn->info.httpcode) return; /* EARLY RETURN */
+
+  struct ua_resp_header *header = &conn->info.resp_header;
+  struct sized_buffer etag={0}, last_modified;
+  if (header->known.etag >= 0) {
+    etag.start = header->buf + header->pairs[header->known.etag].value.idx;
+    etag.size = header->pairs[header->known.etag].value.size;
+  }
+  last_modified = ua_info_respheader_field(&conn->info, "last-modified");
+  if (!etag.size && !last_modified.size) return; /* EARLY RETURN (no validator) */
+
+  struct _ua_cache_entry *new_entry = calloc(1, sizeof *new_entry);
+  new_entry->url = strdup(url);
+  if (etag.size)
+    asprintf(&new_entry->etag, "%.*s", (int)etag.size, etag.start);
+  if (last_modified.size)
+    asprintf(&new_entry->last_modified, "%.*s", (int)last_modified.size, last_modified.start);
+  new_entry->body.size = conn->info.resp_body.length;
+  new_entry->body.start = malloc(new_entry->body.size + 1);
+  memcpy(new_entry->body.start, conn->info.resp_body.buf, new_entry->body.size);
+  new_entry->body.start[new_entry->body.size] = '\0';
+  new_entry->size = sizeof *new_entry + strlen(url) + etag.size + last_modified.size + new_entry->body.size;
+
+  pthread_mutex_lock(&cache->lock);
+  struct _ua_cache_entry *entry = cache_find(cache, url);
+  if (entry) cache_remove(cache, entry); // outdated
+
+  if (new_entry->size > cache->max_size) { // doesn't fit
+    pthread_mutex_unlock(&cache->lock);
+    cache_entry_cleanup(new_entry);
+    return; /* EARLY RETURN */
+  }
+  while (cache->size + new_entry->size > cache->max_size) {
+    cache_remove(cache, cache->tail);
+    ++cache->stats.evictions;
+  }
+  unsigned hash = cache_hash(url);
+  new_entry->hnext = cache->buckets[hash];
+  cache->buckets[hash] = new_entry;
+  cache_lru_push(cache, new_entry);
+  cache->size += new_entry->size;
+  ++cache->stats.misses;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/* index of the histogram bucket counting value */
+static size_t
+hist_index(uint64_t value)
+{
+  if (value >> UA_HIST_MAX_EXP) // clamp to the highest trackable value
+    value = (1ULL << UA_HIST_MAX_EXP) - 1;
+  if (value < (1 << UA_HIST_SUB_BITS)) 
+    return value; /* EARLY RETURN (exact values) */
+
+  int exp = UA_HIST_SUB_BITS;
+  while (value >> (exp + 1)) 
+    ++exp;
+  size_t sub = (value >> (exp - UA_HIST_SUB_BITS)) & ((1 << UA_HIST_SUB_BITS) - 1);
+  return ((size_t)(exp - UA_HIST_SUB_BITS + 1) << UA_HIST_SUB_BITS) + sub;
+}
+
+/* highest value counted by the histogram bucket at index */
+static uint64_t
+hist_value(size_t idx)
+{
+  if (idx < (1 << UA_HIST_SUB_BITS)) 
+    return idx; /* EARLY RETURN (exact values) */
+
+  int exp = (int)(idx >> UA_HIST_SUB_BITS) + UA_HIST_SUB_BITS - 1;
+  uint64_t sub = (idx & ((1 << UA_HIST_SUB_BITS) - 1)) | (1 << UA_HIST_SUB_BITS);
+  return ((sub + 1) << (exp - UA_HIST_SUB_BITS)) - 1;
+}
+
+static void
+hist_record(struct _ua_histogram *hist, uint64_t value)
+{
+  ++hist->counts[hist_index(value)];
+  if (!hist->count || value < hist->min) hist->min = value;
+  if (value > hist->max) hist->max = value;
+  ++hist->count;
+  hist->sum += value;
+}
+
+/* value at percentile, within the histogram's precision */
+static uint64_t
+hist_percentile(struct _ua_histogram *hist, double percentile)
+{
+  uint64_t target = (uint64_t)((percentile / 100.0) * hist->count + 0.5);
+  if (!target) target = 1;
+
+  uint64_t seen=0;
+  for (size_t i=0; i < UA_HIST_AMT; ++i) {
+    seen += hist->counts[i];
+    if (seen >= target) {
+      uint64_t value = hist_value(i);
+      return (value > hist->max) ? hist->max : value;
+    }
+  }
+  return hist->max;
+}
+
+static void
+metrics_route_key(char key[], size_t keysize, enum http_method http_method, char endpoint[])
+{
+  snprintf(key, keysize, "%s %s", http_method_print(http_method), endpoint);
+}
+
+/* get a route's histograms, create them if missing 
+ * @note metrics->lock should be locked */
+static struct _ua_route_metrics*
+metrics_route(struct _ua_metrics *metrics, const char key[])
+{
+  struct _ua_route_metrics *route;
+  for (route = metrics->routes; route; route = route->next) {
+    if (0 == strcmp(route->route, key)) 
+      return route; /* EARLY RETURN */
+  }
+  route = calloc(1, sizeof *route);
+  snprintf(route->route, sizeof(route->route), "%s", key);
+  route->next = metrics->routes;
+  metrics->routes = route;
+  return route;
+}
+
+void
+ua_set_metrics(struct user_agent *ua, bool enable)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  if (!ua->shared->metrics && enable) {
+    ua->shared->metrics = calloc(1, sizeof *ua->shared->metrics);
+    if (pthread_mutex_init(&ua->shared->metrics->lock, NULL))
+      ERR("Couldn't initialize mutex");
+  }
+  ua->shared->is_metrics = enable;
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+/* the metrics shared by the ua and its clones, NULL if there are none,
+ *  or if they're not being recorded and is_recording is set */
+static struct _ua_metrics*
+metrics_get(struct user_agent *ua, bool is_recording)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_metrics *metrics = ua->shared->metrics;
+  if (is_recording && !ua->shared->is_metrics)
+    metrics = NULL;
+  pthread_mutex_unlock(&ua->shared->lock);
+  return metrics;
+}
+
+static void
+metrics_cleanup(struct _ua_metrics *metrics)
+{
+  struct _ua_route_metrics *route, *next;
+  for (route = metrics->routes; route; route = next) {
+    next = route->next;
+    free(route);
+  }
+  pthread_mutex_destroy(&metrics->lock);
+  free(metrics);
+}
+
+void
+ua_metrics_record(struct user_agent *ua, enum http_method http_method, char endpoint[], enum ua_metric metric, uint64_t value_us)
+{
+  struct _ua_metrics *metrics = metrics_get(ua, true);
+  if (!metrics) return; /* EARLY RETURN */
+
+  char key[256];
+  metrics_route_key(key, sizeof(key), http_method, endpoint);
+
+  pthread_mutex_lock(&metrics->lock);
+  hist_record(&metrics_route(metrics, key)->hists[metric], value_us);
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+/* record the timings of a completed transfer */
+static void
+metrics_record_timings(struct user_agent *ua, struct _ua_conn *conn)
+{
+  if (!*conn->route) return; /* EARLY RETURN */
+  struct _ua_metrics *metrics = metrics_get(ua, true);
+  if (!metrics) return; /* EARLY RETURN */
+
+  struct ua_timings *timings = &conn->info.timings;
+  pthread_mutex_lock(&metrics->lock);
+  struct _ua_route_metrics *route = metrics_route(metrics, conn->route);
+  hist_record(&route->hists[UA_METRIC_NAMELOOKUP], timings->namelookup);
+  hist_record(&route->hists[UA_METRIC_CONNECT], timings->connect);
+  hist_record(&route->hists[UA_METRIC_APPCONNECT], timings->appconnect);
+  hist_record(&route->hists[UA_METRIC_STARTTRANSFER], timings->starttransfer);
+  hist_record(&route->hists[UA_METRIC_TOTAL], timings->total);
+  hist_record(&route->hists[UA_METRIC_BLOCKED], timings->blocked);
+  pthread_mutex_unlock(&metrics->lock);
+}
+
+static void
+hist_stats(struct _ua_histogram *hist, struct ua_metrics_stats *stats)
+{
+  stats->count = hist->count;
+  stats->min = hist->min;
+  stats->max = hist->max;
+  stats->mean = hist->count ? (double)hist->sum / hist->count : 0;
+  stats->p50 = hist_percentile(hist, 50.0);
+  stats->p90 = hist_percentile(hist, 90.0);
+  stats->p99 = hist_percentile(hist, 99.0);
+  stats->p999 = hist_percentile(hist, 99.9);
+}
+
+bool
+ua_get_metrics(struct user_agent *ua, enum http_method http_method, char endpoint[], enum ua_metric metric, struct ua_metrics_stats *stats)
+{
+  memset(stats, 0, sizeof *stats);
+  struct _ua_metrics *metrics = metrics_get(ua, false);
+  if (!metrics) return false; /* EARLY RETURN */
+
+  char key[256];
+  metrics_route_key(key, sizeof(key), http_method, endpoint);
+
+  bool found=false;
+  pthread_mutex_lock(&metrics->lock);
+  for (struct _ua_route_metrics *route = metrics->routes; route; route = route->next) {
+    if (0 == strcmp(route->route, key)) {
+      hist_stats(&route->hists[metric], stats);
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&metrics->lock);
+  return found;
+}
+
+size_t
+ua_metrics_dump(struct user_agent *ua, char buf[], size_t bufsize)
+{
+  static const char *names[UA_METRIC_AMT] = {
+    [UA_METRIC_NAMELOOKUP]    = "namelookup",
+    [UA_METRIC_CONNECT]       = "connect",
+    [UA_METRIC_APPCONNECT]    = "appconnect",
+    [UA_METRIC_STARTTRANSFER] = "starttransfer",
+    [UA_METRIC_TOTAL]         = "total",
+    [UA_METRIC_BLOCKED]       = "blocked",
+    [UA_METRIC_RATELIMITED]   = "ratelimited"
+  };
+  static const struct { const char *label; double percentile; } quantiles[] = {
+    { "0.5", 50.0 }, { "0.9", 90.0 }, { "0.99", 99.0 }, { "0.999", 99.9 }
+  };
+
+  size_t len=0;
+#define DUMP(...) \
+  len += snprintf(buf + ((len < bufsize) ? len : bufsize), \
+                  (len < bufsize) ? bufsize - len : 0, __VA_ARGS__)
+
+  if (bufsize) *buf = '\0';
+  struct _ua_metrics *metrics = metrics_get(ua, false);
+  if (!metrics) return 0; /* EARLY RETURN */
+
+  pthread_mutex_lock(&metrics->lock);
+  for (int i=0; i < UA_METRIC_AMT; ++i) {
+    DUMP("# HELP ua_%s_seconds Time spent on %s per request\n", names[i], names[i]);
+    DUMP("# TYPE ua_%s_seconds summary\n", names[i]);
+
+    for (struct _ua_route_metrics *route = metrics->routes; route; route = route->next) {
+      struct _ua_histogram *hist = &route->hists[i];
+      if (!hist->count) continue;
+
+      char label[512]; // route escaped as a label value
+      size_t j=0;
+      for (const char *c = route->route; *c && j < sizeof(label) - 2; ++c) {
+        if ('\\' == *c || '"' == *c) label[j++] = '\\';
+        label[j++] = ('\n' == *c) ? ' ' : *c;
+      }
+      label[j] = '\0';
+
+      for (size_t k=0; k < sizeof(quantiles)/sizeof(*quantiles); ++k) {
+        DUMP("ua_%s_seconds{route=\"%s\",quantile=\"%s\"} %.6f\n", 
+            names[i], label, quantiles[k].label, 
+            hist_percentile(hist, quantiles[k].percentile) / 1e6);
+      }
+      DUMP("ua_%s_seconds_sum{route=\"%s\"} %.6f\n", names[i], label, hist->sum / 1e6);
+      DUMP("ua_%s_seconds_count{route=\"%s\"} %"PRIu64"\n", names[i], label, hist->count);
+    }
+  }
+  pthread_mutex_unlock(&metrics->lock);
+#undef DUMP
+
+  return len;
+}
+
+/* the log state shared by the ua and its clones, created if is_created
+ *  is set, otherwise NULL if there's none */
+static struct _ua_log*
+log_get(struct user_agent *ua, bool is_created)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  if (!ua->shared->log && is_created) {
+    ua->shared->log = calloc(1, sizeof *ua->shared->log);
+    if (pthread_mutex_init(&ua->shared->log->lock, NULL))
+      ERR("Couldn't initialize mutex");
+  }
+  struct _ua_log *log = ua->shared->log;
+  pthread_mutex_unlock(&ua->shared->lock);
+  return log;
+}
+
+void
+ua_set_log_sampling(struct user_agent *ua, unsigned sampling)
+{
+  struct _ua_log *log = log_get(ua, true);
+  pthread_mutex_lock(&log->lock);
+  log->sampling = sampling;
+  pthread_mutex_unlock(&log->lock);
+}
+
+void
+ua_set_log_ring(struct user_agent *ua, size_t amt)
+{
+  struct _ua_log *log = log_get(ua, true);
+  pthread_mutex_lock(&log->lock);
+  if (log->ring) 
+    free(log->ring);
+  log->ring = amt ? calloc(amt, sizeof *log->ring) : NULL;
+  log->ring_size = amt;
+  pthread_mutex_unlock(&log->lock);
+}
+
+void
+ua_log_ring_dump(struct user_agent *ua, FILE *f)
+{
+  struct _ua_log *log = log_get(ua, false);
+  if (!log) return; /* EARLY RETURN */
+
+  pthread_mutex_lock(&log->lock);
+  size_t amt = log->amt_requests < log->ring_size 
+                 ? log->amt_requests 
+                 : log->ring_size;
+  fprintf(f, "[%s] last %zu requests:\n", ua->conf.id, amt);
+  for (size_t i = log->amt_requests - amt; i < log->amt_requests; ++i) {
+    struct _ua_log_entry *entry = &log->ring[i % log->ring_size];
+    if (!entry->tstamp) continue; // request didn't complete
+    fprintf(f, "#%zu %"PRIu64" %s %s -> %d (%"PRIu64" us) %zu bytes: %s%s\n",
+        entry->counter, entry->tstamp, 
+        http_method_print(entry->http_method), entry->url, 
+        entry->httpcode, entry->total_us, 
+        entry->body_len, entry->body, 
+        (entry->body_len >= sizeof(entry->body)) ? "..." : "");
+  }
+  pthread_mutex_unlock(&log->lock);
+  fflush(f);
+}
+
+static void
+log_cleanup(struct _ua_log *log)
+{
+  if (log->ring) 
+    free(log->ring);
+  pthread_mutex_destroy(&log->lock);
+  free(log);
+}
+
+/* number the request, and decide whether it should be written to the 
+ *  HTTP log (only if it's active and the request is sampled) */
+static void
+log_prepare(struct user_agent *ua, struct _ua_conn *conn)
+{
+  struct _ua_log *log = log_get(ua, false);
+  if (!log) {
+    conn->is_logged = HTTP_LOG_ACTIVE(&ua->conf);
+    return; /* EARLY RETURN */
+  }
+
+  pthread_mutex_lock(&log->lock);
+  size_t counter = log->amt_requests++;
+  conn->is_logged = HTTP_LOG_ACTIVE(&ua->conf)
+                    && (log->sampling <= 1 || 0 == counter % log->sampling);
+  if (log->ring) {
+    struct _ua_log_entry *entry = &log->ring[counter % log->ring_size];
+    memset(entry, 0, sizeof *entry);
+    entry->counter = counter;
+    entry->http_method = conn->http_method;
+    snprintf(entry->url, sizeof(entry->url), "%s", conn->info.req_url.start);
+  }
+  conn->log_counter = counter;
+  pthread_mutex_unlock(&log->lock);
+}
+
+/* fill the request's ring entry with its response */
+static void
+log_ring_record(struct user_agent *ua, struct _ua_conn *conn, int httpcode)
+{
+  struct _ua_log *log = log_get(ua, false);
+  if (!log) return; /* EARLY RETURN */
+
+  pthread_mutex_lock(&log->lock);
+  struct _ua_log_entry *entry = log->ring ? &log->ring[conn->log_counter % log->ring_size] : NULL;
+  if (entry && entry->counter == conn->log_counter) { // not overwritten by a newer request
+    entry->tstamp = conn->info.req_tstamp;
+    entry->httpcode = httpcode;
+    entry->total_us = conn->info.timings.total;
+    entry->body_len = conn->info.resp_body.length;
+    snprintf(entry->body, sizeof(entry->body), "%.*s", 
+        (int)conn->info.resp_body.length, conn->info.resp_body.buf);
+  }
+  pthread_mutex_unlock(&log->lock);
+}
+
+static struct _ua_tape*
+tape_init(void)
+{
+  struct _ua_tape *tape = calloc(1, sizeof *tape);
+  if (pthread_mutex_init(&tape->lock, NULL))
+    ERR("Couldn't initialize mutex");
+  return tape;
+}
+
+static void
+tape_cleanup(struct _ua_tape *tape)
+{
+  if (tape->f) 
+    fclose(tape->f);
+  if (tape->contents) 
+    free(tape->contents);
+  if (tape->entries) 
+    free(tape->entries);
+  pthread_mutex_destroy(&tape->lock);
+  free(tape);
+}
+
+/* swap the tape shared by the ua and its clones, the previous one is 
+ *  freed */
+static void
+tape_set(struct user_agent *ua, struct _ua_tape *tape)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_tape *prev = ua->shared->tape;
+  ua->shared->tape = tape;
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  if (prev) tape_cleanup(prev);
+}
+
+ORCAcode
+ua_set_record(struct user_agent *ua, const char path[])
+{
+  FILE *f=NULL;
+  if (path && !(f = fopen(path, "w"))) {
+    logconf_error(&ua->conf, "Couldn't open '%s' for recording", path);
+    return ORCA_BAD_PARAMETER;
+  }
+  struct _ua_tape *tape=NULL;
+  if (f) {
+    tape = tape_init();
+    tape->f = f;
+  }
+  tape_set(ua, tape);
+  return ORCA_OK;
+}
+
+ORCAcode
+ua_set_replay(struct user_agent *ua, const char path[], double speed)
+{
+  if (!path) {
+    tape_set(ua, NULL);
+    return ORCA_OK; /* EARLY RETURN */
+  }
+
+  size_t len=0;
+  char *contents = cee_load_whole_file(path, &len);
+  if (!contents) {
+    logconf_error(&ua->conf, "Couldn't load recording '%s'", path);
+    return ORCA_BAD_PARAMETER;
+  }
+
+  struct _ua_tape *tape = tape_init();
+  tape->contents = contents;
+  tape->speed = speed;
+
+  // each entry is a descriptive line followed by the raw header and body
+  char *ptr = contents, *end = contents + len;
+  while (ptr < end) {
+    char *eol = memchr(ptr, '\n', end - ptr);
+    if (!eol) break; /* EARLY BREAK */
+    *eol = '\0';
+
+    struct _ua_tape_entry entry={0};
+    char method[16]="";
+    if (6 != sscanf(ptr, "%15s %4095s %d %"SCNu64" %zu %zu", method, entry.url, 
+                &entry.httpcode, &entry.total_us, &entry.header.size, &entry.body.size)
+        || (size_t)(end - (eol + 1)) < entry.header.size + entry.body.size)
+    {
+      logconf_error(&ua->conf, "Malformed recording '%s' at offset %zu", path, (size_t)(ptr - contents));
+      tape_cleanup(tape);
+      return ORCA_BAD_PARAMETER;
+    }
+    entry.http_method = http_method_eval(method);
+    entry.header.start = eol + 1;
+    entry.body.start = entry.header.start + entry.header.size;
+
+    void *tmp = realloc(tape->entries, (1 + tape->amt) * sizeof *tape->entries);
+    ASSERT_S(NULL != tmp, "Couldn't increase replay entries");
+    tape->entries = tmp;
+    tape->entries[tape->amt++] = entry;
+
+    ptr = entry.body.start + entry.body.size + 1; // skip trailing '\n'
+  }
+
+  tape_set(ua, tape);
+  logconf_info(&ua->conf, "Replaying %zu responses from '%s'", tape->amt, path);
+  return ORCA_OK;
+}
+
+/* append the completed request's response to the recording */
+static void
+tape_record(struct user_agent *ua, struct _ua_conn *conn, int httpcode)
+{
+  struct _ua_tape *tape = tape_get(ua);
+  if (!tape || !tape->f) return; /* EARLY RETURN */
+
+  struct ua_resp_header *header = &conn->info.resp_header;
+  struct ua_resp_body *body = &conn->info.resp_body;
+
+  pthread_mutex_lock(&tape->lock);
+  fprintf(tape->f, "%s %s %d %"PRIu64" %zu %zu\n", 
+      http_method_print(conn->http_method), conn->info.req_url.start, 
+      httpcode, conn->info.timings.total, header->length, body->length);
+  fwrite(header->buf, 1, header->length, tape->f);
+  fwrite(body->buf, 1, body->length, tape->f);
+  fputc('\n', tape->f);
+  fflush(tape->f);
+  pthread_mutex_unlock(&tape->lock);
+}
+
+/* feed a recorded response to the conn instead of performing the 
+ *  transfer, matching the request's method and URL 
+ * @note identical requests are served their matching responses in turn */
+static void
+tape_replay(struct user_agent *ua, struct _ua_conn *conn, bool is_delayed)
+{
+  struct _ua_tape *tape = tape_get(ua);
+  struct _ua_tape_entry *entry=NULL;
+
+  pthread_mutex_lock(&tape->lock);
+  for (size_t i=0; i < tape->amt; ++i) {
+    if (tape->entries[i].http_method == conn->http_method
+        && 0 == strcmp(tape->entries[i].url, conn->info.req_url.start)
+        && (!entry || tape->entries[i].amt_served < entry->amt_served))
+    {
+      entry = &tape->entries[i];
+    }
+  }
+  if (entry) ++entry->amt_served;
+  pthread_mutex_unlock(&tape->lock);
+
+  if (!entry) {
+    logconf_error(conn->conf, "No recorded response for %s %s", 
+        http_method_print(conn->http_method), conn->info.req_url.start);
+    return; /* EARLY RETURN */
+  }
+  conn->replayed = entry;
+
+  if (is_delayed && tape->speed > 0) {
+    cee_sleep_ms((int64_t)(entry->total_us / (1000 * tape->speed)));
+  }
+
+  // header lines are parsed as they would've been received
+  char *line = entry->header.start, *end = entry->header.start + entry->header.size;
+  while (line < end) {
+    char *eol = memchr(line, '\n', end - line);
+    size_t len = eol ? (size_t)(eol + 1 - line) : (size_t)(end - line);
+    conn_respheader_cb(line, 1, len, &conn->info.resp_header);
+    line += len;
+  }
+  if (conn->stream.elem_cb)
+    conn_respbody_stream_cb(entry->body.start, 1, entry->body.size, conn);
+  else
+    conn_respbody_cb(entry->body.start, 1, entry->body.size, &conn->info.resp_body);
+}
+
+static void
+share_lock_cb(CURL *ehandle, curl_lock_data data, curl_lock_access access, void *p_share)
+{
+  struct ua_share *share = p_share;
+  pthread_mutex_lock(&share->lock[data]);
+}
+
+static void
+share_unlock_cb(CURL *ehandle, curl_lock_data data, void *p_share)
+{
+  struct ua_share *share = p_share;
+  pthread_mutex_unlock(&share->lock[data]);
+}
+
+struct ua_share*
+ua_share_init(void)
+{
+  struct ua_share *new_share = calloc(1, sizeof *new_share);
+  for (int i=0; i < CURL_LOCK_DATA_LAST; ++i) {
+    if (pthread_mutex_init(&new_share->lock[i], NULL))
+      ERR("Couldn't initialize mutex");
+  }
+
+  new_share->shandle = curl_share_init();
+  curl_share_setopt(new_share->shandle, CURLSHOPT_LOCKFUNC, &share_lock_cb);
+  curl_share_setopt(new_share->shandle, CURLSHOPT_UNLOCKFUNC, &share_unlock_cb);
+  curl_share_setopt(new_share->shandle, CURLSHOPT_USERDATA, new_share);
+
+  CURLSHcode shcode;
+  shcode = curl_share_setopt(new_share->shandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  VASSERT_S(CURLSHE_OK == shcode, "(CURLSH code: %d) %s", shcode, curl_share_strerror(shcode));
+  shcode = curl_share_setopt(new_share->shandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  VASSERT_S(CURLSHE_OK == shcode, "(CURLSH code: %d) %s", shcode, curl_share_strerror(shcode));
+  /* @note CURL_LOCK_DATA_CONNECT is left out on purpose, libcurl doesn't
+   *        support sharing connections between concurrent threads, which is
+   *        how the conn pool is used (connections are instead reused within 
+   *        each conn, or multiplexed by the async multi handle) */
+
+  return new_share;
+}
+
+void
+ua_share_cleanup(struct ua_share *share)
+{
+  curl_share_cleanup(share->shandle);
+  for (int i=0; i < CURL_LOCK_DATA_LAST; ++i)
+    pthread_mutex_destroy(&share->lock[i]);
+  free(share);
+}
+
+void
+ua_set_share(struct user_agent *ua, struct ua_share *share)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  ua->shared->share = share;
+  // join existing conns
+  for (size_t i=0; i < ua->conn->amt; ++i) {
+    struct _ua_conn *conn = ua->conn->pool[i];
+    VASSERT_S(!conn->is_busy, "[%s] Can't join share while performing requests", ua->conf.id);
+    CURLcode ecode = curl_easy_setopt(conn->ehandle, CURLOPT_SHARE, share ? share->shandle : NULL);
+    CURLE_CHECK(conn, ecode);
+  }
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+void
+ua_set_http2(struct user_agent *ua, bool enable)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  ua->shared->is_http2 = enable;
+  for (size_t i=0; i < ua->conn->amt; ++i) {
+    struct _ua_conn *conn = ua->conn->pool[i];
+    VASSERT_S(!conn->is_busy, "[%s] Can't switch HTTP version while performing requests", ua->conf.id);
+    conn_set_http2(conn, conn->ehandle, enable);
+  }
+  curl_multi_setopt(ua->async->mhandle, CURLMOPT_PIPELINING, 
+    enable ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
 struct user_agent*
 ua_init(struct logconf *conf) 
 {
   struct user_agent *new_ua = calloc(1, sizeof *new_ua);
   new_ua->conn = calloc(1, sizeof *new_ua->conn);
   new_ua->shared = calloc(1, sizeof *new_ua->shared);
+  new_ua->bufpool = calloc(1, sizeof *new_ua->bufpool);
+  new_ua->flights = calloc(1, sizeof *new_ua->flights);
+  new_ua->async = calloc(1, sizeof *new_ua->async);
+  new_ua->async->mhandle = curl_multi_init();
 
   // default header
   ua_reqheader_add(new_ua, "User-Agent", "orca (http://github.com/cee-studio/orca)");
@@ -471,6 +2333,11 @@ ua_init(struct logconf *conf)
     logconf_fatal(&new_ua->conf, "Couldn't initialize mutex");
     ABORT();
   }
+  if (pthread_cond_init(&new_ua->conn->cond, NULL)) {
+    logconf_fatal(&new_ua->conf, "Couldn't initialize pthread cond");
+    ABORT();
+  }
+  new_ua->conn->idle_ttl_ms = UA_DEFAULT_IDLE_TTL_MS;
 
   new_ua->is_original = true;
 
@@ -516,12 +2383,34 @@ ua_cleanup(struct user_agent *ua)
   if (ua->is_original) 
   {
     if (ua->conn->pool) {
-      for (size_t i=0; i < ua->conn->amt; ++i)
+      for (size_t i=0; i < ua->conn->amt; ++i) {
+        curl_multi_remove_handle(ua->async->mhandle, ua->conn->pool[i]->ehandle);
         conn_cleanup(ua->conn->pool[i]);
+      }
       free(ua->conn->pool);
     }
+    pthread_cond_destroy(&ua->conn->cond);
     free(ua->conn);
 
+    curl_multi_cleanup(ua->async->mhandle);
+    struct _ua_deferred *req, *next;
+    for (req = ua->async->deferred; req; req = next) {
+      next = req->next;
+      deferred_cleanup(req);
+    }
+    free(ua->async);
+
+    for (size_t i=0; i < ua->bufpool->amt; ++i)
+      free(ua->bufpool->bufs[i].start);
+    free(ua->bufpool);
+
+    free(ua->flights);
+
+    if (ua->shared->cache) cache_cleanup(ua->shared->cache);
+    if (ua->shared->metrics) metrics_cleanup(ua->shared->metrics);
+    if (ua->shared->log) log_cleanup(ua->shared->log);
+    if (ua->shared->tape) tape_cleanup(ua->shared->tape);
+
     pthread_mutex_destroy(&ua->shared->lock);
     free(ua->shared);
     logconf_cleanup(&ua->conf);
@@ -565,12 +2454,18 @@ set_method(
   case HTTP_POST:
       curl_easy_setopt(conn->ehandle, CURLOPT_POST, 1L);
       break;
-  case HTTP_MIMEPOST: //@todo this is temporary
+  case HTTP_MIMEPOST:
+      ASSERT_S(NULL == conn->mime, "'conn->mime' not freed");
+
+      if (req_body->size) { // per-request body, see UA_MULTIPART_BODY()
+        ASSERT_S(UA_MULTIPART_SIZE == req_body->size, "Expect a UA_MULTIPART_BODY()");
+        conn_set_multipart(ua, conn, (struct ua_multipart*)req_body->start);
+        return; /* EARLY RETURN */
+      }
       ASSERT_S(NULL != ua->mime_cb, "Missing 'ua->mime_cb' callback");
-      ASSERT_S(NULL == ua->mime, "'ua->mime' not freed");
 
-      ua->mime = (*ua->mime_cb)(conn->ehandle, ua->data2);
-      curl_easy_setopt(conn->ehandle, CURLOPT_MIMEPOST, ua->mime);
+      conn->mime = (*ua->mime_cb)(conn->ehandle, ua->data2);
+      curl_easy_setopt(conn->ehandle, CURLOPT_MIMEPOST, conn->mime);
       return; /* EARLY RETURN */
   case HTTP_PATCH:
       curl_easy_setopt(conn->ehandle, CURLOPT_CUSTOMREQUEST, "PATCH");
@@ -613,19 +2508,101 @@ set_url(struct user_agent *ua, struct _ua_conn *conn, char endpoint[], va_list a
   ret += vsnprintf(conn->info.req_url.start+ret, conn->info.req_url.size-ret, endpoint, args);
   ASSERT_S(ret < conn->info.req_url.size, "Out of bounds write attempt");
 
-  CURLcode ecode = curl_easy_setopt(conn->ehandle, CURLOPT_URL, conn->info.req_url.start);
-  CURLE_CHECK(conn, ecode);
+  CURLcode ecode = curl_easy_setopt(conn->ehandle, CURLOPT_URL, conn->info.req_url.start);
+  CURLE_CHECK(conn, ecode);
+
+  logconf_trace(conn->conf, "Request URL: %s", conn->info.req_url.start);
+}
+
+/* fetch the completed transfer's timings */
+static void
+get_timings(struct user_agent *ua, struct _ua_conn *conn)
+{
+  static const CURLINFO infos[] = {
+    CURLINFO_NAMELOOKUP_TIME_T,
+    CURLINFO_CONNECT_TIME_T,
+    CURLINFO_APPCONNECT_TIME_T,
+    CURLINFO_STARTTRANSFER_TIME_T,
+    CURLINFO_TOTAL_TIME_T
+  };
+  uint64_t *fields[] = {
+    &conn->info.timings.namelookup,
+    &conn->info.timings.connect,
+    &conn->info.timings.appconnect,
+    &conn->info.timings.starttransfer,
+    &conn->info.timings.total
+  };
+
+  for (size_t i=0; i < sizeof(infos)/sizeof(*infos); ++i) {
+    curl_off_t value_us=0;
+    curl_easy_getinfo(conn->ehandle, infos[i], &value_us);
+    *fields[i] = (uint64_t)value_us;
+  }
+}
+
+/* fetch the response code of a completed transfer and log it */
+static int
+get_httpcode(struct user_agent *ua, struct _ua_conn *conn)
+{
+  uint64_t tstamp = conn->info.req_tstamp;
+  conn->info.req_tstamp = cee_timestamp_ms();
+
+  int httpcode=0;
+  char *resp_url=NULL;
+  if (tape_is_replaying(ua)) {
+    if (conn->replayed) 
+      httpcode = conn->replayed->httpcode;
+    resp_url = conn->info.req_url.start;
+    conn->info.timings.total = 1000 * (conn->info.req_tstamp - tstamp);
+  }
+  else {
+    get_timings(ua, conn);
+
+    CURLcode ecode;
+    //get response's code
+    ecode = curl_easy_getinfo(conn->ehandle, CURLINFO_RESPONSE_CODE, &httpcode);
+    CURLE_CHECK(conn, ecode);
 
-  logconf_trace(conn->conf, "Request URL: %s", conn->info.req_url.start);
+    ecode = curl_easy_getinfo(conn->ehandle, CURLINFO_EFFECTIVE_URL, &resp_url);
+    CURLE_CHECK(conn, ecode);
+  }
+  metrics_record_timings(ua, conn);
+
+  if (conn->is_logged) {
+    logconf_http(
+      &ua->conf, 
+      &conn->info.loginfo,
+      resp_url, 
+      (struct sized_buffer){conn->info.resp_header.buf, conn->info.resp_header.length},
+      (struct sized_buffer){conn->info.resp_body.buf, conn->info.resp_body.length},
+      "HTTP_RCV_%s(%d)", http_code_print(httpcode), httpcode);
+  }
+  log_ring_record(ua, conn, httpcode);
+  tape_record(ua, conn, httpcode);
+
+  return httpcode;
 }
 
 static int
 send_request(struct user_agent *ua, struct _ua_conn *conn)
 {
-  pthread_mutex_lock(&ua->shared->lock);
-  
   // enforces global ratelimiting with ua_block_ms();
-  cee_sleep_ms(ua->shared->blockuntil_tstamp - cee_timestamp_ms());
+  pthread_mutex_lock(&ua->shared->lock);
+  uint64_t blockuntil_tstamp = ua->shared->blockuntil_tstamp;
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  int64_t blocked_ms = (int64_t)(blockuntil_tstamp - cee_timestamp_ms());
+  if (blocked_ms > 0) {
+    cee_sleep_ms(blocked_ms);
+    conn->info.timings.blocked = 1000 * (uint64_t)blocked_ms;
+  }
+
+  if (tape_is_replaying(ua)) {
+    conn->info.req_tstamp = cee_timestamp_ms(); // replay start
+    tape_replay(ua, conn, true);
+    return get_httpcode(ua, conn); /* EARLY RETURN */
+  }
+
   CURLcode ecode;
   
   ecode = curl_easy_perform(conn->ehandle);
@@ -638,135 +2615,132 @@ send_request(struct user_agent *ua, struct _ua_conn *conn)
 #else
   CURLE_CHECK(conn, ecode);
 #endif
-  conn->info.req_tstamp = cee_timestamp_ms();
-
-  //get response's code
-  int httpcode=0;
-  ecode = curl_easy_getinfo(conn->ehandle, CURLINFO_RESPONSE_CODE, &httpcode);
-  CURLE_CHECK(conn, ecode);
-
-  char *resp_url=NULL;
-  ecode = curl_easy_getinfo(conn->ehandle, CURLINFO_EFFECTIVE_URL, &resp_url);
-  CURLE_CHECK(conn, ecode);
-
-  logconf_http(
-    &ua->conf, 
-    &conn->info.loginfo,
-    resp_url, 
-    (struct sized_buffer){conn->info.resp_header.buf, conn->info.resp_header.length},
-    (struct sized_buffer){conn->info.resp_body.buf, conn->info.resp_body.length},
-    "HTTP_RCV_%s(%d)", http_code_print(httpcode), httpcode);
-
-  pthread_mutex_unlock(&ua->shared->lock);
 
-  return httpcode;
+  return get_httpcode(ua, conn);
 }
 
+/* triggers response related callbacks from info->httpcode, errors are
+ *  always logged but other responses only if is_logged is set
+ *  (see log_prepare()) */
 static ORCAcode
-perform_request(
-  struct user_agent *ua,
-  struct _ua_conn *conn, 
-  struct ua_resp_handle *resp_handle)
+eval_response(struct logconf *conf, struct ua_info *info, struct ua_resp_handle *resp_handle, bool is_logged)
 {
-  conn->info.httpcode = send_request(ua, conn);
-
-  /* triggers response related callbacks */
-  if (conn->info.httpcode >= 500 && conn->info.httpcode < 600) {
-    logconf_error(conn->conf, ANSICOLOR("SERVER ERROR", ANSI_FG_RED)" (%d)%s - %s [@@@_%zu_@@@]",
-        conn->info.httpcode,
-        http_code_print(conn->info.httpcode),
-        http_reason_print(conn->info.httpcode),
-        conn->info.loginfo.counter);
+  if (info->httpcode >= 500 && info->httpcode < 600) {
+    logconf_error(conf, ANSICOLOR("SERVER ERROR", ANSI_FG_RED)" (%d)%s - %s [@@@_%zu_@@@]",
+        info->httpcode,
+        http_code_print(info->httpcode),
+        http_reason_print(info->httpcode),
+        info->loginfo.counter);
 
     if (resp_handle) {
       if (resp_handle->err_cb) {
         (*resp_handle->err_cb)(
-          conn->info.resp_body.buf,
-          conn->info.resp_body.length,
+          info->resp_body.buf,
+          info->resp_body.length,
           resp_handle->err_obj);
       }
       else if (resp_handle->cxt_err_cb) {
         (*resp_handle->cxt_err_cb)(
           resp_handle->cxt,
-          conn->info.resp_body.buf,
-          conn->info.resp_body.length,
+          info->resp_body.buf,
+          info->resp_body.length,
           resp_handle->err_obj);
       }
     }
     return ORCA_HTTP_CODE;
   }
-  if (conn->info.httpcode >= 400) {
-    logconf_error(conn->conf, ANSICOLOR("CLIENT ERROR", ANSI_FG_RED)" (%d)%s - %s [@@@_%zu_@@@]",
-        conn->info.httpcode,
-        http_code_print(conn->info.httpcode),
-        http_reason_print(conn->info.httpcode),
-        conn->info.loginfo.counter);
+  if (info->httpcode >= 400) {
+    logconf_error(conf, ANSICOLOR("CLIENT ERROR", ANSI_FG_RED)" (%d)%s - %s [@@@_%zu_@@@]",
+        info->httpcode,
+        http_code_print(info->httpcode),
+        http_reason_print(info->httpcode),
+        info->loginfo.counter);
 
     if (resp_handle) {
       if(resp_handle->err_cb) {
         (*resp_handle->err_cb)(
-          conn->info.resp_body.buf,
-          conn->info.resp_body.length,
+          info->resp_body.buf,
+          info->resp_body.length,
           resp_handle->err_obj);
       }
       else if (resp_handle->cxt_err_cb) {
         (*resp_handle->cxt_err_cb)(
           resp_handle->cxt,
-          conn->info.resp_body.buf,
-          conn->info.resp_body.length,
+          info->resp_body.buf,
+          info->resp_body.length,
           resp_handle->err_obj);
       }
     }
     return ORCA_HTTP_CODE;
   }
-  if (conn->info.httpcode >= 300) {
-    logconf_warn(conn->conf, ANSICOLOR("REDIRECTING", ANSI_FG_YELLOW)" (%d)%s - %s [@@@_%zu_@@@]",
-        conn->info.httpcode,
-        http_code_print(conn->info.httpcode),
-        http_reason_print(conn->info.httpcode),
-        conn->info.loginfo.counter);
+  if (info->httpcode >= 300) {
+    if (is_logged) {
+      logconf_warn(conf, ANSICOLOR("REDIRECTING", ANSI_FG_YELLOW)" (%d)%s - %s [@@@_%zu_@@@]",
+          info->httpcode,
+          http_code_print(info->httpcode),
+          http_reason_print(info->httpcode),
+          info->loginfo.counter);
+    }
     return ORCA_HTTP_CODE;
   }
-  if (conn->info.httpcode >= 200) {
-    logconf_info(conn->conf, ANSICOLOR("SUCCESS", ANSI_FG_GREEN)" (%d)%s - %s [@@@_%zu_@@@]",
-        conn->info.httpcode,
-        http_code_print(conn->info.httpcode),
-        http_reason_print(conn->info.httpcode),
-        conn->info.loginfo.counter);
+  if (info->httpcode >= 200) {
+    if (is_logged) {
+      logconf_info(conf, ANSICOLOR("SUCCESS", ANSI_FG_GREEN)" (%d)%s - %s [@@@_%zu_@@@]",
+          info->httpcode,
+          http_code_print(info->httpcode),
+          http_reason_print(info->httpcode),
+          info->loginfo.counter);
+    }
 
     if (resp_handle) {
       if (resp_handle->ok_cb) {
         (*resp_handle->ok_cb)(
-          conn->info.resp_body.buf,
-          conn->info.resp_body.length,
+          info->resp_body.buf,
+          info->resp_body.length,
           resp_handle->ok_obj);
       }
       else if (resp_handle->cxt_ok_cb) {
         (*resp_handle->cxt_ok_cb)(
           resp_handle->cxt,
-          conn->info.resp_body.buf,
-          conn->info.resp_body.length,
+          info->resp_body.buf,
+          info->resp_body.length,
           resp_handle->ok_obj);
       }
     }
     return ORCA_OK;
   }
-  if (conn->info.httpcode >= 100) {
-    logconf_info(conn->conf, ANSICOLOR("INFO", ANSI_FG_GRAY)" (%d)%s - %s [@@@_%zu_@@@]",
-        conn->info.httpcode,
-        http_code_print(conn->info.httpcode),
-        http_reason_print(conn->info.httpcode),
-        conn->info.loginfo.counter);
-    return conn->info.httpcode;
+  if (info->httpcode >= 100) {
+    if (is_logged) {
+      logconf_info(conf, ANSICOLOR("INFO", ANSI_FG_GRAY)" (%d)%s - %s [@@@_%zu_@@@]",
+          info->httpcode,
+          http_code_print(info->httpcode),
+          http_reason_print(info->httpcode),
+          info->loginfo.counter);
+    }
+    return info->httpcode;
   }
-  if (!conn->info.httpcode) {
-    logconf_error(conn->conf, "No http response received by libcurl");
+  if (!info->httpcode) {
+    logconf_error(conf, "No http response received by libcurl");
     return ORCA_NO_RESPONSE;
   }
-  logconf_error(conn->conf, "Unusual HTTP response code: %d", conn->info.httpcode);
+  logconf_error(conf, "Unusual HTTP response code: %d", info->httpcode);
   return ORCA_UNUSUAL_HTTP_CODE;
 }
 
+static ORCAcode
+perform_request(
+  struct user_agent *ua,
+  struct _ua_conn *conn, 
+  struct ua_resp_handle *resp_handle)
+{
+  conn->info.httpcode = send_request(ua, conn);
+  cache_update(ua, conn);
+
+  struct ua_resp_handle tmp;
+  return eval_response(conn->conf, &conn->info, 
+           stream_resp_handle(conn, resp_handle, &tmp), conn->is_logged);
+}
+
 // make the main thread wait for a specified amount of time
 void
 ua_block_ms(struct user_agent *ua, const uint64_t wait_ms) 
@@ -776,58 +2750,253 @@ ua_block_ms(struct user_agent *ua, const uint64_t wait_ms)
   pthread_mutex_unlock(&ua->shared->lock);
 }
 
-/* template function for performing requests */
-ORCAcode
-ua_vrun(
-  struct user_agent *ua,
-  struct ua_info *info,
+/* deep copy a ua_info */
+static void
+info_dup(struct ua_info *dest, struct ua_info *src)
+{
+  memcpy(dest, src, sizeof(struct ua_info));
+  if (src->req_url.start) {
+    dest->req_url.start = malloc(src->req_url.size);
+    memcpy(dest->req_url.start, src->req_url.start, src->req_url.size);
+  }
+  if (src->resp_body.buf) {
+    dest->resp_body.bufsize = src->resp_body.length + 1;
+    dest->resp_body.buf = malloc(dest->resp_body.bufsize);
+    memcpy(dest->resp_body.buf, src->resp_body.buf, dest->resp_body.bufsize);
+  }
+  if (src->resp_header.buf) {
+    dest->resp_header.bufsize = src->resp_header.length + 1;
+    dest->resp_header.buf = malloc(dest->resp_header.bufsize);
+    memcpy(dest->resp_header.buf, src->resp_header.buf, dest->resp_header.bufsize);
+  }
+  if (src->resp_header.pairs) {
+    dest->resp_header.capacity = src->resp_header.size;
+    dest->resp_header.pairs = malloc(src->resp_header.size * sizeof *src->resp_header.pairs);
+    memcpy(dest->resp_header.pairs, src->resp_header.pairs, src->resp_header.size * sizeof *src->resp_header.pairs);
+  }
+}
+
+struct ua_flight*
+ua_flight_begin(
+  struct user_agent *ua, 
+  const char key[], 
   struct ua_resp_handle *resp_handle,
+  struct ua_info *info,
+  ORCAcode *p_code)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+
+  struct ua_flight *flight = ua->flights->list;
+  while (flight && strcmp(flight->key, key))
+    flight = flight->next;
+
+  if (!flight) { // caller becomes the leader
+    flight = calloc(1, sizeof *flight);
+    flight->key = strdup(key);
+    if (pthread_cond_init(&flight->cond, NULL))
+      ERR("Couldn't initialize pthread cond");
+    flight->next = ua->flights->list;
+    ua->flights->list = flight;
+
+    pthread_mutex_unlock(&ua->shared->lock);
+    return flight;
+  }
+
+  // wait for the leader's request to be done
+  ++flight->amt_followers;
+  ++ua->flights->amt_coalesced;
+  logconf_trace(&ua->conf, "Coalesced with identical request in flight: %s", key);
+  while (!flight->is_done)
+    pthread_cond_wait(&flight->cond, &ua->shared->lock);
+
+  struct ua_info tmp_info;
+  if (!info) info = &tmp_info;
+  info_dup(info, &flight->info);
+  *p_code = flight->code;
+
+  if (0 == --flight->amt_followers) { // last one out
+    pthread_cond_destroy(&flight->cond);
+    ua_info_cleanup(&flight->info);
+    free(flight->key);
+    free(flight);
+  }
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  // each follower decodes the response with its own callbacks
+  eval_response(&ua->conf, info, resp_handle, false); // logged by the leader
+
+  if (info == &tmp_info) ua_info_cleanup(&tmp_info);
+
+  return NULL;
+}
+
+void
+ua_flight_end(struct user_agent *ua, struct ua_flight *flight, struct ua_info *info, ORCAcode code)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+
+  // no longer joinable
+  struct ua_flight **p_flight = &ua->flights->list;
+  while (*p_flight != flight)
+    p_flight = &(*p_flight)->next;
+  *p_flight = flight->next;
+
+  if (!flight->amt_followers) {
+    pthread_cond_destroy(&flight->cond);
+    free(flight->key);
+    free(flight);
+  }
+  else {
+    info_dup(&flight->info, info);
+    flight->code = code;
+    flight->is_done = true;
+    pthread_cond_broadcast(&flight->cond);
+  }
+
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+void
+ua_set_coalescing(struct user_agent *ua, bool enable) {
+  pthread_mutex_lock(&ua->shared->lock);
+  ua->shared->is_coalescing = enable;
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+size_t
+ua_get_coalesced_count(struct user_agent *ua)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  size_t amt = ua->flights->amt_coalesced;
+  pthread_mutex_unlock(&ua->shared->lock);
+  return amt;
+}
+
+/* set the conn's url and method, and log the request about to be sent */
+static void
+prepare_request(
+  struct user_agent *ua,
+  struct _ua_conn *conn,
   struct sized_buffer *req_body,
+  struct ua_reqheader_field overlay[],
   enum http_method http_method, char endpoint[], va_list args)
 {
   const char *method_str = http_method_print(http_method);
-  static struct sized_buffer blank_req_body = {"", 0};
-  if (NULL == req_body) {
-    req_body = &blank_req_body;
-  }
 
-  struct _ua_conn *conn = get_conn(ua);
   set_url(ua, conn, endpoint, args); //set the request url
+  set_method(ua, conn, http_method, req_body); //set the request method
+
+  // a streamed body can't be stored for later revalidation
+  struct _ua_cache *cache;
+  if (HTTP_GET == http_method && !conn->stream.elem_cb && (cache = cache_get(ua))) {
+    cache_prepare(ua, conn, cache);
+  }
+  if (overlay) {
+    for (size_t i=0; overlay[i].field; ++i)
+      conn_reqheader_set(ua, conn, overlay[i].field, overlay[i].value);
+  }
+
+  if (conn->req_header) { // request specific header
+    CURLcode ecode = curl_easy_setopt(conn->ehandle, CURLOPT_HTTPHEADER, conn->req_header);
+    CURLE_CHECK(conn, ecode);
+  }
+
+  conn->http_method = http_method;
+  log_prepare(ua, conn);
+  if (!conn->is_logged) return; /* EARLY RETURN (nothing to format) */
 
   char buf[1024]="";
-  ua_reqheader_str(ua, buf, sizeof(buf));
+  size_t ret=0;
+  struct curl_slist *node = conn->req_header ? conn->req_header : ua->req_header;
+  for (; node; node = node->next) {
+    ret += snprintf(buf+ret, sizeof(buf)-ret, "%s\r\n", node->data);
+    VASSERT_S(ret < sizeof(buf), "[%s] Out of bounds write attempt", ua->conf.id);
+  }
 
   logconf_http(
     &ua->conf, 
     &conn->info.loginfo,
     conn->info.req_url.start, 
-    (struct sized_buffer){buf, sizeof(buf)},
-    *req_body,
+    (struct sized_buffer){buf, ret},
+    HTTP_MIMEPOST == http_method ? (struct sized_buffer){"", 0} : *req_body,
     "HTTP_SEND_%s", method_str);
 
   logconf_trace(conn->conf, ANSICOLOR("SEND", ANSI_FG_GREEN)" %s [@@@_%zu_@@@]", 
       method_str, conn->info.loginfo.counter);
+}
 
-  set_method(ua, conn, http_method, req_body); //set the request method
-  ORCAcode code = perform_request(ua, conn, resp_handle);
+/* template function for performing requests */
+ORCAcode
+ua_vrun(
+  struct user_agent *ua,
+  struct ua_info *info,
+  struct ua_resp_handle *resp_handle,
+  struct sized_buffer *req_body,
+  struct ua_reqheader_field overlay[],
+  enum http_method http_method, char endpoint[], va_list args)
+{
+  static struct sized_buffer blank_req_body = {"", 0};
+  if (NULL == req_body) {
+    req_body = &blank_req_body;
+  }
+  if (HTTP_MIMEPOST == http_method) {
+    ORCAcode code = multipart_validate(req_body);
+    if (ORCA_OK != code) return code; /* EARLY RETURN */
+  }
 
   pthread_mutex_lock(&ua->shared->lock);
-  if (info) {
-    memcpy(info, &conn->info, sizeof(struct ua_info));
-    asprintf(&info->resp_body.buf, "%.*s", \
-        (int)conn->info.resp_body.length, conn->info.resp_body.buf);
-    asprintf(&info->resp_header.buf, "%.*s", \
-        (int)conn->info.resp_header.length, conn->info.resp_header.buf);
-    asprintf(&info->req_url.start, "%.*s", \
-        (int)conn->info.req_url.size, conn->info.req_url.start);
+  bool is_coalescing = ua->shared->is_coalescing;
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  ORCAcode code;
+  struct ua_flight *flight=NULL;
+  // a streamed body can't be shared with identical requests
+  if (is_coalescing 
+      && HTTP_GET == http_method 
+      && !(resp_handle && resp_handle->elem_cb)) 
+  {
+    char key[4096];
+    size_t ret = snprintf(key, sizeof(key), "%.*s", (int)ua->base_url.size, ua->base_url.start);
+    va_list tmp;
+    va_copy(tmp, args);
+    ret += vsnprintf(key+ret, sizeof(key)-ret, endpoint, tmp);
+    va_end(tmp);
+    // requests differing on their header overlay get different responses
+    for (size_t i=0; overlay && overlay[i].field && ret < sizeof(key); ++i) {
+      ret += snprintf(key+ret, sizeof(key)-ret, "\n%s:%s", 
+                overlay[i].field, overlay[i].value ? overlay[i].value : "");
+    }
+    ASSERT_S(ret < sizeof(key), "Out of bounds write attempt");
+
+    flight = ua_flight_begin(ua, key, resp_handle, info, &code);
+    if (!flight) return code; /* EARLY RETURN (served by identical request) */
   }
 
-  conn_reset(conn); // reset for next iteration
-  if (ua->mime) { /// @todo this is temporary
-    curl_mime_free(ua->mime); 
-    ua->mime = NULL;
+  struct _ua_conn *conn = get_conn(ua, true);
+  if (metrics_get(ua, true)) {
+    metrics_route_key(conn->route, sizeof(conn->route), http_method, endpoint);
+  }
+  stream_setup(ua, conn, resp_handle);
+  prepare_request(ua, conn, req_body, overlay, http_method, endpoint, args);
+
+  code = perform_request(ua, conn, resp_handle);
+
+  if (flight) {
+    ua_flight_end(ua, flight, &conn->info, code);
+  }
+
+  if (info) { // hand over the conn's buffers instead of copying them
+    memcpy(info, &conn->info, sizeof(struct ua_info));
+    conn->info.resp_body.buf = NULL;
+    conn->info.resp_body.bufsize = 0;
+    conn->info.resp_header.buf = NULL;
+    conn->info.resp_header.bufsize = 0;
+    conn->info.resp_header.pairs = NULL;
+    conn->info.resp_header.capacity = 0;
+    conn->info.req_url = (struct sized_buffer){0};
   }
-  pthread_mutex_unlock(&ua->shared->lock);
+
+  release_conn(ua, conn); // reset for next iteration
 
   return code;
 }
@@ -849,12 +3018,280 @@ ua_run(
                     info,
                     resp_handle, 
                     req_body, 
+                    NULL,
+                    http_method, endpoint, args);
+
+  va_end(args);
+  return code;
+}
+
+/* prepare the conn for an asynchronous transfer and enqueue it */
+static void
+async_enqueue(
+  struct user_agent *ua,
+  struct _ua_conn *conn,
+  struct ua_resp_handle *resp_handle,
+  struct sized_buffer *req_body,
+  ua_async_cb *done_cb,
+  void *data,
+  enum http_method http_method, char endpoint[], va_list args)
+{
+  stream_setup(ua, conn, resp_handle);
+  prepare_request(ua, conn, req_body, NULL, http_method, endpoint, args);
+
+  // the payload must outlive the caller's req_body
+  if (HTTP_GET != http_method && HTTP_MIMEPOST != http_method) {
+    CURLcode ecode = curl_easy_setopt(conn->ehandle, CURLOPT_COPYPOSTFIELDS, req_body->start);
+    CURLE_CHECK(conn, ecode);
+  }
+  curl_easy_setopt(conn->ehandle, CURLOPT_PRIVATE, conn);
+
+  if (resp_handle) {
+    conn->async.resp_handle = *resp_handle;
+    conn->async.has_resp_handle = true;
+  }
+  conn->async.done_cb = done_cb;
+  conn->async.data = data;
+  conn->async.enqueue_tstamp = cee_timestamp_ms();
+
+  // enqueue, the transfer will start at the next ua_async_perform()
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_conn **p_last = &ua->async->pending;
+  while (*p_last) p_last = &(*p_last)->async.next;
+  *p_last = conn;
+  pthread_mutex_unlock(&ua->shared->lock);
+}
+
+static void
+async_enqueue_deferred(struct user_agent *ua, struct _ua_conn *conn, struct _ua_deferred *req, ...)
+{
+  va_list args;
+  va_start(args, req);
+  async_enqueue(
+    ua, 
+    conn,
+    req->has_resp_handle ? &req->resp_handle : NULL,
+    &req->req_body,
+    req->done_cb,
+    req->data,
+    req->http_method, "%s", args);
+  va_end(args);
+}
+
+ORCAcode
+ua_vrun_async(
+  struct user_agent *ua,
+  struct ua_resp_handle *resp_handle,
+  struct sized_buffer *req_body,
+  ua_async_cb *done_cb,
+  void *data,
+  enum http_method http_method, char endpoint[], va_list args)
+{
+  static struct sized_buffer blank_req_body = {"", 0};
+  if (NULL == req_body) {
+    req_body = &blank_req_body;
+  }
+  if (HTTP_MIMEPOST == http_method) {
+    ORCAcode code = multipart_validate(req_body);
+    if (ORCA_OK != code) return code; /* EARLY RETURN */
+  }
+
+  // never block, this may be called from the thread driving the transfers
+  struct _ua_conn *conn = get_conn(ua, false);
+  if (conn) {
+    if (metrics_get(ua, true)) {
+      metrics_route_key(conn->route, sizeof(conn->route), http_method, endpoint);
+    }
+    async_enqueue(ua, conn, resp_handle, req_body, done_cb, data, http_method, endpoint, args);
+    return ORCA_OK; /* EARLY RETURN */
+  }
+
+  // MIME data fetched from ua->mime_cb can't be deferred
+  if (HTTP_MIMEPOST == http_method && !req_body->size) {
+    logconf_error(&ua->conf, "Connection pool exhausted, can't defer a MIMEPOST without a UA_MULTIPART_BODY()");
+    return ORCA_NO_RESPONSE; /* EARLY RETURN */
+  }
+
+  // pool is exhausted, defer until ua_async_perform() can fetch a conn
+  struct _ua_deferred *req = calloc(1, sizeof *req);
+  req->http_method = http_method;
+  vasprintf(&req->endpoint, endpoint, args);
+  if (metrics_get(ua, true)) {
+    metrics_route_key(req->route, sizeof(req->route), http_method, endpoint);
+  }
+  if (HTTP_MIMEPOST == http_method) {
+    multipart_dup(&req->multipart, (struct ua_multipart*)req_body->start);
+    req->req_body = *UA_MULTIPART_BODY(&req->multipart);
+  }
+  else {
+    req->req_body.start = malloc(req_body->size + 1);
+    memcpy(req->req_body.start, req_body->start, req_body->size);
+    req->req_body.start[req_body->size] = '\0';
+    req->req_body.size = req_body->size;
+  }
+  if (resp_handle) {
+    req->resp_handle = *resp_handle;
+    req->has_resp_handle = true;
+  }
+  req->done_cb = done_cb;
+  req->data = data;
+
+  pthread_mutex_lock(&ua->shared->lock);
+  struct _ua_deferred **p_last = &ua->async->deferred;
+  while (*p_last) p_last = &(*p_last)->next;
+  *p_last = req;
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  return ORCA_OK;
+}
+
+ORCAcode
+ua_run_async(
+  struct user_agent *ua,
+  struct ua_resp_handle *resp_handle,
+  struct sized_buffer *req_body,
+  ua_async_cb *done_cb,
+  void *data,
+  enum http_method http_method, char endpoint[], ...)
+{
+  va_list args;
+  va_start(args, endpoint);
+
+  ORCAcode code = ua_vrun_async(
+                    ua,
+                    resp_handle,
+                    req_body,
+                    done_cb,
+                    data,
                     http_method, endpoint, args);
 
   va_end(args);
   return code;
 }
 
+/* evaluate a finished asynchronous transfer and give its conn back to the pool */
+static void
+async_complete(struct user_agent *ua, struct _ua_conn *conn, CURLcode ecode)
+{
+  ORCAcode code;
+  if (CURLE_OK != ecode) {
+    logconf_error(conn->conf, "(CURLE code: %d) %s", ecode,
+        IS_EMPTY_STRING(conn->errbuf) ? curl_easy_strerror(ecode) : conn->errbuf);
+    code = ORCA_NO_RESPONSE;
+  }
+  else {
+    conn->info.httpcode = get_httpcode(ua, conn);
+    cache_update(ua, conn);
+
+    struct ua_resp_handle tmp;
+    code = eval_response(conn->conf, &conn->info,
+             stream_resp_handle(conn, 
+               conn->async.has_resp_handle ? &conn->async.resp_handle : NULL, &tmp),
+             conn->is_logged);
+  }
+
+  if (conn->async.done_cb) {
+    (*conn->async.done_cb)(ua, &conn->info, code, conn->async.data);
+  }
+
+  release_conn(ua, conn);
+}
+
+int
+ua_async_perform(struct user_agent *ua, uint64_t wait_ms)
+{
+  CURLM *mhandle = ua->async->mhandle;
+
+  // deferred requests take conns as they get released
+  struct _ua_conn *conn;
+  while (1) {
+    pthread_mutex_lock(&ua->shared->lock);
+    bool has_deferred = (NULL != ua->async->deferred);
+    pthread_mutex_unlock(&ua->shared->lock);
+    if (!has_deferred || !(conn = get_conn(ua, false))) 
+      break; /* EARLY BREAK */
+
+    // only this thread removes from 'deferred', so it can't be emptied meanwhile
+    pthread_mutex_lock(&ua->shared->lock);
+    struct _ua_deferred *req = ua->async->deferred;
+    ua->async->deferred = req->next;
+    pthread_mutex_unlock(&ua->shared->lock);
+
+    memcpy(conn->route, req->route, sizeof(conn->route));
+    async_enqueue_deferred(ua, conn, req, req->endpoint);
+    deferred_cleanup(req);
+  }
+
+  // start pending transfers, unless blocked with ua_block_ms()
+  bool is_replaying = tape_is_replaying(ua); // takes the lock itself
+  pthread_mutex_lock(&ua->shared->lock);
+  int amt_pending=0;
+  for (struct _ua_deferred *req = ua->async->deferred; req; req = req->next)
+    ++amt_pending;
+  uint64_t tstamp = cee_timestamp_ms();
+  // an idle client releases no conns, so the pump evicts them too
+  struct _ua_conn *evicted = evict_conns(ua, tstamp);
+  struct _ua_conn *replaying=NULL, **p_replaying=&replaying;
+  if (tstamp >= ua->shared->blockuntil_tstamp) {
+    while ((conn = ua->async->pending)) {
+      ua->async->pending = conn->async.next;
+      conn->async.next = NULL;
+      conn->info.timings.blocked = 1000 * (tstamp - conn->async.enqueue_tstamp);
+      if (is_replaying) { // completed below (in order), without the network
+        *p_replaying = conn;
+        p_replaying = &conn->async.next;
+        continue;
+      }
+      curl_multi_add_handle(mhandle, conn->ehandle);
+    }
+  }
+  else {
+    for (conn = ua->async->pending; conn; conn = conn->async.next)
+      ++amt_pending;
+  }
+  pthread_mutex_unlock(&ua->shared->lock);
+
+  struct _ua_conn *next;
+  for (; evicted; evicted = next) {
+    next = evicted->next;
+    conn_cleanup(evicted);
+  }
+
+  for (conn = replaying; conn; conn = next) {
+    next = conn->async.next;
+    conn->async.next = NULL;
+    conn->info.req_tstamp = tstamp; // replay start
+    tape_replay(ua, conn, false);
+    async_complete(ua, conn, CURLE_OK);
+  }
+
+  CURLMcode mcode = curl_multi_perform(mhandle, &ua->async->running);
+  VASSERT_S(CURLM_OK == mcode, "[%s] (CURLM code: %d) %s",
+      ua->conf.id, mcode, curl_multi_strerror(mcode));
+
+  // check for finished transfers
+  CURLMsg *msg;
+  int msgq=0;
+  while ((msg = curl_multi_info_read(mhandle, &msgq))) {
+    if (CURLMSG_DONE != msg->msg) continue;
+
+    CURL *ehandle = msg->easy_handle;
+    CURLcode ecode = msg->data.result;
+    curl_easy_getinfo(ehandle, CURLINFO_PRIVATE, (char**)&conn);
+    curl_multi_remove_handle(mhandle, ehandle);
+
+    async_complete(ua, conn, ecode);
+  }
+
+  if (ua->async->running && wait_ms) {
+    mcode = curl_multi_wait(mhandle, NULL, 0, wait_ms, NULL);
+    VASSERT_S(CURLM_OK == mcode, "[%s] (CURLM code: %d) %s",
+        ua->conf.id, mcode, curl_multi_strerror(mcode));
+  }
+
+  return ua->async->running + amt_pending;
+}
+
 void
 ua_info_cleanup(struct ua_info *info) 
 {
@@ -864,6 +3301,21 @@ ua_info_cleanup(struct ua_info *info)
     free(info->resp_body.buf);
   if (info->resp_header.buf)
     free(info->resp_header.buf);
+  if (info->resp_header.pairs)
+    free(info->resp_header.pairs);
+  memset(info, 0, sizeof(struct ua_info));
+}
+
+void
+ua_info_recycle(struct user_agent *ua, struct ua_info *info)
+{
+  pthread_mutex_lock(&ua->shared->lock);
+  bufpool_put(ua, info->req_url.start, info->req_url.size);
+  bufpool_put(ua, info->resp_body.buf, info->resp_body.bufsize);
+  bufpool_put(ua, info->resp_header.buf, info->resp_header.bufsize);
+  bufpool_put(ua, (char*)info->resp_header.pairs, 
+    info->resp_header.capacity * sizeof(struct ua_resp_header_pair));
+  pthread_mutex_unlock(&ua->shared->lock);
   memset(info, 0, sizeof(struct ua_info));
 }
 
@@ -873,21 +3325,14 @@ ua_info_cleanup(struct ua_info *info)
 struct sized_buffer
 ua_info_respheader_field(struct ua_info *info, char field[])
 {
-  const size_t len = strlen(field);
-  struct sized_buffer h_field; // header field
-  for (int i=0; i < info->resp_header.size; ++i) {
-    h_field = (struct sized_buffer){
-      info->resp_header.buf + info->resp_header.pairs[i].field.idx,
-      info->resp_header.pairs[i].field.size
-    };
-    if (len == h_field.size && 0 == strncasecmp(field, h_field.start, len)) {
-      return (struct sized_buffer){
-        info->resp_header.buf + info->resp_header.pairs[i].value.idx,
-        info->resp_header.pairs[i].value.size
-      };
-    }
-  }
-  return (struct sized_buffer){NULL, 0};
+  struct ua_resp_header *header = &info->resp_header;
+  int i = respheader_find(header, field, strlen(field));
+  if (-1 == i) return (struct sized_buffer){NULL, 0};
+
+  return (struct sized_buffer){
+    header->buf + header->pairs[i].value.idx,
+    header->pairs[i].value.size
+  };
 }
 
 struct sized_buffer
@@ -13,12 +13,16 @@ extern "C" {
 #endif // __cplusplus
 
 #include <stdint.h> /* uint64_t */
+#include <stdbool.h>
+#include <sys/types.h> /* off_t */
 #include <curl/curl.h> 
 #include "ntl.h" /* struct sized_buffer */
 #include "types.h" /* ORCAcode */
 #include "logconf.h" /* logging facilities */
 
 struct user_agent; // forward declaration
+struct ua_share; // forward declaration
+struct ua_flight; // forward declaration
 
 //possible http methods
 enum http_method {
@@ -46,7 +50,69 @@ https://en.wikipedia.org/wiki/List_of_HTTP_status_codes */
 #define HTTP_TOO_MANY_REQUESTS    429
 #define HTTP_GATEWAY_UNAVAILABLE  502
 
-#define UA_MAX_HEADER_SIZE 100 + 1
+/* amount of slots of the response header hash index, headers past
+ *  3/4 of it are still stored but looked up linearly */
+#define UA_HEADER_INDEX_SIZE 128
+
+/**
+ * @brief A part of a multipart/form-data request body
+ *
+ * The part's content is streamed as the request is sent, either from
+ *        memory (which may be a mmap'd region) or from a file 
+ *        descriptor, it is never copied as a whole
+ * @note in-memory data isn't copied, and should outlive the transfer
+ * @see ua_multipart_add_data(), ua_multipart_add_fd(), ua_multipart_add_file()
+ */
+struct ua_multipart_part {
+  const char *name;     ///< the form field name
+  const char *filename; ///< the remote filename, NULL for none
+  const char *type;     ///< the content type, NULL for the default
+  const char *data;     ///< content in memory, NULL if read from 'fd'
+  int fd;               ///< file descriptor the content is read from with pread()
+  off_t offset;         ///< offset of the content in 'fd'
+  size_t size;          ///< content size
+  bool is_fd_owned;     ///< whether fd is closed by ua_multipart_cleanup()
+};
+
+/**
+ * @brief A multipart/form-data request body, built per request
+ *
+ * Given as the req_body of a HTTP_MIMEPOST request with 
+ *        UA_MULTIPART_BODY(), so that concurrent uploads don't share
+ *        any state
+ * @note the same body may be sent many times (ex: on retries)
+ * @note the parts are copied and their fds dup()'d once the request is
+ *        enqueued, so the body may be freed with ua_multipart_cleanup() as
+ *        soon as ua_run_async() returns, only in-memory data must outlive
+ *        the transfer
+ */
+struct ua_multipart {
+  struct ua_multipart_part *parts;
+  size_t amt; ///< amount of parts
+};
+
+/**
+ * @brief The req_body size that tags a UA_MULTIPART_BODY(), which no
+ *        actual payload can have
+ */
+#define UA_MULTIPART_SIZE ((size_t)-1)
+/**
+ * @brief Wrap a struct ua_multipart as the req_body of a HTTP_MIMEPOST
+ */
+#define UA_MULTIPART_BODY(p_multipart) \
+  (&(struct sized_buffer){ (char*)(p_multipart), UA_MULTIPART_SIZE })
+
+/**
+ * @brief A request header field for a single request
+ *
+ * An array of these (terminated by a NULL field) is merged over 
+ *        ua->req_header as the request is sent, without modifying it
+ * @see ua_vrun()
+ */
+struct ua_reqheader_field {
+  const char *field; ///< the field name, NULL to terminate the array
+  const char *value; ///< the field value, NULL to remove the field
+};
 
 //callback for object to be loaded by api response
 typedef void (load_obj_cb)(char *str, size_t len, void *p_obj);
@@ -63,6 +129,15 @@ struct ua_resp_handle {
 
   cxt_load_obj_cb *cxt_ok_cb; // ok call back with an execution context
   cxt_load_obj_cb *cxt_err_cb; // err call back with an execution context
+
+  /**
+   * if set, each element of a successful response's top-level JSON array
+   *        is given to elem_cb as soon as it has been received, instead
+   *        of buffering the whole body for ok_cb
+   * @note ok_cb is still triggered if the response isn't a JSON array
+   */
+  load_obj_cb *elem_cb;
+  void *elem_obj; // the pointer to be passed to elem_cb
 };
 
 struct ua_resp_header {
@@ -80,16 +155,36 @@ struct ua_resp_header {
    * index and size of individual field and values
    *        from 'buf'
    */
-  struct {
+  struct ua_resp_header_pair {
     struct {
       uintptr_t idx;
       size_t size;
     } field, value;
-  } pairs[UA_MAX_HEADER_SIZE];
+  } *pairs;
   /**
    * amount of field/value pairs
    */
   int size;
+  /**
+   * amount of pairs that fit in 'pairs'
+   */
+  int capacity;
+  /**
+   * case-insensitive hash index of fields, each slot stores a 
+   *        'pairs' position + 1 (0 for empty slots)
+   */
+  uint8_t index[UA_HEADER_INDEX_SIZE];
+  /**
+   * well-known fields, parsed as the response streams in
+   */
+  struct {
+    int    ratelimit_remaining;   ///< x-ratelimit-remaining, -1 if missing
+    double ratelimit_reset;       ///< x-ratelimit-reset (epoch in seconds), -1 if missing
+    double ratelimit_reset_after; ///< x-ratelimit-reset-after (in seconds), -1 if missing
+    double retry_after;           ///< retry-after (in seconds), -1 if missing
+    int    ratelimit_bucket;      ///< 'pairs' position of x-ratelimit-bucket, -1 if missing
+    int    etag;                  ///< 'pairs' position of etag, -1 if missing
+  } known;
 };
 
 struct ua_resp_body {
@@ -104,6 +199,54 @@ struct ua_resp_body {
   size_t bufsize;
 };
 
+/**
+ * @brief Time spent on each phase of a request, in microseconds
+ *
+ * Phases are cumulative since the start of the transfer (as reported
+ *        by libcurl), except for 'blocked'
+ * @see https://curl.se/libcurl/c/curl_easy_getinfo.html#TIMES
+ */
+struct ua_timings {
+  uint64_t namelookup;    ///< until the name resolving was completed
+  uint64_t connect;       ///< until the connect to the remote host was completed
+  uint64_t appconnect;    ///< until the TLS handshake was completed (0 for plain HTTP)
+  uint64_t starttransfer; ///< until the first byte was received
+  uint64_t total;         ///< until the transfer was completed
+  uint64_t blocked;       ///< waited before starting, on ua_block_ms() or the async queue
+};
+
+/**
+ * @brief The metrics aggregated into per-route histograms
+ *
+ * @see ua_set_metrics()
+ */
+enum ua_metric {
+  UA_METRIC_NAMELOOKUP = 0, ///< ua_timings.namelookup
+  UA_METRIC_CONNECT,        ///< ua_timings.connect
+  UA_METRIC_APPCONNECT,     ///< ua_timings.appconnect
+  UA_METRIC_STARTTRANSFER,  ///< ua_timings.starttransfer
+  UA_METRIC_TOTAL,          ///< ua_timings.total
+  UA_METRIC_BLOCKED,        ///< ua_timings.blocked
+  UA_METRIC_RATELIMITED,    ///< waited on the API's ratelimit, reported by the caller
+  UA_METRIC_AMT
+};
+
+/**
+ * @brief Summary of a metric's histogram, in microseconds
+ *
+ * @see ua_get_metrics()
+ */
+struct ua_metrics_stats {
+  uint64_t count; ///< amount of recorded values
+  uint64_t min;
+  uint64_t max;
+  double mean;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+};
+
 struct ua_info {
   struct loginfo loginfo;
   /**
@@ -126,8 +269,50 @@ struct ua_info {
    * the response body
    */
   struct ua_resp_body resp_body;
+  /**
+   * time spent on each phase of the request
+   */
+  struct ua_timings timings;
+};
+
+/**
+ * @brief Connection pool counters
+ *
+ * @see ua_get_pool_stats()
+ */
+struct ua_pool_stats {
+  size_t hits;      ///< requests that reused a idle conn
+  size_t misses;    ///< requests that had to create a new conn
+  size_t waits;     ///< times a request blocked on a exhausted pool
+  size_t evictions; ///< idle conns freed for being past the TTL or above the max
+  size_t amt;       ///< amount of conns currently alive
+  size_t amt_idle;  ///< amount of conns currently idle
+};
+
+/**
+ * @brief Response cache counters
+ *
+ * @see ua_get_cache_stats()
+ */
+struct ua_cache_stats {
+  size_t hits;      ///< 304 responses served with a cached body
+  size_t misses;    ///< responses stored (or refreshed) in the cache
+  size_t evictions; ///< entries evicted to fit the memory cap
+  size_t size;      ///< memory currently used by the cache
 };
 
+/**
+ * @brief Callback for when an asynchronous transfer has finished
+ *
+ * @param ua the user agent that performed the transfer
+ * @param info information on how the transfer went, only valid for the
+ *        duration of the callback
+ * @param code the ORCAcode that ua_run() would have returned
+ * @param data user arbitrary data given to ua_run_async()
+ * @see ua_run_async()
+ */
+typedef void (ua_async_cb)(struct user_agent *ua, struct ua_info *info, ORCAcode code, void *data);
+
 const char* http_code_print(int httpcode);
 const char* http_reason_print(int httpcode);
 const char* http_method_print(enum http_method method);
@@ -138,12 +323,116 @@ void ua_reqheader_del(struct user_agent *ua, const char field[]);
 char* ua_reqheader_str(struct user_agent *ua, char *buf, size_t bufsize);
 
 void ua_curl_easy_setopt(struct user_agent *ua, void *data, void (setopt_cb)(CURL *ehandle, void *data));
-void ua_curl_mime_setopt(struct user_agent *ua, void *data, curl_mime* (mime_cb)(CURL *ehandle, void *data)); // @todo this is temporary
+void ua_curl_mime_setopt(struct user_agent *ua, void *data, curl_mime* (mime_cb)(CURL *ehandle, void *data)); // @deprecated use UA_MULTIPART_BODY() instead
+
+/**
+ * @brief Add a part whose content is in memory
+ *
+ * @param multipart the multipart body
+ * @param name the form field name
+ * @param filename the remote filename, NULL for none
+ * @param type the content type, NULL for the default
+ * @param data the content, may be a mmap'd region
+ * @param size the content size
+ */
+void ua_multipart_add_data(struct ua_multipart *multipart, const char name[], const char filename[], const char type[], const char *data, size_t size);
+/**
+ * @brief Add a part whose content is read from a file descriptor
+ *
+ * @param multipart the multipart body
+ * @param name the form field name
+ * @param filename the remote filename, NULL for none
+ * @param type the content type, NULL for the default
+ * @param fd the file descriptor, read with pread() so that its file 
+ *        offset is left untouched
+ * @param offset offset of the content in fd
+ * @param size the content size
+ */
+void ua_multipart_add_fd(struct ua_multipart *multipart, const char name[], const char filename[], const char type[], int fd, off_t offset, size_t size);
+/**
+ * @brief Add a part whose content is the file at path
+ *
+ * @param multipart the multipart body
+ * @param name the form field name
+ * @param type the content type, NULL for the default
+ * @param path the file path, its basename is the remote filename
+ * @return ORCA_OK, or ORCA_BAD_PARAMETER if @a name or @a path is
+ *        missing, or the file can't be read
+ */
+ORCAcode ua_multipart_add_file(struct ua_multipart *multipart, const char name[], const char type[], const char path[]);
+/**
+ * @brief Free the parts of a multipart body and close its owned fds
+ *
+ * @param multipart the multipart body
+ */
+void ua_multipart_cleanup(struct ua_multipart *multipart);
 
 struct user_agent* ua_init(struct logconf *config);
 struct user_agent* ua_clone(struct user_agent *orig_ua);
 void ua_cleanup(struct user_agent *ua);
 
+/**
+ * @brief Create a cache that may be shared between user agents
+ *
+ * DNS lookups and TLS sessions are cached in the share, so that user
+ *        agents (and their connections) joining it won't need to redo
+ *        them for hosts already reached by another
+ * @return the share handle, free with ua_share_cleanup()
+ * @see ua_set_share()
+ */
+struct ua_share* ua_share_init(void);
+/**
+ * @brief Free a share created with ua_share_init()
+ *
+ * @param share the share handle
+ * @note every user agent that joined it should be cleaned up first
+ */
+void ua_share_cleanup(struct ua_share *share);
+/**
+ * @brief Join a share created with ua_share_init()
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param share the share handle, NULL to leave the current one
+ * @note the ua and all of its clones join it, whichever one this is
+ *        called on, should be called while no requests are being performed
+ */
+void ua_set_share(struct user_agent *ua, struct ua_share *share);
+/**
+ * @brief Opt-in to HTTP/2 for HTTPS transfers
+ *
+ * Asynchronous transfers to the same host will then be multiplexed over a
+ *        single connection, instead of each paying for its own handshake.
+ *        Requests performed with ua_run() still take a conn (and a 
+ *        connection) of their own, HTTP/2 is only negotiated for them
+ * @param ua the user agent handle created with ua_init()
+ * @param enable true to negotiate HTTP/2, false for the default behavior
+ * @note applies to the ua and all of its clones, whichever one this is
+ *        called on, should be called while no requests are being performed
+ * @see ua_run_async()
+ */
+void ua_set_http2(struct user_agent *ua, bool enable);
+
+/**
+ * @brief Set the connection pool limits
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param max max amount of conns alive at once, 0 for unlimited (default).
+ *        Once reached, ua_run() blocks until a conn is released and
+ *        ua_run_async() requests are queued
+ * @param idle_ttl_ms conns left idle for longer are freed, 0 to keep them
+ *        forever (default: 60000)
+ * @note eviction is checked whenever a conn is released, and on every
+ *        ua_async_perform()
+ */
+void ua_set_conn_limits(struct user_agent *ua, size_t max, uint64_t idle_ttl_ms);
+/**
+ * @brief Get the connection pool counters
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param stats receives the counters
+ */
+void ua_get_pool_stats(struct user_agent *ua, struct ua_pool_stats *stats);
+
 void ua_set_url(struct user_agent *ua, const char *base_url);
 const char* ua_get_url(struct user_agent *ua);
 void ua_block_ms(struct user_agent *ua, const uint64_t wait_ms);
@@ -152,6 +441,7 @@ ORCAcode ua_vrun(
   struct ua_info *info,
   struct ua_resp_handle *resp_handle,
   struct sized_buffer *req_body,
+  struct ua_reqheader_field overlay[], // optional header fields for this request only
   enum http_method http_method, char endpoint[], va_list args);
 ORCAcode ua_run(
   struct user_agent *ua,
@@ -160,7 +450,262 @@ ORCAcode ua_run(
   struct sized_buffer *req_body,
   enum http_method http_method, char endpoint[], ...);
 
+/**
+ * @brief Cache GET responses that carry a ETag or Last-Modified validator
+ *
+ * Further GETs to a cached URL are sent with If-None-Match and/or
+ *        If-Modified-Since, and if the server replies with 
+ *        HTTP_NOT_MODIFIED the cached body is served to the callbacks
+ *        as a HTTP_OK response
+ * @param ua the user agent handle created with ua_init()
+ * @param max_size memory cap in bytes, least recently used entries are
+ *        evicted past it. 0 disables the cache (default)
+ * @note the cache is shared by the ua and all of its clones, whichever
+ *        one this is called on
+ */
+void ua_set_cache(struct user_agent *ua, size_t max_size);
+/**
+ * @brief Get the response cache counters
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param stats receives the counters
+ */
+void ua_get_cache_stats(struct user_agent *ua, struct ua_cache_stats *stats);
+
+/**
+ * @brief Aggregate request timings into per-route histograms
+ *
+ * A route is the HTTP method followed by the endpoint format string
+ *        given to ua_run(), so that requests differing only on their
+ *        parameters share the same histograms
+ * @param ua the user agent handle created with ua_init()
+ * @param enable true to start recording, false to stop (recorded 
+ *        histograms are kept)
+ * @note the histograms are shared by the ua and all of its clones, whichever
+ *        one this is called on
+ */
+void ua_set_metrics(struct user_agent *ua, bool enable);
+/**
+ * @brief Record a value to a route's histogram
+ *
+ * For metrics measured outside of the user agent, such as 
+ *        UA_METRIC_RATELIMITED
+ * @param ua the user agent handle created with ua_init()
+ * @param http_method the route's HTTP method
+ * @param endpoint the route's endpoint format string
+ * @param metric the histogram to record to
+ * @param value_us the value in microseconds
+ */
+void ua_metrics_record(struct user_agent *ua, enum http_method http_method, char endpoint[], enum ua_metric metric, uint64_t value_us);
+/**
+ * @brief Get the summary of a route's histogram
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param http_method the route's HTTP method
+ * @param endpoint the route's endpoint format string
+ * @param metric the histogram to summarize
+ * @param stats receives the summary
+ * @return false if nothing has been recorded for the route
+ */
+bool ua_get_metrics(struct user_agent *ua, enum http_method http_method, char endpoint[], enum ua_metric metric, struct ua_metrics_stats *stats);
+/**
+ * @brief Dump every histogram in the Prometheus text exposition format
+ *
+ * Each metric is exposed as a summary labeled by route
+ * @param ua the user agent handle created with ua_init()
+ * @param buf the buffer to write to
+ * @param bufsize the buffer size
+ * @return the length of the whole dump (excluding the nul terminator),
+ *        if >= bufsize then the output was truncated
+ */
+size_t ua_metrics_dump(struct user_agent *ua, char buf[], size_t bufsize);
+
+/**
+ * @brief Only write 1 in every N requests to the HTTP log
+ *
+ * Requests that aren't sampled (or every request, if the HTTP log is 
+ *        disabled) are never formatted, and neither are their 
+ *        non-error response log lines
+ * @param ua the user agent handle created with ua_init()
+ * @param sampling the N, 0 or 1 to log every request (default)
+ * @note the setting is shared by the ua and all of its clones, whichever
+ *        one this is called on
+ */
+void ua_set_log_sampling(struct user_agent *ua, unsigned sampling);
+/**
+ * @brief Keep a summary of the last N requests for post-mortem
+ *
+ * Each entry keeps the request method and URL, the response code, 
+ *        duration and the beginning of its body, regardless of the
+ *        HTTP log being enabled or sampled
+ * @param ua the user agent handle created with ua_init()
+ * @param amt the N, 0 to disable (default)
+ * @see ua_log_ring_dump()
+ */
+void ua_set_log_ring(struct user_agent *ua, size_t amt);
+/**
+ * @brief Write the last N requests kept by ua_set_log_ring()
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param f the stream to write to (ex: stderr)
+ */
+void ua_log_ring_dump(struct user_agent *ua, FILE *f);
+
+/**
+ * @brief Record every response to a file, to be replayed later
+ *
+ * Each entry keeps the request method and URL, the response code,
+ *        header and body, and the transfer duration
+ * @param ua the user agent handle created with ua_init()
+ * @param path the file to record to (truncated), NULL to stop recording
+ * @return ORCA_OK, or ORCA_BAD_PARAMETER if the file can't be opened
+ * @note bodies streamed to ua_resp_handle.elem_cb are also buffered
+ *        while recording
+ * @note the recording is shared by the ua and all of its clones, and
+ *        should be set while none of them has a request in flight
+ * @see ua_set_replay()
+ */
+ORCAcode ua_set_record(struct user_agent *ua, const char path[]);
+/**
+ * @brief Replay the responses recorded with ua_set_record() instead of
+ *        reaching the network
+ *
+ * Requests are served the recorded response with the same method and
+ *        URL (identical requests are served their matching responses
+ *        in turn), headers included so that ratelimiting behaves as 
+ *        recorded
+ * @param ua the user agent handle created with ua_init()
+ * @param path the recording, NULL to stop replaying
+ * @param speed the replay speed factor over the recorded durations
+ *        (ex: 10 is ten times faster), 0 to replay without delays
+ * @return ORCA_OK, or ORCA_BAD_PARAMETER if the recording can't be read
+ * @note asynchronous requests are replayed without delays, on the next
+ *        ua_async_perform()
+ * @note the replay is shared by the ua and all of its clones, and
+ *        should be set while none of them has a request in flight
+ */
+ORCAcode ua_set_replay(struct user_agent *ua, const char path[], double speed);
+
+/**
+ * @brief Coalesce identical GET requests performed with ua_run()
+ *
+ * Concurrent GETs to the same URL (and with the same header overlay)
+ *        will share a single transfer, each receiving a copy of its
+ *        response
+ * @param ua the user agent handle created with ua_init()
+ * @param enable true to coalesce, false for the default behavior
+ * @note shared by the ua and all of its clones
+ * @see ua_flight_begin()
+ */
+void ua_set_coalescing(struct user_agent *ua, bool enable);
+/**
+ * @brief Join or start a request that identical ones may share
+ *
+ * If a request with the same @a key is in flight, wait for it to be
+ *        done and receive a copy of its result. Otherwise the caller
+ *        becomes its leader and must perform the request, then call
+ *        ua_flight_end()
+ * @param ua the user agent handle created with ua_init()
+ * @param key identifies the request, such as its method and URL
+ * @param resp_handle the callbacks triggered with the shared response
+ *        (only for followers)
+ * @param info optional, receives a copy of the shared ua_info (only
+ *        for followers)
+ * @param p_code receives the leader's ORCAcode (only for followers)
+ * @return NULL if the request has been served by an identical one,
+ *        otherwise a handle to be given to ua_flight_end()
+ */
+struct ua_flight* ua_flight_begin(
+  struct user_agent *ua,
+  const char key[],
+  struct ua_resp_handle *resp_handle,
+  struct ua_info *info,
+  ORCAcode *p_code);
+/**
+ * @brief Share the result of a request started with ua_flight_begin()
+ *        with the identical requests waiting on it
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @param flight the handle returned by ua_flight_begin()
+ * @param info the request's ua_info, copied for each follower
+ * @param code the request's ORCAcode
+ */
+void ua_flight_end(struct user_agent *ua, struct ua_flight *flight, struct ua_info *info, ORCAcode code);
+/**
+ * @brief Get the amount of requests that have been served by an
+ *        identical one in flight
+ *
+ * @param ua the user agent handle created with ua_init()
+ * @return the amount of transfers saved
+ */
+size_t ua_get_coalesced_count(struct user_agent *ua);
+
+/**
+ * @brief Enqueue a request to be performed asynchronously
+ *
+ * The request is started and driven by ua_async_perform(), many
+ *        requests may be in flight at once from a single thread.
+ * @param ua the user agent handle created with ua_init()
+ * @param resp_handle the response callbacks, copied but the objects
+ *        it points to must outlive the transfer
+ * @param req_body the request payload (copied), NULL if unecessary
+ * @param done_cb optional callback for when the transfer has finished
+ * @param data user arbitrary data passed to @a done_cb
+ * @param http_method the request method
+ * @param endpoint the printf-like format endpoint appended to base_url
+ * @return ORCA_OK if the request has been enqueued, ORCA_NO_RESPONSE if
+ *        the pool is exhausted and its MIME data comes from a
+ *        ua_curl_mime_setopt() callback
+ * @note never blocks, if the pool is exhausted the request (including a
+ *        UA_MULTIPART_BODY()) is copied and started once a conn is released
+ * @note thread-safe, but the completion callbacks are always
+ *        triggered from the thread calling ua_async_perform()
+ */
+ORCAcode ua_vrun_async(
+  struct user_agent *ua,
+  struct ua_resp_handle *resp_handle,
+  struct sized_buffer *req_body,
+  ua_async_cb *done_cb,
+  void *data,
+  enum http_method http_method, char endpoint[], va_list args);
+ORCAcode ua_run_async(
+  struct user_agent *ua,
+  struct ua_resp_handle *resp_handle,
+  struct sized_buffer *req_body,
+  ua_async_cb *done_cb,
+  void *data,
+  enum http_method http_method, char endpoint[], ...);
+/**
+ * @brief Reads/Write available data from asynchronous transfers
+ *
+ * Helper over curl_multi_perform(), starts requests enqueued with
+ *        ua_run_async() and triggers the callbacks of finished ones
+ * @param ua the user agent handle created with ua_init()
+ * @param wait_ms limit amount in milliseconds to wait for until activity,
+ *        0 to return immediately
+ * @return amount of transfers still pending or in flight
+ * @note should be called from a single thread, such as the event-loop
+ *        also calling ws_perform()
+ */
+int ua_async_perform(struct user_agent *ua, uint64_t wait_ms);
+
+/**
+ * @brief Free the buffers of a ua_info filled by ua_run()
+ *
+ * @param info the ua_info to be cleaned
+ */
 void ua_info_cleanup(struct ua_info *info);
+/**
+ * @brief Give the buffers of a ua_info filled by ua_run() back to
+ *        the user agent, so that they may be reused by later requests
+ *
+ * Prefer this over ua_info_cleanup() when the ua_info is reused between
+ *        requests, as ua_run() lends its internal buffers to the
+ *        ua_info instead of copying them
+ * @param ua the user agent handle that filled @a info
+ * @param info the ua_info to be recycled
+ */
+void ua_info_recycle(struct user_agent *ua, struct ua_info *info);
 struct sized_buffer ua_info_respheader_field(struct ua_info *info, char field[]);
 struct sized_buffer ua_info_get_resp_body(struct ua_info *info);
 
@@ -2,6 +2,16 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <poll.h>
+#include <fcntl.h>
+#endif
 
 #include "curl-websocket.h"
 
@@ -23,6 +33,118 @@
       mcode,                                               \
       curl_multi_strerror(mcode))
 
+#define WS_QUEUE_MAX_DEPTH 1024 ///< default limit of messages waiting to be sent
+#define WS_MAX_EVENTS 8          ///< socket events read per wait
+
+/**
+ * A socket ready for curl_multi_socket_action()
+ * @see _ws_reactor_wait()
+ */
+struct _ws_event {
+  curl_socket_t sockfd;
+  int action; ///< CURL_CSELECT_IN, CURL_CSELECT_OUT and CURL_CSELECT_ERR bitmask
+};
+
+/**
+ * A timer ran by ws_perform()
+ * @see ws_timer_add()
+ */
+struct _ws_timer {
+  struct websockets *ws;
+  unsigned id;
+  uint64_t deadline;  ///< timestamp in milliseconds
+  uint64_t repeat_ms; ///< 0 for a single shot
+  ws_timer_cb *cb;
+  void *data;
+  struct _ws_timer *next;
+};
+
+/**
+ * A message sent from a thread other than the event-loop's, waiting
+ *        to be sent by ws_perform()
+ */
+struct _ws_msg {
+  _Atomic(struct _ws_msg*) next;
+  bool is_text;
+  size_t len;
+  char *data; ///< stored right after the node
+};
+
+/**
+ * Lock-free multi-producer single-consumer queue, any thread may push
+ *        while only the event-loop thread pops
+ *
+ * Producers swap themselves in at @a head, the consumer walks from
+ *        @a tail. A @a stub node keeps the queue from ever being empty,
+ *        so producers never have to touch @a tail.
+ * @see http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+ */
+struct _ws_queue {
+  _Atomic(struct _ws_msg*) head;
+  struct _ws_msg *tail;
+  struct _ws_msg stub;
+
+  atomic_size_t depth;          ///< messages pushed and not yet popped
+  size_t max_depth;             ///< pushes past this depth are rejected
+  atomic_size_t high_watermark;
+  atomic_uint_fast64_t amt_queued;
+  atomic_uint_fast64_t amt_rejected;
+};
+
+/**
+ * Drives the transfers of one or many WebSockets handles from a single
+ *        thread: their sockets are watched with epoll (poll() outside
+ *        of Linux), and curl is
+ *        driven with curl_multi_socket_action() only for the sockets that
+ *        are ready, or when its timeout expires
+ * @see ws_reactor_perform()
+ */
+struct ws_reactor {
+  CURLM *mhandle;
+#ifdef __linux__
+  int epfd;
+  int wakefd;             ///< eventfd to interrupt epoll_wait() @see ws_wakeup()
+#else
+  int wakefds[2];         ///< self-pipe to interrupt poll() @see ws_wakeup()
+  /**
+   * Sockets watched by poll(), the first one being the self-pipe's read
+   *        end, only accessed from the event-loop thread
+   */
+  struct {
+    struct pollfd *fds;
+    size_t amt;
+  } poll;
+#endif
+  uint64_t curl_deadline; ///< when curl expects to be called back (0 for never)
+
+  /**
+   * Started handles whose transfer is in @a mhandle, only accessed
+   *        from the event-loop thread
+   */
+  struct websockets *handles;
+  /**
+   * Handles started with ws_start(), added to @a mhandle by the next
+   *        ws_reactor_perform() as curl can't be called from its own
+   *        callbacks, nor from concurrent threads
+   */
+  struct websockets *pending;
+
+  pthread_mutex_t lock; ///< guards @a pending, @a now and @a tid
+  uint64_t now;         ///< @see ws_timestamp()
+  pthread_t tid;        ///< the event-loop thread @see ws_same_thread()
+  atomic_int refcount;  ///< the ws_reactor_init() reference, plus one per attached handle
+
+  /**
+   * Timers sorted by deadline, only accessed from the event-loop thread
+   * @see ws_timer_add()
+   */
+  struct {
+    struct _ws_timer *list;
+    unsigned next_id;
+  } timers;
+
+  struct logconf conf;
+};
 
 struct websockets {
   /**
@@ -43,17 +165,22 @@ struct websockets {
   enum ws_status status;
 
   /**
-   * CURL multi_handle used in conjuction with easy_handle
-   *        to perform non-blocking requests to a WebSockets server.
+   * The reactor that performs the transfer of @a ehandle, a private
+   *        one unless the handle is attached to another with
+   *        ws_set_reactor()
    * @see ws_perform()
    */
-  CURLM *mhandle;
+  struct ws_reactor *reactor;
+  struct websockets *next; ///< next handle in the reactor's list
   CURL *ehandle;
 
   /**
-   * Timestamp updated every ws_perform() call
+   * The transfer state, as seen by the reactor
    */
-  uint64_t now_tstamp;
+  bool is_running; ///< @a ehandle is in the reactor's multi handle
+  bool is_closed;  ///< the closing handshake is over
+  bool is_done;    ///< curl reported the transfer as done, with @a result
+  CURLcode result;
 
   /**
    * WebSockets server URL and Protocols
@@ -82,12 +209,6 @@ struct websockets {
   struct logconf conf;
 
   pthread_mutex_t lock;
-  /*
-   * This is used to check whether the running thread
-   * is the same as the thread that ran ws_start.
-   * Some functions can only run in the same thread
-   */
-  pthread_t tid;
 
   /**
    * The user may close the active connection via ws_close()
@@ -103,6 +224,20 @@ struct websockets {
     enum ws_close_reason code;
     char reason[125 + 1];
   } pending_close;
+
+  /**
+   * Messages sent from other threads, flushed by ws_perform()
+   * @see ws_send_text() and ws_send_binary()
+   */
+  struct _ws_queue queue;
+
+  /**
+   * permessage-deflate settings, and counters of the previous
+   *        connections
+   * @see ws_set_deflate()
+   */
+  struct ws_deflate_config deflate;
+  struct ws_deflate_stats deflate_stats;
 };
  
 static void 
@@ -276,6 +411,12 @@ cws_on_connect_cb(void *p_ws, CURL *ehandle, const char *ws_protocols)
 
   logconf_trace(&ws->conf, ANSICOLOR("RCV", ANSI_FG_YELLOW)" CONNECT (WS-Protocols: '%s') [@@@_%zu_@@@]", ws_protocols, ws->info.loginfo.counter);
 
+  if (ws->deflate.enable) {
+    struct cws_deflate_stats stats;
+    logconf_info(&ws->conf, "permessage-deflate %s", 
+        cws_get_deflate_stats(ehandle, &stats) ? "negotiated" : "declined by the server");
+  }
+
   (*ws->cbs.on_connect)(ws->cbs.data, ws, &ws->info, ws_protocols);
 }
 
@@ -320,6 +461,16 @@ cws_on_text_cb(void *p_ws, CURL *ehandle, const char *text, size_t len)
   (*ws->cbs.on_text)(ws->cbs.data, ws, &ws->info, text, len);
 }
 
+static void
+cws_on_text_partial_cb(void *p_ws, CURL *ehandle, const char *chunk, size_t len, bool is_final)
+{
+  struct websockets *ws = p_ws;
+
+  logconf_trace(&ws->conf, ANSICOLOR("RCV", ANSI_FG_YELLOW)" TEXT CHUNK (%zu bytes%s) [@@@_%zu_@@@]", len, is_final ? ", final" : "", ws->info.loginfo.counter);
+
+  (*ws->cbs.on_text_partial)(ws->cbs.data, ws, &ws->info, chunk, len, is_final);
+}
+
 static void
 cws_on_binary_cb(void *p_ws, CURL *ehandle, const void *mem, size_t len)
 {
@@ -413,6 +564,8 @@ _ws_cws_new(struct websockets *ws, const char ws_protocols[])
   struct cws_callbacks cws_cbs = {
     .on_connect = &cws_on_connect_cb,
     .on_text = &cws_on_text_cb,
+    // text messages are only streamed if the user asked for it
+    .on_text_partial = ws->cbs.on_text_partial ? &cws_on_text_partial_cb : NULL,
     .on_binary = &cws_on_binary_cb,
     .on_ping = &cws_on_ping_cb,
     .on_pong = &cws_on_pong_cb,
@@ -437,6 +590,17 @@ _ws_cws_new(struct websockets *ws, const char ws_protocols[])
   ecode = curl_easy_setopt(new_ehandle, CURLOPT_NOPROGRESS, 0L);
   CURLE_CHECK(ws, ecode);
 
+  if (ws->deflate.enable) {
+    struct cws_deflate_config config = {
+      .client_no_context_takeover = ws->deflate.client_no_context_takeover,
+      .server_no_context_takeover = ws->deflate.server_no_context_takeover,
+      .client_max_window_bits = ws->deflate.client_max_window_bits,
+      .server_max_window_bits = ws->deflate.server_max_window_bits
+    };
+    if (!cws_set_deflate(new_ehandle, &config))
+      logconf_error(&ws->conf, "Couldn't offer permessage-deflate");
+  }
+
 #ifdef _ORCA_DEBUG_WEBSOCKETS
   ecode = curl_easy_setopt(new_ehandle, CURLOPT_DEBUGFUNCTION, _curl_debug_trace);
   CURLE_CHECK(ws, ecode);
@@ -505,12 +669,389 @@ noop_on_pong(void *a, struct websockets *b, struct ws_info *info, const char *c,
 static void 
 noop_on_close(void *a, struct websockets *b, struct ws_info *info, enum ws_close_reason c, const char *d, size_t e)
 {return;}
+static void 
+noop_on_disconnect(void *a, struct websockets *b, struct ws_info *info)
+{return;}
+
+#ifdef __linux__
+/* CURLMOPT_SOCKETFUNCTION: keep epoll's interest in sync with curl's */
+static int
+_ws_socket_cb(CURL *ehandle, curl_socket_t sockfd, int what, void *p_reactor, void *p_assigned)
+{
+  struct ws_reactor *reactor = p_reactor;
+
+  if (CURL_POLL_REMOVE == what) {
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, sockfd, NULL);
+    return 0; /* EARLY RETURN */
+  }
+
+  struct epoll_event ev = { .data.fd = sockfd };
+  if (what & CURL_POLL_IN)  ev.events |= EPOLLIN;
+  if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+
+  if (epoll_ctl(reactor->epfd, EPOLL_CTL_MOD, sockfd, &ev)) {
+    if (ENOENT != errno 
+        || epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, sockfd, &ev))
+    {
+      logconf_error(&reactor->conf, "Couldn't watch socket %d (errno: %d)", (int)sockfd, errno);
+      return -1; /* EARLY RETURN */
+    }
+  }
+  return 0;
+}
+
+static void
+_ws_reactor_poller_init(struct ws_reactor *reactor)
+{
+  reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (reactor->epfd < 0)
+    ERR("[%s] Couldn't create epoll instance", reactor->conf.id);
+  reactor->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (reactor->wakefd < 0)
+    ERR("[%s] Couldn't create eventfd", reactor->conf.id);
+  struct epoll_event ev = { .events = EPOLLIN, .data.fd = reactor->wakefd };
+  if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wakefd, &ev))
+    ERR("[%s] Couldn't watch eventfd", reactor->conf.id);
+}
+
+static void
+_ws_reactor_poller_cleanup(struct ws_reactor *reactor)
+{
+  close(reactor->wakefd);
+  close(reactor->epfd);
+}
+
+static void
+_ws_reactor_wakeup(struct ws_reactor *reactor)
+{
+  uint64_t one = 1;
+  if (write(reactor->wakefd, &one, sizeof(one)) < 0 && EAGAIN != errno)
+    logconf_error(&reactor->conf, "Couldn't wake up the event-loop (errno: %d)", errno);
+}
+
+/* wait up to 'timeout_ms' for socket activity, a wake up is consumed 
+ *  here and not reported
+ * @return the amount of sockets ready */
+static int
+_ws_reactor_wait(struct ws_reactor *reactor, struct _ws_event events[], int max_events, int timeout_ms)
+{
+  struct epoll_event epevents[WS_MAX_EVENTS];
+  if (max_events > WS_MAX_EVENTS) max_events = WS_MAX_EVENTS;
+
+  int amt_epevents = epoll_wait(reactor->epfd, epevents, max_events, timeout_ms);
+  if (amt_epevents < 0) {
+    if (EINTR != errno)
+      logconf_error(&reactor->conf, "epoll_wait() failed (errno: %d)", errno);
+    return 0; /* EARLY RETURN */
+  }
+
+  int amt_events = 0;
+  for (int i=0; i < amt_epevents; ++i) {
+    if (epevents[i].data.fd == reactor->wakefd) {
+      uint64_t count;
+      if (read(reactor->wakefd, &count, sizeof(count)) < 0 && EAGAIN != errno)
+        logconf_error(&reactor->conf, "Couldn't read eventfd (errno: %d)", errno);
+      continue;
+    }
+
+    struct _ws_event *event = &events[amt_events++];
+    event->sockfd = epevents[i].data.fd;
+    event->action = 0;
+    if (epevents[i].events & EPOLLIN)  event->action |= CURL_CSELECT_IN;
+    if (epevents[i].events & EPOLLOUT) event->action |= CURL_CSELECT_OUT;
+    if (epevents[i].events & (EPOLLERR|EPOLLHUP)) event->action |= CURL_CSELECT_ERR;
+  }
+  return amt_events;
+}
+#else
+/* CURLMOPT_SOCKETFUNCTION: keep poll()'s interest in sync with curl's */
+static int
+_ws_socket_cb(CURL *ehandle, curl_socket_t sockfd, int what, void *p_reactor, void *p_assigned)
+{
+  struct ws_reactor *reactor = p_reactor;
+
+  size_t i = 1; // skip the self-pipe
+  while (i < reactor->poll.amt && reactor->poll.fds[i].fd != sockfd)
+    ++i;
+
+  if (CURL_POLL_REMOVE == what) {
+    if (i < reactor->poll.amt) // swap with last
+      reactor->poll.fds[i] = reactor->poll.fds[--reactor->poll.amt];
+    return 0; /* EARLY RETURN */
+  }
+
+  if (i == reactor->poll.amt) {
+    void *tmp = realloc(reactor->poll.fds, (1 + reactor->poll.amt) * sizeof *reactor->poll.fds);
+    if (!tmp) {
+      logconf_error(&reactor->conf, "Couldn't watch socket %d", (int)sockfd);
+      return -1; /* EARLY RETURN */
+    }
+    reactor->poll.fds = tmp;
+    reactor->poll.fds[reactor->poll.amt++] = (struct pollfd){ .fd = sockfd };
+  }
+  reactor->poll.fds[i].events = 0;
+  if (what & CURL_POLL_IN)  reactor->poll.fds[i].events |= POLLIN;
+  if (what & CURL_POLL_OUT) reactor->poll.fds[i].events |= POLLOUT;
+  return 0;
+}
+
+static void
+_ws_reactor_poller_init(struct ws_reactor *reactor)
+{
+  if (pipe(reactor->wakefds))
+    ERR("[%s] Couldn't create self-pipe", reactor->conf.id);
+  for (int i=0; i < 2; ++i) {
+    fcntl(reactor->wakefds[i], F_SETFL, fcntl(reactor->wakefds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(reactor->wakefds[i], F_SETFD, FD_CLOEXEC);
+  }
+  reactor->poll.fds = malloc(sizeof *reactor->poll.fds);
+  reactor->poll.fds[0] = (struct pollfd){ .fd = reactor->wakefds[0], .events = POLLIN };
+  reactor->poll.amt = 1;
+}
+
+static void
+_ws_reactor_poller_cleanup(struct ws_reactor *reactor)
+{
+  close(reactor->wakefds[0]);
+  close(reactor->wakefds[1]);
+  free(reactor->poll.fds);
+}
+
+static void
+_ws_reactor_wakeup(struct ws_reactor *reactor)
+{
+  char one = 1; // a full pipe means a wake up is already pending
+  if (write(reactor->wakefds[1], &one, sizeof(one)) < 0 && EAGAIN != errno)
+    logconf_error(&reactor->conf, "Couldn't wake up the event-loop (errno: %d)", errno);
+}
+
+/* wait up to 'timeout_ms' for socket activity, a wake up is consumed 
+ *  here and not reported
+ * @return the amount of sockets ready */
+static int
+_ws_reactor_wait(struct ws_reactor *reactor, struct _ws_event events[], int max_events, int timeout_ms)
+{
+  int amt_ready = poll(reactor->poll.fds, (nfds_t)reactor->poll.amt, timeout_ms);
+  if (amt_ready < 0) {
+    if (EINTR != errno)
+      logconf_error(&reactor->conf, "poll() failed (errno: %d)", errno);
+    return 0; /* EARLY RETURN */
+  }
+
+  if (reactor->poll.fds[0].revents) {
+    char buf[64];
+    while (read(reactor->wakefds[0], buf, sizeof(buf)) > 0)
+      continue;
+  }
+
+  // the sockets left over are still ready (level-triggered) on the next wait
+  int amt_events = 0;
+  for (size_t i=1; i < reactor->poll.amt && amt_events < max_events; ++i) {
+    short revents = reactor->poll.fds[i].revents;
+    if (!revents) continue;
+
+    struct _ws_event *event = &events[amt_events++];
+    event->sockfd = reactor->poll.fds[i].fd;
+    event->action = 0;
+    if (revents & POLLIN)  event->action |= CURL_CSELECT_IN;
+    if (revents & POLLOUT) event->action |= CURL_CSELECT_OUT;
+    if (revents & (POLLERR|POLLHUP|POLLNVAL)) event->action |= CURL_CSELECT_ERR;
+  }
+  return amt_events;
+}
+#endif
+
+/* CURLMOPT_TIMERFUNCTION: curl wants to be called back in 'timeout_ms' */
+static int
+_ws_curl_timer_cb(CURLM *mhandle, long timeout_ms, void *p_reactor)
+{
+  struct ws_reactor *reactor = p_reactor;
+  reactor->curl_deadline = (timeout_ms < 0) ? 0 : cee_timestamp_ms() + timeout_ms;
+  return 0;
+}
+
+static void
+_ws_timer_insert(struct ws_reactor *reactor, struct _ws_timer *timer)
+{
+  struct _ws_timer **p = &reactor->timers.list;
+  while (*p && (*p)->deadline <= timer->deadline)
+    p = &(*p)->next;
+  timer->next = *p;
+  *p = timer;
+}
+
+unsigned
+ws_timer_add(struct websockets *ws, uint64_t timeout_ms, uint64_t repeat_ms, ws_timer_cb *cb, void *data)
+{
+  struct ws_reactor *reactor = ws->reactor;
+  struct _ws_timer *timer = malloc(sizeof *timer);
+  *timer = (struct _ws_timer){
+    .ws = ws,
+    .id = ++reactor->timers.next_id,
+    .deadline = cee_timestamp_ms() + timeout_ms,
+    .repeat_ms = repeat_ms,
+    .cb = cb,
+    .data = data
+  };
+  if (0 == timer->id) // wrapped around, 0 is never a valid id
+    timer->id = ++reactor->timers.next_id;
+  _ws_timer_insert(reactor, timer);
+  return timer->id;
+}
+
+bool
+ws_timer_cancel(struct websockets *ws, unsigned id)
+{
+  for (struct _ws_timer **p = &ws->reactor->timers.list; *p; p = &(*p)->next) {
+    if (id == (*p)->id) {
+      struct _ws_timer *timer = *p;
+      *p = timer->next;
+      free(timer);
+      return true; /* EARLY RETURN */
+    }
+  }
+  return false;
+}
+
+/* cancel the timers of a handle leaving its reactor */
+static void
+_ws_timer_cancel_all(struct websockets *ws)
+{
+  struct _ws_timer **p = &ws->reactor->timers.list;
+  while (*p) {
+    if (ws == (*p)->ws) {
+      struct _ws_timer *timer = *p;
+      *p = timer->next;
+      free(timer);
+    }
+    else {
+      p = &(*p)->next;
+    }
+  }
+}
+
+/* run the callbacks of expired timers */
+static void
+_ws_run_timers(struct ws_reactor *reactor, uint64_t now)
+{
+  struct _ws_timer *timer;
+  while ((timer = reactor->timers.list) && timer->deadline <= now) {
+    reactor->timers.list = timer->next;
+
+    struct websockets *ws = timer->ws;
+    ws_timer_cb *cb = timer->cb;
+    void *data = timer->data;
+    if (timer->repeat_ms) { // reinsert before the callback, so it may cancel itself
+      timer->deadline += timer->repeat_ms;
+      if (timer->deadline <= now) // don't try to catch up on missed runs
+        timer->deadline = now + timer->repeat_ms;
+      _ws_timer_insert(reactor, timer);
+    }
+    else {
+      free(timer);
+    }
+    (*cb)(ws, data);
+  }
+}
+
+void
+ws_wakeup(struct websockets *ws) {
+  _ws_reactor_wakeup(ws->reactor);
+}
+
+static void
+_ws_queue_init(struct _ws_queue *queue)
+{
+  atomic_init(&queue->stub.next, NULL);
+  atomic_init(&queue->head, &queue->stub);
+  queue->tail = &queue->stub;
+  queue->max_depth = WS_QUEUE_MAX_DEPTH;
+}
+
+static void // thread-safe
+_ws_queue_push(struct _ws_queue *queue, struct _ws_msg *msg)
+{
+  atomic_store_explicit(&msg->next, NULL, memory_order_relaxed);
+  struct _ws_msg *prev = atomic_exchange_explicit(&queue->head, msg, memory_order_acq_rel);
+  // until this store, the consumer sees the queue as ending at 'prev'
+  atomic_store_explicit(&prev->next, msg, memory_order_release);
+}
+
+/* only called from the event-loop thread, returns NULL if empty, or if
+ *  a producer is halfway through a push (it will be popped next time) */
+static struct _ws_msg*
+_ws_queue_pop(struct _ws_queue *queue)
+{
+  struct _ws_msg *tail = queue->tail;
+  struct _ws_msg *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+  if (tail == &queue->stub) {
+    if (NULL == next) return NULL; /* EARLY RETURN */
+    queue->tail = tail = next;
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  }
+  if (next) {
+    queue->tail = next;
+    return tail; /* EARLY RETURN */
+  }
+
+  if (tail != atomic_load_explicit(&queue->head, memory_order_acquire))
+    return NULL; /* EARLY RETURN */
+
+  // 'tail' is the last message, put back the stub behind it
+  _ws_queue_push(queue, &queue->stub);
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (next) {
+    queue->tail = next;
+    return tail; /* EARLY RETURN */
+  }
+  return NULL;
+}
+
+struct ws_reactor*
+ws_reactor_init(struct logconf *conf)
+{
+  struct ws_reactor *new_reactor = calloc(1, sizeof *new_reactor);
+  new_reactor->mhandle = curl_multi_init();
+  atomic_init(&new_reactor->refcount, 1);
+
+  logconf_branch(&new_reactor->conf, conf, "WEBSOCKETS");
+
+  if (pthread_mutex_init(&new_reactor->lock, NULL))
+    ERR("[%s] Couldn't initialize pthread mutex", new_reactor->conf.id);
+
+  _ws_reactor_poller_init(new_reactor);
+
+  curl_multi_setopt(new_reactor->mhandle, CURLMOPT_SOCKETFUNCTION, &_ws_socket_cb);
+  curl_multi_setopt(new_reactor->mhandle, CURLMOPT_SOCKETDATA, new_reactor);
+  curl_multi_setopt(new_reactor->mhandle, CURLMOPT_TIMERFUNCTION, &_ws_curl_timer_cb);
+  curl_multi_setopt(new_reactor->mhandle, CURLMOPT_TIMERDATA, new_reactor);
+
+  return new_reactor;
+}
+
+/* drop a reference, the reactor is freed with the last one */
+void
+ws_reactor_cleanup(struct ws_reactor *reactor)
+{
+  if (atomic_fetch_sub(&reactor->refcount, 1) > 1)
+    return; /* EARLY RETURN */
+
+  struct _ws_timer *timer, *next;
+  for (timer = reactor->timers.list; timer; timer = next) {
+    next = timer->next;
+    free(timer);
+  }
+  curl_multi_cleanup(reactor->mhandle);
+  pthread_mutex_destroy(&reactor->lock);
+  _ws_reactor_poller_cleanup(reactor);
+  free(reactor);
+}
 
 struct websockets*
 ws_init(struct ws_callbacks *cbs, struct logconf *conf)
 {
   struct websockets *new_ws = calloc(1, sizeof *new_ws);
-  new_ws->mhandle = curl_multi_init();
 
   logconf_branch(&new_ws->conf, conf, "WEBSOCKETS");
 
@@ -522,13 +1063,67 @@ ws_init(struct ws_callbacks *cbs, struct logconf *conf)
   if (!new_ws->cbs.on_ping) new_ws->cbs.on_ping = &noop_on_ping;
   if (!new_ws->cbs.on_pong) new_ws->cbs.on_pong = &noop_on_pong;
   if (!new_ws->cbs.on_close) new_ws->cbs.on_close = &noop_on_close;
+  if (!new_ws->cbs.on_disconnect) new_ws->cbs.on_disconnect = &noop_on_disconnect;
 
   if (pthread_mutex_init(&new_ws->lock, NULL))
     ERR("[%s] Couldn't initialize pthread mutex", new_ws->conf.id);
 
+  _ws_queue_init(&new_ws->queue);
+
+  // a private reactor, until attached to another with ws_set_reactor()
+  new_ws->reactor = ws_reactor_init(conf);
+
   return new_ws;
 }
 
+/* take a handle out of its reactor's lists, and its transfer out of
+ *  the multi handle */
+static void
+_ws_reactor_detach(struct ws_reactor *reactor, struct websockets *ws)
+{
+  struct websockets **p;
+
+  pthread_mutex_lock(&reactor->lock);
+  for (p = &reactor->pending; *p; p = &(*p)->next) {
+    if (ws == *p) {
+      *p = ws->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&reactor->lock);
+
+  for (p = &reactor->handles; *p; p = &(*p)->next) {
+    if (ws == *p) {
+      *p = ws->next;
+      break;
+    }
+  }
+  if (ws->is_running) {
+    curl_multi_remove_handle(reactor->mhandle, ws->ehandle);
+    ws->is_running = false;
+  }
+  ws->next = NULL;
+}
+
+void
+ws_set_reactor(struct websockets *ws, struct ws_reactor *reactor)
+{
+  VASSERT_S(false == ws_is_alive(ws), \
+      "[%s] Can't switch the reactor of an active connection (Current status: %s)", ws->conf.id, _ws_status_print(ws->status));
+
+  if (reactor == ws->reactor) return; /* EARLY RETURN */
+
+  _ws_timer_cancel_all(ws);
+  atomic_fetch_add(&reactor->refcount, 1);
+  ws_reactor_cleanup(ws->reactor);
+  ws->reactor = reactor;
+}
+
+struct ws_reactor*
+ws_get_reactor(struct websockets *ws) {
+  return ws->reactor;
+}
+
 void
 ws_set_url(struct websockets *ws, const char base_url[], const char ws_protocols[])
 {
@@ -553,17 +1148,23 @@ ws_set_url(struct websockets *ws, const char base_url[], const char ws_protocols
 void
 ws_cleanup(struct websockets *ws)
 {
-  curl_multi_cleanup(ws->mhandle);
+  _ws_reactor_detach(ws->reactor, ws);
+  _ws_timer_cancel_all(ws);
+
+  struct _ws_msg *msg;
+  while ((msg = _ws_queue_pop(&ws->queue)))
+    free(msg);
   if (ws->ehandle)
     cws_free(ws->ehandle);
   pthread_mutex_destroy(&ws->lock);
+  ws_reactor_cleanup(ws->reactor);
   free(ws);
 }
 
-bool
-ws_send_binary(struct websockets *ws, struct ws_info *info, const char msg[], size_t msglen)
+static bool
+_ws_send(struct websockets *ws, struct ws_info *info, bool is_text, const char msg[], size_t msglen)
 {
-  VASSERT_S(ws->tid == pthread_self(), "Can only be called from thread %u", ws->tid);
+  const char *type = is_text ? "TEXT" : "BINARY";
 
   logconf_http(
     &ws->conf, 
@@ -571,51 +1172,153 @@ ws_send_binary(struct websockets *ws, struct ws_info *info, const char msg[], si
     ws->base_url, 
     (struct sized_buffer){"", 0},
     (struct sized_buffer){(char*)msg, msglen},
-    "WS_SEND_BINARY");
+    is_text ? "WS_SEND_TEXT" : "WS_SEND_BINARY");
 
-  logconf_trace(&ws->conf, ANSICOLOR("SEND", ANSI_FG_GREEN)" BINARY (%zu bytes) [@@@_%zu_@@@]", msglen, ws->info.loginfo.counter);
+  logconf_trace(&ws->conf, ANSICOLOR("SEND", ANSI_FG_GREEN)" %s (%zu bytes) [@@@_%zu_@@@]", type, msglen, ws->info.loginfo.counter);
 
   if (WS_CONNECTED != ws->status) {
-    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at SEND BINARY : No active connection [@@@_%zu_@@@]", ws->info.loginfo.counter);
+    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at SEND %s : No active connection [@@@_%zu_@@@]", type, ws->info.loginfo.counter);
     return false;
   }
 
   if (info) *info = ws->info;
 
-  if (!cws_send(ws->ehandle, false, msg, msglen)) {
-    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at SEND BINARY [@@@_%zu_@@@]", ws->info.loginfo.counter);
+  if (!cws_send(ws->ehandle, is_text, msg, msglen)) {
+    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at SEND %s [@@@_%zu_@@@]", type, ws->info.loginfo.counter);
+    return false;
+  }
+  return true;
+}
+
+/* copy a message sent from another thread to the queue, it is sent
+ *  by the next ws_perform() */
+static bool // thread-safe
+_ws_enqueue(struct websockets *ws, bool is_text, const char msg[], size_t msglen)
+{
+  if (!ws_is_functional(ws)) {
+    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at QUEUE %s : No active connection", is_text ? "TEXT" : "BINARY");
+    return false;
+  }
+
+  struct _ws_queue *queue = &ws->queue;
+  size_t depth = atomic_fetch_add(&queue->depth, 1) + 1;
+  if (depth > queue->max_depth) {
+    atomic_fetch_sub(&queue->depth, 1);
+    atomic_fetch_add(&queue->amt_rejected, 1);
+    logconf_warn(&ws->conf, "Send queue is full (%zu messages), dropping %s (%zu bytes)", 
+        queue->max_depth, is_text ? "TEXT" : "BINARY", msglen);
     return false;
   }
+
+  size_t high = atomic_load(&queue->high_watermark);
+  while (depth > high && !atomic_compare_exchange_weak(&queue->high_watermark, &high, depth))
+    continue;
+
+  struct _ws_msg *node = malloc(sizeof *node + msglen);
+  ASSERT_S(NULL != node, "Out of memory");
+  node->is_text = is_text;
+  node->len = msglen;
+  node->data = (char*)(node + 1);
+  memcpy(node->data, msg, msglen);
+
+  _ws_queue_push(queue, node);
+  atomic_fetch_add(&queue->amt_queued, 1);
+
+  // interrupt ws_perform()'s wait, so the message isn't held for 'wait_ms'
+  ws_wakeup(ws);
   return true;
 }
 
+/* send the messages queued from other threads, in the order they
+ *  were queued */
+static void
+_ws_flush_queue(struct websockets *ws)
+{
+  struct _ws_msg *msg;
+  while ((msg = _ws_queue_pop(&ws->queue))) {
+    atomic_fetch_sub(&ws->queue.depth, 1);
+    _ws_send(ws, NULL, msg->is_text, msg->data, msg->len);
+    free(msg);
+  }
+}
+
+/* discard the messages queued from other threads, without sending them */
+static void
+_ws_drop_queue(struct websockets *ws)
+{
+  size_t amt=0;
+  struct _ws_msg *msg;
+  while ((msg = _ws_queue_pop(&ws->queue))) {
+    atomic_fetch_sub(&ws->queue.depth, 1);
+    free(msg);
+    ++amt;
+  }
+  if (amt)
+    logconf_warn(&ws->conf, "Discarded %zu queued message(s)", amt);
+}
+
+bool
+ws_send_binary(struct websockets *ws, struct ws_info *info, const char msg[], size_t msglen)
+{
+  if (!ws_same_thread(ws))
+    return _ws_enqueue(ws, false, msg, msglen);
+  return _ws_send(ws, info, false, msg, msglen);
+}
+
 bool
 ws_send_text(struct websockets *ws, struct ws_info *info, const char text[], size_t len)
 {
-  VASSERT_S(ws->tid == pthread_self(), "Can only be called from thread %u", ws->tid);
+  if (!ws_same_thread(ws))
+    return _ws_enqueue(ws, true, text, len);
+  return _ws_send(ws, info, true, text, len);
+}
 
-  logconf_http(
-    &ws->conf, 
-    NULL,
-    ws->base_url, 
-    (struct sized_buffer){"", 0},
-    (struct sized_buffer){(char*)text, len},
-    "WS_SEND_TEXT");
+void
+ws_set_queue_limit(struct websockets *ws, size_t max_depth) {
+  ws->queue.max_depth = max_depth;
+}
 
-  logconf_trace(&ws->conf, ANSICOLOR("SEND", ANSI_FG_GREEN)" TEXT (%zu bytes) [@@@_%zu_@@@]", len, ws->info.loginfo.counter);
+void
+ws_set_deflate(struct websockets *ws, const struct ws_deflate_config *config) {
+  ws->deflate = *config;
+}
 
-  if (WS_CONNECTED != ws->status) {
-    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at SEND TEXT : No active connection [@@@_%zu_@@@]", ws->info.loginfo.counter);
-    return false;
-  }
+/* add the counters of the current connection to 'p_stats' */
+static bool
+_ws_add_deflate_stats(struct websockets *ws, struct ws_deflate_stats *p_stats)
+{
+  if (!ws->ehandle) return false; /* EARLY RETURN */
+
+  struct cws_deflate_stats stats;
+  bool is_negotiated = cws_get_deflate_stats(ws->ehandle, &stats);
+  p_stats->msgs_inflated += stats.msgs_inflated;
+  p_stats->bytes_in_wire += stats.bytes_in_wire;
+  p_stats->bytes_in += stats.bytes_in;
+  p_stats->inflate_ns += stats.inflate_ns;
+  p_stats->msgs_deflated += stats.msgs_deflated;
+  p_stats->bytes_out += stats.bytes_out;
+  p_stats->bytes_out_wire += stats.bytes_out_wire;
+  p_stats->deflate_ns += stats.deflate_ns;
+  return is_negotiated;
+}
 
-  if (info) *info = ws->info;
+void
+ws_get_deflate_stats(struct websockets *ws, struct ws_deflate_stats *p_stats)
+{
+  *p_stats = ws->deflate_stats;
+  p_stats->is_negotiated = _ws_add_deflate_stats(ws, p_stats);
+}
 
-  if (!cws_send(ws->ehandle, true, text, len)) {
-    logconf_error(&ws->conf, ANSICOLOR("Failed", ANSI_FG_RED)" at SEND TEXT [@@@_%zu_@@@]", ws->info.loginfo.counter);
-    return false;
-  }
-  return true;
+void
+ws_get_queue_stats(struct websockets *ws, struct ws_queue_stats *p_stats)
+{
+  *p_stats = (struct ws_queue_stats){
+    .depth = atomic_load(&ws->queue.depth),
+    .max_depth = ws->queue.max_depth,
+    .high_watermark = atomic_load(&ws->queue.high_watermark),
+    .amt_queued = atomic_load(&ws->queue.amt_queued),
+    .amt_rejected = atomic_load(&ws->queue.amt_rejected)
+  };
 }
 
 bool 
@@ -675,7 +1378,8 @@ ws_pong(struct websockets *ws, struct ws_info *info, const char *reason, size_t
 void
 ws_start(struct websockets *ws) 
 {
-  ws->tid = pthread_self(); // save the starting thread
+  struct ws_reactor *reactor = ws->reactor;
+
   memset(&ws->pending_close, 0, sizeof ws->pending_close);
   ws->action = WS_ACTION_NONE;
 
@@ -684,29 +1388,105 @@ ws_start(struct websockets *ws)
   VASSERT_S(NULL == ws->ehandle, \
       "[%s] (Internal error) Attempt to reconnect without properly closing the connection", ws->conf.id);
   ws->ehandle = _ws_cws_new(ws, ws->protocols);
-  curl_multi_add_handle(ws->mhandle, ws->ehandle);
+  ws->is_closed = false;
+  ws->is_done = false;
   _ws_set_status(ws, WS_CONNECTING);  
+
+  // the transfer is added by the reactor's thread @see ws_reactor_perform()
+  pthread_mutex_lock(&reactor->lock);
+  if (1 == atomic_load(&reactor->refcount)) // a private reactor runs from the starting thread
+    reactor->tid = pthread_self();
+  ws->next = reactor->pending;
+  reactor->pending = ws;
+  pthread_mutex_unlock(&reactor->lock);
+
+  _ws_reactor_wakeup(reactor);
 }
 
-void
-ws_perform(struct websockets *ws, bool *p_is_running, uint64_t wait_ms)
+/* the connection is severed, free the transfer and notify the user */
+static void
+_ws_finish(struct ws_reactor *reactor, struct websockets *ws)
 {
-  ASSERT_S(ws->tid == pthread_self(), "ws_perform() should only be called from its initialization thread");
+  _ws_set_status(ws, WS_DISCONNECTING);
+
+  if (ws->is_done) {
+    switch (ws->result) {
+    case CURLE_OK:
+    case CURLE_ABORTED_BY_CALLBACK: // _ws_check_action_cb()
+        logconf_info(&ws->conf, "Disconnected gracefully");
+        break;
+    case CURLE_READ_ERROR:
+    default:
+        logconf_error(&ws->conf, "(CURLE code: %d) %s",
+            ws->result, 
+            IS_EMPTY_STRING(ws->errbuf) 
+                ? curl_easy_strerror(ws->result) 
+                : ws->errbuf);
+        logconf_error(&ws->conf, "Disconnected abruptly");
+        break;
+    }
+  }
+  else if (ws->is_closed) {
+    logconf_info(&ws->conf, "Disconnected gracefully");
+  }
+  else {
+    logconf_warn(&ws->conf, "Exit before establishing a connection");
+  }
 
-  int is_running = 0;
+  curl_multi_remove_handle(reactor->mhandle, ws->ehandle);
+
+  // messages queued for the severed connection can't be sent
+  _ws_drop_queue(ws);
+
+  // reset for next iteration
+  *ws->errbuf = '\0';
+  _ws_add_deflate_stats(ws, &ws->deflate_stats);
+  if (ws->ehandle) {
+    cws_free(ws->ehandle);
+    ws->ehandle = NULL;
+  }
+
+  _ws_set_status(ws, WS_DISCONNECTED);
+
+  // may start the connection again
+  (*ws->cbs.on_disconnect)(ws->cbs.data, ws, &ws->info);
+}
+
+int
+ws_reactor_perform(struct ws_reactor *reactor, uint64_t wait_ms)
+{
+  struct websockets *ws, *next;
+  int running = 0;
   CURLMcode mcode;
-  int numfds = 0;
 
   /**
-   * Update WebSockets concept of "now"
-   * @see ws_timestamp()
+   * Update WebSockets concept of "now", and add the transfers
+   *        started since the last call
+   * @see ws_timestamp() and ws_start()
    */
-  pthread_mutex_lock(&ws->lock);
-  ws->now_tstamp = cee_timestamp_ms();
-  pthread_mutex_unlock(&ws->lock);
+  pthread_mutex_lock(&reactor->lock);
+  reactor->tid = pthread_self();
+  uint64_t now = reactor->now = cee_timestamp_ms();
+  struct websockets *pending = reactor->pending;
+  reactor->pending = NULL;
+  pthread_mutex_unlock(&reactor->lock);
+
+  for (ws = pending; ws; ws = next) {
+    next = ws->next;
+    mcode = curl_multi_add_handle(reactor->mhandle, ws->ehandle); // triggers _ws_curl_timer_cb()
+    CURLM_CHECK(reactor, mcode);
+    ws->is_running = true;
+    ws->next = reactor->handles;
+    reactor->handles = ws;
+  }
+
+  // batch the messages sent from other threads into this perform
+  for (ws = reactor->handles; ws; ws = ws->next)
+    _ws_flush_queue(ws);
 
   /**
-   * Perform Read/Write pending sockets activity (if any)
+   * Wait for socket activity, or until the first of 'wait_ms', curl's
+   *        timeout or the next timer expires
    * @note ws_close() and ws_send_text() are example of pending
    *        write activities
    * @note Callbacks such as ws_on_text(), ws_on_ping(), etc are
@@ -715,62 +1495,108 @@ ws_perform(struct websockets *ws, bool *p_is_running, uint64_t wait_ms)
    *        inherently single-threaded. websockets.c doesn't create
    *        new threads.
    */
-  mcode = curl_multi_perform(ws->mhandle, &is_running);
-  CURLM_CHECK(ws, mcode);
-  
-  // wait for some activity or timeout after "wait_ms" elapsed
-  mcode = curl_multi_wait(ws->mhandle, NULL, 0, wait_ms, &numfds);
-  CURLM_CHECK(ws, mcode);
-
-  if (!is_running) { // WebSockets connection is severed
-    _ws_set_status(ws, WS_DISCONNECTING);
-
-    // read messages/informationals from the individual transfers
-    int msgq = 0;
-    struct CURLMsg *curlmsg = curl_multi_info_read(ws->mhandle, &msgq);
-    if (curlmsg) {
-      CURLcode ecode = curlmsg->data.result;
-      switch (ecode) {
-      case CURLE_OK:
-      case CURLE_ABORTED_BY_CALLBACK: // _ws_check_action_cb()
-          logconf_info(&ws->conf, "Disconnected gracefully");
-          break;
-      case CURLE_READ_ERROR:
-      default:
-          logconf_error(&ws->conf, "(CURLE code: %d) %s",
-              ecode, 
-              IS_EMPTY_STRING(ws->errbuf) 
-                  ? curl_easy_strerror(ecode) 
-                  : ws->errbuf);
-          logconf_error(&ws->conf, "Disconnected abruptly");
-          break;
+  uint64_t deadline = now + wait_ms;
+  if (reactor->curl_deadline && reactor->curl_deadline < deadline)
+    deadline = reactor->curl_deadline;
+  if (reactor->timers.list && reactor->timers.list->deadline < deadline)
+    deadline = reactor->timers.list->deadline;
+  int timeout_ms = (deadline > now) ? (int)(deadline - now) : 0;
+
+  struct _ws_event events[WS_MAX_EVENTS];
+  int amt_events = _ws_reactor_wait(reactor, events, WS_MAX_EVENTS, timeout_ms);
+  for (int i=0; i < amt_events; ++i) {
+    mcode = curl_multi_socket_action(reactor->mhandle, events[i].sockfd, events[i].action, &running);
+    CURLM_CHECK(reactor, mcode);
+  }
+
+  pthread_mutex_lock(&reactor->lock);
+  reactor->now = now = cee_timestamp_ms();
+  pthread_mutex_unlock(&reactor->lock);
+
+  if (reactor->curl_deadline && reactor->curl_deadline <= now) {
+    reactor->curl_deadline = 0;
+    mcode = curl_multi_socket_action(reactor->mhandle, CURL_SOCKET_TIMEOUT, 0, &running);
+    CURLM_CHECK(reactor, mcode);
+  }
+
+  // read the outcome of the transfers that are over
+  int msgq = 0;
+  struct CURLMsg *curlmsg;
+  while ((curlmsg = curl_multi_info_read(reactor->mhandle, &msgq))) {
+    if (CURLMSG_DONE != curlmsg->msg) continue;
+    for (ws = reactor->handles; ws; ws = ws->next) {
+      if (curlmsg->easy_handle == ws->ehandle) {
+        ws->is_running = false;
+        ws->is_done = true;
+        ws->result = curlmsg->data.result;
+        break;
       }
     }
-    else {
-      logconf_warn(&ws->conf, "Exit before establishing a connection");
+  }
+
+  /**
+   * The transfers are only processed by curl on activity, so a close
+   *        requested meanwhile is started, or finished, from here
+   * @see _ws_check_action_cb()
+   */
+  for (ws = reactor->handles; ws; ws = ws->next) {
+    pthread_mutex_lock(&ws->lock);
+    if (WS_ACTION_BEGIN_CLOSE == ws->action) {
+      logconf_warn(&ws->conf, "Received pending %s, closing the connection ...", ws_close_opcode_print(ws->pending_close.code));
+      _ws_close(ws, ws->pending_close.code, ws->pending_close.reason);
+      ws->action = WS_ACTION_NONE;
     }
-    
-    curl_multi_remove_handle(ws->mhandle, ws->ehandle);
-
-    // reset for next iteration
-    *ws->errbuf = '\0';
-    if (ws->ehandle) {
-      cws_free(ws->ehandle);
-      ws->ehandle = NULL;
+    else if (WS_ACTION_END_CLOSE == ws->action) {
+      ws->action = WS_ACTION_NONE;
+      ws->is_running = false;
+      ws->is_closed = true;
     }
+    pthread_mutex_unlock(&ws->lock);
+  }
+
+  _ws_run_timers(reactor, now);
 
-    _ws_set_status(ws, WS_DISCONNECTED);
+  // unlink the severed connections first, as their callback may start them again
+  struct websockets *severed = NULL, **p = &reactor->handles;
+  while ((ws = *p)) {
+    if (ws->is_running) {
+      p = &ws->next;
+      continue;
+    }
+    *p = ws->next;
+    ws->next = severed;
+    severed = ws;
+  }
+  for (ws = severed; ws; ws = next) {
+    next = ws->next;
+    ws->next = NULL;
+    _ws_finish(reactor, ws);
   }
 
-  *p_is_running = is_running;
+  int amt_alive = 0;
+  for (ws = reactor->handles; ws; ws = ws->next)
+    ++amt_alive;
+  pthread_mutex_lock(&reactor->lock);
+  for (ws = reactor->pending; ws; ws = ws->next)
+    ++amt_alive;
+  pthread_mutex_unlock(&reactor->lock);
+
+  return amt_alive;
+}
+
+void
+ws_perform(struct websockets *ws, bool *p_is_running, uint64_t wait_ms)
+{
+  ws_reactor_perform(ws->reactor, wait_ms);
+  *p_is_running = ws_is_alive(ws);
 }
 
 uint64_t
 ws_timestamp(struct websockets *ws) 
 {
-  pthread_mutex_lock(&ws->lock);
-  uint64_t now_tstamp = ws->now_tstamp;
-  pthread_mutex_unlock(&ws->lock);
+  pthread_mutex_lock(&ws->reactor->lock);
+  uint64_t now_tstamp = ws->reactor->now;
+  pthread_mutex_unlock(&ws->reactor->lock);
   return now_tstamp;
 }
 
@@ -795,9 +1621,14 @@ ws_close(struct websockets *ws, const enum ws_close_reason code, const char reas
   snprintf(ws->pending_close.reason, sizeof(ws->pending_close.reason),
       "%.*s", (int)len, reason);
   pthread_mutex_unlock(&ws->lock);
+
+  ws_wakeup(ws);
 }
 
 bool 
 ws_same_thread(struct websockets *ws) {
-  return ws->tid == pthread_self();
+  pthread_mutex_lock(&ws->reactor->lock);
+  pthread_t tid = ws->reactor->tid;
+  pthread_mutex_unlock(&ws->reactor->lock);
+  return pthread_equal(tid, pthread_self());
 }
@@ -23,6 +23,21 @@ extern "C" {
  */
 struct websockets;
 
+/**
+ * @struct ws_reactor
+ * @brief Opaque handler for the event-loop of one or many WebSockets
+ *        handles
+ *
+ * Every handle is created with a private reactor, and may be attached
+ *        to another one so that a single thread drives all of their
+ *        transfers with one curl multi handle
+ * - Initializer:
+ *   - ws_reactor_init()
+ * - Cleanup:
+ *   - ws_reactor_cleanup()
+ */
+struct ws_reactor;
+
 /**
  * @brief Stores info on the latest transfer performed via websockets
  */
@@ -84,6 +99,16 @@ struct ws_callbacks {
    * with WS_CLOSE_REASON_INCONSISTENT_DATA.
    */
   void (*on_text)(void *data, struct websockets *ws, struct ws_info *info, const char *text, size_t len);
+  /**
+   * @brief reports UTF-8 text messages in chunks, as they're received
+   *
+   * Optional: if provided, on_text() is not called and text messages
+   *        are not buffered
+   * @note chunks are not NULL (\0) terminated and may split UTF-8
+   *        sequences, the message's last chunk has @a is_final set
+   *        and may be empty
+   */
+  void (*on_text_partial)(void *data, struct websockets *ws, struct ws_info *info, const char *chunk, size_t len, bool is_final);
   /**
    * @brief reports binary data.
    */
@@ -106,6 +131,13 @@ struct ws_callbacks {
    * closed
    */
   void (*on_close)(void *data, struct websockets *ws, struct ws_info *info, enum ws_close_reason wscode, const char *reason, size_t len);
+  /**
+   * @brief reports the connection is over and the handle is back to
+   *        WS_DISCONNECTED
+   *
+   * @note it's safe to call ws_start() from here to reconnect
+   */
+  void (*on_disconnect)(void *data, struct websockets *ws, struct ws_info *info);
   /**
    * @brief user arbitrary data to be passed around callbacks
    */
@@ -125,9 +157,65 @@ struct websockets* ws_init(struct ws_callbacks *cbs, struct logconf *config);
  * @brief Free a WebSockets handle created with ws_init()
  *
  * @param ws the WebSockets handle created with ws_init()
+ * @note the handle is detached from its reactor, should be called
+ *        from the reactor's thread if it's shared and the connection
+ *        is still alive
  */
 void ws_cleanup(struct websockets *ws);
 
+/**
+ * @brief Create a reactor that WebSockets handles can be attached to
+ *
+ * @param config optional parent logconf struct
+ * @return newly created reactor, free with ws_reactor_cleanup()
+ * @see ws_set_reactor()
+ */
+struct ws_reactor* ws_reactor_init(struct logconf *config);
+
+/**
+ * @brief Release a reactor created with ws_reactor_init()
+ *
+ * The reactor is freed once its last attached handle is also
+ *        freed with ws_cleanup()
+ * @param reactor the reactor created with ws_reactor_init()
+ */
+void ws_reactor_cleanup(struct ws_reactor *reactor);
+
+/**
+ * @brief Have the transfers of a WebSockets handle driven by another
+ *        reactor
+ *
+ * @param ws the WebSockets handle created with ws_init(), must be
+ *        WS_DISCONNECTED
+ * @param reactor a reactor created with ws_reactor_init(), or obtained
+ *        from another handle with ws_get_reactor()
+ * @note the handle's pending timers are cancelled
+ */
+void ws_set_reactor(struct websockets *ws, struct ws_reactor *reactor);
+
+/**
+ * @brief Get the reactor driving a WebSockets handle
+ *
+ * @param ws the WebSockets handle created with ws_init()
+ * @return the reactor, to be shared with other handles
+ *        @see ws_set_reactor()
+ */
+struct ws_reactor* ws_get_reactor(struct websockets *ws);
+
+/**
+ * @brief Read/Write available data of all the reactor's connections
+ *
+ * Waits until a connection's socket is ready, a timer expires or
+ *        @a wait_ms elapses, then drives the transfers with
+ *        curl_multi_socket_action(), runs expired timers and reports
+ *        severed connections with their on_disconnect() callback
+ * @param reactor the reactor created with ws_reactor_init()
+ * @param wait_ms limit amount in milliseconds to wait for until activity
+ * @return the amount of connections still alive
+ * @note the calling thread becomes the reactor's event-loop thread
+ */
+int ws_reactor_perform(struct ws_reactor *reactor, uint64_t wait_ms);
+
 /**
  * @brief Set the URL for the WebSockets handle to connect
  * 
@@ -148,6 +236,10 @@ void ws_set_url(struct websockets *ws, const char base_url[], const char ws_prot
  * @param msg the pointer to memory (linear) to send.
  * @param msglen the length in bytes of @a msg.
  * @return true if sent, false on errors.
+ * @note may be called from any thread: from threads other than the
+ *        event-loop's the message is copied to a queue, sent by the next
+ *        ws_perform(), and false is returned if the queue is full
+ *        @see ws_set_queue_limit()
  */
 bool ws_send_binary(struct websockets *ws, struct ws_info *info, const char msg[], size_t msglen);
 /**
@@ -161,8 +253,95 @@ bool ws_send_binary(struct websockets *ws, struct ws_info *info, const char msg[
  * @param text the pointer to memory (linear) to send.
  * @param len the length in bytes of @a text.
  * @return true if sent, false on errors.
+ * @note may be called from any thread: from threads other than the
+ *        event-loop's the message is copied to a queue, sent by the next
+ *        ws_perform(), and false is returned if the queue is full
+ *        @see ws_set_queue_limit()
  */
 bool ws_send_text(struct websockets *ws, struct ws_info *info, const char text[], size_t len);
+/**
+ * @brief Outbound queue counters
+ *
+ * @see ws_get_queue_stats()
+ */
+struct ws_queue_stats {
+  size_t depth;            ///< messages waiting to be sent
+  size_t max_depth;        ///< limit of messages waiting to be sent
+  size_t high_watermark;   ///< deepest the queue has been
+  uint64_t amt_queued;     ///< messages queued from other threads
+  uint64_t amt_rejected;   ///< messages rejected because the queue was full
+};
+
+/**
+ * @brief Limit the amount of messages sent from other threads that
+ *        may wait to be sent
+ *
+ * Once reached, ws_send_text() and ws_send_binary() return false
+ *        from threads other than the event-loop's, until ws_perform()
+ *        catches up
+ * @param ws the WebSockets handle created with ws_init()
+ * @param max_depth the limit (1024 by default)
+ */
+void ws_set_queue_limit(struct websockets *ws, size_t max_depth);
+
+/**
+ * @brief Get the outbound queue counters
+ *
+ * @param ws the WebSockets handle created with ws_init()
+ * @param p_stats receives the counters
+ */
+void ws_get_queue_stats(struct websockets *ws, struct ws_queue_stats *p_stats);
+
+/**
+ * @brief permessage-deflate (RFC 7692) settings
+ *
+ * @see ws_set_deflate()
+ */
+struct ws_deflate_config {
+  bool enable;                     ///< offer the extension to the server
+  bool client_no_context_takeover; ///< reset our compressor after every message (less memory, worse ratio)
+  bool server_no_context_takeover; ///< ask the server to reset its compressor after every message
+  int client_max_window_bits;      ///< our compressor's window (9..15), 0 for 15
+  int server_max_window_bits;      ///< ask the server for a smaller window (9..15), 0 to leave it to the server
+};
+
+/**
+ * @brief permessage-deflate counters, summed over the handle's connections
+ *
+ * @see ws_get_deflate_stats()
+ */
+struct ws_deflate_stats {
+  bool is_negotiated;      ///< the current connection uses the extension
+  uint64_t msgs_inflated;  ///< compressed messages received
+  uint64_t bytes_in_wire;  ///< their size as received
+  uint64_t bytes_in;       ///< their size once inflated
+  uint64_t inflate_ns;     ///< time spent inflating
+  uint64_t msgs_deflated;  ///< compressed messages sent
+  uint64_t bytes_out;      ///< their size before deflating
+  uint64_t bytes_out_wire; ///< their size as sent
+  uint64_t deflate_ns;     ///< time spent deflating
+};
+
+/**
+ * @brief Offer per-message compression to the server
+ *
+ * If the server accepts, messages of at least 64 bytes are sent
+ *        compressed and compressed messages are inflated before being
+ *        reported, otherwise messages are exchanged uncompressed
+ * @param ws the WebSockets handle created with ws_init()
+ * @param config the extension settings, applied from the next ws_start()
+ */
+void ws_set_deflate(struct websockets *ws, const struct ws_deflate_config *config);
+
+/**
+ * @brief Get the permessage-deflate counters
+ *
+ * @param ws the WebSockets handle created with ws_init()
+ * @param p_stats receives the counters
+ * @note should only be called from the event-loop thread
+ */
+void ws_get_deflate_stats(struct websockets *ws, struct ws_deflate_stats *p_stats);
+
 /**
  * @brief Send a PING (opcode 0x9) frame with @a reason as payload.
  *
@@ -192,23 +371,74 @@ bool ws_pong(struct websockets *ws, struct ws_info *info, const char reason[], s
 /**
  * @brief Signals connecting state before entering the WebSockets event loop
  *
+ * The connection is established by the next ws_perform() or
+ *        ws_reactor_perform()
  * @param ws the WebSockets handle created with ws_init()
  * @note Helper over _ws_set_status(ws, WS_CONNECTING)
+ * @note may be called from any thread for a handle attached to a
+ *        shared reactor
  */
 void ws_start(struct websockets *ws);
 
 /**
  * @brief Reads/Write available data from WebSockets
  *
- * Helper over curl_multi_perform()
+ * Waits until the connection's socket is ready, a timer expires or
+ *        @a wait_ms elapses, then drives the transfer with
+ *        curl_multi_socket_action() and runs expired timers
  *
+ * This performs the handle's reactor, so the connections of the
+ *        handles attached to the same reactor are served as well
  * @param ws the WebSockets handle created with ws_init()
  * @param is_running receives true if the client is running and false otherwise
  * @param wait_ms limit amount in milliseconds to wait for until activity
- * @see https://curl.se/libcurl/c/curl_multi_perform.html
+ * @see https://curl.se/libcurl/c/curl_multi_socket_action.html
+ * @see ws_timer_add() and ws_wakeup()
+ * @see ws_reactor_perform()
  */
 void ws_perform(struct websockets *ws, _Bool *is_running, uint64_t wait_ms);
 
+/**
+ * @brief Timer callback
+ *
+ * @param ws the WebSockets handle running the timer
+ * @param data user arbitrary data given to ws_timer_add()
+ * @see ws_timer_add()
+ */
+typedef void (ws_timer_cb)(struct websockets *ws, void *data);
+
+/**
+ * @brief Run a callback from ws_perform() once a timeout expires
+ *
+ * ws_perform() wakes up for timers, so periodic work such as
+ *        heartbeating doesn't need ws_perform() to be polled
+ * @param ws the WebSockets handle created with ws_init()
+ * @param timeout_ms milliseconds until the first run
+ * @param repeat_ms milliseconds between following runs, or 0 to run once
+ * @param cb the callback
+ * @param data user arbitrary data to be given to @a cb
+ * @return the timer id, to be given to ws_timer_cancel()
+ * @note should only be called from the event-loop thread
+ */
+unsigned ws_timer_add(struct websockets *ws, uint64_t timeout_ms, uint64_t repeat_ms, ws_timer_cb *cb, void *data);
+
+/**
+ * @brief Cancel a timer created with ws_timer_add()
+ *
+ * @param ws the WebSockets handle created with ws_init()
+ * @param id the timer id
+ * @return true if the timer was pending and is now cancelled
+ * @note should only be called from the event-loop thread
+ */
+bool ws_timer_cancel(struct websockets *ws, unsigned id);
+
+/**
+ * @brief Thread-safe way to interrupt ws_perform() while it waits
+ *
+ * @param ws the WebSockets handle created with ws_init()
+ */
+void ws_wakeup(struct websockets *ws);
+
 /**
  * @brief Returns the WebSockets handle connection status
  *
@@ -14,10 +14,21 @@ discord_adapter_init(struct discord_adapter *adapter, struct logconf *conf, stru
 {
   adapter->ua = ua_init(conf);
   ua_set_url(adapter->ua, DISCORD_API_BASE_URL);
+  ua_set_metrics(adapter->ua, true);
+
+  bool is_cached=true, is_http2=false;
+  struct sized_buffer http = logconf_get_field(conf, "discord.http");
+  if (http.size) {
+    json_extract(http.start, http.size, 
+        "(dns_tls_cache):b,(http2):b", &is_cached, &is_http2);
+  }
+  discord_adapter_set_transport(adapter, is_cached, is_http2);
 
   adapter->ratelimit = calloc(1, sizeof *adapter->ratelimit);
   if (pthread_mutex_init(&adapter->ratelimit->lock, NULL))
     ERR("Couldn't initialize pthread mutex");
+  if (pthread_mutex_init(&adapter->err.lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
 
   if (!token->size) { // is a webhook only client
     logconf_branch(&adapter->conf, conf, "DISCORD_WEBHOOK");
@@ -36,10 +47,28 @@ void
 discord_adapter_cleanup(struct discord_adapter *adapter)
 {
   ua_cleanup(adapter->ua);
+  if (adapter->share) 
+    ua_share_cleanup(adapter->share);
   discord_buckets_cleanup(adapter);
   pthread_mutex_destroy(&adapter->ratelimit->lock);
   free(adapter->ratelimit);
-  ua_info_cleanup(&adapter->err.info);
+  pthread_mutex_destroy(&adapter->err.lock);
+}
+
+// defined at discord-internal.h
+void
+discord_adapter_set_transport(struct discord_adapter *adapter, bool is_cached, bool is_http2)
+{
+  if (is_cached && !adapter->share) {
+    adapter->share = ua_share_init();
+    ua_set_share(adapter->ua, adapter->share);
+  }
+  else if (!is_cached && adapter->share) {
+    ua_set_share(adapter->ua, NULL);
+    ua_share_cleanup(adapter->share);
+    adapter->share = NULL;
+  }
+  ua_set_http2(adapter->ua, is_http2);
 }
 
 /**
@@ -51,15 +80,19 @@ json_error_cb(char *str, size_t len, void *p_adapter)
 {
   struct discord_adapter *adapter = p_adapter;
   char message[256]="";
+  int jsoncode=0;
 
   json_extract(str, len, "(message):.*s (code):d", 
-      sizeof(message), message, &adapter->err.jsoncode);
+      sizeof(message), message, &jsoncode);
   logconf_error(&adapter->conf, ANSICOLOR("(JSON Error %d) %s", ANSI_BG_RED)
             " - See Discord's JSON Error Codes\n\t\t%.*s",
-            adapter->err.jsoncode, message, (int)len, str);
+            jsoncode, message, (int)len, str);
 
+  pthread_mutex_lock(&adapter->err.lock);
+  adapter->err.jsoncode = jsoncode;
   snprintf(adapter->err.jsonstr, sizeof(adapter->err.jsonstr), 
       "%.*s", (int)len, str);
+  pthread_mutex_unlock(&adapter->err.lock);
 }
 
 /* template function for performing requests */
@@ -96,17 +129,47 @@ discord_adapter_run(
   pthread_mutex_unlock(&adapter->ratelimit->lock);
 
   ORCAcode code;
+  struct ua_info info={0}; // the adapter is shared, each call gets its own
+
+  /* concurrent GETs to the same endpoint share a single request, so
+   *  that they don't use up the bucket's ratelimit (unless the
+   *  response is streamed element-wise) */
+  struct ua_flight *flight=NULL;
+  if (HTTP_GET == http_method && !(resp_handle && resp_handle->elem_cb)) {
+    char key[4096];
+    size_t ret = snprintf(key, sizeof(key), "%s", ua_get_url(adapter->ua));
+    va_list tmp;
+    va_copy(tmp, args);
+    ret += vsnprintf(key+ret, sizeof(key)-ret, endpoint, tmp);
+    va_end(tmp);
+    ASSERT_S(ret < sizeof(key), "Out of bounds write attempt");
+
+    flight = ua_flight_begin(adapter->ua, key, resp_handle, &info, &code);
+    if (!flight) {
+      pthread_mutex_lock(&adapter->err.lock);
+      adapter->err.httpcode = info.httpcode;
+      pthread_mutex_unlock(&adapter->err.lock);
+      ua_info_recycle(adapter->ua, &info);
+      va_end(args);
+      return code; /* EARLY RETURN (served by identical request) */
+    }
+  }
+
   bool keepalive=true;
   do {
-    ua_info_cleanup(&adapter->err.info);
+    ua_info_recycle(adapter->ua, &info);
 
+    uint64_t tstamp = cee_timestamp_ms();
     discord_bucket_try_cooldown(bucket);
+    ua_metrics_record(adapter->ua, http_method, endpoint, UA_METRIC_RATELIMITED, 
+        1000 * (cee_timestamp_ms() - tstamp));
 
     code = ua_vrun(
       adapter->ua,
-      &adapter->err.info,
+      &info,
       resp_handle,
       req_body,
+      NULL,
       http_method, endpoint, args);
     
     if (code != ORCA_HTTP_CODE)
@@ -115,7 +178,7 @@ discord_adapter_run(
     }
     else 
     {
-        const int httpcode = adapter->err.info.httpcode;
+        const int httpcode = info.httpcode;
         switch (httpcode) {
         case HTTP_FORBIDDEN:
         case HTTP_NOT_FOUND:
@@ -136,7 +199,7 @@ discord_adapter_run(
             char message[256]="";
             double retry_after=-1; // seconds
 
-            struct sized_buffer body = ua_info_get_resp_body(&adapter->err.info);
+            struct sized_buffer body = ua_info_get_resp_body(&info);
             json_extract(body.start, body.size,
                         "(message):s (retry_after):lf",
                         message, &retry_after);
@@ -157,10 +220,19 @@ discord_adapter_run(
     }
 
     pthread_mutex_lock(&adapter->ratelimit->lock);
-    discord_bucket_build(adapter, bucket, route, code, &adapter->err.info);
+    discord_bucket_build(adapter, bucket, route, code, &info);
     pthread_mutex_unlock(&adapter->ratelimit->lock);
   } while (keepalive);
 
+  if (flight) {
+    ua_flight_end(adapter->ua, flight, &info, code);
+  }
+
+  pthread_mutex_lock(&adapter->err.lock);
+  adapter->err.httpcode = info.httpcode;
+  pthread_mutex_unlock(&adapter->err.lock);
+  ua_info_recycle(adapter->ua, &info);
+
   va_end(args);
 
   return code;
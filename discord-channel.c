@@ -79,6 +79,26 @@ discord_delete_channel(struct discord *client, const u64_snowflake_t channel_id,
            "/channels/%"PRIu64, channel_id);
 }
 
+/* messages received so far, the list is built once they're all in */
+struct message_list {
+  struct discord_message *elems;
+  size_t amt;
+  size_t cap;
+};
+
+/* decode each message as soon as it's received */
+static void
+message_list_append(char *str, size_t len, void *p_list)
+{
+  struct message_list *list = p_list;
+  if (list->amt == list->cap) { // grow geometrically
+    list->cap = list->cap ? 2 * list->cap : 64;
+    list->elems = realloc(list->elems, list->cap * sizeof *list->elems);
+  }
+  struct discord_message *message = &list->elems[list->amt++];
+  discord_message_from_json(str, len, &message);
+}
+
 ORCAcode
 discord_get_channel_messages(
   struct discord *client, 
@@ -120,16 +140,36 @@ discord_get_channel_messages(
     }
   }
 
-  return discord_adapter_run( 
+  *p_messages = NULL;
+  struct message_list list={0};
+  ORCAcode code;
+  code = discord_adapter_run( 
            &client->adapter,
            &(struct ua_resp_handle){ 
              .ok_cb = &discord_message_list_from_json_v, 
-             .ok_obj = p_messages 
+             .ok_obj = p_messages,
+             .elem_cb = &message_list_append,
+             .elem_obj = &list
            },
            NULL,
            HTTP_GET, 
            "/channels/%"PRIu64"/messages%s%s", 
            channel_id, (*query)?"?":"", query);
+  if (list.amt) {
+    if (ORCA_OK == code) {
+      *p_messages = (NTL_T(struct discord_message))ntl_calloc(list.amt, sizeof(struct discord_message));
+      for (size_t i=0; i < list.amt; ++i)
+        memcpy((*p_messages)[i], &list.elems[i], sizeof(struct discord_message));
+    }
+    else {
+      for (size_t i=0; i < list.amt; ++i)
+        discord_message_cleanup(&list.elems[i]);
+    }
+  }
+  free(list.elems);
+  if (ORCA_OK == code && !*p_messages) // empty list
+    *p_messages = (NTL_T(struct discord_message))ntl_calloc(0, sizeof(struct discord_message));
+  return code;
 }
 
 ORCAcode
@@ -198,20 +238,18 @@ discord_create_message(
   }
 
   // content-type is multipart/form-data
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "multipart/form-data");
-  ua_curl_mime_setopt(client->adapter.ua, params->file, &discord_file_to_mime);
+  struct ua_multipart multipart={0};
+  ORCAcode code = discord_file_to_multipart(params->file, &multipart);
+  if (ORCA_OK != code) return code; /* EARLY RETURN */
 
-  ORCAcode code;
   code = discord_adapter_run( 
            &client->adapter,
            &resp_handle,
-           NULL,
+           UA_MULTIPART_BODY(&multipart),
            HTTP_MIMEPOST, 
            "/channels/%"PRIu64"/messages", channel_id);
 
-  //set back to default
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "application/json");
-  ua_curl_mime_setopt(client->adapter.ua, NULL, NULL);
+  ua_multipart_cleanup(&multipart);
 
   return code;
 }
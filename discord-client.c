@@ -67,6 +67,8 @@ discord_clone(const struct discord *orig_client)
 
   clone_client->adapter.ua = ua_clone(orig_client->adapter.ua);
   memset(&clone_client->adapter.err, 0, sizeof clone_client->adapter.err);
+  if (pthread_mutex_init(&clone_client->adapter.err.lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
 
   clone_client->is_original = false;
 
@@ -78,13 +80,14 @@ discord_cleanup(struct discord *client)
 {
   if (client->is_original) {
     logconf_cleanup(client->conf);
+    discord_voice_connections_cleanup(client);
     discord_adapter_cleanup(&client->adapter);
     discord_gateway_cleanup(&client->gw);
     free(client->conf);
   }
   else {
     ua_cleanup(client->adapter.ua);
-    ua_info_cleanup(&client->adapter.err.info);
+    pthread_mutex_destroy(&client->adapter.err.lock);
   }
   free(client);
 }
@@ -446,6 +449,124 @@ discord_replace_presence(struct discord *client, struct discord_gateway_status_u
   client->gw.id.presence = presence;
 }
 
+void
+discord_set_http_transport(struct discord *client, bool dns_tls_cache, bool http2) {
+  discord_adapter_set_transport(&client->adapter, dns_tls_cache, http2);
+}
+
+bool
+discord_get_route_stats(struct discord *client, char method[], char endpoint[], bool is_ratelimited, struct discord_route_stats *p_stats)
+{
+  struct ua_metrics_stats stats;
+  bool found = ua_get_metrics(
+                 client->adapter.ua, 
+                 http_method_eval(method), 
+                 endpoint, 
+                 is_ratelimited ? UA_METRIC_RATELIMITED : UA_METRIC_TOTAL, 
+                 &stats);
+
+  *p_stats = (struct discord_route_stats){
+    .count = stats.count,
+    .min   = stats.min,
+    .max   = stats.max,
+    .mean  = stats.mean,
+    .p50   = stats.p50,
+    .p90   = stats.p90,
+    .p99   = stats.p99,
+    .p999  = stats.p999
+  };
+  return found;
+}
+
+size_t
+discord_dump_route_stats(struct discord *client, char buf[], size_t bufsize) {
+  return ua_metrics_dump(client->adapter.ua, buf, bufsize);
+}
+
+ORCAcode
+discord_set_record(struct discord *client, const char path[]) {
+  return ua_set_record(client->adapter.ua, path);
+}
+
+ORCAcode
+discord_set_replay(struct discord *client, const char path[], double speed) {
+  return ua_set_replay(client->adapter.ua, path, speed);
+}
+
+void
+discord_set_gateway_compress(struct discord *client, bool enable) {
+  client->gw.compress->enable = enable;
+}
+
+void
+discord_set_gateway_etf(struct discord *client, bool enable) {
+  client->gw.etf->enable = enable;
+}
+
+void
+discord_get_gateway_stats(struct discord *client, struct discord_gateway_stats *p_stats) {
+  *p_stats = client->gw.compress->stats;
+}
+
+void
+discord_set_shards(struct discord *client, int shard_id, int amt_shards, int total_shards)
+{
+  if (WS_DISCONNECTED != ws_get_status(client->gw.ws)) {
+    log_error("Can't shard a running client.");
+    return;
+  }
+  client->shards.enable = true;
+  client->shards.first_id = shard_id;
+  client->shards.amt = amt_shards;
+  client->shards.total = total_shards;
+}
+
+void
+discord_set_cluster(struct discord *client, const char socket_path[])
+{
+  if (WS_DISCONNECTED != ws_get_status(client->gw.ws)) {
+    log_error("Can't cluster a running client.");
+    return;
+  }
+  if (client->shards.cluster)
+    discord_cluster_cleanup(client->shards.cluster);
+  client->shards.cluster = discord_cluster_init(client->conf, socket_path);
+  client->shards.enable = true;
+}
+
+int
+discord_get_shard_id(struct discord *client) {
+  return client->gw.shard.id;
+}
+
+ORCAcode
+discord_get_shard_info(struct discord *client, int shard_id, struct discord_shard_info *p_info)
+{
+  struct discord_gateway *gw = NULL;
+  struct discord_shards *shards = client->gw.shard.shards;
+  if (shards) {
+    for (int i=0; i < shards->amt_clients; ++i) {
+      if (shard_id == shards->clients[i]->gw.shard.id) {
+        gw = &shards->clients[i]->gw;
+        break; /* EARLY BREAK */
+      }
+    }
+  }
+  else if (shard_id == client->gw.shard.id) {
+    gw = &client->gw;
+  }
+  if (!gw) return ORCA_BAD_PARAMETER;
+
+  *p_info = (struct discord_shard_info){
+    .id = gw->shard.id,
+    .status = gw->shard.status,
+    .ping_ms = gw->hbeat->ping_ms,
+    .reconnects = gw->reconnect->attempt,
+    .guilds = gw->shard.guilds
+  };
+  return ORCA_OK;
+}
+
 void
 discord_set_presence(
   struct discord *client, 
@@ -0,0 +1,736 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "discord.h"
+#include "discord-internal.h"
+#include "cee-utils.h"
+
+/*
+ * The workers of a cluster talk to their coordinator over a Unix domain
+ *  socket, with a line of text per message:
+ *
+ * worker -> coordinator
+ *   HELLO                    ask for a shard range
+ *   IDENTIFY <shard_id>      ask for the shard's turn to IDENTIFY
+ *   IDENTIFIED <shard_id>    the shard sent its IDENTIFY
+ *   RELEASE <shard_id>       the shard gave up its turn before IDENTIFY
+ *   STAT <name> <value>      the worker's value of a stat
+ *   BYE                      the worker is done with its range
+ *
+ * coordinator -> worker
+ *   SHARDS <first_id> <amt> <total> <max_concurrency> <gateway_url>
+ *   FULL                     every range is taken
+ *   GO <shard_id>            the shard may connect and IDENTIFY
+ *   TOTAL <name> <total>     the sum of a stat across the workers
+ */
+
+#define DISCORD_CLUSTER_LINE_LEN        1024
+#define DISCORD_CLUSTER_JOIN_TIMEOUT_MS 10000
+#define DISCORD_CLUSTER_MAX_WAIT_MS     1000
+
+
+/* send a line, the link is closed on failure */
+static bool
+cluster_send(struct logconf *conf, int fd, const char fmt[], ...)
+{
+  char line[DISCORD_CLUSTER_LINE_LEN];
+  va_list args;
+  va_start(args, fmt);
+  size_t len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+  va_end(args);
+  ASSERT_S(len < sizeof(line) - 1, "Out of bounds write attempt");
+  line[len++] = '\n';
+
+  logconf_trace(conf, "SEND %.*s", (int)len - 1, line);
+  for (size_t sent=0; sent < len; ) {
+    ssize_t ret = send(fd, line + sent, len - sent, MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (EINTR == errno) continue;
+      if (EAGAIN == errno || EWOULDBLOCK == errno) { // a few bytes, the peer is stuck
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        if (poll(&pfd, 1, DISCORD_CLUSTER_MAX_WAIT_MS) > 0) continue;
+      }
+      logconf_error(conf, "Couldn't send to the cluster: %s", strerror(errno));
+      return false;
+    }
+    sent += ret;
+  }
+  return true;
+}
+
+/* read what's available into buf, false if the peer is gone */
+static bool
+cluster_read(int fd, char buf[], size_t size, size_t *p_len)
+{
+  while (*p_len < size) {
+    ssize_t ret = read(fd, buf + *p_len, size - *p_len);
+    if (0 == ret) return false; // closed by the peer
+    if (ret < 0) {
+      if (EINTR == errno) continue;
+      return (EAGAIN == errno || EWOULDBLOCK == errno);
+    }
+    *p_len += ret;
+  }
+  return false; // a line longer than the buffer
+}
+
+/* pop the next complete line out of buf, false if there's none */
+static bool
+cluster_next_line(char buf[], size_t *p_len, char line[], size_t size)
+{
+  char *end = memchr(buf, '\n', *p_len);
+  if (!end) return false;
+
+  size_t len = end - buf;
+  snprintf(line, size, "%.*s", (int)len, buf);
+  *p_len -= len + 1;
+  memmove(buf, end + 1, *p_len);
+  return true;
+}
+
+static void
+cluster_set_nonblock(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static bool
+cluster_get_addr(struct logconf *conf, const char path[], struct sockaddr_un *addr)
+{
+  *addr = (struct sockaddr_un){ .sun_family = AF_UNIX };
+  if (!path || strlen(path) >= sizeof(addr->sun_path)) {
+    logconf_error(conf, "Bad cluster socket path '%s'", path ? path : "");
+    return false;
+  }
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+// defined at discord-internal.h
+struct discord_cluster*
+discord_cluster_init(struct logconf *conf, const char path[])
+{
+  struct discord_cluster *new_cluster = calloc(1, sizeof *new_cluster);
+  logconf_branch(&new_cluster->conf, conf, "DISCORD_CLUSTER");
+  new_cluster->path = strdup(path);
+  new_cluster->fd = -1;
+  if (pthread_mutex_init(&new_cluster->lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
+  return new_cluster;
+}
+
+// defined at discord-internal.h
+void
+discord_cluster_cleanup(struct discord_cluster *cluster)
+{
+  if (!cluster) return; /* EARLY RETURN */
+
+  if (cluster->fd != -1)
+    close(cluster->fd);
+  free(cluster->path);
+  pthread_mutex_destroy(&cluster->lock);
+  free(cluster);
+}
+
+static void
+cluster_disconnect(struct discord_cluster *cluster)
+{
+  close(cluster->fd);
+  cluster->fd = -1;
+  cluster->recv.len = 0;
+}
+
+// defined at discord-internal.h
+ORCAcode
+discord_cluster_join(struct discord_cluster *cluster, struct discord_shards *shards, int *p_max_concurrency, char **p_url)
+{
+  struct sockaddr_un addr;
+  if (!cluster_get_addr(&cluster->conf, cluster->path, &addr))
+    return ORCA_BAD_PARAMETER;
+
+  if (cluster->fd != -1)
+    cluster_disconnect(cluster);
+  cluster->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  VASSERT_S(cluster->fd != -1, "Couldn't create socket: %s", strerror(errno));
+  if (connect(cluster->fd, (struct sockaddr*)&addr, sizeof(addr))) {
+    logconf_fatal(&cluster->conf, "Couldn't connect to the cluster coordinator at '%s': %s",
+        cluster->path, strerror(errno));
+    cluster_disconnect(cluster);
+    return ORCA_DISCORD_CONNECTION;
+  }
+  cluster_set_nonblock(cluster->fd);
+
+  if (!cluster_send(&cluster->conf, cluster->fd, "HELLO")) {
+    cluster_disconnect(cluster);
+    return ORCA_DISCORD_CONNECTION;
+  }
+
+  // wait for the shard range
+  char line[DISCORD_CLUSTER_LINE_LEN], url[DISCORD_CLUSTER_LINE_LEN];
+  u64_unix_ms_t deadline = cee_timestamp_ms() + DISCORD_CLUSTER_JOIN_TIMEOUT_MS;
+  while (!cluster_next_line(cluster->recv.buf, &cluster->recv.len, line, sizeof(line))) {
+    struct pollfd pfd = { .fd = cluster->fd, .events = POLLIN };
+    u64_unix_ms_t now = cee_timestamp_ms();
+    if (now >= deadline
+        || poll(&pfd, 1, deadline - now) < 0
+        || !cluster_read(cluster->fd, cluster->recv.buf, sizeof(cluster->recv.buf), &cluster->recv.len))
+    {
+      logconf_fatal(&cluster->conf, "The cluster coordinator didn't assign shards");
+      cluster_disconnect(cluster);
+      return ORCA_DISCORD_CONNECTION;
+    }
+  }
+  logconf_trace(&cluster->conf, "RCV %s", line);
+
+  if (5 != sscanf(line, "SHARDS %d %d %d %d %1023s",
+              &shards->first_id, &shards->amt, &shards->total, p_max_concurrency, url))
+  {
+    logconf_fatal(&cluster->conf, "The cluster coordinator refused to assign shards: %s", line);
+    cluster_disconnect(cluster);
+    return ORCA_DISCORD_CONNECTION;
+  }
+  *p_url = strdup(url);
+
+  // a rejoining worker sends its stats again
+  pthread_mutex_lock(&cluster->lock);
+  for (int i=0; i < cluster->amt_stats; ++i)
+    cluster->stats[i].is_dirty = true;
+  pthread_mutex_unlock(&cluster->lock);
+
+  logconf_info(&cluster->conf, "Joined the cluster at '%s'", cluster->path);
+  return ORCA_OK;
+}
+
+// defined at discord-internal.h
+void
+discord_cluster_leave(struct discord_cluster *cluster)
+{
+  if (-1 == cluster->fd) return; /* EARLY RETURN */
+
+  cluster_send(&cluster->conf, cluster->fd, "BYE");
+  cluster_disconnect(cluster);
+}
+
+// defined at discord-internal.h
+void
+discord_cluster_request(struct discord_cluster *cluster, int shard_id)
+{
+  if (-1 == cluster->fd) return; /* EARLY RETURN */
+
+  if (!cluster_send(&cluster->conf, cluster->fd, "IDENTIFY %d", shard_id))
+    cluster_disconnect(cluster);
+}
+
+// defined at discord-internal.h
+void
+discord_cluster_release(struct discord_cluster *cluster, int shard_id, bool identified)
+{
+  if (-1 == cluster->fd) return; /* EARLY RETURN */
+
+  if (!cluster_send(&cluster->conf, cluster->fd, "%s %d", identified ? "IDENTIFIED" : "RELEASE", shard_id))
+    cluster_disconnect(cluster);
+}
+
+/* the stat's entry, added if missing, must be called with the lock held */
+static int
+cluster_get_stat(struct discord_cluster *cluster, const char name[])
+{
+  for (int i=0; i < cluster->amt_stats; ++i)
+    if (0 == strcmp(name, cluster->stats[i].name))
+      return i;
+
+  if (cluster->amt_stats == DISCORD_CLUSTER_MAX_STATS
+      || strlen(name) >= sizeof(cluster->stats->name)
+      || strpbrk(name, " \n"))
+  {
+    return -1;
+  }
+  int i = cluster->amt_stats++;
+  memset(&cluster->stats[i], 0, sizeof(cluster->stats[i]));
+  strcpy(cluster->stats[i].name, name);
+  return i;
+}
+
+// defined at discord-internal.h
+bool
+discord_cluster_perform(struct discord_cluster *cluster, void (*on_go)(void *data, int shard_id), void *data)
+{
+  if (-1 == cluster->fd) return false; /* EARLY RETURN */
+
+  bool is_alive = cluster_read(cluster->fd, cluster->recv.buf, sizeof(cluster->recv.buf), &cluster->recv.len);
+
+  char line[DISCORD_CLUSTER_LINE_LEN], name[32];
+  int shard_id;
+  long total;
+  while (cluster_next_line(cluster->recv.buf, &cluster->recv.len, line, sizeof(line))) {
+    logconf_trace(&cluster->conf, "RCV %s", line);
+    if (1 == sscanf(line, "GO %d", &shard_id)) {
+      (*on_go)(data, shard_id);
+    }
+    else if (2 == sscanf(line, "TOTAL %31s %ld", name, &total)) {
+      pthread_mutex_lock(&cluster->lock);
+      int i = cluster_get_stat(cluster, name);
+      if (i != -1)
+        cluster->stats[i].total = total;
+      pthread_mutex_unlock(&cluster->lock);
+    }
+    else {
+      logconf_warn(&cluster->conf, "Unexpected message from the cluster coordinator: %s", line);
+    }
+  }
+  if (!is_alive || -1 == cluster->fd) {
+    logconf_error(&cluster->conf, "Lost the cluster coordinator");
+    if (cluster->fd != -1)
+      cluster_disconnect(cluster);
+    return false; /* EARLY RETURN */
+  }
+
+  // send the stats updated since the last call
+  pthread_mutex_lock(&cluster->lock);
+  for (int i=0; i < cluster->amt_stats; ++i) {
+    if (!cluster->stats[i].is_dirty) continue;
+    cluster->stats[i].is_dirty = false;
+    if (!cluster_send(&cluster->conf, cluster->fd, "STAT %s %ld", cluster->stats[i].name, cluster->stats[i].value)) {
+      cluster_disconnect(cluster);
+      break; /* EARLY BREAK */
+    }
+  }
+  pthread_mutex_unlock(&cluster->lock);
+
+  return cluster->fd != -1;
+}
+
+ORCAcode
+discord_cluster_set_stat(struct discord *client, const char name[], long value)
+{
+  struct discord_cluster *cluster = client->shards.cluster;
+  if (!cluster) return ORCA_MISSING_PARAMETER;
+
+  pthread_mutex_lock(&cluster->lock);
+  int i = cluster_get_stat(cluster, name);
+  if (i != -1 && value != cluster->stats[i].value) {
+    cluster->stats[i].value = value;
+    cluster->stats[i].is_dirty = true;
+  }
+  pthread_mutex_unlock(&cluster->lock);
+
+  return (i != -1) ? ORCA_OK : ORCA_BAD_PARAMETER;
+}
+
+ORCAcode
+discord_cluster_get_stat(struct discord *client, const char name[], long *p_total)
+{
+  struct discord_cluster *cluster = client->shards.cluster;
+  if (!cluster) return ORCA_MISSING_PARAMETER;
+
+  ORCAcode code = ORCA_BAD_PARAMETER;
+  pthread_mutex_lock(&cluster->lock);
+  for (int i=0; i < cluster->amt_stats; ++i) {
+    if (0 == strcmp(name, cluster->stats[i].name)) {
+      *p_total = cluster->stats[i].total;
+      code = ORCA_OK;
+      break; /* EARLY BREAK */
+    }
+  }
+  pthread_mutex_unlock(&cluster->lock);
+
+  return code;
+}
+
+
+/* * * * * * * * * * * * * * * * * * * */
+/* * * * * CLUSTER COORDINATOR * * * * */
+
+struct cluster_worker {
+  int fd;
+  int range; ///< the shard range assigned, -1 if none
+  struct {
+    char buf[4096];
+    size_t len;
+  } recv;
+  struct {
+    char name[32];
+    long value;
+  } stats[DISCORD_CLUSTER_MAX_STATS];
+  int amt_stats;
+};
+
+struct cluster_coordinator {
+  struct logconf conf;
+  char *url;           ///< the Gateway URL handed to the workers
+  int total;           ///< total amount of shards
+  int listen_fd;
+
+  struct cluster_worker **workers; ///< the connected workers
+  int amt_workers;
+
+  struct {
+    bool is_taken;     ///< assigned to a connected worker
+    bool has_left;     ///< its worker said BYE
+  } *ranges;
+  int amt_ranges;
+
+  struct {
+    int fd;            ///< the worker asking
+    int shard_id;
+  } *queue;            ///< the IDENTIFY requests, in order of arrival
+  int amt_queue;
+
+  struct {
+    u64_unix_ms_t tstamp; ///< when the bucket may IDENTIFY next
+    int fd;               ///< the worker holding the bucket, -1 if none
+    int shard_id;
+  } *buckets;          ///< the max_concurrency buckets, shard id % amt_buckets
+  int amt_buckets;
+};
+
+static void
+coordinator_range(struct cluster_coordinator *coord, int range, int *p_first_id, int *p_amt)
+{
+  *p_first_id = range * coord->total / coord->amt_ranges;
+  *p_amt = (range + 1) * coord->total / coord->amt_ranges - *p_first_id;
+}
+
+static void
+coordinator_broadcast_stat(struct cluster_coordinator *coord, const char name[])
+{
+  long total = 0;
+  for (int i=0; i < coord->amt_workers; ++i) {
+    struct cluster_worker *worker = coord->workers[i];
+    for (int j=0; j < worker->amt_stats; ++j)
+      if (0 == strcmp(name, worker->stats[j].name))
+        total += worker->stats[j].value;
+  }
+  for (int i=0; i < coord->amt_workers; ++i)
+    if (coord->workers[i]->range != -1)
+      cluster_send(&coord->conf, coord->workers[i]->fd, "TOTAL %s %ld", name, total);
+}
+
+/* drop the requests and turns to IDENTIFY of a worker's shard, or of
+ *  every shard of the worker if shard_id is -1 */
+static void
+coordinator_release(struct cluster_coordinator *coord, int fd, int shard_id, bool identified)
+{
+  int j=0;
+  for (int i=0; i < coord->amt_queue; ++i)
+    if (coord->queue[i].fd != fd || (shard_id != -1 && coord->queue[i].shard_id != shard_id))
+      coord->queue[j++] = coord->queue[i];
+  coord->amt_queue = j;
+
+  for (int i=0; i < coord->amt_buckets; ++i) {
+    if (coord->buckets[i].fd != fd) continue;
+    if (shard_id != -1 && coord->buckets[i].shard_id != shard_id) continue;
+    coord->buckets[i].fd = -1;
+    if (identified)
+      coord->buckets[i].tstamp = cee_timestamp_ms() + DISCORD_SHARD_IDENTIFY_INTERVAL_MS;
+  }
+}
+
+static void
+coordinator_drop_worker(struct cluster_coordinator *coord, int i)
+{
+  struct cluster_worker *worker = coord->workers[i];
+  coord->workers[i] = coord->workers[--coord->amt_workers];
+
+  if (worker->range != -1) {
+    int first_id, amt;
+    coordinator_range(coord, worker->range, &first_id, &amt);
+    if (coord->ranges[worker->range].has_left) {
+      logconf_info(&coord->conf, "Worker of shards %d to %d left", first_id, first_id + amt - 1);
+    }
+    else {
+      logconf_error(&coord->conf, "Lost the worker of shards %d to %d, waiting for another worker",
+          first_id, first_id + amt - 1);
+      coord->ranges[worker->range].is_taken = false;
+    }
+  }
+  // the worker may have sent IDENTIFY right before going away
+  coordinator_release(coord, worker->fd, -1, true);
+  close(worker->fd);
+
+  for (int j=0; j < worker->amt_stats; ++j)
+    coordinator_broadcast_stat(coord, worker->stats[j].name);
+  free(worker);
+}
+
+/* handle a worker's line, false if the worker must be dropped */
+static bool
+coordinator_on_line(struct cluster_coordinator *coord, struct cluster_worker *worker, const char line[])
+{
+  char name[32];
+  int shard_id, first_id, amt;
+  long value;
+
+  logconf_trace(&coord->conf, "RCV %s", line);
+  if (0 == strcmp(line, "HELLO")) {
+    if (worker->range != -1) return true; /* EARLY RETURN */
+
+    for (int i=0; i < coord->amt_ranges; ++i) {
+      if (coord->ranges[i].is_taken || coord->ranges[i].has_left) continue;
+      coord->ranges[i].is_taken = true;
+      worker->range = i;
+      coordinator_range(coord, i, &first_id, &amt);
+      logconf_info(&coord->conf, "Assigning shards %d to %d to a worker", first_id, first_id + amt - 1);
+      return cluster_send(&coord->conf, worker->fd, "SHARDS %d %d %d %d %s",
+               first_id, amt, coord->total, coord->amt_buckets, coord->url);
+    }
+    logconf_warn(&coord->conf, "Refusing a worker, every shard range is taken");
+    cluster_send(&coord->conf, worker->fd, "FULL");
+    return false;
+  }
+  if (worker->range == -1) {
+    logconf_error(&coord->conf, "Unexpected message from a worker: %s", line);
+    return false;
+  }
+  if (1 == sscanf(line, "IDENTIFY %d", &shard_id)) {
+    coordinator_range(coord, worker->range, &first_id, &amt);
+    if (shard_id < first_id || shard_id >= first_id + amt) {
+      logconf_error(&coord->conf, "Shard %d isn't ran by the worker", shard_id);
+      return false;
+    }
+    for (int i=0; i < coord->amt_queue; ++i) {
+      if (shard_id == coord->queue[i].shard_id) {
+        logconf_error(&coord->conf, "Shard %d is already waiting to IDENTIFY", shard_id);
+        return false;
+      }
+    }
+    coord->queue[coord->amt_queue].fd = worker->fd;
+    coord->queue[coord->amt_queue].shard_id = shard_id;
+    ++coord->amt_queue;
+    return true;
+  }
+  if (1 == sscanf(line, "IDENTIFIED %d", &shard_id)) {
+    coordinator_release(coord, worker->fd, shard_id, true);
+    return true;
+  }
+  if (1 == sscanf(line, "RELEASE %d", &shard_id)) {
+    coordinator_release(coord, worker->fd, shard_id, false);
+    return true;
+  }
+  if (2 == sscanf(line, "STAT %31s %ld", name, &value)) {
+    int i;
+    for (i=0; i < worker->amt_stats; ++i)
+      if (0 == strcmp(name, worker->stats[i].name))
+        break;
+    if (i == worker->amt_stats) {
+      if (worker->amt_stats == DISCORD_CLUSTER_MAX_STATS) return true; /* EARLY RETURN */
+      snprintf(worker->stats[i].name, sizeof(worker->stats[i].name), "%s", name);
+      ++worker->amt_stats;
+    }
+    worker->stats[i].value = value;
+    coordinator_broadcast_stat(coord, name);
+    return true;
+  }
+  if (0 == strcmp(line, "BYE")) {
+    coord->ranges[worker->range].has_left = true;
+    return false;
+  }
+  logconf_error(&coord->conf, "Unexpected message from a worker: %s", line);
+  return false;
+}
+
+/* grant the queued requests whose bucket is free, and return how long
+ *  until the next request may be granted */
+static int
+coordinator_schedule(struct cluster_coordinator *coord)
+{
+  u64_unix_ms_t now = cee_timestamp_ms();
+  int wait_ms = DISCORD_CLUSTER_MAX_WAIT_MS;
+
+  int j=0;
+  for (int i=0; i < coord->amt_queue; ++i) {
+    int bucket = coord->queue[i].shard_id % coord->amt_buckets;
+    if (coord->buckets[bucket].fd != -1) { // wait for the holder's IDENTIFY
+      coord->queue[j++] = coord->queue[i];
+      continue;
+    }
+    if (now < coord->buckets[bucket].tstamp) {
+      if (coord->buckets[bucket].tstamp - now < (u64_unix_ms_t)wait_ms)
+        wait_ms = coord->buckets[bucket].tstamp - now;
+      coord->queue[j++] = coord->queue[i];
+      continue;
+    }
+    coord->buckets[bucket].fd = coord->queue[i].fd;
+    coord->buckets[bucket].shard_id = coord->queue[i].shard_id;
+    logconf_info(&coord->conf, "Shard %d may IDENTIFY", coord->queue[i].shard_id);
+    cluster_send(&coord->conf, coord->queue[i].fd, "GO %d", coord->queue[i].shard_id);
+  }
+  coord->amt_queue = j;
+
+  return wait_ms;
+}
+
+static bool
+coordinator_is_running(struct cluster_coordinator *coord)
+{
+  for (int i=0; i < coord->amt_ranges; ++i)
+    if (!coord->ranges[i].has_left)
+      return true;
+  return false;
+}
+
+/* fill the missing configuration from /gateway/bot */
+static ORCAcode
+coordinator_get_config(struct discord *client, struct discord_cluster_config *config, struct cluster_coordinator *coord)
+{
+  coord->total = config->total_shards;
+  coord->amt_buckets = config->max_concurrency;
+  if (config->gateway_url)
+    coord->url = strdup(config->gateway_url);
+  if (coord->url && coord->total && coord->amt_buckets)
+    return ORCA_OK; /* EARLY RETURN */
+
+  struct sized_buffer json={0};
+  if (discord_get_gateway_bot(client, &json)) {
+    logconf_fatal(&coord->conf, "Couldn't retrieve Gateway Bot information");
+    return ORCA_DISCORD_BAD_AUTH;
+  }
+
+  char *url=NULL;
+  int shards=0;
+  struct discord_session_start_limit start_limit={0};
+  json_extract(json.start, json.size,
+    "(url):?s,(shards):d,(session_start_limit):F",
+    &url,
+    &shards,
+    &discord_session_start_limit_from_json,
+    &(struct discord_session_start_limit*){&start_limit});
+  free(json.start);
+
+  if (!coord->url)
+    coord->url = url;
+  else if (url)
+    free(url);
+  if (!coord->total)
+    coord->total = shards;
+  if (!coord->amt_buckets)
+    coord->amt_buckets = start_limit.max_concurrency;
+
+  if (start_limit.remaining < coord->total) {
+    logconf_warn(&coord->conf, "Only %d sessions may start until the limit resets in %d seconds",
+        start_limit.remaining, start_limit.reset_after/1000);
+  }
+  return ORCA_OK;
+}
+
+ORCAcode
+discord_cluster_coordinate(struct discord *client, struct discord_cluster_config *config)
+{
+  struct cluster_coordinator coord = { .listen_fd = -1 };
+  logconf_branch(&coord.conf, client->conf, "DISCORD_CLUSTER");
+
+  struct sockaddr_un addr;
+  if (!cluster_get_addr(&coord.conf, config->socket_path, &addr))
+    return ORCA_BAD_PARAMETER;
+
+  ORCAcode code = coordinator_get_config(client, config, &coord);
+  if (ORCA_OK == code && !coord.url) {
+    logconf_fatal(&coord.conf, "Missing the Gateway URL");
+    code = ORCA_MISSING_PARAMETER;
+  }
+  if (coord.total < 1)
+    coord.total = 1;
+  if (coord.amt_buckets < 1)
+    coord.amt_buckets = 1;
+  coord.amt_ranges = config->amt_workers;
+  if (ORCA_OK == code && (coord.amt_ranges < 1 || coord.amt_ranges > coord.total)) {
+    logconf_fatal(&coord.conf, "Can't split %d shards between %d workers", coord.total, coord.amt_ranges);
+    code = ORCA_BAD_PARAMETER;
+  }
+  if (code != ORCA_OK) {
+    if (coord.url)
+      free(coord.url);
+    return code; /* EARLY RETURN */
+  }
+
+  coord.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  VASSERT_S(coord.listen_fd != -1, "Couldn't create socket: %s", strerror(errno));
+  unlink(addr.sun_path); // left by a previous coordinator
+  if (bind(coord.listen_fd, (struct sockaddr*)&addr, sizeof(addr))
+      || listen(coord.listen_fd, coord.amt_ranges))
+  {
+    logconf_fatal(&coord.conf, "Couldn't listen at '%s': %s", addr.sun_path, strerror(errno));
+    close(coord.listen_fd);
+    free(coord.url);
+    return ORCA_BAD_PARAMETER;
+  }
+  cluster_set_nonblock(coord.listen_fd);
+
+  coord.ranges = calloc(coord.amt_ranges, sizeof *coord.ranges);
+  coord.queue = calloc(coord.total, sizeof *coord.queue);
+  coord.buckets = calloc(coord.amt_buckets, sizeof *coord.buckets);
+  for (int i=0; i < coord.amt_buckets; ++i)
+    coord.buckets[i].fd = -1;
+
+  logconf_info(&coord.conf, "Coordinating %d shards between %d workers at '%s' (max_concurrency: %d)",
+      coord.total, coord.amt_ranges, addr.sun_path, coord.amt_buckets);
+
+  struct pollfd *pfds = NULL;
+  while (coordinator_is_running(&coord)) {
+    int wait_ms = coordinator_schedule(&coord);
+
+    pfds = realloc(pfds, (1 + coord.amt_workers) * sizeof *pfds);
+    pfds[0] = (struct pollfd){ .fd = coord.listen_fd, .events = POLLIN };
+    for (int i=0; i < coord.amt_workers; ++i)
+      pfds[1+i] = (struct pollfd){ .fd = coord.workers[i]->fd, .events = POLLIN };
+    int amt_pfds = 1 + coord.amt_workers;
+
+    if (poll(pfds, amt_pfds, wait_ms) < 0) {
+      VASSERT_S(EINTR == errno, "poll() failed: %s", strerror(errno));
+      continue;
+    }
+
+    // the workers are dropped in reverse, so the pfds' indexes still match
+    for (int i=amt_pfds-2; i >= 0; --i) {
+      if (!pfds[1+i].revents) continue;
+      struct cluster_worker *worker = coord.workers[i];
+
+      // the lines received before the worker closed are handled first (i.e. BYE)
+      bool is_alive = cluster_read(worker->fd, worker->recv.buf, sizeof(worker->recv.buf), &worker->recv.len);
+      char line[DISCORD_CLUSTER_LINE_LEN];
+      while (cluster_next_line(worker->recv.buf, &worker->recv.len, line, sizeof(line))) {
+        if (!coordinator_on_line(&coord, worker, line)) {
+          is_alive = false;
+          break; /* EARLY BREAK */
+        }
+      }
+      if (!is_alive)
+        coordinator_drop_worker(&coord, i);
+    }
+
+    if (pfds[0].revents) {
+      int fd;
+      while ((fd = accept(coord.listen_fd, NULL, NULL)) != -1) {
+        cluster_set_nonblock(fd);
+        struct cluster_worker *worker = calloc(1, sizeof *worker);
+        worker->fd = fd;
+        worker->range = -1;
+        coord.workers = realloc(coord.workers, (1 + coord.amt_workers) * sizeof *coord.workers);
+        coord.workers[coord.amt_workers++] = worker;
+      }
+    }
+  }
+  logconf_info(&coord.conf, "Every worker left, stopping the coordinator");
+
+  while (coord.amt_workers)
+    coordinator_drop_worker(&coord, coord.amt_workers - 1);
+  close(coord.listen_fd);
+  unlink(addr.sun_path);
+  free(pfds);
+  free(coord.workers);
+  free(coord.ranges);
+  free(coord.queue);
+  free(coord.buckets);
+  free(coord.url);
+
+  return ORCA_OK;
+}
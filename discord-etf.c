@@ -0,0 +1,324 @@
+/* See:
+https://discord.com/developers/docs/topics/gateway#encoding-and-compression */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "discord.h"
+#include "discord-internal.h"
+#include "etf.h"
+
+#include "cee-utils.h"
+
+/* scratch buffer for the fields decoded through JSON */
+struct etf_cxt {
+  char *json;
+  size_t size;
+};
+
+/* read a scalar value, a container is skipped whole and read as
+ *  ETF_UNDEFINED */
+static bool
+etf_read_scalar(struct etf_reader *reader, struct etf_term *value)
+{
+  struct etf_reader tmp = *reader;
+  if (!etf_read(&tmp, value)) return false; /* EARLY RETURN */
+
+  switch (value->type) {
+  case ETF_LIST:
+  case ETF_TUPLE:
+  case ETF_MAP:
+      value->type = ETF_UNDEFINED;
+      return etf_skip(reader);
+  default:
+      *reader = tmp;
+      return true;
+  }
+}
+
+static int64_t
+etf_int(const struct etf_term *term) {
+  return (ETF_INTEGER == term->type || ETF_BIG == term->type) ? term->value.integer : 0;
+}
+
+static bool
+etf_bool(const struct etf_term *term) {
+  return ETF_BOOLEAN == term->type && term->value.boolean;
+}
+
+static void
+etf_strcpy(const struct etf_term *term, char dest[], size_t size)
+{
+  if (ETF_STRING != term->type) return; /* EARLY RETURN */
+  size_t len = (term->value.str.size < size - 1) ? term->value.str.size : size - 1;
+  memcpy(dest, term->value.str.start, len);
+  dest[len] = '\0';
+}
+
+static char*
+etf_strdup(const struct etf_term *term)
+{
+  char num[32];
+  switch (term->type) {
+  case ETF_STRING:
+      return strndup(term->value.str.start, term->value.str.size);
+  case ETF_INTEGER: // ex: a nonce sent as an integer
+      snprintf(num, sizeof(num), "%"PRId64, term->value.integer);
+      return strdup(num);
+  case ETF_BIG:
+      snprintf(num, sizeof(num), "%s%"PRIu64, term->is_negative ? "-" : "", term->big);
+      return strdup(num);
+  default:
+      return NULL;
+  }
+}
+
+static void
+etf_timestamp(const struct etf_term *term, u64_unix_ms_t *p_tstamp)
+{
+  if (ETF_STRING != term->type) return; /* EARLY RETURN */
+  cee_iso8601_to_unix_ms((char*)term->value.str.start, term->value.str.size, p_tstamp);
+}
+
+/* fields without a native decoder are transcoded to JSON, and given to
+ *  their generated JSON decoder */
+static bool
+etf_from_json_cb(struct etf_reader *reader, struct etf_cxt *cxt, void (*from_json)(char*, size_t, void*), void *p_field)
+{
+  struct etf_reader tmp = *reader;
+  struct etf_term term;
+  if (!etf_read(&tmp, &term)) return false; /* EARLY RETURN */
+  if (ETF_NULL == term.type) {
+    *reader = tmp;
+    return true; /* EARLY RETURN */
+  }
+
+  size_t len = etf_to_json(reader, &cxt->json, &cxt->size);
+  if (!len) return false; /* EARLY RETURN */
+  (*from_json)(cxt->json, len, p_field);
+  return true;
+}
+
+static bool
+u64_list_from_etf(struct etf_reader *reader, ja_u64 ***p_list)
+{
+  struct etf_reader tmp = *reader;
+  struct etf_term term;
+  if (!etf_read(&tmp, &term)) return false; /* EARLY RETURN */
+  if (ETF_LIST != term.type) return etf_skip(reader); /* EARLY RETURN */
+  // each element takes at least a byte, don't trust a bogus count
+  if (term.value.amt > tmp.len - tmp.pos) return false; /* EARLY RETURN */
+  *reader = tmp;
+
+  *p_list = ntl_calloc(term.value.amt, sizeof(ja_u64));
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term elem;
+    if (!etf_read_scalar(reader, &elem)) return false;
+    (*p_list)[i]->value = etf_term_u64(&elem);
+  }
+  return term.value.amt ? etf_read_tail(reader) : true;
+}
+
+/* read the header of an object's map, NULL objects are skipped */
+static bool
+etf_read_object(struct etf_reader *reader, struct etf_term *term)
+{
+  struct etf_reader tmp = *reader;
+  if (!etf_read(&tmp, term)) return false; /* EARLY RETURN */
+  if (ETF_MAP != term->type) {
+    term->value.amt = 0;
+    return etf_skip(reader); /* EARLY RETURN */
+  }
+  *reader = tmp;
+  return true;
+}
+
+static bool
+user_from_etf(struct etf_reader *reader, struct discord_user **pp)
+{
+  struct etf_term term;
+  if (!etf_read_object(reader, &term)) return false; /* EARLY RETURN */
+  if (ETF_MAP != term.type) return true; /* EARLY RETURN */
+
+  if (!*pp) *pp = malloc(sizeof **pp);
+  struct discord_user *p = *pp;
+  discord_user_init(p);
+
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term key, value;
+    if (!etf_read(reader, &key) || !etf_read_scalar(reader, &value))
+      return false;
+
+    if (etf_term_eq(&key, "id"))
+      p->id = etf_term_u64(&value);
+    else if (etf_term_eq(&key, "username"))
+      etf_strcpy(&value, p->username, sizeof(p->username));
+    else if (etf_term_eq(&key, "discriminator"))
+      etf_strcpy(&value, p->discriminator, sizeof(p->discriminator));
+    else if (etf_term_eq(&key, "avatar"))
+      etf_strcpy(&value, p->avatar, sizeof(p->avatar));
+    else if (etf_term_eq(&key, "bot"))
+      p->bot = etf_bool(&value);
+    else if (etf_term_eq(&key, "system"))
+      p->System = etf_bool(&value);
+    else if (etf_term_eq(&key, "mfa_enabled"))
+      p->mfa_enabled = etf_bool(&value);
+    else if (etf_term_eq(&key, "locale"))
+      etf_strcpy(&value, p->locale, sizeof(p->locale));
+    else if (etf_term_eq(&key, "verified"))
+      p->verified = etf_bool(&value);
+    else if (etf_term_eq(&key, "email"))
+      etf_strcpy(&value, p->email, sizeof(p->email));
+    else if (etf_term_eq(&key, "flags"))
+      p->flags = etf_int(&value);
+    else if (etf_term_eq(&key, "premium_type"))
+      p->premium_type = etf_int(&value);
+    else if (etf_term_eq(&key, "public_flags"))
+      p->public_flags = etf_int(&value);
+  }
+  return true;
+}
+
+static bool
+guild_member_from_etf(struct etf_reader *reader, struct discord_guild_member **pp)
+{
+  struct etf_term term;
+  if (!etf_read_object(reader, &term)) return false; /* EARLY RETURN */
+  if (ETF_MAP != term.type) return true; /* EARLY RETURN */
+
+  if (!*pp) *pp = malloc(sizeof **pp);
+  struct discord_guild_member *p = *pp;
+  discord_guild_member_init(p);
+
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term key, value;
+    if (!etf_read(reader, &key)) return false;
+
+    bool ok;
+    if (etf_term_eq(&key, "user"))
+      ok = user_from_etf(reader, &p->user);
+    else if (etf_term_eq(&key, "roles"))
+      ok = u64_list_from_etf(reader, &p->roles);
+    else if ((ok = etf_read_scalar(reader, &value))) {
+      if (etf_term_eq(&key, "nick"))
+        etf_strcpy(&value, p->nick, sizeof(p->nick));
+      else if (etf_term_eq(&key, "joined_at"))
+        etf_timestamp(&value, &p->joined_at);
+      else if (etf_term_eq(&key, "premium_since"))
+        etf_timestamp(&value, &p->premium_since);
+      else if (etf_term_eq(&key, "deaf"))
+        p->deaf = etf_bool(&value);
+      else if (etf_term_eq(&key, "mute"))
+        p->mute = etf_bool(&value);
+      else if (etf_term_eq(&key, "pending"))
+        p->pending = etf_bool(&value);
+      else if (etf_term_eq(&key, "permissions"))
+        p->permissions = etf_strdup(&value);
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+static bool
+message_from_etf(struct etf_reader *reader, struct etf_cxt *cxt, struct discord_message **pp)
+{
+  struct etf_term term;
+  if (!etf_read_object(reader, &term)) return false; /* EARLY RETURN */
+  if (ETF_MAP != term.type) return true; /* EARLY RETURN */
+
+  if (!*pp) *pp = malloc(sizeof **pp);
+  struct discord_message *p = *pp;
+  discord_message_init(p);
+
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term key, value;
+    if (!etf_read(reader, &key)) return false;
+
+    bool ok;
+    if (etf_term_eq(&key, "author"))
+      ok = user_from_etf(reader, &p->author);
+    else if (etf_term_eq(&key, "member"))
+      ok = guild_member_from_etf(reader, &p->member);
+    else if (etf_term_eq(&key, "mention_roles"))
+      ok = u64_list_from_etf(reader, &p->mention_roles);
+    else if (etf_term_eq(&key, "referenced_message"))
+      ok = message_from_etf(reader, cxt, &p->referenced_message);
+    else if (etf_term_eq(&key, "mentions"))
+      ok = etf_from_json_cb(reader, cxt, &discord_user_list_from_json_v, &p->mentions);
+    else if (etf_term_eq(&key, "mention_channels"))
+      ok = etf_from_json_cb(reader, cxt, &discord_channel_mention_list_from_json_v, &p->mention_channels);
+    else if (etf_term_eq(&key, "attachments"))
+      ok = etf_from_json_cb(reader, cxt, &discord_attachment_list_from_json_v, &p->attachments);
+    else if (etf_term_eq(&key, "embeds"))
+      ok = etf_from_json_cb(reader, cxt, &discord_embed_list_from_json_v, &p->embeds);
+    else if (etf_term_eq(&key, "reactions"))
+      ok = etf_from_json_cb(reader, cxt, &discord_reaction_list_from_json_v, &p->reactions);
+    else if (etf_term_eq(&key, "activity"))
+      ok = etf_from_json_cb(reader, cxt, &discord_message_activity_from_json_v, &p->activity);
+    else if (etf_term_eq(&key, "application"))
+      ok = etf_from_json_cb(reader, cxt, &discord_message_application_list_from_json_v, &p->application);
+    else if (etf_term_eq(&key, "message_reference"))
+      ok = etf_from_json_cb(reader, cxt, &discord_message_reference_from_json_v, &p->message_reference);
+    else if (etf_term_eq(&key, "interaction"))
+      ok = etf_from_json_cb(reader, cxt, &discord_message_interaction_from_json_v, &p->interaction);
+    else if (etf_term_eq(&key, "thread"))
+      ok = etf_from_json_cb(reader, cxt, &discord_channel_from_json_v, &p->thread);
+    else if (etf_term_eq(&key, "components"))
+      ok = etf_from_json_cb(reader, cxt, &discord_component_list_from_json_v, &p->components);
+    else if (etf_term_eq(&key, "sticker_items"))
+      ok = etf_from_json_cb(reader, cxt, &discord_message_sticker_list_from_json_v, &p->sticker_items);
+    else if (etf_term_eq(&key, "stickers"))
+      ok = etf_from_json_cb(reader, cxt, &discord_message_sticker_list_from_json_v, &p->stickers);
+    else if ((ok = etf_read_scalar(reader, &value))) {
+      if (etf_term_eq(&key, "id"))
+        p->id = etf_term_u64(&value);
+      else if (etf_term_eq(&key, "channel_id"))
+        p->channel_id = etf_term_u64(&value);
+      else if (etf_term_eq(&key, "guild_id"))
+        p->guild_id = etf_term_u64(&value);
+      else if (etf_term_eq(&key, "content"))
+        p->content = etf_strdup(&value);
+      else if (etf_term_eq(&key, "timestamp"))
+        etf_timestamp(&value, &p->timestamp);
+      else if (etf_term_eq(&key, "edited_timestamp"))
+        etf_timestamp(&value, &p->edited_timestamp);
+      else if (etf_term_eq(&key, "tts"))
+        p->tts = etf_bool(&value);
+      else if (etf_term_eq(&key, "mention_everyone"))
+        p->mention_everyone = etf_bool(&value);
+      else if (etf_term_eq(&key, "nonce"))
+        p->nonce = etf_strdup(&value);
+      else if (etf_term_eq(&key, "pinned"))
+        p->pinned = etf_bool(&value);
+      else if (etf_term_eq(&key, "webhook_id"))
+        p->webhook_id = etf_term_u64(&value);
+      else if (etf_term_eq(&key, "type"))
+        p->type = etf_int(&value);
+      else if (etf_term_eq(&key, "flags"))
+        p->flags = etf_int(&value);
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+void
+discord_guild_member_from_etf(char etf[], size_t len, struct discord_guild_member **pp)
+{
+  struct etf_reader reader = { .buf = etf, .len = len };
+  if (!guild_member_from_etf(&reader, pp))
+    log_error("Couldn't decode guild member from ETF");
+}
+
+void
+discord_message_from_etf(char etf[], size_t len, struct discord_message **pp)
+{
+  struct etf_reader reader = { .buf = etf, .len = len };
+  struct etf_cxt cxt={0};
+  if (!message_from_etf(&reader, &cxt, pp))
+    log_error("Couldn't decode message from ETF");
+  if (cxt.json)
+    free(cxt.json);
+}
@@ -4,12 +4,19 @@
 #include <string.h>
 #include <stddef.h> /* offsetof() */
 #include <ctype.h> /* isspace() */
+#include <zlib.h>
 
 #include "discord.h"
 #include "discord-internal.h"
+#include "etf.h"
 
 #include "cee-utils.h"
 
+// longest wait for Gateway activity, the event loop otherwise sleeps until timers are due
+#define DISCORD_GATEWAY_MAX_WAIT_MS 1000
+// interval between checks for queued shards that may connect
+#define DISCORD_SHARD_SCHEDULE_MS 100
+
 // get client from gw pointer
 #define _CLIENT(p_gw) (struct discord*)((int8_t*)(p_gw) - offsetof(struct discord, gw))
 
@@ -102,11 +109,45 @@ send_resume(struct discord_gateway *gw)
   ASSERT_S(ret < sizeof(payload), "Out of bounds write attempt");
 
   struct ws_info info={0};
-  ws_send_text(gw->ws, &info, payload, ret);
+  discord_gateway_send(gw, &info, payload, ret);
 
   logconf_info(&gw->conf, ANSICOLOR("SEND", ANSI_FG_BRIGHT_GREEN)" RESUME (%d bytes) [@@@_%zu_@@@]", ret, info.loginfo.counter);
 }
 
+/* the IDENTIFY payload's 'd', with the shard array of a sharded session */
+static size_t
+identify_to_json(char *json, size_t len, void *p_gw)
+{
+  struct discord_gateway *gw = p_gw;
+  size_t ret = discord_identify_to_json(json, len, &gw->id);
+  if (!gw->shard.total) return ret; /* EARLY RETURN */
+
+  // replace the object's closing bracket with the shard array
+  char shard[64];
+  int n = snprintf(shard, sizeof(shard), ",\"shard\":[%d,%d]}", gw->shard.id, gw->shard.total);
+  if (!ret) return 0; /* EARLY RETURN */
+  if (ret - 1 + n < len)
+    memcpy(json + ret - 1, shard, n + 1);
+  return ret - 1 + n;
+}
+
+/* give back the shard's max_concurrency bucket, held from its start by
+ *  on_shards_timer() until its IDENTIFY */
+static void
+shards_release(struct discord_gateway *gw, bool identified)
+{
+  struct discord_shards *shards = gw->shard.shards;
+  int bucket = gw->shard.id % shards->amt_buckets;
+
+  if (identified)
+    shards->buckets[bucket].tstamp = gw->session.identify_tstamp + DISCORD_SHARD_IDENTIFY_INTERVAL_MS;
+  if (shards->buckets[bucket].holder != gw) return; /* EARLY RETURN */
+
+  shards->buckets[bucket].holder = NULL;
+  if (shards->cluster)
+    discord_cluster_release(shards->cluster, gw->shard.id, identified);
+}
+
 static void
 send_identify(struct discord_gateway *gw)
 {
@@ -124,27 +165,53 @@ send_identify(struct discord_gateway *gw)
   size_t ret = json_inject(payload, sizeof(payload), 
                 "(op):2" // IDENTIFY OPCODE
                 "(d):F",
-                &discord_identify_to_json_v, &gw->id);
+                &identify_to_json, gw);
   ASSERT_S(ret < sizeof(payload), "Out of bounds write attempt");
 
   struct ws_info info={0};
-  ws_send_text(gw->ws, &info, payload, ret);
+  discord_gateway_send(gw, &info, payload, ret);
 
   logconf_info(&gw->conf, ANSICOLOR("SEND", ANSI_FG_BRIGHT_GREEN)" IDENTIFY (%d bytes) [@@@_%zu_@@@]", ret, info.loginfo.counter);
   
   //get timestamp for this identify
   gw->session.identify_tstamp = ws_timestamp(gw->ws);
+
+  if (gw->shard.shards) // the shard's bucket is free again once the interval elapses
+    shards_release(gw, true);
+}
+
+static void send_heartbeat(struct discord_gateway *gw);
+
+/* heartbeat timer, pulses once the session is ready */
+static void
+on_heartbeat_timer(struct websockets *ws, void *p_gw)
+{
+  struct discord_gateway *gw = p_gw;
+  if (!gw->status->is_ready) return; /* EARLY RETURN */
+
+  send_heartbeat(gw);
+  gw->hbeat->tstamp = ws_timestamp(gw->ws); //update heartbeat timestamp
 }
 
 static void
 on_hello(struct discord_gateway *gw)
 {
+  if (gw->status->shutdown) { // shutdown while connecting
+    ws_close(gw->ws, WS_CLOSE_REASON_NORMAL, "", 0);
+    return; /* EARLY RETURN */
+  }
+
   gw->hbeat->interval_ms = 0;
   gw->hbeat->tstamp = cee_timestamp_ms();
 
   json_extract(gw->payload->event_data.start, gw->payload->event_data.size,
              "(heartbeat_interval):ld", &gw->hbeat->interval_ms);
 
+  if (gw->hbeat->timer_id)
+    ws_timer_cancel(gw->ws, gw->hbeat->timer_id);
+  gw->hbeat->timer_id = ws_timer_add(gw->ws, gw->hbeat->interval_ms, 
+                          gw->hbeat->interval_ms, &on_heartbeat_timer, gw);
+
   if (gw->status->is_resumable)
     send_resume(gw);
   else
@@ -266,10 +333,19 @@ static void
 on_guild_member_add(struct discord_gateway *gw, struct sized_buffer *data)
 {
   struct discord_guild_member *member=NULL;
-  discord_guild_member_from_json(data->start, data->size, &member);
-
   u64_snowflake_t guild_id = 0;
-  json_extract(data->start, data->size, "(guild_id):s_as_u64", &guild_id);
+  if (!data->start) { // decode straight from ETF
+    discord_guild_member_from_etf(gw->etf->data.start, gw->etf->data.size, &member);
+
+    struct etf_reader reader = { .buf = gw->etf->data.start, .len = gw->etf->data.size };
+    struct etf_term term;
+    if (etf_map_find(&reader, "guild_id") && etf_read(&reader, &term))
+      guild_id = etf_term_u64(&term);
+  }
+  else {
+    discord_guild_member_from_json(data->start, data->size, &member);
+    json_extract(data->start, data->size, "(guild_id):s_as_u64", &guild_id);
+  }
 
   _ON(guild_member_add, guild_id, member);
 
@@ -483,7 +559,10 @@ static void
 on_message_create(struct discord_gateway *gw, struct sized_buffer *data)
 {
   struct discord_message *msg=NULL;
-  discord_message_from_json(data->start, data->size, &msg);
+  if (!data->start) // decode straight from ETF
+    discord_message_from_etf(gw->etf->data.start, gw->etf->data.size, &msg);
+  else
+    discord_message_from_json(data->start, data->size, &msg);
 
   if (gw->user_cmd->pool \
       && STRNEQ(gw->user_cmd->prefix.start, msg->content, gw->user_cmd->prefix.size)) 
@@ -533,7 +612,10 @@ static void
 on_message_update(struct discord_gateway *gw, struct sized_buffer *data)
 {
   struct discord_message *msg=NULL;
-  discord_message_from_json(data->start, data->size, &msg);
+  if (!data->start) // decode straight from ETF
+    discord_message_from_etf(gw->etf->data.start, gw->etf->data.size, &msg);
+  else
+    discord_message_from_json(data->start, data->size, &msg);
 
   if (gw->user_cmd->cbs.sb_on_message_update)
     (*gw->user_cmd->cbs.sb_on_message_update)(
@@ -707,6 +789,13 @@ on_ready(struct discord_gateway *gw, struct sized_buffer *data) {
   _ON(ready);
 }
 
+static void noop_idle_cb(struct discord *a, const struct discord_user *b)
+{ return; }
+static void noop_event_raw_cb(struct discord *a, enum discord_gateway_events b, struct sized_buffer *c, struct sized_buffer *d)
+{ return; }
+static enum discord_event_handling_mode noop_event_handler(struct discord *a, struct discord_user *b, struct sized_buffer *c, enum discord_gateway_events d)
+{ return DISCORD_EVENT_MAIN_THREAD; }
+
 static void*
 dispatch_run(void *p_cxt)
 {
@@ -750,6 +839,86 @@ dispatch_run(void *p_cxt)
   pthread_exit(NULL);
 }
 
+static int
+snowflake_cmp(const void *p_a, const void *p_b)
+{
+  u64_snowflake_t a = *(u64_snowflake_t*)p_a, b = *(u64_snowflake_t*)p_b;
+  return (a > b) - (a < b);
+}
+
+/* add or remove a guild from the sorted ids of the unavailable guilds,
+ *  return true if its availability changed */
+static bool
+set_guild_unavailable(struct discord_gateway *gw, u64_snowflake_t guild_id, bool unavailable)
+{
+  u64_snowflake_t *ids = gw->shard.unavailable;
+  int amt = gw->shard.amt_unavailable;
+  int i=0;
+  while (i < amt && ids[i] < guild_id) // the position it's at, or would be inserted at
+    ++i;
+
+  if (i < amt && ids[i] == guild_id) {
+    if (unavailable) return false; /* EARLY RETURN */
+    memmove(ids + i, ids + i + 1, (amt - i - 1) * sizeof *ids);
+    --gw->shard.amt_unavailable;
+  }
+  else {
+    if (!unavailable) return false; /* EARLY RETURN */
+    gw->shard.unavailable = ids = realloc(ids, (amt + 1) * sizeof *ids);
+    memmove(ids + i + 1, ids + i, (amt - i) * sizeof *ids);
+    ids[i] = guild_id;
+    ++gw->shard.amt_unavailable;
+  }
+  return true;
+}
+
+/*
+ * keep count of the session's guilds: READY lists them as unavailable, each
+ *  one is then received with GUILD_CREATE, as are the guilds joined later
+ */
+static void
+count_guilds(struct discord_gateway *gw, enum discord_gateway_events event)
+{
+  struct sized_buffer *data = &gw->payload->event_data;
+  u64_snowflake_t guild_id=0;
+  bool unavailable=false;
+
+  switch (event) {
+  case DISCORD_GATEWAY_EVENTS_READY: {
+      NTL_T(struct discord_guild) guilds=NULL;
+      json_extract(data->start, data->size, 
+          "(guilds):F", &discord_guild_list_from_json, &guilds);
+
+      int amt = guilds ? ntl_length((ntl_t)guilds) : 0;
+      gw->shard.unavailable = realloc(gw->shard.unavailable, (amt + 1) * sizeof(u64_snowflake_t));
+      for (int i=0; i < amt; ++i)
+        gw->shard.unavailable[i] = guilds[i]->id;
+      qsort(gw->shard.unavailable, amt, sizeof(u64_snowflake_t), &snowflake_cmp);
+      gw->shard.amt_unavailable = gw->shard.guilds = amt;
+      if (guilds)
+        discord_guild_list_free(guilds);
+      break; }
+  case DISCORD_GATEWAY_EVENTS_GUILD_CREATE:
+      json_extract(data->start, data->size, "(id):s_as_u64", &guild_id);
+      if (!set_guild_unavailable(gw, guild_id, false)) // not a guild of READY's
+        ++gw->shard.guilds;
+      break;
+  case DISCORD_GATEWAY_EVENTS_GUILD_DELETE:
+      json_extract(data->start, data->size, 
+          "(id):s_as_u64,(unavailable):b", &guild_id, &unavailable);
+      if (unavailable) { // outage
+        set_guild_unavailable(gw, guild_id, true);
+      }
+      else { // left the guild
+        set_guild_unavailable(gw, guild_id, false);
+        --gw->shard.guilds;
+      }
+      break;
+  default:
+      break;
+  }
+}
+
 static void
 on_dispatch(struct discord_gateway *gw)
 {
@@ -779,6 +948,8 @@ on_dispatch(struct discord_gateway *gw)
 
       gw->status->is_ready = true;
       gw->reconnect->attempt = 0;
+      gw->shard.status = DISCORD_SHARD_READY;
+      count_guilds(gw, event);
       if (gw->user_cmd->cbs.on_ready)
         on_event = &on_ready;
       break;
@@ -786,6 +957,7 @@ on_dispatch(struct discord_gateway *gw)
       logconf_info(&gw->conf, "Succesfully resumed a Discord session!");
       gw->status->is_ready = true;
       gw->reconnect->attempt = 0;
+      gw->shard.status = DISCORD_SHARD_READY;
       /// @todo add callback
       break;
   case DISCORD_GATEWAY_EVENTS_APPLICATION_COMMAND_CREATE:
@@ -838,12 +1010,14 @@ on_dispatch(struct discord_gateway *gw)
       /// @todo implement
       break;
   case DISCORD_GATEWAY_EVENTS_GUILD_CREATE:
+      count_guilds(gw, event);
       /// @todo implement
       break;
   case DISCORD_GATEWAY_EVENTS_GUILD_UPDATE:
       /// @todo implement
       break;
   case DISCORD_GATEWAY_EVENTS_GUILD_DELETE:
+      count_guilds(gw, event);
       /// @todo implement
       break;
   case DISCORD_GATEWAY_EVENTS_GUILD_BAN_ADD:
@@ -1052,6 +1226,11 @@ on_connect_cb(void *p_gw, struct websockets *ws, struct ws_info *info, const cha
 {
   struct discord_gateway *gw = p_gw;
   logconf_info(&gw->conf, "Connected, WS-Protocols: '%s'", ws_protocols);
+
+  // a new connection starts a new zlib stream
+  gw->compress->inlen = 0;
+  if (gw->compress->zs)
+    inflateReset(gw->compress->zs);
 }
 
 static void
@@ -1062,6 +1241,10 @@ on_close_cb(void *p_gw, struct websockets *ws, struct ws_info *info, enum ws_clo
 
   logconf_warn(&gw->conf, ANSICOLOR("CLOSE %s",ANSI_FG_RED)" (code: %4d, %zu bytes): '%.*s'", 
       close_opcode_print(opcode), opcode, len, (int)len, reason);
+  if (gw->compress->stats.bytes_received) {
+    logconf_info(&gw->conf, "Transport compression: %"PRIu64" bytes received, %"PRIu64" bytes inflated",
+        gw->compress->stats.bytes_received, gw->compress->stats.bytes_inflated);
+  }
 
   if (gw->status->shutdown) {
     logconf_warn(&gw->conf, "Gateway was shutdown");
@@ -1109,23 +1292,71 @@ on_close_cb(void *p_gw, struct websockets *ws, struct ws_info *info, enum ws_clo
   }
 }
 
+/* a sharded session reconnects on its own, while the other shards keep
+ *  running (an unsharded session reconnects from discord_gateway_run()) */
+/* a shard's RESUME backoff elapsed */
 static void
-on_text_cb(void *p_gw, struct websockets *ws, struct ws_info *info, const char *text, size_t len) 
+on_resume_timer(struct websockets *ws, void *p_gw)
 {
   struct discord_gateway *gw = p_gw;
+  gw->shard.resume_timer_id = 0;
+  if (gw->status->shutdown) return; /* EARLY RETURN */
 
-  int seq=0; //check value first, then assign
-  json_extract((char*)text, len,
-              "(t):s (s):d (op):d (d):T",
-               gw->payload->event_name,
-               &seq,
-               &gw->payload->opcode,
-               &gw->payload->event_data);
+  gw->shard.status = DISCORD_SHARD_CONNECTING;
+  ws_start(gw->ws);
+}
 
-  if (seq) {
-    gw->payload->seq = seq;
+static void
+on_disconnect_cb(void *p_gw, struct websockets *ws, struct ws_info *info)
+{
+  struct discord_gateway *gw = p_gw;
+  if (!gw->shard.shards) return; /* EARLY RETURN */
+
+  struct discord_shards *shards = gw->shard.shards;
+  // if disconnected before IDENTIFY, let the bucket's next shard go
+  shards_release(gw, false);
+
+  gw->status->is_ready = false;
+  if (gw->hbeat->timer_id) {
+    ws_timer_cancel(gw->ws, gw->hbeat->timer_id);
+    gw->hbeat->timer_id = 0;
+  }
+
+  if (!gw->reconnect->enable) {
+    logconf_warn(&gw->conf, "Shard %d shutdown", gw->shard.id);
+    gw->shard.status = DISCORD_SHARD_DISCONNECTED;
+    return; /* EARLY RETURN */
+  }
+  if (gw->reconnect->attempt >= gw->reconnect->threshold) {
+    logconf_fatal(&gw->conf, "Could not reconnect shard %d after %d tries",
+              gw->shard.id, gw->reconnect->threshold);
+    gw->shard.status = DISCORD_SHARD_DISCONNECTED;
+    shards->code = ORCA_DISCORD_CONNECTION;
+    return; /* EARLY RETURN */
   }
 
+  ++gw->reconnect->attempt;
+  logconf_info(&gw->conf, "Shard %d reconnect attempt #%d", gw->shard.id, gw->reconnect->attempt);
+  if (gw->status->is_resumable) { // RESUME isn't limited by max_concurrency
+    uint64_t backoff_ms = DISCORD_SHARD_RESUME_BACKOFF_MS;
+    for (int i=1; i < gw->reconnect->attempt && backoff_ms < DISCORD_SHARD_RESUME_MAX_BACKOFF_MS; ++i)
+      backoff_ms *= 2;
+    if (backoff_ms > DISCORD_SHARD_RESUME_MAX_BACKOFF_MS)
+      backoff_ms = DISCORD_SHARD_RESUME_MAX_BACKOFF_MS;
+
+    // don't hammer the Gateway when a shard keeps being disconnected
+    gw->shard.status = DISCORD_SHARD_CONNECTING;
+    gw->shard.resume_timer_id = ws_timer_add(gw->ws, backoff_ms, 0, &on_resume_timer, gw);
+  }
+  else {
+    gw->shard.status = DISCORD_SHARD_QUEUED;
+  }
+}
+
+/* handle a payload decoded into gw->payload */
+static void
+on_payload(struct discord_gateway *gw, struct ws_info *info, size_t len)
+{
   logconf_trace(&gw->conf, ANSICOLOR("RCV", ANSI_FG_BRIGHT_YELLOW)" %s%s%s (%zu bytes) [@@@_%zu_@@@]", 
             opcode_print(gw->payload->opcode), 
             (*gw->payload->event_name) ? " -> " : "",
@@ -1155,6 +1386,205 @@ on_text_cb(void *p_gw, struct websockets *ws, struct ws_info *info, const char *
   }
 }
 
+static void
+on_text_cb(void *p_gw, struct websockets *ws, struct ws_info *info, const char *text, size_t len) 
+{
+  struct discord_gateway *gw = p_gw;
+
+  int seq=0; //check value first, then assign
+  json_extract((char*)text, len,
+              "(t):s (s):d (op):d (d):T",
+               gw->payload->event_name,
+               &seq,
+               &gw->payload->opcode,
+               &gw->payload->event_data);
+
+  if (seq) {
+    gw->payload->seq = seq;
+  }
+
+  on_payload(gw, info, len);
+}
+
+/* whether a dispatch's 'd' can be decoded straight from ETF, instead of
+ *  being transcoded to JSON: only when the user doesn't ask for its
+ *  JSON, and the event is served from the main thread */
+static bool
+is_etf_native(struct discord_gateway *gw)
+{
+  if (gw->payload->opcode != DISCORD_GATEWAY_DISPATCH
+      || gw->user_cmd->event_handler != &noop_event_handler
+      || gw->user_cmd->cbs.on_event_raw != &noop_event_raw_cb)
+  {
+    return false;
+  }
+
+  switch (get_dispatch_event(gw->payload->event_name)) {
+  case DISCORD_GATEWAY_EVENTS_MESSAGE_CREATE:
+      return NULL == gw->user_cmd->cbs.sb_on_message_create;
+  case DISCORD_GATEWAY_EVENTS_MESSAGE_UPDATE:
+      return NULL == gw->user_cmd->cbs.sb_on_message_update;
+  case DISCORD_GATEWAY_EVENTS_GUILD_MEMBER_ADD:
+      return true;
+  default:
+      return false;
+  }
+}
+
+static void
+on_etf_payload(struct discord_gateway *gw, struct ws_info *info, const char *etf, size_t len)
+{
+  struct etf_reader reader;
+  struct etf_term term;
+  if (!etf_reader_init(&reader, etf, len) || !etf_read(&reader, &term) || term.type != ETF_MAP) {
+    logconf_error(&gw->conf, "Couldn't decode ETF payload (%zu bytes)", len);
+    return; /* EARLY RETURN */
+  }
+
+  *gw->payload->event_name = '\0';
+  gw->etf->data = (struct sized_buffer){0};
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term key, value;
+    if (!etf_read(&reader, &key)) break;
+
+    if (etf_term_eq(&key, "d")) {
+      gw->etf->data.start = (char*)reader.buf + reader.pos;
+      if (!etf_skip(&reader)) break;
+      gw->etf->data.size = reader.pos - (size_t)(gw->etf->data.start - reader.buf);
+      continue;
+    }
+
+    if (!etf_read(&reader, &value)) break;
+    if (etf_term_eq(&key, "op") && ETF_INTEGER == value.type) {
+      gw->payload->opcode = (enum discord_gateway_opcodes)value.value.integer;
+    }
+    else if (etf_term_eq(&key, "s") && ETF_INTEGER == value.type) {
+      if (value.value.integer) //check value first, then assign
+        gw->payload->seq = (int)value.value.integer;
+    }
+    else if (etf_term_eq(&key, "t") && (ETF_STRING == value.type || ETF_ATOM == value.type)) {
+      snprintf(gw->payload->event_name, sizeof(gw->payload->event_name), 
+          "%.*s", (int)value.value.str.size, value.value.str.start);
+    }
+  }
+
+  gw->payload->event_data = (struct sized_buffer){0};
+  if (gw->etf->data.size && !is_etf_native(gw)) {
+    struct etf_reader d = { .buf = gw->etf->data.start, .len = gw->etf->data.size };
+    size_t ret = etf_to_json(&d, &gw->etf->json, &gw->etf->json_size);
+    if (!ret) {
+      logconf_error(&gw->conf, "Couldn't transcode ETF payload to JSON (%zu bytes)", len);
+      return; /* EARLY RETURN */
+    }
+    gw->payload->event_data = (struct sized_buffer){ gw->etf->json, ret };
+  }
+
+  on_payload(gw, info, len);
+}
+
+/* zlib-stream payloads may be split across binary messages, the last
+ *  one ending with the Z_SYNC_FLUSH suffix. Once complete, a payload
+ *  is inflated and handled as a text message */
+static void
+on_binary_cb(void *p_gw, struct websockets *ws, struct ws_info *info, const void *mem, size_t len)
+{
+  struct discord_gateway *gw = p_gw;
+
+  if (!gw->compress->enable) { // uncompressed ETF payload
+    on_etf_payload(gw, info, mem, len);
+    return; /* EARLY RETURN */
+  }
+
+  struct z_stream_s *zs = gw->compress->zs;
+
+  if (!zs) {
+    zs = gw->compress->zs = calloc(1, sizeof *zs);
+    if (Z_OK != inflateInit(zs))
+      ERR("Couldn't initialize zlib inflate context");
+  }
+
+  if (gw->compress->inlen + len > gw->compress->insize) {
+    size_t new_size = gw->compress->insize ? gw->compress->insize : 4096;
+    while (gw->compress->inlen + len > new_size) 
+      new_size *= 2;
+    char *tmp = realloc(gw->compress->inbuf, new_size);
+    ASSERT_S(NULL != tmp, "Couldn't increase compressed payload buffer");
+    gw->compress->inbuf = tmp;
+    gw->compress->insize = new_size;
+  }
+  memcpy(gw->compress->inbuf + gw->compress->inlen, mem, len);
+  gw->compress->inlen += len;
+  gw->compress->stats.bytes_received += len;
+
+  if (gw->compress->inlen < 4
+      || memcmp(gw->compress->inbuf + gw->compress->inlen - 4, "\x00\x00\xff\xff", 4))
+  {
+    return; /* EARLY RETURN (wait for the rest of the payload) */
+  }
+
+  zs->next_in = (Bytef*)gw->compress->inbuf;
+  zs->avail_in = (uInt)gw->compress->inlen;
+
+  size_t outlen=0;
+  do {
+    if (outlen + 1 >= gw->compress->outsize) { // leave room for '\0'
+      size_t new_size = gw->compress->outsize ? 2 * gw->compress->outsize : 16384;
+      char *tmp = realloc(gw->compress->outbuf, new_size);
+      ASSERT_S(NULL != tmp, "Couldn't increase inflated payload buffer");
+      gw->compress->outbuf = tmp;
+      gw->compress->outsize = new_size;
+    }
+    zs->next_out = (Bytef*)gw->compress->outbuf + outlen;
+    zs->avail_out = (uInt)(gw->compress->outsize - outlen - 1);
+
+    int ret = inflate(zs, Z_SYNC_FLUSH);
+    if (Z_OK != ret && Z_BUF_ERROR != ret) {
+      logconf_error(&gw->conf, "Couldn't inflate payload (zlib code: %d): %s", 
+          ret, zs->msg ? zs->msg : "");
+      gw->compress->inlen = 0;
+      discord_gateway_reconnect(gw, true);
+      return; /* EARLY RETURN */
+    }
+    outlen = gw->compress->outsize - 1 - zs->avail_out;
+  } while (0 == zs->avail_out);
+
+  gw->compress->outbuf[outlen] = '\0';
+  gw->compress->stats.bytes_inflated += outlen;
+  ++gw->compress->stats.amt_payloads;
+  logconf_trace(&gw->conf, "Inflated payload (%zu -> %zu bytes)", gw->compress->inlen, outlen);
+  gw->compress->inlen = 0;
+
+  if (gw->etf->enable)
+    on_etf_payload(gw, info, gw->compress->outbuf, outlen);
+  else
+    on_text_cb(gw, ws, info, gw->compress->outbuf, outlen);
+}
+
+bool
+discord_gateway_send(struct discord_gateway *gw, struct ws_info *info, const char json[], size_t len)
+{
+  if (!gw->etf->enable)
+    return ws_send_text(gw->ws, info, json, len); /* EARLY RETURN */
+
+  if (!ws_same_thread(gw->ws)) { // the shared buffer belongs to the event-loop thread
+    char *buf=NULL;
+    size_t bufsize=0;
+    size_t ret = etf_from_json(json, len, &buf, &bufsize);
+    bool ok = ret && ws_send_binary(gw->ws, info, buf, ret);
+    if (!ret)
+      logconf_error(&gw->conf, "Couldn't encode payload to ETF: %.*s", (int)len, json);
+    free(buf);
+    return ok; /* EARLY RETURN */
+  }
+
+  size_t ret = etf_from_json(json, len, &gw->etf->sendbuf, &gw->etf->sendbuf_size);
+  if (!ret) {
+    logconf_error(&gw->conf, "Couldn't encode payload to ETF: %.*s", (int)len, json);
+    return false; /* EARLY RETURN */
+  }
+  return ws_send_binary(gw->ws, info, gw->etf->sendbuf, ret);
+}
+
 /* send heartbeat pulse to websockets server in order
  *  to maintain connection alive */
 static void
@@ -1166,30 +1596,25 @@ send_heartbeat(struct discord_gateway *gw)
   ASSERT_S(ret < sizeof(payload), "Out of bounds write attempt");
 
   struct ws_info info={0};
-  ws_send_text(gw->ws, &info, payload, ret);
+  discord_gateway_send(gw, &info, payload, ret);
 
   logconf_info(&gw->conf, ANSICOLOR("SEND", ANSI_FG_BRIGHT_GREEN)" HEARTBEAT (%d bytes) [@@@_%zu_@@@]", ret, info.loginfo.counter);
 }
 
-static void noop_idle_cb(struct discord *a, const struct discord_user *b)
-{ return; }
-static void noop_event_raw_cb(struct discord *a, enum discord_gateway_events b, struct sized_buffer *c, struct sized_buffer *d)
-{ return; }
-static enum discord_event_handling_mode noop_event_handler(struct discord *a, struct discord_user *b, struct sized_buffer *c, enum discord_gateway_events d)
-{ return DISCORD_EVENT_MAIN_THREAD; }
-
-void
-discord_gateway_init(struct discord_gateway *gw, struct logconf *conf, struct sized_buffer *token)
+/* initialize what a Gateway session doesn't share with other shards */
+static void
+_discord_gateway_session_init(struct discord_gateway *gw, struct logconf *conf)
 {
   struct ws_callbacks cbs = {
     .data = gw,
     .on_connect = &on_connect_cb,
     .on_text = &on_text_cb,
-    .on_close = &on_close_cb
+    .on_binary = &on_binary_cb,
+    .on_close = &on_close_cb,
+    .on_disconnect = &on_disconnect_cb
   };
 
   gw->ws = ws_init(&cbs, conf);
-  logconf_branch(&gw->conf, conf, "DISCORD_GATEWAY");
 
   gw->reconnect = malloc(sizeof *gw->reconnect);
   gw->reconnect->enable = true;
@@ -1198,6 +1623,44 @@ discord_gateway_init(struct discord_gateway *gw, struct logconf *conf, struct si
 
   gw->status = calloc(1, sizeof *gw->status);
 
+  gw->payload = calloc(1, sizeof *gw->payload);
+  gw->hbeat = calloc(1, sizeof *gw->hbeat);
+  gw->compress = calloc(1, sizeof *gw->compress); // disabled by default
+  gw->etf = calloc(1, sizeof *gw->etf);
+}
+
+static void
+_discord_gateway_session_cleanup(struct discord_gateway *gw)
+{
+  ws_cleanup(gw->ws);
+  free(gw->reconnect);
+  free(gw->status);
+  free(gw->payload);
+  free(gw->hbeat);
+  if (gw->compress->zs) {
+    inflateEnd(gw->compress->zs);
+    free(gw->compress->zs);
+  }
+  if (gw->compress->inbuf)
+    free(gw->compress->inbuf);
+  if (gw->compress->outbuf)
+    free(gw->compress->outbuf);
+  free(gw->compress);
+  if (gw->etf->json)
+    free(gw->etf->json);
+  if (gw->etf->sendbuf)
+    free(gw->etf->sendbuf);
+  free(gw->etf);
+  if (gw->shard.unavailable)
+    free(gw->shard.unavailable);
+}
+
+void
+discord_gateway_init(struct discord_gateway *gw, struct logconf *conf, struct sized_buffer *token)
+{
+  _discord_gateway_session_init(gw, conf);
+  logconf_branch(&gw->conf, conf, "DISCORD_GATEWAY");
+
   gw->id = (struct discord_identify){
     .token      = strndup(token->start, token->size),
     .properties = malloc(sizeof(struct discord_identify_connection)),
@@ -1212,10 +1675,7 @@ discord_gateway_init(struct discord_gateway *gw, struct logconf *conf, struct si
     .since = cee_timestamp_ms()
   };
 
-  gw->payload = calloc(1, sizeof *gw->payload);
-  gw->hbeat = calloc(1, sizeof *gw->hbeat);
   gw->user_cmd = calloc(1, sizeof *gw->user_cmd);
-
   gw->user_cmd->cbs.on_idle = &noop_idle_cb;
   gw->user_cmd->cbs.on_event_raw = &noop_event_raw_cb;
   gw->user_cmd->event_handler = &noop_event_handler;
@@ -1244,12 +1704,49 @@ discord_gateway_init(struct discord_gateway *gw, struct logconf *conf, struct si
   }
 }
 
+/* the shards other than the first share the original client's
+ *  identity, callbacks and reactor, with a session of their own */
+static struct discord*
+shard_client_init(struct discord *orig_client)
+{
+  struct discord *client = discord_clone(orig_client);
+  struct discord_gateway *gw = &client->gw;
+
+  _discord_gateway_session_init(gw, orig_client->conf);
+  ws_set_reactor(gw->ws, ws_get_reactor(orig_client->gw.ws));
+  gw->compress->enable = orig_client->gw.compress->enable;
+  gw->etf->enable = orig_client->gw.etf->enable;
+  gw->session.url = NULL; // not owned
+  gw->shard.unavailable = NULL;
+  gw->shard.amt_unavailable = gw->shard.guilds = 0;
+
+  return client;
+}
+
+static void
+shards_cleanup(struct discord_shards *shards)
+{
+  // clients[0] is the original client
+  for (int i=1; i < shards->amt_clients; ++i) {
+    _discord_gateway_session_cleanup(&shards->clients[i]->gw);
+    discord_cleanup(shards->clients[i]);
+  }
+  if (shards->clients)
+    free(shards->clients);
+  if (shards->buckets)
+    free(shards->buckets);
+  shards->clients = NULL;
+  shards->amt_clients = 0;
+  shards->buckets = NULL;
+  shards->amt_buckets = 0;
+}
+
 void
 discord_gateway_cleanup(struct discord_gateway *gw)
 {
-  ws_cleanup(gw->ws);
-  free(gw->reconnect);
-  free(gw->status);
+  shards_cleanup(&(_CLIENT(gw))->shards);
+  discord_cluster_cleanup((_CLIENT(gw))->shards.cluster);
+  _discord_gateway_session_cleanup(gw);
   // @todo Add a bitfield in generated structures to ignore freeing strings unless set ( useful for structures created via xxx_from_json() )
 #if 0
   discord_identify_cleanup(&gw->id);
@@ -1264,18 +1761,36 @@ discord_gateway_cleanup(struct discord_gateway *gw)
   discord_user_cleanup(&gw->bot);
   if (gw->sb_bot.start)
     free(gw->sb_bot.start);
-  free(gw->payload);
-  free(gw->hbeat);
   if (gw->user_cmd->pool)
     free(gw->user_cmd->pool);
   free(gw->user_cmd);
 }
 
-/*
- * the event loop to serve the events sent by Discord
- */
+static void
+on_idle_timer(struct websockets *ws, void *p_gw)
+{
+  struct discord_gateway *gw = p_gw;
+  if (!gw->status->is_ready) return; /* EARLY RETURN */
+
+  (*gw->user_cmd->cbs.on_idle)(_CLIENT(gw), &gw->bot);
+}
+
+/* build the URL to connect to from the Gateway URL */
+static void
+build_gateway_url(struct discord_gateway *gw, char url[], size_t size)
+{
+  size_t ret = snprintf(url, size, "%s%s%s%s",
+                 gw->session.url,                                       
+                 ('/' == gw->session.url[strlen(gw->session.url)-1]) ? "" : "/",
+                 gw->etf->enable ? DISCORD_GATEWAY_ETF_URL_SUFFIX : DISCORD_GATEWAY_URL_SUFFIX,
+                 gw->compress->enable ? DISCORD_GATEWAY_COMPRESS_SUFFIX : "");
+  ASSERT_S(ret < size, "Out of bounds write attempt");
+}
+
+/* get the Gateway URL and session start limits, then build the URL
+ *  to connect to */
 static ORCAcode
-event_loop(struct discord_gateway *gw) 
+get_gateway_url(struct discord_gateway *gw, char url[], size_t size)
 {
   // get gateway bot info
   struct sized_buffer json={0};
@@ -1292,45 +1807,262 @@ event_loop(struct discord_gateway *gw)
     &(struct discord_session_start_limit*){&gw->session.start_limit});
   free(json.start);
 
+  if (!gw->session.start_limit.remaining) {
+    logconf_fatal(&gw->conf, "Reach sessions threshold (%d),"
+              "Please wait %d seconds and try again",
+              gw->session.start_limit.total, gw->session.start_limit.reset_after/1000);
+    return ORCA_DISCORD_RATELIMIT;
+  }
+
   // build URL that will be used to connect to Discord
+  build_gateway_url(gw, url, size);
+
+  return ORCA_OK;
+}
+
+/*
+ * the event loop to serve the events sent by Discord
+ */
+static ORCAcode
+event_loop(struct discord_gateway *gw) 
+{
   char url[1024];
-  size_t ret = snprintf(url, sizeof(url), "%s%s"DISCORD_GATEWAY_URL_SUFFIX,
-                 gw->session.url,                                       
-                 ('/' == gw->session.url[strlen(gw->session.url)-1]) ? "" : "/");
-  ASSERT_S(ret < sizeof(url), "Out of bounds write attempt");
+  ORCAcode code = get_gateway_url(gw, url, sizeof(url));
+  if (code != ORCA_OK) return code;
+
+  if (gw->session.shards > 1 && !gw->reconnect->attempt)
+    logconf_warn(&gw->conf, "Discord recommends %d shards @see discord_set_shards()", gw->session.shards);
 
   ws_set_url(gw->ws, url, NULL);
 
   ws_start(gw->ws);
+  gw->shard.status = DISCORD_SHARD_CONNECTING;
 
-  if (!gw->session.start_limit.remaining) {
-    logconf_fatal(&gw->conf, "Reach sessions threshold (%d),"
-              "Please wait %d seconds and try again",
-              gw->session.start_limit.total, gw->session.start_limit.reset_after/1000);
-    return ORCA_DISCORD_RATELIMIT;
-  }
+  // the user's idle callback is ran from a timer, an idle bot without one sleeps
+  unsigned idle_timer = 0;
+  if (gw->user_cmd->cbs.on_idle != &noop_idle_cb)
+    idle_timer = ws_timer_add(gw->ws, DISCORD_IDLE_INTERVAL_MS, DISCORD_IDLE_INTERVAL_MS, &on_idle_timer, gw);
 
   bool is_running=false;
+  uint64_t wait_ms = DISCORD_GATEWAY_MAX_WAIT_MS;
   while (1) {
-    ws_perform(gw->ws, &is_running, 5);
+    // ws_perform() wakes up on Gateway activity, timers (heartbeat, idle) and sends from other threads
+    ws_perform(gw->ws, &is_running, wait_ms);
     if (!is_running) break; // exit event loop
-    if (!gw->status->is_ready) continue; // wait until on_ready()
-    
-    // connection is established
-
-    /*check if timespan since first pulse is greater than
-     * minimum heartbeat interval required*/
-    if (gw->hbeat->interval_ms < (ws_timestamp(gw->ws) - gw->hbeat->tstamp)) {
-      send_heartbeat(gw);
-      gw->hbeat->tstamp = ws_timestamp(gw->ws); //update heartbeat timestamp
-    }
-    (*gw->user_cmd->cbs.on_idle)(_CLIENT(gw), &gw->bot);
+    // drive asynchronous REST requests (non-blocking, ws_perform() already waited)
+    int amt_async = ua_async_perform((_CLIENT(gw))->adapter.ua, 0);
+    // REST transfers aren't watched by ws_perform(), poll while there are some
+    wait_ms = amt_async ? 5 : DISCORD_GATEWAY_MAX_WAIT_MS;
   }
   gw->status->is_ready = false;
+  gw->shard.status = DISCORD_SHARD_DISCONNECTED;
+
+  if (idle_timer)
+    ws_timer_cancel(gw->ws, idle_timer);
+  if (gw->hbeat->timer_id) {
+    ws_timer_cancel(gw->ws, gw->hbeat->timer_id);
+    gw->hbeat->timer_id = 0;
+  }
 
   return ORCA_OK;
 }
 
+/* start a queued shard, holding its max_concurrency bucket */
+static void
+shard_connect(struct discord_gateway *gw)
+{
+  struct discord_shards *shards = gw->shard.shards;
+  shards->buckets[gw->shard.id % shards->amt_buckets].holder = gw;
+
+  logconf_info(&gw->conf, "Shard %d/%d connecting", gw->shard.id, gw->shard.total);
+  gw->shard.status = DISCORD_SHARD_CONNECTING;
+  ws_start(gw->ws);
+}
+
+/* the cluster coordinator granted a shard its turn to IDENTIFY */
+static void
+on_cluster_go(void *p_shards, int shard_id)
+{
+  struct discord_shards *shards = p_shards;
+  for (int i=0; i < shards->amt_clients; ++i) {
+    struct discord_gateway *gw = &shards->clients[i]->gw;
+    if (gw->shard.id != shard_id) continue;
+
+    gw->shard.is_requested = false;
+    if (DISCORD_SHARD_QUEUED == gw->shard.status)
+      shard_connect(gw);
+    else // shutdown while waiting
+      discord_cluster_release(shards->cluster, shard_id, false);
+    return; /* EARLY RETURN */
+  }
+}
+
+/* the cluster coordinator schedules the IDENTIFYs of every worker, and
+ *  relays the stats of every worker */
+static void
+cluster_perform(struct discord_shards *shards)
+{
+  int guilds=0;
+  for (int i=0; i < shards->amt_clients; ++i) {
+    struct discord_gateway *gw = &shards->clients[i]->gw;
+    guilds += gw->shard.guilds;
+    if (DISCORD_SHARD_QUEUED == gw->shard.status && !gw->shard.is_requested) {
+      gw->shard.is_requested = true;
+      discord_cluster_request(shards->cluster, gw->shard.id);
+    }
+  }
+  discord_cluster_set_stat(shards->clients[0], "guilds", guilds);
+
+  if (shards->cluster->fd != -1 
+      && !discord_cluster_perform(shards->cluster, &on_cluster_go, shards)) 
+  {
+    // the shards wouldn't be allowed to IDENTIFY anymore
+    logconf_fatal(&shards->clients[0]->gw.conf, "Shutting down the shards of this worker");
+    shards->code = ORCA_DISCORD_CONNECTION;
+    discord_gateway_shutdown(&shards->clients[0]->gw);
+  }
+}
+
+/* start the queued shards whose max_concurrency bucket is free, a
+ *  bucket is held from the connection until its IDENTIFY is sent */
+static void
+on_shards_timer(struct websockets *ws, void *p_shards)
+{
+  struct discord_shards *shards = p_shards;
+  if (shards->cluster) {
+    cluster_perform(shards);
+    return; /* EARLY RETURN */
+  }
+
+  u64_unix_ms_t now = ws_timestamp(ws);
+  for (int i=0; i < shards->amt_clients; ++i) {
+    struct discord_gateway *gw = &shards->clients[i]->gw;
+    if (gw->shard.status != DISCORD_SHARD_QUEUED) continue;
+
+    int bucket = gw->shard.id % shards->amt_buckets;
+    if (shards->buckets[bucket].holder || now < shards->buckets[bucket].tstamp)
+      continue;
+    shard_connect(gw);
+  }
+}
+
+static bool
+shards_is_running(struct discord_shards *shards)
+{
+  for (int i=0; i < shards->amt_clients; ++i)
+    if (shards->clients[i]->gw.shard.status != DISCORD_SHARD_DISCONNECTED)
+      return true;
+  return false;
+}
+
+/*
+ * the event loop of a sharded client, its sessions are driven by the
+ *  original client's reactor and reconnect on their own
+ */
+static ORCAcode
+shards_run(struct discord_gateway *gw)
+{
+  struct discord *client = _CLIENT(gw);
+  struct discord_shards *shards = &client->shards;
+
+  char url[1024];
+  ORCAcode code;
+  if (shards->cluster) { // the coordinator assigns the shards and the Gateway URL
+    char *cluster_url=NULL;
+    code = discord_cluster_join(shards->cluster, shards, 
+             &gw->session.start_limit.max_concurrency, &cluster_url);
+    if (code != ORCA_OK) return code;
+
+    if (gw->session.url)
+      free(gw->session.url);
+    gw->session.url = cluster_url;
+    build_gateway_url(gw, url, sizeof(url));
+  }
+  else {
+    code = get_gateway_url(gw, url, sizeof(url));
+    if (code != ORCA_OK) return code;
+  }
+
+  int total = shards->total ? shards->total : gw->session.shards;
+  if (total < 1) total = 1;
+  int amt = shards->amt ? shards->amt : total - shards->first_id;
+  if (shards->first_id < 0 || amt < 1 || shards->first_id + amt > total) {
+    logconf_fatal(&gw->conf, "Invalid shard range (%d shards from shard %d, out of %d)", 
+        amt, shards->first_id, total);
+    return ORCA_BAD_PARAMETER;
+  }
+  if (!shards->cluster && gw->session.start_limit.remaining < amt) {
+    logconf_warn(&gw->conf, "Only %d sessions may start until the limit resets in %d seconds",
+        gw->session.start_limit.remaining, gw->session.start_limit.reset_after/1000);
+  }
+
+  if (amt != shards->amt_clients) {
+    shards_cleanup(shards);
+    shards->clients = calloc(amt, sizeof *shards->clients);
+    shards->clients[0] = client;
+    for (int i=1; i < amt; ++i)
+      shards->clients[i] = shard_client_init(client);
+    shards->amt_clients = amt;
+  }
+
+  if (shards->buckets) 
+    free(shards->buckets);
+  shards->amt_buckets = gw->session.start_limit.max_concurrency > 0 
+                          ? gw->session.start_limit.max_concurrency : 1;
+  shards->buckets = calloc(shards->amt_buckets, sizeof *shards->buckets);
+  shards->code = ORCA_OK;
+
+  for (int i=0; i < amt; ++i) {
+    struct discord_gateway *shard_gw = &shards->clients[i]->gw;
+    shard_gw->shard.id = shards->first_id + i;
+    shard_gw->shard.total = total;
+    shard_gw->shard.shards = shards;
+    shard_gw->shard.status = DISCORD_SHARD_QUEUED;
+    shard_gw->shard.is_requested = false;
+    shard_gw->shard.resume_timer_id = 0;
+    shard_gw->reconnect->enable = true;
+    shard_gw->reconnect->attempt = 0;
+    ws_set_url(shard_gw->ws, url, NULL);
+  }
+
+  logconf_info(&gw->conf, "Running shards %d to %d out of %d (max_concurrency: %d)",
+      shards->first_id, shards->first_id + amt - 1, total, shards->amt_buckets);
+
+  shards->timer_id = ws_timer_add(gw->ws, 0, DISCORD_SHARD_SCHEDULE_MS, &on_shards_timer, shards);
+
+  unsigned idle_timer = 0;
+  if (gw->user_cmd->cbs.on_idle != &noop_idle_cb)
+    idle_timer = ws_timer_add(gw->ws, DISCORD_IDLE_INTERVAL_MS, DISCORD_IDLE_INTERVAL_MS, &on_idle_timer, gw);
+
+  struct ws_reactor *reactor = ws_get_reactor(gw->ws);
+  uint64_t wait_ms = DISCORD_GATEWAY_MAX_WAIT_MS;
+  while (1) {
+    // serves every shard, and the timers (scheduling, heartbeats, idle)
+    ws_reactor_perform(reactor, wait_ms);
+    if (!shards_is_running(shards)) break; // exit event loop
+    int amt_async = ua_async_perform(client->adapter.ua, 0);
+    wait_ms = amt_async ? 5 : DISCORD_GATEWAY_MAX_WAIT_MS;
+  }
+
+  ws_timer_cancel(gw->ws, shards->timer_id);
+  shards->timer_id = 0;
+  if (idle_timer)
+    ws_timer_cancel(gw->ws, idle_timer);
+  for (int i=0; i < amt; ++i) { // shut down while waiting to RESUME
+    struct discord_gateway *shard_gw = &shards->clients[i]->gw;
+    if (shard_gw->shard.resume_timer_id) {
+      ws_timer_cancel(shard_gw->ws, shard_gw->shard.resume_timer_id);
+      shard_gw->shard.resume_timer_id = 0;
+    }
+  }
+
+  // a worker that failed keeps its range, to be reassigned once it exits
+  if (shards->cluster && ORCA_OK == shards->code)
+    discord_cluster_leave(shards->cluster);
+
+  return shards->code;
+}
+
 /*
  * Discord's ws is not reliable. This function is responsible for
  * reconnection/resume/exit
@@ -1338,6 +2070,9 @@ event_loop(struct discord_gateway *gw)
 ORCAcode
 discord_gateway_run(struct discord_gateway *gw)
 {
+  if ((_CLIENT(gw))->shards.enable)
+    return shards_run(gw); /* EARLY RETURN */
+
   ORCAcode code;
   while (gw->reconnect->attempt < gw->reconnect->threshold) 
   {
@@ -1360,13 +2095,30 @@ discord_gateway_run(struct discord_gateway *gw)
   return ORCA_DISCORD_CONNECTION;
 }
 
-void
-discord_gateway_shutdown(struct discord_gateway *gw) 
+static void
+_discord_gateway_shutdown(struct discord_gateway *gw)
 {
   gw->reconnect->enable = false;
   gw->status->is_resumable = false;
   gw->status->shutdown = true;
-  ws_close(gw->ws, WS_CLOSE_REASON_NORMAL, "", 0);
+  // not connected, a pending RESUME timer is cancelled by shards_run()
+  if (DISCORD_SHARD_QUEUED == gw->shard.status || gw->shard.resume_timer_id)
+    gw->shard.status = DISCORD_SHARD_DISCONNECTED;
+  else
+    ws_close(gw->ws, WS_CLOSE_REASON_NORMAL, "", 0);
+}
+
+void
+discord_gateway_shutdown(struct discord_gateway *gw) 
+{
+  struct discord_shards *shards = gw->shard.shards;
+  if (!shards) {
+    _discord_gateway_shutdown(gw);
+    return; /* EARLY RETURN */
+  }
+  // shutdown every shard of the client
+  for (int i=0; i < shards->amt_clients; ++i)
+    _discord_gateway_shutdown(&shards->clients[i]->gw);
 }
 
 void
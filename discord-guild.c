@@ -241,6 +241,26 @@ discord_get_guild_member(struct discord *client, u64_snowflake_t guild_id, u64_s
            "/guilds/%"PRIu64"/members/%"PRIu64, guild_id, user_id);
 }
 
+/* members received so far, the list is built once they're all in */
+struct guild_member_list {
+  struct discord_guild_member *elems;
+  size_t amt;
+  size_t cap;
+};
+
+/* decode each member as soon as it's received */
+static void
+guild_member_list_append(char *str, size_t len, void *p_list)
+{
+  struct guild_member_list *list = p_list;
+  if (list->amt == list->cap) { // grow geometrically
+    list->cap = list->cap ? 2 * list->cap : 64;
+    list->elems = realloc(list->elems, list->cap * sizeof *list->elems);
+  }
+  struct discord_guild_member *member = &list->elems[list->amt++];
+  discord_guild_member_from_json(str, len, &member);
+}
+
 ORCAcode
 discord_list_guild_members(
   struct discord *client, 
@@ -272,16 +292,36 @@ discord_list_guild_members(
     }
   }
   
-  return discord_adapter_run( 
+  *p_members = NULL;
+  struct guild_member_list list={0};
+  ORCAcode code;
+  code = discord_adapter_run( 
            &client->adapter,
            &(struct ua_resp_handle){ 
              .ok_cb = &discord_guild_member_list_from_json_v, 
-             .ok_obj = p_members 
+             .ok_obj = p_members,
+             .elem_cb = &guild_member_list_append,
+             .elem_obj = &list
            },
            NULL,
            HTTP_GET,
            "/guilds/%"PRIu64"/members%s%s", 
            guild_id, (*query)?"?":"", query);
+  if (list.amt) {
+    if (ORCA_OK == code) {
+      *p_members = (NTL_T(struct discord_guild_member))ntl_calloc(list.amt, sizeof(struct discord_guild_member));
+      for (size_t i=0; i < list.amt; ++i)
+        memcpy((*p_members)[i], &list.elems[i], sizeof(struct discord_guild_member));
+    }
+    else {
+      for (size_t i=0; i < list.amt; ++i)
+        discord_guild_member_cleanup(&list.elems[i]);
+    }
+  }
+  free(list.elems);
+  if (ORCA_OK == code && !*p_members) // empty list
+    *p_members = (NTL_T(struct discord_guild_member))ntl_calloc(0, sizeof(struct discord_guild_member));
+  return code;
 }
 
 ORCAcode
@@ -114,21 +114,24 @@ discord_edit_original_interaction_response(
   }
 
   // content-type is multipart/form-data
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "multipart/form-data");
-  ua_curl_mime_setopt(client->adapter.ua, params->file, &discord_file_to_mime);
+  struct ua_multipart multipart={0};
+  ORCAcode code = discord_file_to_multipart(
+                    &(struct discord_file){ 
+                      .content = params->file, 
+                      .size = strlen(params->file) 
+                    }, 
+                    &multipart);
+  if (ORCA_OK != code) return code; /* EARLY RETURN */
 
-  ORCAcode code;
   code = discord_adapter_run( 
            &client->adapter,
            &resp_handle,
-           NULL,
+           UA_MULTIPART_BODY(&multipart),
            HTTP_MIMEPOST, 
            "/webhooks/%"PRIu64"/%s/messages/@original", 
            interaction_id, interaction_token);
 
-  //set back to default
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "application/json");
-  ua_curl_mime_setopt(client->adapter.ua, NULL, NULL);
+  ua_multipart_cleanup(&multipart);
 
   return code;
 }
@@ -212,21 +215,24 @@ discord_create_followup_message(
   }
 
   // content-type is multipart/form-data
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "multipart/form-data");
-  ua_curl_mime_setopt(client->adapter.ua, params->file, &discord_file_to_mime);
+  struct ua_multipart multipart={0};
+  ORCAcode code = discord_file_to_multipart(
+                    &(struct discord_file){ 
+                      .content = params->file, 
+                      .size = strlen(params->file) 
+                    }, 
+                    &multipart);
+  if (ORCA_OK != code) return code; /* EARLY RETURN */
 
-  ORCAcode code;
   code = discord_adapter_run( 
            &client->adapter,
            &resp_handle,
-           NULL,
+           UA_MULTIPART_BODY(&multipart),
            HTTP_MIMEPOST, 
            "/webhooks/%"PRIu64"/%s%s%s", 
            application_id, interaction_token, *query ? "?" : "", query);
 
-  //set back to default
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "application/json");
-  ua_curl_mime_setopt(client->adapter.ua, NULL, NULL);
+  ua_multipart_cleanup(&multipart);
 
   return code;
 }
@@ -314,21 +320,24 @@ discord_edit_followup_message(
   }
 
   // content-type is multipart/form-data
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "multipart/form-data");
-  ua_curl_mime_setopt(client->adapter.ua, params->file, &discord_file_to_mime);
+  struct ua_multipart multipart={0};
+  ORCAcode code = discord_file_to_multipart(
+                    &(struct discord_file){ 
+                      .content = params->file, 
+                      .size = strlen(params->file) 
+                    }, 
+                    &multipart);
+  if (ORCA_OK != code) return code; /* EARLY RETURN */
 
-  ORCAcode code;
   code = discord_adapter_run( 
            &client->adapter,
            &resp_handle,
-           NULL,
+           UA_MULTIPART_BODY(&multipart),
            HTTP_MIMEPOST, 
            "/webhooks/%"PRIu64"/%s/messages/%"PRIu64, 
            application_id, interaction_token, message_id);
 
-  //set back to default
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "application/json");
-  ua_curl_mime_setopt(client->adapter.ua, NULL, NULL);
+  ua_multipart_cleanup(&multipart);
 
   return code;
 }
@@ -34,6 +34,7 @@
  */
 struct discord_adapter {
   struct user_agent *ua; ///< The user agent handle for performing requests
+  struct ua_share *share; ///< DNS/TLS cache of the user agent's connections, NULL if disabled @see discord_adapter_set_transport()
   struct logconf conf; ///< store conf file contents and sync logging between clients
 
   struct { ///< Ratelimiting structure
@@ -42,7 +43,8 @@ struct discord_adapter {
   } *ratelimit;
 
   struct { ///< Error storage context
-    struct ua_info info; ///< Informational on the latest transfer
+    pthread_mutex_t lock; ///< the adapter is shared by the callbacks' threads
+    int  httpcode;       ///< HTTP status code of the latest transfer
     int  jsoncode;       ///< JSON error code on failed request
     char jsonstr[512];   ///< The entire JSON response of the error
   } err;
@@ -64,6 +66,16 @@ void discord_adapter_init(struct discord_adapter *adapter, struct logconf *conf,
  */
 void discord_adapter_cleanup(struct discord_adapter *adapter);
 
+/**
+ * @brief Tune the transport of the adapter's requests
+ *
+ * @param adapter the handle initialized with discord_adapter_init()
+ * @param is_cached cache DNS lookups and TLS sessions across connections
+ * @param is_http2 negotiate HTTP/2
+ * @see discord_set_http_transport()
+ */
+void discord_adapter_set_transport(struct discord_adapter *adapter, bool is_cached, bool is_http2);
+
 /**
  * @brief Start a HTTP Request to Discord
  *
@@ -235,6 +247,18 @@ struct discord_gateway {
     int event_count;               ///< event counter to avoid reaching limit of 120 events per 60 sec
   } session;
 
+  struct { ///< Sharding structure
+    int id;                           ///< the shard id sent with IDENTIFY
+    int total;                        ///< total amount of shards, 0 if the session isn't sharded
+    enum discord_shard_status status; ///< @see discord_get_shard_info()
+    struct discord_shards *shards;    ///< the shards this session belongs to, NULL if not sharded
+    bool is_requested;                ///< waiting for the cluster's go to IDENTIFY @see discord_cluster_request()
+    unsigned resume_timer_id;         ///< the backoff timer of a shard waiting to RESUME, 0 if none
+    int guilds;                       ///< amount of guilds served by this session
+    u64_snowflake_t *unavailable;     ///< sorted ids of the guilds not yet received with GUILD_CREATE
+    int amt_unavailable;
+  } shard;
+
   struct discord_user bot;             ///< the client's user structure
   struct sized_buffer sb_bot;          ///< the client's user raw JSON @todo this is temporary
   
@@ -252,8 +276,30 @@ struct discord_gateway {
     u64_unix_ms_t interval_ms; ///< fixed interval between heartbeats
     u64_unix_ms_t tstamp;      ///< start pulse timestamp in milliseconds
     int ping_ms;               ///< latency calculated by HEARTBEAT and HEARTBEAT_ACK interval
+    unsigned timer_id;         ///< the heartbeat timer @see ws_timer_add()
   } *hbeat;
 
+  // https://discord.com/developers/docs/topics/gateway#transport-compression
+  struct { ///< Transport compression structure
+    bool enable;            ///< connect with compress=zlib-stream @see discord_set_gateway_compress()
+    struct z_stream_s *zs;  ///< inflate context, shared by every payload of a connection
+    char *inbuf;            ///< compressed payload being received
+    size_t inlen, insize;
+    char *outbuf;           ///< inflated payload, reused between payloads
+    size_t outsize;
+    struct discord_gateway_stats stats;
+  } *compress;
+
+  // https://discord.com/developers/docs/topics/gateway#etfjson
+  struct { ///< ETF encoding structure
+    bool enable;             ///< connect with encoding=etf @see discord_set_gateway_etf()
+    struct sized_buffer data; ///< field 'd' as ETF, when payload->event_data is left empty
+    char *json;              ///< field 'd' transcoded to JSON, reused between payloads
+    size_t json_size;
+    char *sendbuf;           ///< payload being sent encoded as ETF
+    size_t sendbuf_size;
+  } *etf;
+
   struct { ///< User-Commands structure
     struct sized_buffer prefix;                ///< the prefix expected before every command @see discord_set_prefix()
     struct discord_gateway_cmd_cbs *pool;      ///< user's command/callback pair @see discord_set_on_command()
@@ -305,6 +351,160 @@ void discord_gateway_shutdown(struct discord_gateway *gw);
  */
 void discord_gateway_reconnect(struct discord_gateway *gw, bool resume);
 
+/**
+ * @brief Send a JSON payload to the Discord Gateway, in the connection's encoding
+ *
+ * @param gw the handle initialized with discord_gateway_init()
+ * @param info optional pointer to receive the send information
+ * @param json the JSON payload
+ * @param len the payload length
+ * @return true if the payload was sent
+ */
+bool discord_gateway_send(struct discord_gateway *gw, struct ws_info *info, const char json[], size_t len);
+
+#define DISCORD_SHARD_IDENTIFY_INTERVAL_MS 5000 ///< a max_concurrency bucket IDENTIFYs once per interval
+#define DISCORD_SHARD_RESUME_BACKOFF_MS 1000      ///< wait before a shard's first RESUME attempt, doubled with each attempt
+#define DISCORD_SHARD_RESUME_MAX_BACKOFF_MS 30000 ///< longest wait between a shard's RESUME attempts
+
+/**
+ * @brief The Gateway sessions of a sharded client, driven by the
+ *        original client's reactor
+ *
+ * @see discord_set_shards()
+ */
+struct discord_shards {
+  bool enable;   ///< run sharded sessions @see discord_set_shards()
+  int first_id;  ///< the first shard ran by this client
+  int amt;       ///< amount of shards ran by this client, 0 for every shard from first_id
+  int total;     ///< total amount of shards, 0 for Discord's recommendation
+
+  struct discord **clients; ///< a client per shard, clients[0] being the original
+  int amt_clients;
+  struct {
+    u64_unix_ms_t tstamp;           ///< when the bucket may IDENTIFY next
+    struct discord_gateway *holder; ///< the session connecting to IDENTIFY, if any
+  } *buckets;               ///< the max_concurrency buckets, shard id % amt_buckets
+  int amt_buckets;
+  unsigned timer_id;        ///< starts the queued shards @see ws_timer_add()
+  ORCAcode code;            ///< ORCA_DISCORD_CONNECTION if a shard gave up reconnecting
+
+  struct discord_cluster *cluster; ///< the coordinator handing this worker its shards, NULL if not clustered
+};
+
+#define DISCORD_CLUSTER_MAX_STATS 16
+
+/**
+ * @brief A worker's link to its cluster coordinator
+ *
+ * The coordinator assigns the worker's shard range, and grants each
+ *        shard its turn to IDENTIFY. The link is read and written from
+ *        the shards' event loop only.
+ * @see discord_set_cluster() and discord_cluster_coordinate()
+ */
+struct discord_cluster {
+  struct logconf conf; ///< CLUSTER logging module
+  char *path;          ///< the coordinator's Unix domain socket
+  int fd;              ///< the connection to the coordinator, -1 if not connected
+  struct {
+    char buf[4096];    ///< incomplete line received from the coordinator
+    size_t len;
+  } recv;
+  pthread_mutex_t lock; ///< stats are also accessed from the callbacks' threads
+  struct {
+    char name[32];
+    long value;        ///< this worker's value
+    long total;        ///< the cluster-wide sum, relayed by the coordinator
+    bool is_dirty;     ///< value not yet sent to the coordinator
+  } stats[DISCORD_CLUSTER_MAX_STATS];
+  int amt_stats;
+};
+
+/**
+ * @brief Initialize a worker's link to a cluster coordinator
+ *
+ * @param conf pointer to the client's logconf
+ * @param path the coordinator's Unix domain socket
+ * @return the link, not yet connected
+ */
+struct discord_cluster* discord_cluster_init(struct logconf *conf, const char path[]);
+
+/**
+ * @brief Free a link created with discord_cluster_init()
+ *
+ * @param cluster the link, may be NULL
+ */
+void discord_cluster_cleanup(struct discord_cluster *cluster);
+
+/**
+ * @brief Connect to the coordinator and receive this worker's shards
+ *
+ * Fills shards->first_id, shards->amt and shards->total.
+ * @param cluster the link
+ * @param shards the worker's shards
+ * @param p_max_concurrency receives the IDENTIFY concurrency
+ * @param p_url receives the Gateway URL, to be freed
+ * @return ORCA_OK, or ORCA_DISCORD_CONNECTION if the coordinator couldn't be reached
+ */
+ORCAcode discord_cluster_join(struct discord_cluster *cluster, struct discord_shards *shards, int *p_max_concurrency, char **p_url);
+
+/**
+ * @brief Say goodbye to the coordinator, so it may stop once every
+ *        shard range has left
+ *
+ * @param cluster the link
+ */
+void discord_cluster_leave(struct discord_cluster *cluster);
+
+/**
+ * @brief Ask the coordinator for a shard's turn to IDENTIFY
+ *
+ * The go is received by discord_cluster_perform()
+ * @param cluster the link
+ * @param shard_id the queued shard
+ */
+void discord_cluster_request(struct discord_cluster *cluster, int shard_id);
+
+/**
+ * @brief Give back a shard's turn to IDENTIFY
+ *
+ * @param cluster the link
+ * @param shard_id the shard granted with discord_cluster_request()
+ * @param identified true if the shard sent its IDENTIFY, its bucket
+ *        then waits for DISCORD_SHARD_IDENTIFY_INTERVAL_MS
+ */
+void discord_cluster_release(struct discord_cluster *cluster, int shard_id, bool identified);
+
+/**
+ * @brief Process what the coordinator sent, and send the updated stats
+ *
+ * Doesn't block.
+ * @param cluster the link
+ * @param on_go called for each shard granted its turn to IDENTIFY
+ * @param data user arbitrary data given to on_go
+ * @return false if the link to the coordinator is lost
+ */
+bool discord_cluster_perform(struct discord_cluster *cluster, void (*on_go)(void *data, int shard_id), void *data);
+
+/* ETF DECODING (defined at discord-etf.c) */
+
+/**
+ * @brief Decode a message object straight from ETF
+ *
+ * @param etf the encoded object, without the version byte
+ * @param len the encoded length
+ * @param pp receives the allocated message
+ */
+void discord_message_from_etf(char etf[], size_t len, struct discord_message **pp);
+
+/**
+ * @brief Decode a guild member object straight from ETF
+ *
+ * @param etf the encoded object, without the version byte
+ * @param len the encoded length
+ * @param pp receives the allocated guild member
+ */
+void discord_guild_member_from_etf(char etf[], size_t len, struct discord_guild_member **pp);
+
 
 /**
  * @brief The Discord opaque structure handler
@@ -319,6 +519,21 @@ void discord_gateway_reconnect(struct discord_gateway *gw, bool resume);
  * @see discord_run()
  * @note defined at discord-internal.h
  */
+/**
+ * @brief The event-loop serving the voice connections
+ *
+ * The voice connections share a reactor, performed by a thread of their
+ *        own so they're kept alive while the Gateway reconnects, or waits
+ *        on a blocking REST request
+ * @see discord_voice_connections_init()
+ */
+struct discord_voice_loop {
+  pthread_mutex_t lock;       ///< guards @a tid and @a is_running
+  struct ws_reactor *reactor; ///< the voice connections' reactor @see ws_set_reactor()
+  pthread_t tid;              ///< the thread performing @a reactor
+  bool is_running;            ///< started by the first voice connection, cleared to stop
+};
+
 struct discord {
   /// @privatesection
   bool is_original; ///< whether this is the original client or a clone
@@ -329,7 +544,9 @@ struct discord {
 
   struct discord_adapter adapter; ///< the HTTP adapter for performing requests
   struct discord_gateway gw;      ///< the WebSockets handle for establishing a connection to Discord
+  struct discord_shards shards;   ///< the other Gateway sessions, if sharded @see discord_set_shards()
   struct discord_voice   vcs[DISCORD_MAX_VOICE_CONNECTIONS]; ///< the WebSockets handles for establishing voice connections to Discord
+  struct discord_voice_loop *voice_loop; ///< serves @a vcs, shared with the clones
 
   // @todo? create a analogous struct for gateway
   struct discord_voice_cbs voice_cbs;
@@ -348,6 +565,6 @@ struct discord_event_cxt {
 };
 
 /* MISCELLANEOUS */
-curl_mime* discord_file_to_mime(CURL *ehandle, void *p_file);
+ORCAcode discord_file_to_multipart(struct discord_file *file, struct ua_multipart *multipart);
 
 #endif // DISCORD_INTERNAL_H
@@ -13,29 +13,24 @@ struct msg {
 };
 
 // defined at dicord-internal.h
-curl_mime*
-discord_file_to_mime(CURL *ehandle, void *p_file) 
+ORCAcode
+discord_file_to_multipart(struct discord_file *file, struct ua_multipart *multipart)
 {
-  struct discord_file *file = p_file;
-
-  curl_mime *mime = curl_mime_init(ehandle);
-  curl_mimepart *part = curl_mime_addpart(mime);
-
-  if (file->content) {
-    if (!file->name) { // set a default name
-      file->name = "a.out";
-    }
-    curl_mime_data(part, file->content, file->size);
-    curl_mime_filename(part, file->name);
-    curl_mime_type(part, "application/octet-stream");
+  if (!file->content && !file->name) {
+    log_error("Missing 'file->content' or 'file->name'");
+    return ORCA_BAD_PARAMETER;
   }
-  else { //file->name exists 
-    curl_mime_filedata(part, file->name);
+  if (file->content) { // streamed from memory
+    ua_multipart_add_data(
+      multipart, 
+      "file", 
+      file->name ? file->name : "a.out", // set a default name
+      "application/octet-stream", 
+      file->content, file->size);
+    return ORCA_OK;
   }
-
-  curl_mime_name(part, "file");
-
-  return mime;
+  // file->name is a path, streamed from the file
+  return ua_multipart_add_file(multipart, "file", NULL, file->name);
 }
 
 ORCAcode
@@ -120,13 +120,14 @@ parse_ratelimits(struct discord_bucket *bucket, ORCAcode code, struct ua_info *i
   {
     bucket->update_tstamp = info->req_tstamp;
 
-    struct sized_buffer value; // fetch header value as string
-    value = ua_info_respheader_field(info, "x-ratelimit-reset");
-    if (value.size) bucket->reset_tstamp = 1000 * strtod(value.start, NULL);
-    value = ua_info_respheader_field(info, "x-ratelimit-remaining");
-    if (value.size) bucket->remaining = strtol(value.start, NULL, 10);
-    value = ua_info_respheader_field(info, "x-ratelimit-reset-after");
-    if (value.size) bucket->reset_after_ms = 1000 * strtod(value.start, NULL);
+    // fields are pre-parsed as the response header is received
+    struct ua_resp_header *header = &info->resp_header;
+    if (header->known.ratelimit_reset >= 0) 
+      bucket->reset_tstamp = 1000 * header->known.ratelimit_reset;
+    if (header->known.ratelimit_remaining >= 0) 
+      bucket->remaining = header->known.ratelimit_remaining;
+    if (header->known.ratelimit_reset_after >= 0) 
+      bucket->reset_after_ms = 1000 * header->known.ratelimit_reset_after;
 
     log_trace("\n  [%s]\n\t"                \
               "reset_tstamp: %"PRIu64"\n\t" \
@@ -154,7 +155,12 @@ parse_ratelimits(struct discord_bucket *bucket, ORCAcode code, struct ua_info *i
 static void
 match_route(struct discord_adapter *adapter, const char route[], ORCAcode code, struct ua_info *info)
 {
-  struct sized_buffer hash = ua_info_respheader_field(info, "x-ratelimit-bucket");
+  struct ua_resp_header *header = &info->resp_header;
+  struct sized_buffer hash={0};
+  if (header->known.ratelimit_bucket >= 0) {
+    hash.start = header->buf + header->pairs[header->known.ratelimit_bucket].value.idx;
+    hash.size = header->pairs[header->known.ratelimit_bucket].value.size;
+  }
   if (!hash.size) {
     log_trace("[?] Missing bucket-hash from response header," \
               " route '%s' can't be assigned to a bucket", route);
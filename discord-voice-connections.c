@@ -76,6 +76,19 @@ send_identify(struct discord_voice *vc)
   ws_send_text(vc->ws, NULL, payload, ret);
 }
 
+static void send_heartbeat(struct discord_voice *vc);
+
+/* heartbeat timer, pulses once the connection is ready */
+static void
+on_heartbeat_timer(struct websockets *ws, void *p_vc)
+{
+  struct discord_voice *vc = p_vc;
+  if (!vc->is_ready) return; /* EARLY RETURN */
+
+  send_heartbeat(vc);
+  vc->hbeat.tstamp = ws_timestamp(vc->ws); //update heartbeat timestamp
+}
+
 static void
 on_hello(struct discord_voice *vc)
 {
@@ -91,6 +104,11 @@ on_hello(struct discord_voice *vc)
 
   vc->hbeat.interval_ms = (u64_unix_ms_t)fmin(hbeat_interval, 5000);
 
+  if (vc->hbeat.timer_id)
+    ws_timer_cancel(vc->ws, vc->hbeat.timer_id);
+  vc->hbeat.timer_id = ws_timer_add(vc->ws, vc->hbeat.interval_ms, 
+                         vc->hbeat.interval_ms, &on_heartbeat_timer, vc);
+
   if (vc->is_resumable)
     send_resume(vc);
   else
@@ -204,9 +222,26 @@ on_heartbeat_ack(struct discord_voice *vc)
   log_trace("PING: %d ms", vc->ping_ms);
 }
 
+static void noop_idle_cb(struct discord *a, struct discord_voice *b, const struct discord_user *c) { return; }
+
+static void
+on_idle_timer(struct websockets *ws, void *p_vc)
+{
+  struct discord_voice *vc = p_vc;
+  if (!vc->is_ready) return; /* EARLY RETURN */
+
+  (*vc->p_client->voice_cbs.on_idle)(vc->p_client, vc, &vc->p_client->gw.bot);
+}
+
 static void
-on_connect_cb(void *p_vc, struct websockets *ws, struct ws_info *info, const char *ws_protocols) {
+on_connect_cb(void *p_vc, struct websockets *ws, struct ws_info *info, const char *ws_protocols) 
+{
+  struct discord_voice *vc = p_vc;
   log_info("Connected, WS-Protocols: '%s'", ws_protocols);
+
+  // the user's idle callback is ran from a timer, an idle connection without one sleeps
+  if (vc->p_client->voice_cbs.on_idle != &noop_idle_cb)
+    vc->idle_timer_id = ws_timer_add(vc->ws, DISCORD_IDLE_INTERVAL_MS, DISCORD_IDLE_INTERVAL_MS, &on_idle_timer, vc);
 }
 
 static void
@@ -341,6 +376,95 @@ reset_vc(struct discord_voice *vc) {
   vc->shutdown = false;
 }
 
+/* 
+ * the connection is over, handle ws reconnect/resume/redirect logic
+ *  (ran by the voice event-loop, see voice_loop_run())
+ */
+static void
+on_disconnect_cb(void *p_vc, struct websockets *ws, struct ws_info *info)
+{
+  struct discord_voice *vc = p_vc;
+
+  vc->is_ready = false;
+  if (vc->idle_timer_id) {
+    ws_timer_cancel(vc->ws, vc->idle_timer_id);
+    vc->idle_timer_id = 0;
+  }
+  if (vc->hbeat.timer_id) {
+    ws_timer_cancel(vc->ws, vc->hbeat.timer_id);
+    vc->hbeat.timer_id = 0;
+  }
+
+  log_debug("after disconnect "
+            "reconnect.attempt:%d, reconnect.enable:%d, is_resumable:%d, "
+            "redirect:%d",
+            vc->reconnect.attempt, vc->reconnect.enable, vc->is_resumable,
+            vc->is_redirect);
+
+  if (vc->is_redirect) {
+    log_info("update the token and url");
+    memcpy(vc->token, vc->new_token, sizeof(vc->token));
+    ws_set_url(vc->ws, vc->new_url, NULL);
+    vc->is_redirect = false;
+    vc->reconnect.attempt = 0;
+    vc->reconnect.enable = true;
+    vc->is_resumable = false;
+    ws_start(vc->ws);
+    return; /* EARLY RETURN */
+  }
+
+  if (!vc->reconnect.enable) {
+    log_warn("Discord Voice Shutdown");
+  }
+  else if (++vc->reconnect.attempt < vc->reconnect.threshold) {
+    log_info("Reconnect attempt #%d", vc->reconnect.attempt);
+    ws_start(vc->ws);
+    return; /* EARLY RETURN */
+  }
+  else if (!vc->shutdown) {
+    log_error("Could not reconnect to Discord Voice after %d tries", vc->reconnect.threshold);
+  }
+
+  if (vc->shutdown)
+    log_info(ANSICOLOR("Voice ws was closed per request",ANSI_BG_BLUE));
+  log_debug("exiting %"PRIu64":%"PRIu64, vc->guild_id, vc->channel_id);
+  reset_vc(vc);
+  vc->guild_id = 0; // put this back to the pool
+}
+
+/* serve the voice connections until discord_voice_connections_cleanup(),
+ *  their heartbeats and on_idle() are ran from timers */
+static void*
+voice_loop_run(void *p_loop)
+{
+  struct discord_voice_loop *loop = p_loop;
+  log_info("new voice event-loop thread");
+  while (1) {
+    pthread_mutex_lock(&loop->lock);
+    bool is_running = loop->is_running;
+    pthread_mutex_unlock(&loop->lock);
+    if (!is_running) break; // exit event loop
+
+    // woken up by ws_start(), ws_close() and sends from other threads
+    ws_reactor_perform(loop->reactor, 1000);
+  }
+  log_info("exit voice event-loop thread");
+  return NULL;
+}
+
+/* the thread is started along with the first voice connection */
+static void
+voice_loop_start(struct discord_voice_loop *loop)
+{
+  pthread_mutex_lock(&loop->lock);
+  if (!loop->is_running) {
+    loop->is_running = true;
+    if (pthread_create(&loop->tid, NULL, &voice_loop_run, loop))
+      ERR("Couldn't create thread");
+  }
+  pthread_mutex_unlock(&loop->lock);
+}
+
 static void
 _discord_voice_init(
   struct discord_voice *new_vc,
@@ -357,9 +481,13 @@ _discord_voice_init(
       .data = new_vc,
       .on_connect = &on_connect_cb,
       .on_text = &on_text_cb,
-      .on_close = &on_close_cb
+      .on_close = &on_close_cb,
+      .on_disconnect = &on_disconnect_cb
     };
     new_vc->ws = ws_init(&cbs, new_vc->p_client->conf);
+    // served by the voice event-loop, along with the other voice connections
+    ws_set_reactor(new_vc->ws, client->voice_loop->reactor);
+    voice_loop_start(client->voice_loop);
     new_vc->reconnect.threshold = 5; /** hard limit for now */
     new_vc->reconnect.enable = true;
   }
@@ -454,7 +582,7 @@ send_voice_state_update(
   }
   ASSERT_S(ret < sizeof(payload), "Out of bounds write attempt");
   log_info(msg, payload);
-  ws_send_text(gw->ws, NULL, payload, ret);
+  discord_gateway_send(gw, NULL, payload, ret);
 }
 
 enum discord_join_vc_status
@@ -548,85 +676,6 @@ _discord_on_voice_state_update(struct discord *client, struct discord_voice_stat
   }
 }
 
-static void
-event_loop(struct discord_voice *vc)
-{
-  struct discord *client = vc->p_client;
-  ws_start(vc->ws);
-
-  bool is_running=false;
-
-  // everything goes well, ws event_loop to serve
-  // the ws server side events
-  while (1) {
-    ws_perform(vc->ws, &is_running, 100);
-    if (!is_running) break; // exit event loop
-    if (!vc->is_ready) continue; // wait until on_ready()
-
-    // connection is established
-    /*check if timespan since first pulse is greater than
-     * minimum heartbeat interval required*/
-    if (vc->hbeat.interval_ms < (ws_timestamp(vc->ws) - vc->hbeat.tstamp)) {
-      send_heartbeat(vc);
-      vc->hbeat.tstamp = ws_timestamp(vc->ws); //update heartbeat timestamp
-    }
-    if (client->voice_cbs.on_idle)
-      (*client->voice_cbs.on_idle)(client, vc, &vc->p_client->gw.bot);
-  }
-  vc->is_ready = false;
-}
-
-static void*
-start_voice_ws_thread(void *p_vc) 
-{
-  log_info("new voice ws thread");
-  struct discord_voice *vc = p_vc;
-
-  // handle ws reconnect/resume/redirect logic
-  while (vc->reconnect.attempt < vc->reconnect.threshold) 
-  {
-    event_loop(vc);
-
-    log_debug("after event_loop "
-              "reconnect.attempt:%d, reconnect.enable:%d, is_resumable:%d, "
-              "redirect:%d",
-              vc->reconnect.attempt, vc->reconnect.enable, vc->is_resumable,
-              vc->is_redirect);
-
-    if (vc->is_redirect) {
-      log_info("update the token and url");
-      memcpy(vc->token, vc->new_token, sizeof(vc->token));
-      ws_set_url(vc->ws, vc->new_url, NULL);
-      vc->is_redirect = false;
-      vc->reconnect.attempt = 0;
-      vc->reconnect.enable = true;
-      vc->is_resumable = false;
-      continue;
-    }
-
-    if (!vc->reconnect.enable) {
-      log_warn("Discord Voice Shutdown");
-      goto _end;
-    }
-
-    ++vc->reconnect.attempt;
-    log_info("Reconnect attempt #%d", vc->reconnect.attempt);
-  }
-
-  if (!vc->shutdown)
-    log_error("Could not reconnect to Discord Voice after %d tries", vc->reconnect.threshold);
-
-  // exit from the event loop;
-  _end:
-  if (vc->shutdown)
-    log_info(ANSICOLOR("Voice ws was closed per request",ANSI_BG_BLUE));
-  log_debug("exiting %"PRIu64":%"PRIu64, vc->guild_id, vc->channel_id);
-  reset_vc(vc);
-  vc->guild_id = 0; // put this back to the pool
-  log_info("exit voice ws thread");
-  return NULL;
-}
-
 /*
  * 1. join a vc -> create a new ws connection
  * 2. change voice region -> redirect an existing ws connection
@@ -672,20 +721,13 @@ _discord_on_voice_server_update(struct discord *client, u64_snowflake_t guild_id
 
     memcpy(vc->token, vc->new_token, sizeof(vc->new_token));
     ws_set_url(vc->ws, vc->new_url, NULL);
-    /*
-     * spawn a new thread
-     */
-    pthread_t tid;
-    if (pthread_create(&tid, NULL, &start_voice_ws_thread, vc))
-      ERR("Couldn't create thread");
-    if (pthread_detach(tid))
-      ERR("Couldn't detach thread");
+    // connected by the voice event-loop @see on_disconnect_cb()
+    ws_start(vc->ws);
   }
 }
 
 static void noop_voice_state_update_cb(struct discord *a, const struct discord_user *b, const struct discord_voice_state *c) {return;}
 static void noop_voice_server_update_cb(struct discord *a, const struct discord_user *b, const char *c, const u64_snowflake_t d, const char *endpoint) {return;}
-static void noop_idle_cb(struct discord *a, struct discord_voice *b, const struct discord_user *c) { return; }
 static void noop_on_speaking(struct discord *a, struct discord_voice *b, const struct discord_user *c, const u64_snowflake_t d, const int e, const int f, const int g) { return; }
 static void noop_on_voice_client_disconnect(struct discord *a, struct discord_voice *b, const struct discord_user *c, const u64_snowflake_t d) { return; }
 static void noop_on_voice_codec(struct discord *a, struct discord_voice *b, const struct discord_user *c, const char d[], const char e[]) { return; }
@@ -710,6 +752,43 @@ discord_voice_connections_init(struct discord *client)
   for (int i=0; i < DISCORD_MAX_VOICE_CONNECTIONS; ++i) {
     client->vcs[i].p_voice_cbs = &client->voice_cbs;
   }
+
+  struct discord_voice_loop *loop = calloc(1, sizeof *loop);
+  if (pthread_mutex_init(&loop->lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
+  loop->reactor = ws_reactor_init(client->conf);
+  client->voice_loop = loop;
+}
+
+void
+discord_voice_connections_cleanup(struct discord *client)
+{
+  struct discord_voice_loop *loop = client->voice_loop;
+
+  pthread_mutex_lock(&loop->lock);
+  bool is_running = loop->is_running;
+  loop->is_running = false;
+  pthread_mutex_unlock(&loop->lock);
+
+  if (is_running) {
+    // the thread is started once a handle is attached to its reactor
+    for (int i=0; i < DISCORD_MAX_VOICE_CONNECTIONS; ++i) {
+      if (client->vcs[i].ws) {
+        ws_wakeup(client->vcs[i].ws);
+        break;
+      }
+    }
+    pthread_join(loop->tid, NULL);
+  }
+  for (int i=0; i < DISCORD_MAX_VOICE_CONNECTIONS; ++i) {
+    if (client->vcs[i].ws) {
+      ws_cleanup(client->vcs[i].ws);
+      client->vcs[i].ws = NULL;
+    }
+  }
+  ws_reactor_cleanup(loop->reactor);
+  pthread_mutex_destroy(&loop->lock);
+  free(loop);
 }
 
 void
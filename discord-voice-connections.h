@@ -67,7 +67,7 @@ typedef void (*discord_voice_codec_cb)(
 
 
 struct discord_voice_cbs { /* CALLBACKS STRUCTURE */
-  discord_voice_idle_cb  on_idle; ///< triggers on every event loop iteration
+  discord_voice_idle_cb  on_idle; ///< triggers every DISCORD_IDLE_INTERVAL_MS
   discord_voice_speaking_cb on_speaking; ///< triggers when a user start speaking
   discord_voice_client_disconnect_cb on_client_disconnect; ///< triggers when a user has disconnected from the voice channel
   discord_voice_codec_cb on_codec; ///< triggers when a codec is received
@@ -107,6 +107,7 @@ struct discord_voice {
 
   bool is_redirect; ///< redirect to a different voice server
   bool is_ready; ///< can start sending/receiving additional events to discord
+  unsigned idle_timer_id; ///< the on_idle() timer @see ws_timer_add()
 
   /**
    * @see https://discord.com/developers/docs/topics/voice-connections#establishing-a-voice-websocket-connection-example-voice-ready-payload
@@ -119,6 +120,7 @@ struct discord_voice {
   struct { /* HEARTBEAT STRUCTURE */
     u64_unix_ms_t interval_ms; /**<fixed interval between heartbeats */
     u64_unix_ms_t tstamp; /**<start pulse timestamp in milliseconds */
+    unsigned timer_id; /**<the heartbeat timer @see ws_timer_add() */
   } hbeat;
 
   int ping_ms; ///< latency between client and websockets server, calculated by the interval between HEARTBEAT and HEARTBEAT_ACK
@@ -253,4 +255,11 @@ bool discord_voice_is_alive(struct discord_voice *vc);
  */
 void discord_voice_connections_init(struct discord *client);
 
+/**
+ * @brief Stop the voice connections' event-loop, and free their handles
+ *
+ * @param client the client created with discord_init()
+ */
+void discord_voice_connections_cleanup(struct discord *client);
+
 #endif // DISCORD_VOICE_CONNECTIONS_H
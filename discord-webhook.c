@@ -309,21 +309,24 @@ discord_execute_webhook(
   }
 
   // content-type is multipart/form-data
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "multipart/form-data");
-  ua_curl_mime_setopt(client->adapter.ua, params->file, &discord_file_to_mime);
+  struct ua_multipart multipart={0};
+  ORCAcode code = discord_file_to_multipart(
+                    &(struct discord_file){ 
+                      .content = params->file, 
+                      .size = strlen(params->file) 
+                    }, 
+                    &multipart);
+  if (ORCA_OK != code) return code; /* EARLY RETURN */
 
-  ORCAcode code;
   code = discord_adapter_run( 
            &client->adapter,
            &resp_handle,
-           NULL,
+           UA_MULTIPART_BODY(&multipart),
            HTTP_MIMEPOST, 
            "/webhooks/%"PRIu64"/%s%s%s", 
            webhook_id, webhook_token, *query ? "?" : "", query);
 
-  //set back to default
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "application/json");
-  ua_curl_mime_setopt(client->adapter.ua, NULL, NULL);
+  ua_multipart_cleanup(&multipart);
 
   return code;
 }
@@ -411,21 +414,24 @@ discord_edit_webhook_message(
   }
 
   // content-type is multipart/form-data
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "multipart/form-data");
-  ua_curl_mime_setopt(client->adapter.ua, params->file, &discord_file_to_mime);
+  struct ua_multipart multipart={0};
+  ORCAcode code = discord_file_to_multipart(
+                    &(struct discord_file){ 
+                      .content = params->file, 
+                      .size = strlen(params->file) 
+                    }, 
+                    &multipart);
+  if (ORCA_OK != code) return code; /* EARLY RETURN */
 
-  ORCAcode code;
   code = discord_adapter_run( 
            &client->adapter,
            &resp_handle,
-           NULL,
+           UA_MULTIPART_BODY(&multipart),
            HTTP_MIMEPOST, 
            "/webhooks/%"PRIu64"/%s/messages/%"PRIu64, 
            webhook_id, webhook_token, message_id);
 
-  //set back to default
-  ua_reqheader_add(client->adapter.ua, "Content-Type", "application/json");
-  ua_curl_mime_setopt(client->adapter.ua, NULL, NULL);
+  ua_multipart_cleanup(&multipart);
 
   return code;
 }
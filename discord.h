@@ -19,7 +19,10 @@
 
 #define DISCORD_API_BASE_URL "https://discord.com/api/v9"
 #define DISCORD_GATEWAY_URL_SUFFIX "?v=9&encoding=json"
+#define DISCORD_GATEWAY_ETF_URL_SUFFIX "?v=9&encoding=etf"
+#define DISCORD_GATEWAY_COMPRESS_SUFFIX "&compress=zlib-stream"
 #define DISCORD_VOICE_CONNECTIONS_URL_SUFFIX "?v=4"
+#define DISCORD_IDLE_INTERVAL_MS 5 ///< interval between idle callbacks @see discord_set_on_idle()
 
 /* FORWARD DECLARATIONS */
 struct discord;
@@ -85,7 +88,8 @@ typedef enum discord_event_handling_mode (*discord_event_mode_cb)(struct discord
 /** 
  * @brief Idle callback
  *
- * Runs on every WebSockets loop iteration, no trigger required
+ * Runs every DISCORD_IDLE_INTERVAL_MS once the session is ready, no
+ *        trigger required
  * @see discord_set_on_idle()
  */
 typedef void (*discord_idle_cb)(struct discord *client, const struct discord_user *bot);
@@ -496,7 +500,7 @@ void discord_set_on_command(struct discord *client, char *command, discord_messa
 void discord_set_on_event_raw(struct discord *client, discord_event_raw_cb callback);
 
 /**
- * @brief Set a callback that triggers at every event-loop iteration.
+ * @brief Set a callback that triggers every DISCORD_IDLE_INTERVAL_MS
  *
  * @param client the client created with discord_init()
  * @param callback the callback that will be executed
@@ -747,6 +751,8 @@ void discord_set_on_voice_server_update(struct discord *client, discord_voice_se
  *
  * @param client the client created with discord_init()
  * @param callbacks the voice callbacks that will be executed
+ * @note the callbacks are ran from the voice connections' thread, not
+ *        the Gateway's
  */
 void discord_set_voice_cbs(struct discord *client, struct discord_voice_cbs *callbacks);
 
@@ -801,6 +807,261 @@ void discord_replace_presence(struct discord *client, struct discord_gateway_sta
  */
 void discord_set_presence(struct discord *client, struct discord_activity *activity, char status[], bool afk);
 
+/**
+ * @brief Gateway traffic counters
+ *
+ * @see discord_get_gateway_stats()
+ */
+struct discord_gateway_stats {
+  uint64_t bytes_received; ///< compressed payload bytes received
+  uint64_t bytes_inflated; ///< payload bytes after inflating
+  uint64_t amt_payloads;   ///< amount of compressed payloads received
+};
+
+/**
+ * @brief Tune the transport of REST requests
+ *
+ * Also set by the "discord.http" field of the config file given to 
+ *        discord_config_init(), as in 
+ *        `"http": { "dns_tls_cache": true, "http2": false }`
+ * @param client the client created with discord_init()
+ * @param dns_tls_cache cache DNS lookups and TLS sessions, so that new 
+ *        connections don't redo them (enabled by default)
+ * @param http2 negotiate HTTP/2 with Discord (disabled by default)
+ * @note should be called on the original client (not a clone) while no
+ *        requests are being performed, its clones follow the setting
+ */
+void discord_set_http_transport(struct discord *client, bool dns_tls_cache, bool http2);
+
+/**
+ * @brief Summary of a REST route's histogram, in microseconds
+ *
+ * @see discord_get_route_stats()
+ */
+struct discord_route_stats {
+  uint64_t count; ///< amount of recorded requests
+  uint64_t min;
+  uint64_t max;
+  double mean;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+};
+
+/**
+ * @brief Get the summary of a REST route's timings
+ *
+ * A route is the HTTP method and the endpoint format string used by 
+ *        the wrapper, so that requests differing only on their IDs share
+ *        the same histograms
+ * @param client the client created with discord_init()
+ * @param method the HTTP method, as in "GET"
+ * @param endpoint the endpoint format string, as in "/channels/%"PRIu64
+ * @param is_ratelimited true for the time spent waiting on the route's
+ *        ratelimit, false for the whole transfer time
+ * @param p_stats receives the summary
+ * @return false if no request has been performed on the route
+ * @note shared by the client and all of its clones
+ */
+bool discord_get_route_stats(struct discord *client, char method[], char endpoint[], bool is_ratelimited, struct discord_route_stats *p_stats);
+
+/**
+ * @brief Dump every REST route's histograms in the Prometheus text
+ *        exposition format
+ *
+ * @param client the client created with discord_init()
+ * @param buf the buffer to write to
+ * @param bufsize the buffer size
+ * @return the length of the whole dump (excluding the nul terminator),
+ *        if >= bufsize then the output was truncated
+ */
+size_t discord_dump_route_stats(struct discord *client, char buf[], size_t bufsize);
+
+/**
+ * @brief Record every REST response to a file, to be replayed later with
+ *        discord_set_replay()
+ *
+ * @param client the client created with discord_init()
+ * @param path the file to record to (truncated), NULL to stop recording
+ * @return ORCA_OK, or ORCA_BAD_PARAMETER if the file can't be opened
+ * @note shared by the client and all of its clones, should be set while
+ *        none of them has a request in flight
+ */
+ORCAcode discord_set_record(struct discord *client, const char path[]);
+
+/**
+ * @brief Serve REST requests the responses recorded with 
+ *        discord_set_record() instead of reaching Discord
+ *
+ * Responses are matched by method and URL, headers included so that
+ *        the ratelimiting behaves as recorded
+ * @param client the client created with discord_init()
+ * @param path the recording, NULL to stop replaying
+ * @param speed the replay speed factor over the recorded durations
+ *        (ex: 10 is ten times faster), 0 to replay without delays
+ * @return ORCA_OK, or ORCA_BAD_PARAMETER if the recording can't be read
+ * @note shared by the client and all of its clones, should be set while
+ *        none of them has a request in flight
+ */
+ORCAcode discord_set_replay(struct discord *client, const char path[], double speed);
+
+/**
+ * @brief Enable or disable the Gateway's zlib-stream transport compression
+ *
+ * Disabled by default, takes effect on the next connection
+ * @param client the client created with discord_init()
+ * @param enable true to receive compressed payloads
+ */
+void discord_set_gateway_compress(struct discord *client, bool enable);
+
+/**
+ * @brief Enable or disable the Gateway's ETF (Erlang Term Format) encoding
+ *
+ * Disabled by default, takes effect on the next connection. MESSAGE_CREATE,
+ *        MESSAGE_UPDATE and GUILD_MEMBER_ADD are decoded straight from ETF
+ *        unless a raw JSON callback needs them, other events are transcoded
+ *        to JSON
+ * @param client the client created with discord_init()
+ * @param enable true to receive and send ETF payloads
+ */
+void discord_set_gateway_etf(struct discord *client, bool enable);
+
+/**
+ * @brief Get the Gateway traffic counters, accumulated over connections
+ *
+ * @param client the client created with discord_init()
+ * @param p_stats receives the counters
+ */
+void discord_get_gateway_stats(struct discord *client, struct discord_gateway_stats *p_stats);
+
+/**
+ * @brief The state of a Gateway shard
+ *
+ * @see discord_get_shard_info()
+ */
+enum discord_shard_status {
+  DISCORD_SHARD_DISCONNECTED = 0, ///< not running, or gave up reconnecting
+  DISCORD_SHARD_QUEUED,           ///< waiting for its turn to IDENTIFY
+  DISCORD_SHARD_CONNECTING,       ///< connecting, identifying or resuming
+  DISCORD_SHARD_READY             ///< receiving events
+};
+
+/**
+ * @brief A Gateway shard's state and latency
+ *
+ * @see discord_get_shard_info()
+ */
+struct discord_shard_info {
+  int id;                           ///< the shard id
+  enum discord_shard_status status; ///< the shard's state
+  int ping_ms;                      ///< latency between the last HEARTBEAT and its ACK
+  int reconnects;                   ///< reconnect attempts since the last READY
+  int guilds;                       ///< amount of guilds served by the shard
+};
+
+/**
+ * @brief Split the Gateway connection into shards, each a session of its own
+ *
+ * The shards are connected from discord_run(), on the same thread. Their
+ *        IDENTIFYs are scheduled one per max_concurrency bucket every 5
+ *        seconds, and their events are served by the same callbacks,
+ *        the shard id can be obtained with discord_get_shard_id()
+ * @param client the client created with discord_init()
+ * @param shard_id the first shard ran by this client
+ * @param amt_shards the amount of shards ran by this client from
+ *        @a shard_id, 0 for every shard
+ * @param total_shards the total amount of shards, 0 for the amount
+ *        recommended by Discord
+ * @see https://discord.com/developers/docs/topics/gateway#sharding
+ */
+void discord_set_shards(struct discord *client, int shard_id, int amt_shards, int total_shards);
+
+/**
+ * @brief Get the shard id of the session serving an event
+ *
+ * @param client the client received by an event callback
+ * @return the shard id, 0 if the client isn't sharded
+ */
+int discord_get_shard_id(struct discord *client);
+
+/**
+ * @brief Get a shard's state and latency
+ *
+ * @param client the client created with discord_init(), or received by an
+ *        event callback
+ * @param shard_id the shard id
+ * @param p_info receives the shard information
+ * @return ORCA_OK, or ORCA_BAD_PARAMETER if the shard isn't ran by this client
+ */
+ORCAcode discord_get_shard_info(struct discord *client, int shard_id, struct discord_shard_info *p_info);
+
+/**
+ * @brief The coordinator of a cluster of worker processes
+ *
+ * @see discord_cluster_coordinate()
+ */
+struct discord_cluster_config {
+  char *socket_path;   ///< the Unix domain socket the workers connect to
+  int amt_workers;     ///< the shards are split between this amount of workers
+  int total_shards;    ///< 0 for the amount recommended by Discord
+  int max_concurrency; ///< IDENTIFYs allowed every 5 seconds, 0 for Discord's
+  char *gateway_url;   ///< NULL for Discord's, or a local stub Gateway for testing
+};
+
+/**
+ * @brief Coordinate the worker processes of a cluster
+ *
+ * Each worker connecting to the socket is assigned a range of shards, a
+ *        worker that exits before its discord_run() returns (i.e. it
+ *        crashed) has its range handed to the next worker that connects.
+ *        The IDENTIFYs of every worker are scheduled together, and the
+ *        stats set by the workers are summed up and relayed back to them.
+ * @param client the client created with discord_init(), only used to ask
+ *        Discord for the missing configuration
+ * @param config the cluster's configuration
+ * @return ORCA_OK once every shard range left
+ * @see discord_set_cluster()
+ */
+ORCAcode discord_cluster_coordinate(struct discord *client, struct discord_cluster_config *config);
+
+/**
+ * @brief Run the shards assigned by a cluster coordinator
+ *
+ * The shards are connected from discord_run() as with
+ *        discord_set_shards(), but waiting for the coordinator's go to
+ *        IDENTIFY. The connection to the coordinator is made by discord_run()
+ * @param client the client created with discord_init()
+ * @param socket_path the coordinator's Unix domain socket
+ * @see discord_cluster_coordinate()
+ */
+void discord_set_cluster(struct discord *client, const char socket_path[]);
+
+/**
+ * @brief Set this process' value of a cluster-wide stat
+ *
+ * The "guilds" stat is set by the library.
+ * @param client the client
+ * @param name the stat's name, up to 31 characters
+ * @param value this process' value
+ * @return ORCA_OK, ORCA_MISSING_PARAMETER if the client isn't part of a
+ *        cluster, or ORCA_BAD_PARAMETER if there are too many stats
+ */
+ORCAcode discord_cluster_set_stat(struct discord *client, const char name[], long value);
+
+/**
+ * @brief Get the sum of a stat across the cluster's workers
+ *
+ * The sum is relayed by the coordinator, and so lags behind the
+ *        workers' updates by a few milliseconds.
+ * @param client the client
+ * @param name the stat's name, e.g. "guilds" for the total amount of guilds
+ * @param p_total receives the sum
+ * @return ORCA_OK, ORCA_MISSING_PARAMETER if the client isn't part of a
+ *        cluster, or ORCA_BAD_PARAMETER if the stat is unknown
+ */
+ORCAcode discord_cluster_get_stat(struct discord *client, const char name[], long *p_total);
+
 
  /* * * * * * * * * * * * * * * * */
 /* * * * ENDPOINT FUNCTIONS * * * */
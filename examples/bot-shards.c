@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "discord.h"
+
+
+void on_ready(struct discord *client, const struct discord_user *bot) {
+  log_info("Shards-Bot shard #%d succesfully connected to Discord as %s#%s!",
+      discord_get_shard_id(client), bot->username, bot->discriminator);
+}
+
+void on_shards(
+  struct discord *client,
+  const struct discord_user *bot,
+  const struct discord_message *msg)
+{
+  if (msg->author->bot) return;
+
+  static const char *status[] = { "disconnected", "queued", "connecting", "ready" };
+  char text[DISCORD_MAX_MESSAGE_LEN];
+  size_t len = snprintf(text, sizeof(text), "Served by shard #%d\n",
+                 discord_get_shard_id(client));
+
+  struct discord_shard_info info;
+  for (int id=0; len < sizeof(text)
+                   && ORCA_OK == discord_get_shard_info(client, id, &info); ++id)
+  {
+    len += snprintf(text + len, sizeof(text) - len,
+             "shard #%d: %s, %d ms, %d reconnects\n",
+             info.id, status[info.status], info.ping_ms, info.reconnects);
+  }
+
+  struct discord_create_message_params params = { .content = text };
+  discord_create_message(client, msg->channel_id, &params, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *config_file;
+  if (argc > 1)
+    config_file = argv[1];
+  else
+    config_file = "../config.json";
+  int total_shards = (argc > 2) ? atoi(argv[2]) : 0;
+
+  discord_global_init();
+
+  struct discord *client = discord_config_init(config_file);
+
+  // run every shard from this process, 0 for Discord's recommendation
+  discord_set_shards(client, 0, 0, total_shards);
+
+  discord_set_on_ready(client, &on_ready);
+  discord_set_on_command(client, "shards", &on_shards);
+
+  printf("\n\nThis bot demonstrates how to run a sharded bot.\n"
+         "Usage: ./bot-shards.out [config.json] [total_shards]\n"
+         "1. Type 'shards' in chat to list the shards' state and latency\n"
+         "\nTYPE ANY KEY TO START BOT\n");
+  fgetc(stdin); // wait for input
+
+  discord_run(client);
+
+  discord_cleanup(client);
+
+  discord_global_cleanup();
+}
@@ -10,6 +10,7 @@
 #include "cee-utils.h"
 
 #define GITHUB_BASE_API_URL "https://api.github.com"
+#define GITHUB_CACHE_SIZE   (4 * 1024 * 1024) // revalidated responses cache, in bytes
 
 void
 github_adapter_cleanup(struct github_adapter *adapter) {
@@ -31,6 +32,8 @@ github_adapter_init(struct github_adapter *adapter, struct logconf *conf, struct
   ua_set_url(adapter->ua, GITHUB_BASE_API_URL);
   ua_reqheader_add(adapter->ua, "Accept", "application/vnd.github.v3+json");
   ua_curl_easy_setopt(adapter->ua, presets, &curl_easy_setopt_cb);
+  // 304 responses don't count against GitHub's ratelimit
+  ua_set_cache(adapter->ua, GITHUB_CACHE_SIZE);
 }
 
 static void
@@ -61,6 +64,7 @@ github_adapter_run(
     NULL,
     resp_handle,
     req_body,
+    NULL,
     http_method, endpoint, args);
 
   va_end(args);
@@ -36,6 +36,7 @@ reddit_adapter_init(struct reddit_adapter *adapter, struct logconf *conf)
   logconf_branch(&adapter->conf, conf, "REDDIT_HTTP");
 
   ua_curl_easy_setopt(adapter->ua, adapter->p_client, &curl_setopt_cb);
+  ua_set_cache(adapter->ua, REDDIT_CACHE_SIZE);
 
   char auth[512];
   snprintf(auth, sizeof(auth), "orca:github.com/cee-studio/orca:v.0 (by /u/%.*s)",
@@ -77,6 +78,7 @@ reddit_adapter_run(
              .ok_obj = resp_body
            },
            req_body,
+           NULL,
            http_method, endpoint, args);
 
   va_end(args);
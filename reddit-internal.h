@@ -11,6 +11,7 @@
 
 #define BASE_API_URL "https://www.reddit.com"
 #define BASE_OAUTH_URL "https://oauth.reddit.com"
+#define REDDIT_CACHE_SIZE (4 * 1024 * 1024) // revalidated responses cache, in bytes
 
 
 struct reddit_adapter {
@@ -16,18 +16,15 @@ slack_apps_connections_open(struct slack *client, struct sized_buffer *p_resp_bo
 
   ret = snprintf(auth, sizeof(auth), "Bearer %.*s", (int)client->app_token.size, client->app_token.start);
   ASSERT_S(ret < sizeof(auth), "Out of bounds write attempt");
-  ua_reqheader_add(client->webapi.ua, "Authorization", auth);
 
-  ORCAcode code;
-  code = slack_webapi_run(
+  // the app token is only used for this request
+  return slack_webapi_run(
            &client->webapi,
            p_resp_body,
            NULL,
+           (struct ua_reqheader_field[]){
+             { "Authorization", auth },
+             { NULL }
+           },
            HTTP_POST, "/apps.connections.open");
-
-  ret = snprintf(auth, sizeof(auth), "Bearer %.*s", (int)client->bot_token.size, client->bot_token.start);
-  ASSERT_S(ret < sizeof(auth), "Out of bounds write attempt");
-  ua_reqheader_add(client->webapi.ua, "Authorization", auth);
-
-  return code;
 }
@@ -7,5 +7,6 @@ slack_auth_test(struct slack *client, struct sized_buffer *p_resp_body) {
            &client->webapi,
            p_resp_body,
            NULL,
+           NULL,
            HTTP_POST, "/auth.test");
 }
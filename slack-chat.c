@@ -47,17 +47,17 @@ slack_chat_post_message(
     return ORCA_BAD_PARAMETER;
   }
 
-  ua_reqheader_add(client->webapi.ua, "Content-type", "application/json");
-
   ORCAcode code;
   code = slack_webapi_run(
            &client->webapi,
            p_resp_body,
            &(struct sized_buffer){ payload, ret },
+           (struct ua_reqheader_field[]){
+             { "Content-type", "application/json" },
+             { NULL }
+           },
            HTTP_POST, "/chat.postMessage");
 
-  ua_reqheader_add(client->webapi.ua, "Content-type", "application/x-www-form-urlencoded");
-
   free(payload);
 
   return code;
@@ -77,3 +77,8 @@ void
 slack_sm_set_on_view_submission(struct slack *client, slack_idle_cb callback) {
   client->sm.cbs.on_view_submission = callback;
 }
+
+void
+slack_sm_set_deflate(struct slack *client, bool enable) {
+  ws_set_deflate(client->sm.ws, &(struct ws_deflate_config){ .enable = enable });
+}
@@ -26,6 +26,7 @@ ORCAcode slack_webapi_run(
   struct slack_webapi *webapi, 
   struct sized_buffer *p_resp_body,
   struct sized_buffer *req_body,
+  struct ua_reqheader_field overlay[],
   enum http_method http_method, char endpoint[], ...);
 
 struct slack_sm {
@@ -36,5 +36,6 @@ slack_users_info(
            &client->webapi,
            p_resp_body,
            &(struct sized_buffer){ query, ret },
+           NULL,
            HTTP_POST, "/users.info");
 }
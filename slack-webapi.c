@@ -49,6 +49,7 @@ slack_webapi_run(
   struct slack_webapi *webapi, 
   struct sized_buffer *resp_body,
   struct sized_buffer *req_body,
+  struct ua_reqheader_field overlay[],
   enum http_method http_method, char endpoint[], ...)
 {
   va_list args;
@@ -63,6 +64,7 @@ slack_webapi_run(
              .ok_obj = resp_body
            },
            req_body,
+           overlay,
            http_method, endpoint, args);
 
   va_end(args);
@@ -41,6 +41,8 @@ void slack_sm_set_on_block_actions(struct slack *client, slack_idle_cb callback)
 void slack_sm_set_on_message_actions(struct slack *client, slack_idle_cb callback);
 void slack_sm_set_on_view_closed(struct slack *client, slack_idle_cb callback);
 void slack_sm_set_on_view_submission(struct slack *client, slack_idle_cb callback);
+// offer permessage-deflate from the next connection (off by default)
+void slack_sm_set_deflate(struct slack *client, bool enable);
 
 
 void slack_sm_run(struct slack *client);
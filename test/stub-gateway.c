@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stub-gateway.h"
+#include "cee-utils.h"
+
+static int
+respond(void *data, struct stub_request *req, char resp[], size_t size)
+{
+  struct stub_gateway *gw = data;
+  if (!strstr(req->path, "/gateway/bot"))
+    return stub_server_reply(resp, size, 404, "", "{\"message\":\"404: Not Found\",\"code\":0}");
+
+  char body[512];
+  snprintf(body, sizeof(body),
+      "{\"url\":\"ws://127.0.0.1:%hu\",\"shards\":%d,"
+      "\"session_start_limit\":{\"total\":1000,\"remaining\":1000,"
+        "\"reset_after\":0,\"max_concurrency\":%d}}",
+      gw->server.port, gw->shards, gw->max_concurrency);
+  return stub_server_reply(resp, size, 200, "", body);
+}
+
+static void
+on_open(void *data, struct stub_ws *ws)
+{
+  (void)data;
+  const char hello[] = "{\"t\":null,\"s\":null,\"op\":10,\"d\":{\"heartbeat_interval\":41250}}";
+  stub_ws_send(ws, STUB_WS_TEXT, hello, sizeof(hello) - 1);
+}
+
+/* record the IDENTIFY, and answer READY with the shard's guilds */
+static void
+on_identify(struct stub_gateway *gw, struct stub_ws *ws, const char msg[])
+{
+  struct stub_identify identify = { .shard_id = -1, .tstamp = cee_timestamp_ms() };
+  const char *shard = strstr(msg, "\"shard\":[");
+  if (shard)
+    sscanf(shard, "\"shard\":[%d,%d]", &identify.shard_id, &identify.shard_total);
+
+  pthread_mutex_lock(&gw->lock);
+  if (gw->amt_identifies < STUB_GATEWAY_MAX_IDENTIFIES)
+    gw->identifies[gw->amt_identifies++] = identify;
+  pthread_mutex_unlock(&gw->lock);
+
+  // the guild ids are unique across shards
+  size_t size = 512 + gw->guilds * 64;
+  char *ready = malloc(size);
+  size_t len = snprintf(ready, size,
+      "{\"t\":\"READY\",\"s\":1,\"op\":0,\"d\":{\"v\":9,"
+        "\"session_id\":\"stub-session-%d\","
+        "\"user\":{\"id\":\"1000\",\"username\":\"stub-bot\",\"discriminator\":\"0000\",\"bot\":true},"
+        "\"guilds\":[",
+      identify.shard_id);
+  for (int i=0; i < gw->guilds; ++i)
+    len += snprintf(ready + len, size - len, "%s{\"id\":\"%d\",\"unavailable\":true}",
+             i ? "," : "", (identify.shard_id + 2) * 100000 + i);
+  len += snprintf(ready + len, size - len, "],\"shard\":[%d,%d]}}",
+           identify.shard_id, identify.shard_total);
+  stub_ws_send(ws, STUB_WS_TEXT, ready, len);
+  free(ready);
+}
+
+static void
+on_message(void *data, struct stub_ws *ws, enum stub_ws_opcode opcode, const char msg[], size_t len)
+{
+  (void)len;
+  struct stub_gateway *gw = data;
+  const char *op = strstr(msg, "\"op\":");
+  if (STUB_WS_TEXT != opcode || !op) return; /* EARLY RETURN */
+
+  switch (atoi(op + sizeof("\"op\":") - 1)) {
+  case 1: { // HEARTBEAT
+      const char ack[] = "{\"t\":null,\"s\":null,\"op\":11,\"d\":null}";
+      stub_ws_send(ws, STUB_WS_TEXT, ack, sizeof(ack) - 1);
+      break; }
+  case 2: // IDENTIFY
+      on_identify(gw, ws, msg);
+      break;
+  case 6: { // RESUME
+      const char resumed[] = "{\"t\":\"RESUMED\",\"s\":2,\"op\":0,\"d\":{}}";
+      stub_ws_send(ws, STUB_WS_TEXT, resumed, sizeof(resumed) - 1);
+      break; }
+  default:
+      break;
+  }
+}
+
+void
+stub_gateway_start(struct stub_gateway *gw)
+{
+  if (pthread_mutex_init(&gw->lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
+  gw->amt_identifies = 0;
+  gw->server.respond_cb = &respond;
+  gw->server.ws_open_cb = &on_open;
+  gw->server.ws_message_cb = &on_message;
+  gw->server.data = gw;
+  stub_server_start(&gw->server);
+}
+
+void
+stub_gateway_stop(struct stub_gateway *gw)
+{
+  stub_server_stop(&gw->server);
+}
+
+int
+stub_gateway_get_identifies(struct stub_gateway *gw, struct stub_identify identifies[], int max)
+{
+  pthread_mutex_lock(&gw->lock);
+  int amt = gw->amt_identifies;
+  memcpy(identifies, gw->identifies, (amt < max ? amt : max) * sizeof *identifies);
+  pthread_mutex_unlock(&gw->lock);
+  return amt;
+}
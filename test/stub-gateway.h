@@ -0,0 +1,60 @@
+/*
+ * A local stub of Discord's Gateway, served by the stub server
+ *
+ * GET /gateway/bot answers the Gateway URL (the stub itself), the amount
+ *  of shards and max_concurrency. Each WebSocket connection is sent
+ *  HELLO, its IDENTIFYs are recorded and answered with READY, listing
+ *  as many unavailable guilds as set, and its HEARTBEATs are ACKed.
+ */
+#ifndef STUB_GATEWAY_H
+#define STUB_GATEWAY_H
+
+#include "stub-server.h"
+
+#define STUB_GATEWAY_MAX_IDENTIFIES 64
+
+/**
+ * @brief An IDENTIFY received by the stub Gateway
+ */
+struct stub_identify {
+  int shard_id;    ///< -1 if the IDENTIFY has no shard array
+  int shard_total;
+  uint64_t tstamp; ///< when it was received, in milliseconds
+};
+
+struct stub_gateway {
+  struct stub_server server; ///< serves the Gateway and GET /gateway/bot
+  int shards;                ///< the amount of shards recommended
+  int max_concurrency;       ///< the session_start_limit's max_concurrency
+  int guilds;                ///< unavailable guilds listed by each READY
+  pthread_mutex_t lock;      ///< guards the IDENTIFYs received
+  struct stub_identify identifies[STUB_GATEWAY_MAX_IDENTIFIES];
+  int amt_identifies;        ///< IDENTIFYs received so far
+};
+
+/**
+ * @brief Start the stub server, serving the Gateway
+ *
+ * @param gw the stub Gateway, its server's port is updated if it was 0
+ */
+void stub_gateway_start(struct stub_gateway *gw);
+
+/**
+ * @brief Stop accepting connections
+ *
+ * @param gw the stub Gateway started with stub_gateway_start()
+ */
+void stub_gateway_stop(struct stub_gateway *gw);
+
+/**
+ * @brief Get the IDENTIFYs received so far, in order
+ *
+ * @param gw the stub Gateway
+ * @param identifies receives up to @a max IDENTIFYs
+ * @param max the size of @a identifies
+ * @return the amount of IDENTIFYs received
+ * @note thread-safe
+ */
+int stub_gateway_get_identifies(struct stub_gateway *gw, struct stub_identify identifies[], int max);
+
+#endif // STUB_GATEWAY_H
@@ -0,0 +1,345 @@
+#define _GNU_SOURCE /* strcasestr() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "stub-server.h"
+#include "user-agent.h" /* http_code_print() */
+#include "cee-utils.h"
+#include "curl-websocket-utils.c" /* _cws_sha1(), _cws_encode_base64() */
+
+#define STUB_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+struct stub_client {
+  struct stub_server *server;
+  int clientfd;
+};
+
+bool
+stub_ws_send(struct stub_ws *ws, enum stub_ws_opcode opcode, const char msg[], size_t len)
+{
+  uint8_t header[10];
+  size_t hlen;
+  header[0] = 0x80 | opcode; // FIN
+  if (len < 126) {
+    header[1] = (uint8_t)len;
+    hlen = 2;
+  }
+  else if (len <= UINT16_MAX) {
+    header[1] = 126;
+    header[2] = (uint8_t)(len >> 8);
+    header[3] = (uint8_t)len;
+    hlen = 4;
+  }
+  else {
+    header[1] = 127;
+    for (int i=0; i < 8; ++i)
+      header[2+i] = (uint8_t)((uint64_t)len >> (56 - 8*i));
+    hlen = 10;
+  }
+
+  pthread_mutex_lock(&ws->lock);
+  bool ok = send(ws->clientfd, header, hlen, MSG_NOSIGNAL) == (ssize_t)hlen
+            && (!len || send(ws->clientfd, msg, len, MSG_NOSIGNAL) == (ssize_t)len);
+  pthread_mutex_unlock(&ws->lock);
+  return ok;
+}
+
+void
+stub_ws_close(struct stub_ws *ws, int code)
+{
+  char payload[2] = { (char)(code >> 8), (char)code };
+  stub_ws_send(ws, STUB_WS_CLOSE, payload, sizeof(payload));
+  shutdown(ws->clientfd, SHUT_RDWR); // wakes up the connection's thread
+}
+
+/* answer the upgrade request, then read frames until the connection is
+ *  over, 'buf' holds the 'len' bytes received past the request */
+static void
+stub_ws_run(struct stub_server *server, int clientfd, const char path[], const char key[], char buf[], size_t len, size_t bufsize)
+{
+  char accept[32]="", keyguid[128];
+  int keyguidlen = snprintf(keyguid, sizeof(keyguid), "%s" STUB_WS_GUID, key);
+  uint8_t sha1hash[20];
+  _cws_sha1(keyguid, keyguidlen, sha1hash);
+  _cws_encode_base64(sha1hash, sizeof(sha1hash), accept);
+
+  char resp[256];
+  int resplen = snprintf(resp, sizeof(resp),
+      "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: %s\r\n"
+      "\r\n", accept);
+  if (send(clientfd, resp, resplen, MSG_NOSIGNAL) < 0)
+    return; /* EARLY RETURN */
+
+  struct stub_ws *ws = calloc(1, sizeof *ws);
+  ws->server = server;
+  ws->clientfd = clientfd;
+  snprintf(ws->path, sizeof(ws->path), "%s", path);
+  if (pthread_mutex_init(&ws->lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
+
+  if (server->ws_open_cb)
+    (*server->ws_open_cb)(server->data, ws);
+
+  // message reassembled from its fragments
+  char *msg=NULL;
+  size_t msglen=0;
+  enum stub_ws_opcode msgop=STUB_WS_TEXT;
+
+  bool is_open=true;
+  while (is_open) {
+    uint8_t *frame = (uint8_t*)buf;
+    // parse the frames received so far
+    while (is_open && len >= 2) {
+      bool is_fin = frame[0] & 0x80;
+      enum stub_ws_opcode opcode = frame[0] & 0x0F;
+      bool is_masked = frame[1] & 0x80;
+      size_t hlen=2;
+      uint64_t plen = frame[1] & 0x7F;
+      if (126 == plen) {
+        if (len < 4) break; /* EARLY BREAK (incomplete header) */
+        plen = ((uint64_t)frame[2] << 8) | frame[3];
+        hlen = 4;
+      }
+      else if (127 == plen) {
+        if (len < 10) break; /* EARLY BREAK (incomplete header) */
+        plen = 0;
+        for (int i=0; i < 8; ++i)
+          plen = (plen << 8) | frame[2+i];
+        hlen = 10;
+      }
+      uint8_t *mask = frame + hlen;
+      if (is_masked) hlen += 4;
+
+      if (hlen + plen > bufsize) {
+        stub_ws_close(ws, 1009); // too big
+        is_open = false;
+        break; /* EARLY BREAK */
+      }
+      if (len < hlen + plen) break; /* EARLY BREAK (incomplete payload) */
+
+      uint8_t *payload = frame + hlen;
+      if (is_masked) {
+        for (uint64_t i=0; i < plen; ++i)
+          payload[i] ^= mask[i & 3];
+      }
+
+      switch (opcode) {
+      case STUB_WS_CLOSE:
+          stub_ws_send(ws, STUB_WS_CLOSE, (char*)payload, plen < 2 ? plen : 2);
+          is_open = false;
+          break;
+      case STUB_WS_PING:
+          stub_ws_send(ws, STUB_WS_PONG, (char*)payload, plen);
+          break;
+      case STUB_WS_PONG:
+          break;
+      default:
+          if (STUB_WS_CONT != opcode) {
+            msgop = opcode;
+            msglen = 0;
+          }
+          msg = realloc(msg, msglen + plen + 1);
+          memcpy(msg + msglen, payload, plen);
+          msglen += plen;
+          msg[msglen] = '\0';
+          if (is_fin)
+            (*server->ws_message_cb)(server->data, ws, msgop, msg, msglen);
+          break;
+      }
+
+      size_t framelen = hlen + plen;
+      memmove(buf, buf + framelen, len - framelen);
+      len -= framelen;
+    }
+    if (!is_open) break; /* EARLY BREAK */
+
+    ssize_t ret = recv(clientfd, buf + len, bufsize - len, 0);
+    if (ret <= 0) break; /* EARLY BREAK (connection closed) */
+    len += ret;
+  }
+
+  if (server->ws_close_cb)
+    (*server->ws_close_cb)(server->data, ws);
+  pthread_mutex_destroy(&ws->lock);
+  free(ws);
+  free(msg);
+}
+
+static void*
+stub_client_run(void *p_client)
+{
+  struct stub_client *client = p_client;
+  struct stub_server *server = client->server;
+  int clientfd = client->clientfd;
+  free(client);
+
+  const size_t bufsize = 1 << 20, respsize = 1 << 20;
+  char *buf = malloc(bufsize), *resp = malloc(respsize);
+  size_t len = 0;
+  while (1) {
+    ssize_t ret = recv(clientfd, buf + len, bufsize - len - 1, 0);
+    if (ret <= 0) break; /* EARLY BREAK (connection closed) */
+    len += ret;
+    buf[len] = '\0';
+
+    char *end;
+    while ((end = strstr(buf, "\r\n\r\n"))) {
+      size_t reqlen = (end + 4) - buf;
+
+      // skip request body (if any)
+      size_t body_len = 0;
+      char *clen = strcasestr(buf, "Content-Length:");
+      if (clen && clen < end)
+        body_len = strtoul(clen + sizeof("Content-Length:") - 1, NULL, 10);
+      reqlen += body_len;
+      if (reqlen > len) break; /* EARLY BREAK (wait for remaining body) */
+
+      struct stub_request req = { .body_len = body_len };
+      sscanf(buf, "%15s %2047s", req.method, req.path);
+
+      // NUL-terminate the header and body, and keep the bytes they overwrite
+      char last = buf[reqlen];
+      buf[reqlen] = '\0';
+      req.body = end + 4;
+      char *eol = strstr(buf, "\r\n");
+      req.header = eol + 2;
+      end[2] = '\0';
+
+      char upgrade[32];
+      if (server->ws_message_cb
+          && stub_request_header(&req, "Upgrade", upgrade, sizeof(upgrade))
+          && 0 == strcasecmp(upgrade, "websocket"))
+      {
+        char key[64]="";
+        stub_request_header(&req, "Sec-WebSocket-Key", key, sizeof(key));
+        atomic_fetch_add(&server->amt_requests, 1);
+        end[2] = '\r';
+        buf[reqlen] = last;
+        memmove(buf, buf + reqlen, len - reqlen);
+        stub_ws_run(server, clientfd, req.path, key, buf, len - reqlen, bufsize);
+        goto _close; /* EARLY JUMP */
+      }
+
+      if (server->latency_ms)
+        cee_sleep_ms((int64_t)server->latency_ms);
+
+      int resplen;
+      if (server->respond_cb)
+        resplen = (*server->respond_cb)(server->data, &req, resp, respsize);
+      else
+        resplen = stub_server_reply(resp, respsize, 200, "", STUB_SERVER_BODY);
+      atomic_fetch_add(&server->amt_requests, 1);
+
+      end[2] = '\r';
+      buf[reqlen] = last;
+
+      if (send(clientfd, resp, resplen, MSG_NOSIGNAL) < 0)
+        goto _close; /* EARLY JUMP */
+
+      memmove(buf, buf + reqlen, len - reqlen);
+      len -= reqlen;
+      buf[len] = '\0';
+    }
+  }
+_close:
+  close(clientfd);
+  free(buf);
+  free(resp);
+  return NULL;
+}
+
+static void*
+stub_server_run(void *p_server)
+{
+  struct stub_server *server = p_server;
+  while (1) {
+    int clientfd = accept(server->sockfd, NULL, NULL);
+    if (clientfd < 0) break;
+    atomic_fetch_add(&server->amt_conns, 1);
+
+    struct stub_client *client = malloc(sizeof *client);
+    client->server = server;
+    client->clientfd = clientfd;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, &stub_client_run, client))
+      ERR("Couldn't create thread");
+    pthread_detach(tid);
+  }
+  return NULL;
+}
+
+void
+stub_server_start(struct stub_server *server)
+{
+  server->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_S(server->sockfd >= 0, "Couldn't create socket");
+
+  int enable = 1;
+  setsockopt(server->sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    .sin_port = htons(server->port) // 0 lets the kernel pick a free port
+  };
+  socklen_t addrlen = sizeof(addr);
+  ASSERT_S(0 == bind(server->sockfd, (struct sockaddr*)&addr, addrlen), "Couldn't bind socket");
+  ASSERT_S(0 == listen(server->sockfd, 128), "Couldn't listen to socket");
+  getsockname(server->sockfd, (struct sockaddr*)&addr, &addrlen);
+  server->port = ntohs(addr.sin_port);
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, &stub_server_run, server))
+    ERR("Couldn't create thread");
+  pthread_detach(tid);
+}
+
+void
+stub_server_stop(struct stub_server *server)
+{
+  shutdown(server->sockfd, SHUT_RDWR); // wakes up accept()
+  close(server->sockfd);
+}
+
+int
+stub_server_reply(char resp[], size_t size, int httpcode, const char header[], const char body[])
+{
+  return snprintf(resp, size,
+      "HTTP/1.1 %d %s\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: %zu\r\n"
+      "%s"
+      "\r\n"
+      "%s",
+      httpcode, http_code_print(httpcode), strlen(body), header, body);
+}
+
+bool
+stub_request_header(struct stub_request *req, const char field[], char value[], size_t size)
+{
+  size_t fieldlen = strlen(field);
+  for (char *line = req->header; line && *line; ) {
+    char *eol = strstr(line, "\r\n");
+    if (0 == strncasecmp(line, field, fieldlen) && ':' == line[fieldlen]) {
+      char *start = line + fieldlen + 1;
+      while (isspace((unsigned char)*start)) ++start;
+      int len = eol ? (int)(eol - start) : (int)strlen(start);
+      snprintf(value, size, "%.*s", len, start);
+      return true;
+    }
+    line = eol ? eol + 2 : NULL;
+  }
+  return false;
+}
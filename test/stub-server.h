@@ -0,0 +1,164 @@
+/*
+ * A local HTTP/1.1 stub server, shared by the tests that need something
+ *  to perform requests against
+ *
+ * Each connection is served from its own thread, requests are answered
+ *  in order (keep-alive is honored) by the server's respond_cb, or by a
+ *  fixed 200 if none is given.
+ * Requests asking for a WebSocket upgrade are accepted if the server has
+ *  a ws_message_cb, the connection's thread then reads its frames.
+ */
+#ifndef STUB_SERVER_H
+#define STUB_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define STUB_SERVER_BODY "{\"id\":\"1234\",\"content\":\"pong\"}"
+
+/**
+ * @brief A request received by the stub server
+ */
+struct stub_request {
+  char method[16];
+  char path[2048];  ///< path and query
+  char *header;     ///< the header lines, NUL-terminated
+  char *body;       ///< NUL-terminated, empty if none
+  size_t body_len;
+};
+
+/**
+ * @brief Write the full HTTP response of a request
+ *
+ * @param data the user arbitrary data of struct stub_server
+ * @param req the request received
+ * @param resp where to write the response
+ * @param size the size of @a resp
+ * @return the response length
+ * @see stub_server_reply()
+ */
+typedef int (stub_server_respond_cb)(void *data, struct stub_request *req, char resp[], size_t size);
+
+/**
+ * @brief WebSocket opcodes sent or received by the stub server
+ */
+enum stub_ws_opcode {
+  STUB_WS_CONT   = 0x0,
+  STUB_WS_TEXT   = 0x1,
+  STUB_WS_BINARY = 0x2,
+  STUB_WS_CLOSE  = 0x8,
+  STUB_WS_PING   = 0x9,
+  STUB_WS_PONG   = 0xA
+};
+
+/**
+ * @brief A WebSocket connection accepted by the stub server
+ */
+struct stub_ws {
+  struct stub_server *server;
+  int clientfd;
+  char path[2048];      ///< the upgrade request's path and query
+  pthread_mutex_t lock; ///< serializes stub_ws_send() across threads
+  void *data;           ///< user arbitrary data, for this connection
+};
+
+/**
+ * @brief Called once a WebSocket connection has been upgraded
+ *
+ * @param data the user arbitrary data of struct stub_server
+ * @param ws the connection
+ */
+typedef void (stub_ws_open_cb)(void *data, struct stub_ws *ws);
+/**
+ * @brief Called for every TEXT or BINARY message, reassembled
+ *
+ * @param data the user arbitrary data of struct stub_server
+ * @param ws the connection
+ * @param opcode STUB_WS_TEXT or STUB_WS_BINARY
+ * @param msg the message, NUL-terminated
+ * @param len the message length
+ */
+typedef void (stub_ws_message_cb)(void *data, struct stub_ws *ws, enum stub_ws_opcode opcode, const char msg[], size_t len);
+/**
+ * @brief Called once the WebSocket connection is over, @a ws is freed
+ *        right after
+ *
+ * @param data the user arbitrary data of struct stub_server
+ * @param ws the connection
+ */
+typedef void (stub_ws_close_cb)(void *data, struct stub_ws *ws);
+
+struct stub_server {
+  int sockfd;
+  unsigned short port;           ///< 0 lets the kernel pick a free port
+  uint64_t latency_ms;           ///< delay before each response
+  stub_server_respond_cb *respond_cb; ///< NULL to answer STUB_SERVER_BODY
+  void *data;                    ///< passed to respond_cb and the ws callbacks
+  stub_ws_open_cb *ws_open_cb;       ///< optional
+  stub_ws_message_cb *ws_message_cb; ///< NULL to refuse WebSocket upgrades
+  stub_ws_close_cb *ws_close_cb;     ///< optional
+  atomic_size_t amt_conns;       ///< connections accepted so far
+  atomic_size_t amt_requests;    ///< requests answered so far
+};
+
+/**
+ * @brief Listen on the loopback and serve requests from background threads
+ *
+ * @param server the server, its port is updated if it was 0
+ */
+void stub_server_start(struct stub_server *server);
+
+/**
+ * @brief Stop accepting connections
+ *
+ * @param server the server started with stub_server_start()
+ */
+void stub_server_stop(struct stub_server *server);
+
+/**
+ * @brief Format a response with a JSON body
+ *
+ * @param resp where to write the response
+ * @param size the size of @a resp
+ * @param httpcode the response code
+ * @param header extra header lines, each ending with "\r\n" (may be empty)
+ * @param body the JSON body
+ * @return the response length
+ */
+int stub_server_reply(char resp[], size_t size, int httpcode, const char header[], const char body[]);
+
+/**
+ * @brief Get a request header field value
+ *
+ * @param req the request received
+ * @param field the header field name (case-insensitive)
+ * @param value where to write the value
+ * @param size the size of @a value
+ * @return true if found
+ */
+bool stub_request_header(struct stub_request *req, const char field[], char value[], size_t size);
+
+/**
+ * @brief Send a WebSocket frame (unmasked, unfragmented)
+ *
+ * @param ws the connection
+ * @param opcode the frame opcode
+ * @param msg the payload
+ * @param len the payload length
+ * @return false if the connection is gone
+ * @note thread-safe
+ */
+bool stub_ws_send(struct stub_ws *ws, enum stub_ws_opcode opcode, const char msg[], size_t len);
+
+/**
+ * @brief Send a CLOSE frame and shut the connection down
+ *
+ * @param ws the connection
+ * @param code the close code
+ */
+void stub_ws_close(struct stub_ws *ws, int code);
+
+#endif // STUB_SERVER_H
@@ -0,0 +1,309 @@
+/*
+ * Behavior tests for curl-websocket's permessage-deflate (RFC 7692)
+ *
+ * Handles are created with cws_new() but never performed: the server's
+ *  upgrade answer is handed to _cws_receive_header(), and its frames to
+ *  _cws_receive_data(), the way curl delivers them.
+ *
+ * curl-websocket.c is included to reach its static functions.
+ *
+ * Usage: ./test-cws-deflate.out
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "curl-websocket.c"
+
+struct wire {
+  uint8_t *buffer;
+  size_t len;
+};
+
+struct received {
+  char *text;
+  size_t len;
+  int amt;
+};
+
+static void
+wire_frame(struct wire *wire, enum cws_opcode opcode, bool fin, bool rsv1, const void *payload, size_t len)
+{
+  uint8_t hdr[4] = { (fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode };
+  size_t hdrlen = 2;
+
+  assert(len <= UINT16_MAX);
+  if (len > 125) {
+    hdr[1] = 126;
+    hdr[2] = len >> 8;
+    hdr[3] = len;
+    hdrlen += 2;
+  }
+  else {
+    hdr[1] = len;
+  }
+  wire->buffer = realloc(wire->buffer, wire->len + hdrlen + len);
+  memcpy(wire->buffer + wire->len, hdr, hdrlen);
+  memcpy(wire->buffer + wire->len + hdrlen, payload, len);
+  wire->len += hdrlen + len;
+}
+
+/* hand the wire to the handle in chunks of 'chunk' bytes, then empty it */
+static void
+wire_deliver(struct wire *wire, struct cws_data *priv, size_t chunk)
+{
+  for (size_t offset=0; offset < wire->len; offset += chunk) {
+    size_t len = wire->len - offset;
+    if (len > chunk) len = chunk;
+    assert(len == _cws_receive_data((const char*)wire->buffer + offset, 1, len, priv));
+  }
+  wire->len = 0;
+}
+
+static void
+on_text(void *data, CURL *easy, const char *text, size_t len)
+{
+  (void)easy;
+  struct received *received = data;
+  received->text = realloc(received->text, len + 1);
+  memcpy(received->text, text, len + 1);
+  received->len = len;
+  ++received->amt;
+}
+
+/* a handle that offered 'config', and got 'extensions' (NULL for none)
+ *  as the server's answer */
+static struct cws_data*
+handle_init(const struct cws_deflate_config *config, const char extensions[], struct received *received)
+{
+  CURL *easy = cws_new("ws://127.0.0.1/", NULL,
+      &(struct cws_callbacks){ .on_text = &on_text, .data = received });
+  assert(NULL != easy);
+  assert(true == cws_set_deflate(easy, config));
+
+  struct cws_data *priv=NULL;
+  curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&priv);
+  assert(NULL != priv);
+
+  const char status[] = "HTTP/1.1 101 Switching Protocols\r\n";
+  _cws_receive_header(status, 1, sizeof(status) - 1, priv);
+  if (extensions) {
+    char header[256];
+    int len = snprintf(header, sizeof(header), "Sec-WebSocket-Extensions: %s\r\n", extensions);
+    _cws_receive_header(header, 1, len, priv);
+  }
+  return priv;
+}
+
+static void
+handle_cleanup(struct cws_data *priv)
+{
+  cws_free(priv->easy);
+}
+
+/* whether the last frame queued to the server is compressed */
+static bool
+last_frame_is_compressed(struct cws_data *priv, size_t start)
+{
+  return priv->send.buffer[(priv->send.head + start) & (priv->send.size - 1)] & 0x40;
+}
+
+/* the offer, and what is made of the server's answer */
+static void
+test_negotiation(void)
+{
+  char msg[256];
+  memset(msg, 'a', sizeof(msg));
+
+  // client_max_window_bits is always offered, valueless unless configured
+  struct cws_data *priv = handle_init(&(struct cws_deflate_config){ 0 }, NULL, NULL);
+  const struct curl_slist *header = priv->headers;
+  while (header && strncmp(header->data, "Sec-WebSocket-Extensions:", 25)) header = header->next;
+  assert(NULL != header);
+  assert(0 == strcmp(header->data, "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits"));
+  // ... and nothing is compressed if the server doesn't answer
+  assert(false == priv->deflate.enabled);
+  assert(true == _cws_send(priv, CWS_OPCODE_TEXT, msg, sizeof(msg)));
+  assert(false == last_frame_is_compressed(priv, 0));
+  handle_cleanup(priv);
+
+  priv = handle_init(&(struct cws_deflate_config){ .server_no_context_takeover = true, .server_max_window_bits = 10 }, NULL, NULL);
+  header = priv->headers;
+  while (header && strncmp(header->data, "Sec-WebSocket-Extensions:", 25)) header = header->next;
+  assert(0 == strcmp(header->data, "Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; client_max_window_bits; server_max_window_bits=10"));
+  handle_cleanup(priv);
+
+  // out of range windows are refused
+  CURL *easy = cws_new("ws://127.0.0.1/", NULL, NULL);
+  assert(false == cws_set_deflate(easy, &(struct cws_deflate_config){ .client_max_window_bits = 8 }));
+  assert(false == cws_set_deflate(easy, &(struct cws_deflate_config){ .server_max_window_bits = 16 }));
+  cws_free(easy);
+
+  // the server picks a smaller window for our compressor
+  priv = handle_init(&(struct cws_deflate_config){ 0 },
+      "permessage-deflate; server_no_context_takeover; client_max_window_bits=10", NULL);
+  assert(true == priv->deflate.enabled && true == priv->deflate.can_deflate);
+  assert(true == priv->deflate.server_no_context_takeover);
+  assert(10 == priv->deflate.client_max_window_bits);
+  assert(true == _cws_send(priv, CWS_OPCODE_TEXT, msg, sizeof(msg)));
+  assert(true == last_frame_is_compressed(priv, 0));
+  // messages under CWS_DEFLATE_MIN_SIZE, and control frames, aren't
+  size_t queued = priv->send.len;
+  assert(true == _cws_send(priv, CWS_OPCODE_TEXT, msg, CWS_DEFLATE_MIN_SIZE - 1));
+  assert(false == last_frame_is_compressed(priv, queued));
+  queued = priv->send.len;
+  assert(true == _cws_send(priv, CWS_OPCODE_PING, msg, 16));
+  assert(false == last_frame_is_compressed(priv, queued));
+  handle_cleanup(priv);
+
+  // a 256 bytes window (8 bits) can't be done by zlib: the extension is
+  //  kept for receiving, but messages are sent uncompressed
+  priv = handle_init(&(struct cws_deflate_config){ 0 },
+      "permessage-deflate; client_max_window_bits=\"8\"", NULL);
+  assert(true == priv->deflate.enabled && false == priv->deflate.can_deflate);
+  assert(true == _cws_send(priv, CWS_OPCODE_TEXT, msg, sizeof(msg)));
+  assert(false == last_frame_is_compressed(priv, 0));
+  handle_cleanup(priv);
+
+  // some other extension
+  priv = handle_init(&(struct cws_deflate_config){ 0 }, "x-webkit-deflate-frame", NULL);
+  assert(false == priv->deflate.enabled);
+  handle_cleanup(priv);
+
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+/* messages compressed by one handle are received whole by another, with
+ *  and without the compressors' context kept between messages */
+static void
+test_roundtrip(bool no_context_takeover)
+{
+  const char *extensions = no_context_takeover
+      ? "permessage-deflate; client_no_context_takeover; server_no_context_takeover"
+      : "permessage-deflate";
+  struct cws_deflate_config config = {
+    .client_no_context_takeover = no_context_takeover,
+    .server_no_context_takeover = no_context_takeover
+  };
+  // the sender's compressor plays the server's
+  struct cws_data *sender = handle_init(&config, extensions, NULL);
+  struct received received={0};
+  struct cws_data *receiver = handle_init(&config, extensions, &received);
+  assert(no_context_takeover == sender->deflate.client_no_context_takeover);
+  assert(no_context_takeover == receiver->deflate.server_no_context_takeover);
+
+  const char *msgs[] = {
+    "{\"t\":\"MESSAGE_CREATE\",\"s\":1,\"op\":0,\"d\":{\"content\":\"hello there\",\"channel_id\":\"1234\"}}",
+    "{\"t\":\"MESSAGE_CREATE\",\"s\":2,\"op\":0,\"d\":{\"content\":\"hello there\",\"channel_id\":\"1234\"}}",
+    "{\"t\":\"MESSAGE_CREATE\",\"s\":3,\"op\":0,\"d\":{\"content\":\"hello there\",\"channel_id\":\"1234\"}}"
+  };
+  size_t wire_lens[3];
+  struct wire wire={0};
+  for (int i=0; i < 3; ++i) {
+    size_t msglen = strlen(msgs[i]), outlen;
+    assert(true == _cws_deflate(sender, msgs[i], msglen, &outlen));
+    wire_lens[i] = outlen;
+    // the trailing 00 00 ff ff is left out, and a byte at a time is inflated fine
+    wire_frame(&wire, CWS_OPCODE_TEXT, true, true, sender->deflate.out.buffer, outlen);
+    wire_deliver(&wire, receiver, 1 + i * 7);
+
+    assert(i + 1 == received.amt);
+    assert(msglen == received.len);
+    assert(0 == strcmp(msgs[i], received.text));
+    assert(false == receiver->closed);
+  }
+
+  if (no_context_takeover) {
+    // each message is compressed on its own
+    assert(wire_lens[0] == wire_lens[1] && wire_lens[1] == wire_lens[2]);
+  }
+  else {
+    // the later messages refer to the first one
+    assert(wire_lens[1] < wire_lens[0] / 2);
+    assert(wire_lens[2] < wire_lens[0] / 2);
+  }
+
+  // a compressed message fragmented over frames, RSV1 on its first only
+  size_t outlen;
+  assert(true == _cws_deflate(sender, msgs[0], strlen(msgs[0]), &outlen));
+  wire_frame(&wire, CWS_OPCODE_TEXT, false, true, sender->deflate.out.buffer, outlen / 2);
+  wire_frame(&wire, CWS_OPCODE_PING, true, false, "ping", 4);
+  wire_frame(&wire, CWS_OPCODE_CONTINUATION, true, false, sender->deflate.out.buffer + outlen / 2, outlen - outlen / 2);
+  wire_deliver(&wire, receiver, 5);
+  assert(4 == received.amt);
+  assert(0 == strcmp(msgs[0], received.text));
+  assert(false == receiver->closed);
+
+  struct cws_deflate_stats stats;
+  assert(true == cws_get_deflate_stats(receiver->easy, &stats));
+  assert(4 == stats.msgs_inflated);
+  assert(4 * strlen(msgs[0]) == stats.bytes_in);
+  assert(true == cws_get_deflate_stats(sender->easy, &stats));
+  assert(4 == stats.msgs_deflated);
+
+  handle_cleanup(sender);
+  handle_cleanup(receiver);
+  free(received.text);
+  free(wire.buffer);
+  fprintf(stderr, "%s(no_context_takeover=%d): ok\n", __func__, no_context_takeover);
+}
+
+/* RSV1 may only mark the first frame of a data message, once negotiated */
+static void
+test_rsv1_rejected(void)
+{
+  struct wire wire={0};
+  struct received received={0};
+
+  // on a control frame
+  struct cws_data *priv = handle_init(&(struct cws_deflate_config){ 0 }, "permessage-deflate", &received);
+  wire_frame(&wire, CWS_OPCODE_PING, true, true, "ping", 4);
+  wire_deliver(&wire, priv, 64);
+  assert(true == priv->closed);
+  handle_cleanup(priv);
+
+  // on a continuation frame
+  priv = handle_init(&(struct cws_deflate_config){ 0 }, "permessage-deflate", &received);
+  wire_frame(&wire, CWS_OPCODE_TEXT, false, false, "hello ", 6);
+  wire_deliver(&wire, priv, 64);
+  assert(false == priv->closed);
+  wire_frame(&wire, CWS_OPCODE_CONTINUATION, true, true, "there", 5);
+  wire_deliver(&wire, priv, 64);
+  assert(true == priv->closed);
+  assert(0 == received.amt);
+  handle_cleanup(priv);
+
+  // without the extension
+  priv = handle_init(&(struct cws_deflate_config){ 0 }, NULL, &received);
+  wire_frame(&wire, CWS_OPCODE_TEXT, true, true, "hello", 5);
+  wire_deliver(&wire, priv, 64);
+  assert(true == priv->closed);
+  handle_cleanup(priv);
+
+  // compressed data that doesn't inflate
+  priv = handle_init(&(struct cws_deflate_config){ 0 }, "permessage-deflate", &received);
+  wire_frame(&wire, CWS_OPCODE_TEXT, true, true, "\xff\xff\xff\xff", 4);
+  wire_deliver(&wire, priv, 64);
+  assert(true == priv->closed);
+  assert(0 == received.amt);
+  handle_cleanup(priv);
+
+  free(wire.buffer);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+int main(void)
+{
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  test_negotiation();
+  test_roundtrip(false);
+  test_roundtrip(true);
+  test_rsv1_rejected();
+
+  curl_global_cleanup();
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}
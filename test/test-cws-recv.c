@@ -0,0 +1,247 @@
+/*
+ * Microbenchmark of the curl-websocket frame receive path
+ *
+ * Text messages of increasing sizes, split in 3 frames with a PING in
+ *  between, are handed to _cws_receive_data() in chunks of curl's
+ *  write size, the way curl delivers them. They are received whole
+ *  with on_text(), then streamed with on_text_partial().
+ *
+ * Beforehand, it checks that a compressed (RSV1) message streamed with
+ *  on_text_partial() is inflated chunk by chunk, and that a frame too
+ *  big to be buffered aborts the transfer.
+ *
+ * curl-websocket.c is included to reach its static functions.
+ *
+ * Usage: ./test-cws-recv.out [messages_per_size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "curl-websocket.c"
+#include "debug.h"
+
+#define CURL_WRITE_SIZE 16384 /* curl's default download buffer size */
+
+struct wire {
+  uint8_t *buffer;
+  size_t len;
+};
+
+static size_t amt_received, amt_bytes;
+static size_t amt_streamed; ///< bytes of the last message streamed
+static const uint8_t *expected;
+
+static void
+wire_frame(struct wire *wire, enum cws_opcode opcode, bool fin, bool rsv1, const void *payload, size_t len)
+{
+  uint8_t hdr[10] = { (fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode };
+  size_t hdrlen = 2;
+
+  if (len > UINT16_MAX) {
+    hdr[1] = 127;
+    for (int i=0; i < 8; ++i)
+      hdr[2+i] = (uint64_t)len >> (56 - 8*i);
+    hdrlen += 8;
+  }
+  else if (len > 125) {
+    hdr[1] = 126;
+    hdr[2] = len >> 8;
+    hdr[3] = len;
+    hdrlen += 2;
+  }
+  else {
+    hdr[1] = len;
+  }
+  wire->buffer = realloc(wire->buffer, wire->len + hdrlen + len);
+  memcpy(wire->buffer + wire->len, hdr, hdrlen);
+  memcpy(wire->buffer + wire->len + hdrlen, payload, len);
+  wire->len += hdrlen + len;
+}
+
+static void
+on_text(void *data, CURL *easy, const char *text, size_t len)
+{
+  VASSERT_S(0 == memcmp(text, expected, len) && '\0' == text[len],
+      "Mismatch in a %zu bytes message", len);
+  ++amt_received;
+}
+
+static void
+on_text_partial(void *data, CURL *easy, const char *chunk, size_t len, bool is_final)
+{
+  VASSERT_S(0 == memcmp(chunk, expected + amt_bytes, len),
+      "Mismatch at byte %zu of a streamed message", amt_bytes);
+  amt_bytes += len;
+  if (is_final) {
+    amt_streamed = amt_bytes;
+    amt_bytes = 0;
+    ++amt_received;
+  }
+}
+
+static void
+on_ping(void *data, CURL *easy, const char *reason, size_t len)
+{
+  VASSERT_S(len == 5 && 0 == strcmp(reason, "ping!"), "Bad PING '%.*s'", (int)len, reason);
+}
+
+static double
+elapsed_us(struct timespec *start)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e6 + (end.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static double
+receive(struct cws_data *priv, struct wire *wire, int amt_msgs)
+{
+  struct timespec start;
+
+  amt_received = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i=0; i < amt_msgs; ++i) {
+    for (size_t offset=0; offset < wire->len; offset += CURL_WRITE_SIZE) {
+      size_t len = wire->len - offset;
+      if (len > CURL_WRITE_SIZE) len = CURL_WRITE_SIZE;
+      _cws_receive_data((const char*)wire->buffer + offset, 1, len, priv);
+    }
+  }
+  double us = elapsed_us(&start);
+  VASSERT_S(amt_received == (size_t)amt_msgs,
+      "Expected %d messages, got %zu", amt_msgs, amt_received);
+  return us;
+}
+
+/* hand the wire to _cws_receive_data() in chunks of 'chunk' bytes */
+static void
+deliver(struct cws_data *priv, struct wire *wire, size_t chunk)
+{
+  for (size_t offset=0; offset < wire->len; offset += chunk) {
+    size_t len = wire->len - offset;
+    if (len > chunk) len = chunk;
+    size_t ret = _cws_receive_data((const char*)wire->buffer + offset, 1, len, priv);
+    VASSERT_S(ret == len, "Expected %zu bytes to be consumed, got %zu", len, ret);
+  }
+}
+
+/* a compressed message is inflated as it's streamed: the chunks given
+ *  to on_text_partial() add up to the original text, however the
+ *  frames are cut */
+static void
+check_compressed_partial(const uint8_t msg[], size_t msglen)
+{
+  z_stream zs = {0};
+  ASSERT_S(Z_OK == deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY),
+      "Couldn't initialize deflate");
+  size_t size = deflateBound(&zs, msglen) + 16;
+  uint8_t *deflated = malloc(size);
+  zs.next_in = (Bytef*)msg;
+  zs.avail_in = msglen;
+  zs.next_out = deflated;
+  zs.avail_out = size;
+  ASSERT_S(Z_OK == deflate(&zs, Z_SYNC_FLUSH) && 0 == zs.avail_in && zs.avail_out > 0,
+      "Couldn't deflate message");
+  size_t len = size - zs.avail_out - 4; // without the 00 00 ff ff suffix (RFC 7692)
+  deflateEnd(&zs);
+
+  // RSV1 on the first frame only, a PING in between
+  struct wire wire = {0};
+  wire_frame(&wire, CWS_OPCODE_TEXT, false, true, deflated, len / 2);
+  wire_frame(&wire, CWS_OPCODE_PING, true, false, "ping!", 5);
+  wire_frame(&wire, CWS_OPCODE_CONTINUATION, true, false, deflated + len / 2, len - len / 2);
+
+  struct cws_data *priv = calloc(1, sizeof *priv);
+  priv->recv.needed = sizeof(struct cws_frame_header);
+  priv->deflate.enabled = true;
+  priv->cbs.on_text_partial = &on_text_partial;
+  priv->cbs.on_ping = &on_ping;
+
+  const size_t chunks[] = { 1, 7, CURL_WRITE_SIZE, wire.len };
+  amt_received = 0;
+  for (size_t i=0; i < sizeof(chunks)/sizeof(size_t); ++i) {
+    deliver(priv, &wire, chunks[i]);
+    VASSERT_S(i + 1 == amt_received, "Expected %zu messages, got %zu", i + 1, amt_received);
+    VASSERT_S(msglen == amt_streamed, "Expected %zu bytes, got %zu", msglen, amt_streamed);
+    VASSERT_S(i + 1 == priv->deflate.stats.msgs_inflated,
+        "Expected %zu messages inflated", i + 1);
+  }
+  ASSERT_S(!priv->closed, "Compressed message rejected");
+
+  if (priv->deflate.inflater_init)
+    inflateEnd(&priv->deflate.inflater);
+  free(priv->deflate.in.buffer);
+  free(priv->recv.arena.buffer);
+  free(priv);
+  free(wire.buffer);
+  free(deflated);
+}
+
+/* a frame too big to be buffered closes the connection, and
+ *  _cws_receive_data() returns 0 so that curl aborts the transfer */
+static void
+check_abort(void)
+{
+  CURL *easy = cws_new("ws://127.0.0.1/", NULL, &(struct cws_callbacks){ .on_text = &on_text });
+  ASSERT_S(NULL != easy, "Couldn't create handle");
+  struct cws_data *priv=NULL;
+  curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&priv);
+  const char status[] = "HTTP/1.1 101 Switching Protocols\r\n";
+  _cws_receive_header(status, 1, sizeof(status) - 1, priv);
+
+  // announces 2^63 bytes, more than _cws_buffer_reserve() accepts
+  const uint8_t hdr[] = { 0x80 | CWS_OPCODE_BINARY, 127, 0x80, 0, 0, 0, 0, 0, 0, 0 };
+  size_t ret = _cws_receive_data((const char*)hdr, 1, sizeof(hdr), priv);
+  VASSERT_S(0 == ret, "Expected the transfer to be aborted, got %zu", ret);
+  ASSERT_S(priv->closed, "Expected the connection to be closed");
+
+  cws_free(easy);
+}
+
+int main(int argc, char *argv[])
+{
+  int amt_msgs = (argc > 1) ? atoi(argv[1]) : 2000;
+  const size_t sizes[] = { 16, 1000, 16384, 70000, 1000000 };
+
+  uint8_t *msg = malloc(sizes[sizeof(sizes)/sizeof(size_t) - 1]);
+  for (size_t i=0; i < sizes[sizeof(sizes)/sizeof(size_t) - 1]; ++i)
+    msg[i] = "abcdefgh {\"op\":0}"[i % 17];
+  expected = msg;
+
+  curl_global_init(CURL_GLOBAL_ALL);
+  check_compressed_partial(msg, 70000);
+  check_abort();
+  fprintf(stderr, "checks: ok\n");
+
+  printf("%10s %14s %14s\n", "message", "whole (ns)", "partial (ns)");
+  for (size_t n=0; n < sizeof(sizes)/sizeof(size_t); ++n) {
+    size_t msglen = sizes[n];
+    struct wire wire = {0};
+    wire_frame(&wire, CWS_OPCODE_TEXT, false, false, msg, msglen / 3);
+    wire_frame(&wire, CWS_OPCODE_PING, true, false, "ping!", 5);
+    wire_frame(&wire, CWS_OPCODE_CONTINUATION, true, false, msg + msglen / 3, msglen - msglen / 3);
+
+    struct cws_data *priv = calloc(1, sizeof *priv);
+    priv->recv.needed = sizeof(struct cws_frame_header);
+    priv->cbs.on_text = &on_text;
+    priv->cbs.on_ping = &on_ping;
+    double whole_us = receive(priv, &wire, amt_msgs);
+
+    priv->cbs.on_text_partial = &on_text_partial;
+    double partial_us = receive(priv, &wire, amt_msgs);
+
+    free(priv->recv.arena.buffer);
+    free(priv);
+    free(wire.buffer);
+
+    printf("%10zu %14.1f %14.1f\n", msglen,
+        whole_us * 1000 / amt_msgs, partial_us * 1000 / amt_msgs);
+  }
+
+  free(msg);
+  curl_global_cleanup();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/*
+ * Microbenchmark of the curl-websocket frame send path
+ *
+ * Frames of increasing sizes are queued with _cws_send() and handed to
+ *  a fake curl read buffer with _cws_send_data(), the way curl drains
+ *  them. The same is done with the previous send path (a realloc() per
+ *  write, byte-wise masking through a temporary buffer, and
+ *  /dev/urandom opened for every masking key), kept here for
+ *  comparison.
+ *
+ * curl-websocket.c is included to reach its static functions.
+ *
+ * Usage: ./test-cws-send.out [frames_per_size]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "curl-websocket.c"
+#include "debug.h"
+
+#define CURL_READ_SIZE 65536 /* curl's default upload buffer size */
+
+struct legacy_send {
+  uint8_t *buffer;
+  size_t len;
+};
+
+static bool
+legacy_write(struct legacy_send *send, const void *buffer, size_t len)
+{
+  uint8_t *tmp = realloc(send->buffer, send->len + len);
+  if (!tmp) return false;
+  memcpy(tmp + send->len, buffer, len);
+  send->buffer = tmp;
+  send->len += len;
+  return true;
+}
+
+static bool
+legacy_write_masked(struct legacy_send *send, const uint8_t mask[static 4], const void *buffer, size_t len)
+{
+  const uint8_t *itr_begin = buffer;
+  const uint8_t *itr = itr_begin;
+  const uint8_t *itr_end = itr + len;
+  uint8_t tmpbuf[4096];
+
+  while (itr < itr_end) {
+    uint8_t *o = tmpbuf, *o_end = tmpbuf + sizeof(tmpbuf);
+    for (; o < o_end && itr < itr_end; o++, itr++)
+      *o = *itr ^ mask[(itr - itr_begin) & 0x3];
+    if (!legacy_write(send, tmpbuf, o - tmpbuf))
+      return false;
+  }
+  return true;
+}
+
+static void
+legacy_get_random(void *buffer, size_t len)
+{
+  uint8_t *bytes = buffer;
+  uint8_t *bytes_end = bytes + len;
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd < 0) ERR("Couldn't open /dev/urandom");
+  do {
+    ssize_t r = read(fd, bytes, bytes_end - bytes);
+    if (r < 0) break;
+    bytes += r;
+  } while (bytes < bytes_end);
+  close(fd);
+}
+
+static bool
+legacy_send(struct legacy_send *send, const void *msg, size_t msglen)
+{
+  struct cws_frame_header fh = {
+    .fin = 1,
+    .opcode = CWS_OPCODE_TEXT,
+    .mask = 1,
+    .payload_len = ((msglen > UINT16_MAX) ? 127 : (msglen > 125) ? 126 : msglen),
+  };
+  uint8_t mask[4];
+  legacy_get_random(mask, sizeof(mask));
+
+  if (!legacy_write(send, &fh, sizeof(fh))) return false;
+  if (fh.payload_len == 127) {
+    uint64_t payload_len = msglen;
+    _cws_hton(&payload_len, sizeof(payload_len));
+    if (!legacy_write(send, &payload_len, sizeof(payload_len))) return false;
+  }
+  else if (fh.payload_len == 126) {
+    uint16_t payload_len = msglen;
+    _cws_hton(&payload_len, sizeof(payload_len));
+    if (!legacy_write(send, &payload_len, sizeof(payload_len))) return false;
+  }
+  if (!legacy_write(send, mask, sizeof(mask))) return false;
+  return legacy_write_masked(send, mask, msg, msglen);
+}
+
+static size_t
+legacy_send_data(struct legacy_send *send, char *buffer, size_t len)
+{
+  size_t todo = (send->len > len) ? len : send->len;
+  memcpy(buffer, send->buffer, todo);
+  if (todo < send->len) {
+    memmove(send->buffer, send->buffer + todo, send->len - todo);
+  }
+  else {
+    free(send->buffer);
+    send->buffer = NULL;
+  }
+  send->len -= todo;
+  return todo;
+}
+
+static double
+elapsed_us(struct timespec *start)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e6 + (end.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/* check a frame masked by _cws_send() against the byte-wise definition */
+static void
+check_frame(const uint8_t *frame, const uint8_t *msg, size_t msglen)
+{
+  size_t offset = (msglen > UINT16_MAX) ? 10 : (msglen > 125) ? 4 : 2;
+  const uint8_t *mask = frame + offset;
+  const uint8_t *payload = mask + 4;
+  for (size_t i=0; i < msglen; ++i)
+    VASSERT_S(payload[i] == (msg[i] ^ mask[i & 0x3]),
+        "Mismatch at byte %zu of a %zu bytes frame", i, msglen);
+}
+
+int main(int argc, char *argv[])
+{
+  int amt_frames = (argc > 1) ? atoi(argv[1]) : 20000;
+  const size_t sizes[] = { 16, 125, 1000, 4096, 16384, 70000 };
+
+  uint8_t *msg = malloc(sizes[sizeof(sizes)/sizeof(size_t) - 1]);
+  for (size_t i=0; i < sizes[sizeof(sizes)/sizeof(size_t) - 1]; ++i)
+    msg[i] = (uint8_t)(i * 31 + 7);
+
+  char *curlbuf = malloc(CURL_READ_SIZE);
+  // enough room to check the largest frame
+  uint8_t *frame = malloc(sizes[sizeof(sizes)/sizeof(size_t) - 1] + 14);
+
+  printf("%10s %14s %14s %8s\n", "frame", "legacy (ns)", "ring (ns)", "speedup");
+  for (size_t n=0; n < sizeof(sizes)/sizeof(size_t); ++n) {
+    size_t msglen = sizes[n];
+    struct timespec start;
+
+    struct legacy_send legacy = {0};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i < amt_frames; ++i) {
+      legacy_send(&legacy, msg, msglen);
+      while (legacy.len)
+        legacy_send_data(&legacy, curlbuf, CURL_READ_SIZE);
+    }
+    double legacy_us = elapsed_us(&start);
+
+    struct cws_data *priv = calloc(1, sizeof *priv);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i < amt_frames; ++i) {
+      _cws_send(priv, CWS_OPCODE_TEXT, msg, msglen);
+      while (priv->send.len)
+        _cws_send_data(curlbuf, 1, CURL_READ_SIZE, priv);
+    }
+    double ring_us = elapsed_us(&start);
+
+    // check a frame split across the end of the ring buffer
+    priv->send.head = priv->send.size ? priv->send.size - 3 : 0;
+    _cws_send(priv, CWS_OPCODE_TEXT, msg, msglen);
+    size_t framelen = 0;
+    while (priv->send.len)
+      framelen += _cws_send_data((char*)frame + framelen, 1, CURL_READ_SIZE, priv);
+    check_frame(frame, msg, msglen);
+
+    free(priv->send.buffer);
+    free(priv);
+
+    printf("%10zu %14.1f %14.1f %7.1fx\n", msglen,
+        legacy_us * 1000 / amt_frames, ring_us * 1000 / amt_frames,
+        legacy_us / ring_us);
+  }
+
+  free(frame);
+  free(curlbuf);
+  free(msg);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/*
+ * A cluster coordinator and its worker processes, against a stub Gateway
+ *
+ * The coordinator gets the Gateway URL, the amount of shards and
+ *  max_concurrency from the stub's GET /gateway/bot. The workers run
+ *  their shards with discord_set_cluster() and discord_run(): each
+ *  shard connects to the stub Gateway, IDENTIFYs once the coordinator
+ *  says so, and is answered READY with its guilds. The first worker
+ *  crashes on its first READY, so its range is handed over.
+ *
+ * Checks that every shard IDENTIFYs with its shard array, that the
+ *  IDENTIFYs of a max_concurrency bucket are 5 seconds apart, and that
+ *  the workers see the "guilds" stat summed up over the cluster.
+ *
+ * Usage: ./test-discord-cluster.out
+ */
+#define _GNU_SOURCE /* MAP_ANONYMOUS */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "discord.h"
+#include "discord-internal.h"
+#include "cee-utils.h"
+#include "stub-gateway.h"
+
+#define SOCKET_PATH      "/tmp/test-discord-cluster.sock"
+#define AMT_WORKERS      2
+#define TOTAL_SHARDS     4
+#define MAX_CONCURRENCY  2
+#define GUILDS_PER_SHARD 10
+
+static bool crash;                  ///< crash on the first READY
+static long *guilds_total;          ///< the total seen by this worker, shared with the parent
+static u64_unix_ms_t total_tstamp;  ///< when the total was first seen
+
+void on_ready(struct discord *client, const struct discord_user *bot)
+{
+  log_info("Shard %d is ready", discord_get_shard_id(client));
+  if (crash) _exit(EXIT_FAILURE);
+}
+
+void on_idle(struct discord *client, const struct discord_user *bot)
+{
+  static bool is_shutdown;
+  u64_unix_ms_t now = cee_timestamp_ms();
+
+  if (!total_tstamp) {
+    long total=0;
+    discord_cluster_get_stat(client, "guilds", &total);
+    if (total != GUILDS_PER_SHARD * TOTAL_SHARDS) return;
+
+    log_info("Total of guilds: %ld", total);
+    *guilds_total = total;
+    total_tstamp = now;
+  }
+  else if (!is_shutdown && now - total_tstamp > 1000) { // let the other workers see the total
+    is_shutdown = true;
+    discord_gateway_shutdown(&client->gw);
+  }
+}
+
+int run_worker(bool is_crashing, long *p_guilds_total)
+{
+  crash = is_crashing;
+  guilds_total = p_guilds_total;
+
+  struct discord *client = discord_init("STUB-TOKEN");
+  discord_set_cluster(client, SOCKET_PATH);
+  discord_set_on_ready(client, &on_ready);
+  discord_set_on_idle(client, &on_idle);
+
+  ORCAcode code;
+  for (int tries=0; tries < 50; ++tries) { // wait for the coordinator
+    code = discord_run(client);
+    if (ORCA_OK == code) break;
+    cee_sleep_ms(100);
+  }
+  discord_cleanup(client);
+
+  return ORCA_OK == code ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(void)
+{
+  struct stub_gateway gateway = {
+    .shards = TOTAL_SHARDS,
+    .max_concurrency = MAX_CONCURRENCY,
+    .guilds = GUILDS_PER_SHARD
+  };
+  stub_gateway_start(&gateway);
+
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%hu", gateway.server.port);
+
+  long *guilds_totals = mmap(NULL, (1 + AMT_WORKERS) * sizeof(long),
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  assert(guilds_totals != MAP_FAILED);
+  memset(guilds_totals, 0, (1 + AMT_WORKERS) * sizeof(long));
+
+  pid_t coordinator = fork();
+  if (0 == coordinator) {
+    discord_global_init();
+    struct discord *client = discord_init("STUB-TOKEN");
+    ua_set_url(client->adapter.ua, base_url); // GET /gateway/bot from the stub
+    ORCAcode code = discord_cluster_coordinate(client,
+                      &(struct discord_cluster_config){
+                        .socket_path = SOCKET_PATH,
+                        .amt_workers = AMT_WORKERS
+                      });
+    discord_cleanup(client);
+    discord_global_cleanup();
+    _exit(ORCA_OK == code ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  pid_t workers[1 + AMT_WORKERS];
+  for (int i=0; i < 1 + AMT_WORKERS; ++i) {
+    workers[i] = fork();
+    if (0 == workers[i]) {
+      discord_global_init();
+      int ret = run_worker(0 == i, &guilds_totals[i]);
+      discord_global_cleanup();
+      _exit(ret);
+    }
+    if (0 == i) // the crashed worker's range goes to the last one
+      waitpid(workers[0], NULL, 0);
+  }
+
+  int status;
+  for (int i=1; i < 1 + AMT_WORKERS; ++i) {
+    waitpid(workers[i], &status, 0);
+    assert(WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status));
+    assert(GUILDS_PER_SHARD * TOTAL_SHARDS == guilds_totals[i]);
+  }
+  waitpid(coordinator, &status, 0);
+  assert(WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status));
+
+  struct stub_identify identifies[STUB_GATEWAY_MAX_IDENTIFIES];
+  int amt = stub_gateway_get_identifies(&gateway, identifies, STUB_GATEWAY_MAX_IDENTIFIES);
+  assert(amt <= STUB_GATEWAY_MAX_IDENTIFIES);
+
+  // the crashed worker's shards IDENTIFY again from the last worker
+  bool has_identified[TOTAL_SHARDS] = {0};
+  for (int i=0; i < amt; ++i) {
+    assert(identifies[i].shard_id >= 0 && identifies[i].shard_id < TOTAL_SHARDS);
+    assert(TOTAL_SHARDS == identifies[i].shard_total);
+    has_identified[identifies[i].shard_id] = true;
+
+    for (int j=i+1; j < amt; ++j) {
+      if (identifies[i].shard_id % MAX_CONCURRENCY != identifies[j].shard_id % MAX_CONCURRENCY)
+        continue;
+      u64_unix_ms_t delay = (identifies[i].tstamp > identifies[j].tstamp)
+                              ? identifies[i].tstamp - identifies[j].tstamp
+                              : identifies[j].tstamp - identifies[i].tstamp;
+      fprintf(stderr, "Shards %d and %d IDENTIFY %"PRIu64" ms apart\n",
+          identifies[i].shard_id, identifies[j].shard_id, delay);
+      assert(delay >= DISCORD_SHARD_IDENTIFY_INTERVAL_MS);
+    }
+  }
+  for (int i=0; i < TOTAL_SHARDS; ++i)
+    assert(true == has_identified[i]);
+
+  stub_gateway_stop(&gateway);
+  munmap(guilds_totals, (1 + AMT_WORKERS) * sizeof(long));
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,483 @@
+/*
+ * Check, then benchmark, decoding Gateway dispatches from JSON
+ *  against ETF
+ *
+ * A MESSAGE_CREATE dispatch is decoded the way discord-gateway.c does
+ *  it for each encoding: the JSON path extracts the envelope with
+ *  json_extract() and its 'd' with discord_message_from_json(), the
+ *  ETF path reads the envelope in place and 'd' with
+ *  discord_message_from_etf().
+ * The ETF payloads are encoded the way Discord does it: map keys as
+ *  atoms and snowflakes as bignums.
+ *
+ * Before benchmarking, the builtin payloads (and a GUILD_MEMBER_ADD) are
+ *  handed to on_etf_payload(), and the message, user and guild member
+ *  given to the callbacks must equal their JSON decoding field for
+ *  field. discord-gateway.c is included to reach its static functions.
+ *
+ * Usage: ./test-discord-etf.out [iterations] [payload.json ...]
+ */
+#include "discord-gateway.c" /* defines _GNU_SOURCE, included first */
+
+#include <time.h>
+#include <assert.h>
+
+static const char *builtin_payloads[] = {
+  "{\"t\":\"MESSAGE_CREATE\",\"s\":3,\"op\":0,\"d\":{"
+    "\"type\":0,\"tts\":false,\"timestamp\":\"2021-09-20T17:32:10.123000+00:00\","
+    "\"referenced_message\":null,\"pinned\":false,\"nonce\":\"889572212536623104\","
+    "\"mentions\":[],\"mention_roles\":[],\"mention_everyone\":false,"
+    "\"member\":{\"roles\":[\"889361614451220481\",\"889361614451220482\"],"
+      "\"mute\":false,\"joined_at\":\"2021-09-19T13:10:52.112000+00:00\","
+      "\"hoisted_role\":null,\"deaf\":false,\"avatar\":null},"
+    "\"id\":\"889572213102866472\",\"flags\":0,\"embeds\":[],\"edited_timestamp\":null,"
+    "\"content\":\"!ping hello there, how is it going?\",\"components\":[],"
+    "\"channel_id\":\"889361614451220480\","
+    "\"author\":{\"username\":\"orca-user\",\"public_flags\":0,\"id\":\"302254540010897408\","
+      "\"discriminator\":\"0420\",\"avatar\":\"b3c3a1b5f2e7d9f0aa1c2b3d4e5f6a7b\"},"
+    "\"attachments\":[],\"guild_id\":\"889361614451220479\"}}",
+
+  "{\"t\":\"MESSAGE_CREATE\",\"s\":4,\"op\":0,\"d\":{"
+    "\"type\":19,\"tts\":false,\"timestamp\":\"2021-09-20T17:33:01.555000+00:00\","
+    "\"referenced_message\":{\"type\":0,\"tts\":false,"
+      "\"timestamp\":\"2021-09-20T17:32:10.123000+00:00\",\"pinned\":false,"
+      "\"mentions\":[],\"mention_roles\":[],\"mention_everyone\":false,"
+      "\"id\":\"889572213102866472\",\"flags\":0,\"embeds\":[],\"edited_timestamp\":null,"
+      "\"content\":\"!ping hello there, how is it going?\",\"components\":[],"
+      "\"channel_id\":\"889361614451220480\","
+      "\"author\":{\"username\":\"orca-user\",\"public_flags\":0,\"id\":\"302254540010897408\","
+        "\"discriminator\":\"0420\",\"avatar\":null},\"attachments\":[]},"
+    "\"pinned\":false,\"nonce\":\"889572425934876672\","
+    "\"mentions\":[{\"username\":\"orca-user\",\"public_flags\":0,\"id\":\"302254540010897408\","
+      "\"discriminator\":\"0420\",\"avatar\":null}],"
+    "\"mention_roles\":[\"889361614451220481\"],\"mention_everyone\":false,"
+    "\"message_reference\":{\"message_id\":\"889572213102866472\","
+      "\"guild_id\":\"889361614451220479\",\"channel_id\":\"889361614451220480\"},"
+    "\"member\":{\"roles\":[],\"nick\":\"bot\",\"mute\":false,"
+      "\"joined_at\":\"2021-09-19T13:12:01.001000+00:00\",\"deaf\":false},"
+    "\"id\":\"889572426702434304\",\"flags\":0,"
+    "\"embeds\":[{\"type\":\"rich\",\"title\":\"Pong!\",\"description\":\"latency: 42ms\","
+      "\"color\":3447003,\"fields\":[{\"name\":\"shard\",\"value\":\"0\",\"inline\":true}]}],"
+    "\"edited_timestamp\":null,\"content\":\"pong\",\"components\":[],"
+    "\"channel_id\":\"889361614451220480\","
+    "\"author\":{\"username\":\"orca-bot\",\"public_flags\":0,\"id\":\"889361201234567890\","
+      "\"discriminator\":\"9111\",\"bot\":true,\"avatar\":null},"
+    "\"attachments\":[],\"guild_id\":\"889361614451220479\"}}"
+};
+
+static const char member_payload[] =
+  "{\"t\":\"GUILD_MEMBER_ADD\",\"s\":5,\"op\":0,\"d\":{"
+    "\"user\":{\"username\":\"new-user\",\"public_flags\":64,\"id\":\"889361201234567891\","
+      "\"discriminator\":\"0001\",\"avatar\":\"a1b2c3d4e5f6a7b8c9d0e1f2a3b4c5d6\","
+      "\"bot\":false,\"system\":false},"
+    "\"roles\":[\"889361614451220481\",\"889361614451220483\"],\"premium_since\":null,"
+    "\"pending\":true,\"nick\":\"newbie\",\"mute\":false,"
+    "\"joined_at\":\"2021-09-20T17:40:00.250000+00:00\",\"guild_id\":\"889361614451220479\","
+    "\"deaf\":false,\"avatar\":null}}";
+
+struct out {
+  char *buf;
+  size_t len, size;
+};
+
+static void
+out_append(struct out *out, const void *mem, size_t len)
+{
+  if (out->len + len > out->size) {
+    out->size = 2 * (out->len + len);
+    out->buf = realloc(out->buf, out->size);
+  }
+  memcpy(out->buf + out->len, mem, len);
+  out->len += len;
+}
+
+static void
+out_tag32(struct out *out, uint8_t tag, uint32_t value)
+{
+  uint8_t bytes[] = { tag, value >> 24, value >> 16, value >> 8, value };
+  out_append(out, bytes, sizeof(bytes));
+}
+
+static void
+out_atom(struct out *out, const char *str, size_t len)
+{
+  uint8_t hdr[] = { 119, (uint8_t)len }; // SMALL_ATOM_UTF8_EXT
+  out_append(out, hdr, sizeof(hdr));
+  out_append(out, str, len);
+}
+
+static bool
+is_snowflake(const struct etf_term *term)
+{
+  if (term->value.str.size < 15 || term->value.str.size > 20)
+    return false;
+  for (size_t i=0; i < term->value.str.size; ++i)
+    if (term->value.str.start[i] < '0' || term->value.str.start[i] > '9')
+      return false;
+  return true;
+}
+
+/* re-encode the output of etf_from_json() the way Discord encodes it */
+static void
+reencode(struct etf_reader *reader, struct out *out, bool is_key)
+{
+  struct etf_term term;
+  if (!etf_read(reader, &term))
+    ERR("Couldn't read term at %zu", reader->pos);
+
+  switch (term.type) {
+  case ETF_NULL:    out_atom(out, "nil", 3); break;
+  case ETF_BOOLEAN:
+      out_atom(out, term.value.boolean ? "true" : "false", term.value.boolean ? 4 : 5);
+      break;
+  case ETF_INTEGER: out_tag32(out, 98, (uint32_t)term.value.integer); break;
+  case ETF_FLOAT: {
+      uint64_t bits;
+      memcpy(&bits, &term.value.real, sizeof(bits));
+      uint8_t bytes[9] = { 70 }; // NEW_FLOAT_EXT
+      for (int i=0; i < 8; ++i)
+        bytes[1+i] = bits >> (56 - 8*i);
+      out_append(out, bytes, sizeof(bytes));
+      break; }
+  case ETF_STRING:
+      if (is_key) {
+        out_atom(out, term.value.str.start, term.value.str.size);
+      }
+      else if (is_snowflake(&term)) {
+        uint64_t value = strtoull(term.value.str.start, NULL, 10);
+        uint8_t bytes[11] = { 110, 0, 0 }; // SMALL_BIG_EXT
+        while (value) {
+          bytes[3 + bytes[1]++] = value & 0xff;
+          value >>= 8;
+        }
+        out_append(out, bytes, 3 + bytes[1]);
+      }
+      else {
+        out_tag32(out, 109, term.value.str.size); // BINARY_EXT
+        out_append(out, term.value.str.start, term.value.str.size);
+      }
+      break;
+  case ETF_LIST:
+      if (0 == term.value.amt) {
+        out_append(out, "\x6a", 1); // NIL_EXT
+        break;
+      }
+      out_tag32(out, 108, term.value.amt);
+      for (size_t i=0; i < term.value.amt; ++i)
+        reencode(reader, out, false);
+      etf_read_tail(reader);
+      out_append(out, "\x6a", 1);
+      break;
+  case ETF_MAP:
+      out_tag32(out, 116, term.value.amt);
+      for (size_t i=0; i < term.value.amt; ++i) {
+        reencode(reader, out, true);
+        reencode(reader, out, false);
+      }
+      break;
+  default:
+      ERR("Unexpected term type %d", term.type);
+  }
+}
+
+/* encode a JSON payload as ETF, the way Discord does it */
+static void
+etf_from_discord_json(char json[], size_t len, struct out *out)
+{
+  char *tmp=NULL;
+  size_t tmpsize=0;
+  size_t ret = etf_from_json(json, len, &tmp, &tmpsize);
+  ASSERT_S(ret != 0, "Couldn't encode payload");
+
+  struct etf_reader reader;
+  etf_reader_init(&reader, tmp, ret);
+  out_append(out, "\x83", 1); // ETF_VERSION
+  reencode(&reader, out, false);
+  free(tmp);
+}
+
+/* the JSON 'd' of the payload being checked, the callbacks compare what
+ *  they're given to its decoding */
+static struct sized_buffer expected;
+static int amt_messages, amt_members;
+
+/* fields decoded through JSON either way: compare their encodings */
+static void
+assert_json_eq(size_t (*to_json)(char*, size_t, void*), void *a, void *b)
+{
+  if (!a || !b) {
+    assert(a == b);
+    return; /* EARLY RETURN */
+  }
+  char json_a[16384], json_b[16384];
+  assert((*to_json)(json_a, sizeof(json_a), a) < sizeof(json_a));
+  (*to_json)(json_b, sizeof(json_b), b);
+  assert(0 == strcmp(json_a, json_b));
+}
+
+static void
+assert_str_eq(const char *a, const char *b)
+{
+  if (!a || !b)
+    assert(a == b);
+  else
+    assert(0 == strcmp(a, b));
+}
+
+static void
+assert_u64_list_eq(ja_u64 **a, ja_u64 **b)
+{
+  if (!a || !b) {
+    assert(a == b);
+    return; /* EARLY RETURN */
+  }
+  size_t amt = ntl_length((ntl_t)a);
+  assert(amt == ntl_length((ntl_t)b));
+  for (size_t i=0; i < amt; ++i)
+    assert(a[i]->value == b[i]->value);
+}
+
+static void
+assert_user_eq(const struct discord_user *a, const struct discord_user *b)
+{
+  if (!a || !b) {
+    assert(a == b);
+    return; /* EARLY RETURN */
+  }
+  assert(a->id == b->id);
+  assert_str_eq(a->username, b->username);
+  assert_str_eq(a->discriminator, b->discriminator);
+  assert_str_eq(a->avatar, b->avatar);
+  assert(a->bot == b->bot);
+  assert(a->System == b->System);
+  assert(a->mfa_enabled == b->mfa_enabled);
+  assert_str_eq(a->locale, b->locale);
+  assert(a->verified == b->verified);
+  assert_str_eq(a->email, b->email);
+  assert(a->flags == b->flags);
+  assert(a->premium_type == b->premium_type);
+  assert(a->public_flags == b->public_flags);
+}
+
+static void
+assert_member_eq(const struct discord_guild_member *a, const struct discord_guild_member *b)
+{
+  if (!a || !b) {
+    assert(a == b);
+    return; /* EARLY RETURN */
+  }
+  assert_user_eq(a->user, b->user);
+  assert_str_eq(a->nick, b->nick);
+  assert_u64_list_eq(a->roles, b->roles);
+  assert(a->joined_at == b->joined_at);
+  assert(a->premium_since == b->premium_since);
+  assert(a->deaf == b->deaf);
+  assert(a->mute == b->mute);
+  assert(a->pending == b->pending);
+  assert_str_eq(a->permissions, b->permissions);
+}
+
+static void
+assert_message_eq(const struct discord_message *a, const struct discord_message *b)
+{
+  if (!a || !b) {
+    assert(a == b);
+    return; /* EARLY RETURN */
+  }
+  assert(a->id == b->id);
+  assert(a->channel_id == b->channel_id);
+  assert(a->guild_id == b->guild_id);
+  assert_user_eq(a->author, b->author);
+  assert_member_eq(a->member, b->member);
+  assert_str_eq(a->content, b->content);
+  assert(a->timestamp == b->timestamp);
+  assert(a->edited_timestamp == b->edited_timestamp);
+  assert(a->tts == b->tts);
+  assert(a->mention_everyone == b->mention_everyone);
+  assert_json_eq(&discord_user_list_to_json_v, a->mentions, b->mentions);
+  assert_u64_list_eq(a->mention_roles, b->mention_roles);
+  assert_json_eq(&discord_channel_mention_list_to_json_v, a->mention_channels, b->mention_channels);
+  assert_json_eq(&discord_attachment_list_to_json_v, a->attachments, b->attachments);
+  assert_json_eq(&discord_embed_list_to_json_v, a->embeds, b->embeds);
+  assert_json_eq(&discord_reaction_list_to_json_v, a->reactions, b->reactions);
+  assert_str_eq(a->nonce, b->nonce);
+  assert(a->pinned == b->pinned);
+  assert(a->webhook_id == b->webhook_id);
+  assert(a->type == b->type);
+  assert_json_eq(&discord_message_activity_to_json_v, a->activity, b->activity);
+  assert_json_eq(&discord_message_application_list_to_json_v, a->application, b->application);
+  assert_json_eq(&discord_message_reference_to_json_v, a->message_reference, b->message_reference);
+  assert(a->flags == b->flags);
+  assert_message_eq(a->referenced_message, b->referenced_message);
+  assert_json_eq(&discord_message_interaction_to_json_v, a->interaction, b->interaction);
+  assert_json_eq(&discord_channel_to_json_v, a->thread, b->thread);
+  assert_json_eq(&discord_component_list_to_json_v, a->components, b->components);
+  assert_json_eq(&discord_message_sticker_list_to_json_v, a->sticker_items, b->sticker_items);
+  assert_json_eq(&discord_message_sticker_list_to_json_v, a->stickers, b->stickers);
+}
+
+static void
+check_message_create(struct discord *client, const struct discord_user *bot, const struct discord_message *msg)
+{
+  (void)bot;
+  assert(NULL == client->gw.payload->event_data.start); // decoded from ETF
+
+  struct discord_message *json=NULL;
+  discord_message_from_json(expected.start, expected.size, &json);
+  assert_message_eq(msg, json);
+  discord_message_cleanup(json);
+  free(json);
+  ++amt_messages;
+}
+
+static void
+check_guild_member_add(struct discord *client, const struct discord_user *bot, const u64_snowflake_t guild_id, const struct discord_guild_member *member)
+{
+  (void)bot;
+  assert(NULL == client->gw.payload->event_data.start); // decoded from ETF
+
+  struct discord_guild_member *json=NULL;
+  discord_guild_member_from_json(expected.start, expected.size, &json);
+  u64_snowflake_t json_guild_id=0;
+  json_extract(expected.start, expected.size, "(guild_id):s_as_u64", &json_guild_id);
+  assert(guild_id == json_guild_id);
+  assert_member_eq(member, json);
+  discord_guild_member_cleanup(json);
+  free(json);
+  ++amt_members;
+}
+
+/* hand a payload encoded as ETF to the Gateway, its callbacks check
+ *  the objects decoded straight from ETF against the JSON ones */
+static void
+check_etf_payload(struct discord *client, char json[], size_t len)
+{
+  json_extract(json, len, "(d):T", &expected);
+  assert(expected.size != 0);
+
+  struct out etf={0};
+  etf_from_discord_json(json, len, &etf);
+  on_etf_payload(&client->gw, &(struct ws_info){0}, etf.buf, etf.len);
+  free(etf.buf);
+}
+
+static uint64_t
+now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+decode_json(char *json, size_t len)
+{
+  char event_name[64];
+  int seq=0, opcode=0;
+  struct sized_buffer data={0};
+  json_extract(json, len,
+              "(t):s (s):d (op):d (d):T",
+               event_name, &seq, &opcode, &data);
+
+  struct discord_message *msg=NULL;
+  discord_message_from_json(data.start, data.size, &msg);
+  discord_message_cleanup(msg);
+  free(msg);
+}
+
+static void
+decode_etf(char *etf, size_t len)
+{
+  char event_name[64];
+  int seq=0, opcode=0;
+  struct sized_buffer data={0};
+
+  struct etf_reader reader;
+  struct etf_term term;
+  if (!etf_reader_init(&reader, etf, len) || !etf_read(&reader, &term))
+    ERR("Couldn't read ETF envelope");
+  for (size_t i=0; i < term.value.amt; ++i) {
+    struct etf_term key, value;
+    etf_read(&reader, &key);
+    if (etf_term_eq(&key, "d")) {
+      data.start = etf + reader.pos;
+      etf_skip(&reader);
+      data.size = (etf + reader.pos) - data.start;
+      continue;
+    }
+    etf_read(&reader, &value);
+    if (etf_term_eq(&key, "op"))
+      opcode = (int)value.value.integer;
+    else if (etf_term_eq(&key, "s"))
+      seq = (int)value.value.integer;
+    else if (etf_term_eq(&key, "t"))
+      snprintf(event_name, sizeof(event_name), "%.*s",
+          (int)value.value.str.size, value.value.str.start);
+  }
+
+  struct discord_message *msg=NULL;
+  discord_message_from_etf(data.start, data.size, &msg);
+  discord_message_cleanup(msg);
+  free(msg);
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = (argc > 1) ? atoi(argv[1]) : 100000;
+
+  size_t amt = (argc > 2) ? (size_t)(argc - 2) : sizeof(builtin_payloads) / sizeof(char*);
+  struct sized_buffer *json = calloc(amt, sizeof *json);
+  struct out *etf = calloc(amt, sizeof *etf);
+
+  size_t json_bytes=0, etf_bytes=0;
+  for (size_t i=0; i < amt; ++i) {
+    if (argc > 2) {
+      json[i].start = cee_load_whole_file(argv[2+i], &json[i].size);
+      ASSERT_S(NULL != json[i].start, "Couldn't load payload file");
+    }
+    else {
+      json[i].start = strdup(builtin_payloads[i]);
+      json[i].size = strlen(json[i].start);
+    }
+
+    etf_from_discord_json(json[i].start, json[i].size, &etf[i]);
+
+    json_bytes += json[i].size;
+    etf_bytes += etf[i].len;
+  }
+
+  struct discord *client = discord_init("STUB-TOKEN");
+  discord_set_gateway_etf(client, true);
+  discord_set_on_message_create(client, &check_message_create);
+  discord_set_on_guild_member_add(client, &check_guild_member_add);
+  for (size_t i=0; i < amt; ++i)
+    check_etf_payload(client, json[i].start, json[i].size);
+  assert(amt == (size_t)amt_messages);
+  check_etf_payload(client, (char*)member_payload, sizeof(member_payload) - 1);
+  assert(1 == amt_members);
+  discord_cleanup(client);
+
+  uint64_t t0 = now_us();
+  for (int n=0; n < iterations; ++n)
+    for (size_t i=0; i < amt; ++i)
+      decode_json(json[i].start, json[i].size);
+  uint64_t t1 = now_us();
+  for (int n=0; n < iterations; ++n)
+    for (size_t i=0; i < amt; ++i)
+      decode_etf(etf[i].buf, etf[i].len);
+  uint64_t t2 = now_us();
+
+  double total = (double)iterations * amt;
+  printf("%zu payloads x %d iterations\n", amt, iterations);
+  printf("JSON: %6zu bytes, %8.3f us/payload\n", json_bytes, (t1 - t0) / total);
+  printf("ETF:  %6zu bytes, %8.3f us/payload\n", etf_bytes, (t2 - t1) / total);
+
+  for (size_t i=0; i < amt; ++i) {
+    free(json[i].start);
+    free(etf[i].buf);
+  }
+  free(json);
+  free(etf);
+
+  return EXIT_SUCCESS;
+}
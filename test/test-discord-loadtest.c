@@ -0,0 +1,370 @@
+/*
+ * Load test for the Discord REST path, against a local stand-in server
+ *
+ * The stand-in emulates the channel message endpoints wrapped by orca,
+ *  with realistic ratelimiting: every route has its own bucket hash,
+ *  and each (bucket, channel) pair a window of 'bucket_limit' requests
+ *  every 'bucket_reset_ms', reported through the x-ratelimit-* headers.
+ *  Going over a bucket, or over 'global_limit' requests per second, is
+ *  answered by a 429 with a retry_after. Optionally, a burst of 502s is
+ *  served every 'burst_every' requests (off by default: the client backs
+ *  off for 5 seconds on a 5xx, which would dominate the measurements).
+ * The load generator performs discord_create_message() and
+ *  discord_get_channel_messages() from many threads sharing a few
+ *  channels, then reports throughput, latency percentiles and how many
+ *  429s and 5xxs the client ran into.
+ *
+ * Usage: ./test-discord-loadtest.out [threads] [requests_per_thread] [burst_every]
+ *        ./test-discord-loadtest.out serve [port]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "discord.h"
+#include "discord-internal.h"
+#include "cee-utils.h"
+#include "stub-server.h"
+
+#define AMT_CHANNELS 4
+
+struct standin_route {
+  char *method;
+  char *path; ///< path following '/channels/{id}'
+  char *hash; ///< bucket hash
+};
+
+static struct standin_route ROUTES[] = {
+  { "GET",  "/messages", "80c17d2f203122d936070c88c8d10f33" },
+  { "POST", "/messages", "41f1a2cc8c1d7b2a5a9cd2b1b4b2e3d5" }
+};
+
+struct standin_bucket {
+  struct standin_route *route;
+  u64_snowflake_t channel_id;
+  int remaining;
+  uint64_t reset_tstamp; ///< epoch in ms
+};
+
+struct standin_server {
+  struct stub_server stub;
+
+  int bucket_limit;         ///< requests per bucket window
+  uint64_t bucket_reset_ms; ///< bucket window duration
+  int global_limit;         ///< requests per second, across every bucket
+  int burst_every;          ///< a 5xx burst every N requests, 0 to disable
+  int burst_len;            ///< 5xx responses per burst
+
+  pthread_mutex_t lock;
+  struct standin_bucket buckets[64];
+  size_t amt_buckets;
+  uint64_t global_window;   ///< current second
+  int global_count;         ///< requests within the current second
+  u64_snowflake_t next_id;  ///< next message id
+
+  struct {
+    size_t requests;
+    size_t bucket_429;
+    size_t global_429;
+    size_t server_5xx;
+  } stats;
+};
+
+static struct standin_bucket*
+standin_get_bucket(struct standin_server *server, struct standin_route *route, u64_snowflake_t channel_id)
+{
+  for (size_t i=0; i < server->amt_buckets; ++i) {
+    if (server->buckets[i].route == route
+        && server->buckets[i].channel_id == channel_id)
+    {
+      return &server->buckets[i];
+    }
+  }
+  ASSERT_S(server->amt_buckets < sizeof(server->buckets)/sizeof(*server->buckets), "Too many buckets");
+  struct standin_bucket *bucket = &server->buckets[server->amt_buckets++];
+  *bucket = (struct standin_bucket){ .route = route, .channel_id = channel_id };
+  return bucket;
+}
+
+/* write the response for a request to 'resp', return its length */
+static int
+standin_respond(struct standin_server *server, char method[], char path[], char body[], char resp[], size_t size)
+{
+  char header[512]="", payload[8192];
+  int httpcode=200;
+
+  u64_snowflake_t channel_id=0;
+  int offset=0;
+  sscanf(path, "/channels/%"SCNu64"%n", &channel_id, &offset);
+
+  struct standin_route *route=NULL;
+  if (channel_id) {
+    char *subpath = path + offset;
+    for (size_t i=0; i < sizeof(ROUTES)/sizeof(*ROUTES); ++i) {
+      size_t pathlen = strlen(ROUTES[i].path);
+      if (0 == strcmp(method, ROUTES[i].method)
+          && 0 == strncmp(subpath, ROUTES[i].path, pathlen)
+          && ('\0' == subpath[pathlen] || '?' == subpath[pathlen]))
+      {
+        route = &ROUTES[i];
+        break;
+      }
+    }
+  }
+
+  pthread_mutex_lock(&server->lock);
+  uint64_t now = cee_timestamp_ms();
+  size_t nreq = server->stats.requests++;
+
+  if (server->burst_every && nreq >= (size_t)server->burst_every
+      && nreq % server->burst_every < (size_t)server->burst_len)
+  {
+    ++server->stats.server_5xx;
+    pthread_mutex_unlock(&server->lock);
+    httpcode = 502;
+    snprintf(payload, sizeof(payload), "{\"message\":\"502: Bad Gateway\",\"code\":0}");
+    goto _send; /* EARLY JUMP */
+  }
+
+  if (now / 1000 != server->global_window) {
+    server->global_window = now / 1000;
+    server->global_count = 0;
+  }
+  if (server->global_count >= server->global_limit) {
+    ++server->stats.global_429;
+    double retry_after = (1000 - now % 1000) / 1000.0;
+    pthread_mutex_unlock(&server->lock);
+    httpcode = 429;
+    snprintf(header, sizeof(header),
+        "X-RateLimit-Global: true\r\n"
+        "X-RateLimit-Scope: global\r\n"
+        "Retry-After: 1\r\n");
+    snprintf(payload, sizeof(payload),
+        "{\"message\":\"You are being rate limited.\",\"retry_after\":%.3f,\"global\":true}", retry_after);
+    goto _send; /* EARLY JUMP */
+  }
+  ++server->global_count;
+
+  if (!route) {
+    pthread_mutex_unlock(&server->lock);
+    httpcode = 404;
+    snprintf(payload, sizeof(payload), "{\"message\":\"404: Not Found\",\"code\":0}");
+    goto _send; /* EARLY JUMP */
+  }
+
+  struct standin_bucket *bucket = standin_get_bucket(server, route, channel_id);
+  if (now >= bucket->reset_tstamp) {
+    bucket->remaining = server->bucket_limit;
+    bucket->reset_tstamp = now + server->bucket_reset_ms;
+  }
+  bool is_limited = (0 == bucket->remaining);
+  if (is_limited)
+    ++server->stats.bucket_429;
+  else
+    --bucket->remaining;
+
+  double reset_after = (bucket->reset_tstamp - now) / 1000.0;
+  snprintf(header, sizeof(header),
+      "X-RateLimit-Limit: %d\r\n"
+      "X-RateLimit-Remaining: %d\r\n"
+      "X-RateLimit-Reset: %.3f\r\n"
+      "X-RateLimit-Reset-After: %.3f\r\n"
+      "X-RateLimit-Bucket: %s\r\n"
+      "%s",
+      server->bucket_limit, bucket->remaining, bucket->reset_tstamp / 1000.0,
+      reset_after, route->hash, is_limited ? "X-RateLimit-Scope: user\r\n" : "");
+  u64_snowflake_t id = ++server->next_id;
+  pthread_mutex_unlock(&server->lock);
+
+  if (is_limited) {
+    httpcode = 429;
+    snprintf(payload, sizeof(payload),
+        "{\"message\":\"You are being rate limited.\",\"retry_after\":%.3f,\"global\":false}", reset_after);
+  }
+  else if (0 == strcmp(route->method, "POST")) {
+    char content[2001]="";
+    char *start = body ? strstr(body, "\"content\":\"") : NULL;
+    if (start) sscanf(start + sizeof("\"content\":\"") - 1, "%2000[^\"]", content);
+    snprintf(payload, sizeof(payload),
+        "{\"id\":\"%"PRIu64"\",\"channel_id\":\"%"PRIu64"\",\"content\":\"%s\","
+        "\"author\":{\"id\":\"1\",\"username\":\"stand-in\",\"discriminator\":\"0001\"}}",
+        id, channel_id, content);
+  }
+  else { // GET
+    int limit=50;
+    char *query = strstr(path, "limit=");
+    if (query) limit = atoi(query + sizeof("limit=") - 1);
+    if (limit < 1 || limit > 100) limit = 50;
+
+    size_t len = snprintf(payload, sizeof(payload), "[");
+    for (int i=0; i < limit && len < sizeof(payload); ++i) {
+      len += snprintf(payload + len, sizeof(payload) - len,
+          "%s{\"id\":\"%d\",\"channel_id\":\"%"PRIu64"\",\"content\":\"message %d\"}",
+          i ? "," : "", i + 1, channel_id, i + 1);
+    }
+    ASSERT_S(len + 1 < sizeof(payload), "Out of bounds write attempt");
+    strcat(payload, "]");
+  }
+
+_send:
+  return stub_server_reply(resp, size, httpcode, header, payload);
+}
+
+static int
+standin_respond_cb(void *p_server, struct stub_request *req, char resp[], size_t size)
+{
+  return standin_respond(p_server, req->method, req->path, req->body, resp, size);
+}
+
+static void
+standin_server_start(struct standin_server *server)
+{
+  if (pthread_mutex_init(&server->lock, NULL))
+    ERR("Couldn't initialize pthread mutex");
+
+  server->stub.respond_cb = &standin_respond_cb;
+  server->stub.data = server;
+  stub_server_start(&server->stub);
+}
+
+static uint64_t
+timestamp_us(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+struct load_thread {
+  struct discord *client;
+  u64_snowflake_t channel_id;
+  int amt; ///< amount of requests to perform
+  uint64_t *latencies_us;
+  int failed;
+};
+
+static void*
+load_thread_run(void *p_load)
+{
+  struct load_thread *load = p_load;
+  for (int i=0; i < load->amt; ++i) {
+    ORCAcode code;
+    uint64_t tstamp = timestamp_us();
+    if (i % 2) {
+      NTL_T(struct discord_message) msgs=NULL;
+      code = discord_get_channel_messages(load->client, load->channel_id,
+               &(struct discord_get_channel_messages_params){ .limit = 10 }, &msgs);
+      if (msgs) discord_message_list_free(msgs);
+    }
+    else {
+      struct discord_message msg;
+      discord_message_init(&msg);
+      code = discord_create_message(load->client, load->channel_id,
+               &(struct discord_create_message_params){ .content = "load test" }, &msg);
+      if (ORCA_OK == code && msg.channel_id != load->channel_id)
+        code = ORCA_BAD_JSON;
+      discord_message_cleanup(&msg);
+    }
+    load->latencies_us[i] = timestamp_us() - tstamp;
+    if (ORCA_OK != code) ++load->failed;
+  }
+  return NULL;
+}
+
+static int
+u64_cmp(const void *p_a, const void *p_b)
+{
+  uint64_t a = *(uint64_t*)p_a, b = *(uint64_t*)p_b;
+  return (a > b) - (a < b);
+}
+
+int main(int argc, char *argv[])
+{
+  struct standin_server server = {
+    .bucket_limit = 5,
+    .bucket_reset_ms = 250,
+    .global_limit = 500,
+    .burst_every = 0,
+    .burst_len = 2
+  };
+
+  if (argc > 1 && 0 == strcmp(argv[1], "serve")) {
+    server.stub.port = (argc > 2) ? (unsigned short)atoi(argv[2]) : 8080;
+    standin_server_start(&server);
+    fprintf(stderr, "Discord stand-in listening at http://127.0.0.1:%hu\n", server.stub.port);
+    while (1) pause();
+  }
+
+  int nthreads = (argc > 1) ? atoi(argv[1]) : 16;
+  int amt = (argc > 2) ? atoi(argv[2]) : 20;
+  if (argc > 3) server.burst_every = atoi(argv[3]);
+
+  discord_global_init();
+  standin_server_start(&server);
+
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%hu", server.stub.port);
+
+  struct discord *client = discord_init("STAND-IN-TOKEN");
+  ua_set_url(client->adapter.ua, base_url);
+
+  fprintf(stderr, "Discord stand-in at %s (%d threads, %d requests per thread, %d channels)\n",
+      base_url, nthreads, amt, AMT_CHANNELS);
+
+  pthread_t *tids = calloc(nthreads, sizeof *tids);
+  struct load_thread *loads = calloc(nthreads, sizeof *loads);
+  uint64_t *latencies_us = calloc((size_t)nthreads * amt, sizeof *latencies_us);
+
+  uint64_t start_ms = cee_timestamp_ms();
+  for (int i=0; i < nthreads; ++i) {
+    loads[i] = (struct load_thread){
+      .client = discord_clone(client),
+      .channel_id = 1000 + (i % AMT_CHANNELS),
+      .amt = amt,
+      .latencies_us = latencies_us + (size_t)i * amt
+    };
+    if (pthread_create(&tids[i], NULL, &load_thread_run, &loads[i]))
+      ERR("Couldn't create thread");
+  }
+  int failed = 0;
+  for (int i=0; i < nthreads; ++i) {
+    pthread_join(tids[i], NULL);
+    failed += loads[i].failed;
+    discord_cleanup(loads[i].client);
+  }
+  uint64_t elapsed_ms = cee_timestamp_ms() - start_ms;
+
+  size_t total = (size_t)nthreads * amt;
+  if (total) {
+    qsort(latencies_us, total, sizeof *latencies_us, &u64_cmp);
+
+    fprintf(stderr, "%10s %10s %12s %10s %10s %10s %10s\n",
+        "requests", "time(ms)", "requests/s", "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)");
+    fprintf(stderr, "%10zu %10"PRIu64" %12.1f %10.2f %10.2f %10.2f %10.2f\n",
+        total, elapsed_ms, elapsed_ms ? (1000.0 * total) / elapsed_ms : 0,
+        latencies_us[total / 2] / 1000.0,
+        latencies_us[(total * 9) / 10] / 1000.0,
+        latencies_us[(total * 99) / 100] / 1000.0,
+        latencies_us[total - 1] / 1000.0);
+  }
+  fprintf(stderr, "server: %zu requests, %zu bucket 429s, %zu global 429s, %zu 5xxs\n",
+      server.stats.requests, server.stats.bucket_429,
+      server.stats.global_429, server.stats.server_5xx);
+
+  free(latencies_us);
+  free(loads);
+  free(tids);
+  discord_cleanup(client);
+  stub_server_stop(&server.stub);
+
+  discord_global_cleanup();
+
+  ASSERT_S(0 == failed, "Some requests failed");
+
+  return EXIT_SUCCESS;
+}
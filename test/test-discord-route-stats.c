@@ -0,0 +1,87 @@
+/*
+ * Checks the per-route histograms exposed by discord_get_route_stats(),
+ *  after a few requests to a local stub server
+ *
+ * Usage: ./test-discord-route-stats.out
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "discord.h"
+#include "discord-internal.h"
+#include "cee-utils.h"
+#include "stub-server.h"
+
+#define STUB_LATENCY_MS 20
+
+static int
+respond(void *data, struct stub_request *req, char resp[], size_t size)
+{
+  (void)data;
+  if (strstr(req->path, "/messages"))
+    return stub_server_reply(resp, size, 200, "", "[]");
+  return stub_server_reply(resp, size, 200, "", "{\"id\":\"1234\",\"name\":\"general\"}");
+}
+
+int main(void)
+{
+  struct stub_server server={ .latency_ms = STUB_LATENCY_MS, .respond_cb = &respond };
+
+  discord_global_init();
+  stub_server_start(&server);
+
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%hu", server.port);
+
+  struct discord *client = discord_init("STUB-TOKEN");
+  ua_set_url(client->adapter.ua, base_url);
+
+  for (u64_snowflake_t id=1; id <= 3; ++id) {
+    struct discord_channel channel;
+    discord_channel_init(&channel);
+    assert(ORCA_OK == discord_get_channel(client, id, &channel));
+    assert(1234 == channel.id);
+    discord_channel_cleanup(&channel);
+  }
+  for (u64_snowflake_t id=1; id <= 2; ++id) {
+    NTL_T(struct discord_message) messages=NULL;
+    assert(ORCA_OK == discord_get_channel_messages(client, id, &(struct discord_get_channel_messages_params){ .limit = 1 }, &messages));
+    discord_message_list_free(messages);
+  }
+  assert(5 == atomic_load(&server.amt_requests));
+
+  // requests differing only on their IDs share a route
+  struct discord_route_stats stats;
+  assert(true == discord_get_route_stats(client, "GET", "/channels/%"PRIu64, false, &stats));
+  assert(3 == stats.count);
+  assert(stats.min <= stats.p50 && stats.p50 <= stats.max);
+  // within the histogram's ~12.5% relative error of the stub's latency
+  assert(stats.p50 >= (STUB_LATENCY_MS * 1000 * 7) / 8);
+
+  assert(true == discord_get_route_stats(client, "GET", "/channels/%"PRIu64"/messages%s%s", false, &stats));
+  assert(2 == stats.count);
+
+  // the ratelimit cooldown is recorded once per attempt, even if not waited on
+  assert(true == discord_get_route_stats(client, "GET", "/channels/%"PRIu64, true, &stats));
+  assert(3 == stats.count);
+
+  assert(false == discord_get_route_stats(client, "DELETE", "/channels/%"PRIu64, false, &stats));
+  assert(0 == stats.count);
+
+  char buf[16384], expect[256];
+  size_t len = discord_dump_route_stats(client, buf, sizeof(buf));
+  assert(len < sizeof(buf));
+  snprintf(expect, sizeof(expect),
+      "ua_total_seconds_count{route=\"GET /channels/%%%s\"} 3\n", PRIu64);
+  assert(NULL != strstr(buf, expect));
+
+  discord_cleanup(client);
+  stub_server_stop(&server);
+  discord_global_cleanup();
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}
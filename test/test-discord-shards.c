@@ -0,0 +1,94 @@
+/*
+ * The shards of a client, run by discord_run() against a stub Gateway
+ *
+ * The amount of shards and max_concurrency are read from the stub's
+ *  GET /gateway/bot, and every shard is run from this process.
+ *
+ * Checks that each shard IDENTIFYs once with its shard array, that the
+ *  shards of a max_concurrency bucket (shard_id % max_concurrency)
+ *  IDENTIFY 5 seconds apart, and that the buckets IDENTIFY concurrently.
+ *
+ * Usage: ./test-discord-shards.out
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "discord.h"
+#include "discord-internal.h"
+#include "cee-utils.h"
+#include "stub-gateway.h"
+
+#define TOTAL_SHARDS     4
+#define MAX_CONCURRENCY  2
+#define GUILDS_PER_SHARD 3
+
+void on_idle(struct discord *client, const struct discord_user *bot)
+{
+  static bool is_shutdown;
+  if (is_shutdown) return;
+
+  for (int id=0; id < TOTAL_SHARDS; ++id) {
+    struct discord_shard_info info;
+    assert(ORCA_OK == discord_get_shard_info(client, id, &info));
+    if (info.status != DISCORD_SHARD_READY) return;
+    assert(GUILDS_PER_SHARD == info.guilds);
+  }
+  is_shutdown = true;
+  discord_gateway_shutdown(&client->gw);
+}
+
+int main(void)
+{
+  struct stub_gateway gateway = {
+    .shards = TOTAL_SHARDS,
+    .max_concurrency = MAX_CONCURRENCY,
+    .guilds = GUILDS_PER_SHARD
+  };
+
+  discord_global_init();
+  stub_gateway_start(&gateway);
+
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%hu", gateway.server.port);
+
+  struct discord *client = discord_init("STUB-TOKEN");
+  ua_set_url(client->adapter.ua, base_url); // GET /gateway/bot from the stub
+  discord_set_shards(client, 0, 0, 0);      // every shard Discord recommends
+  discord_set_on_idle(client, &on_idle);
+  assert(ORCA_OK == discord_run(client));
+
+  struct stub_identify identifies[STUB_GATEWAY_MAX_IDENTIFIES];
+  int amt = stub_gateway_get_identifies(&gateway, identifies, STUB_GATEWAY_MAX_IDENTIFIES);
+  assert(TOTAL_SHARDS == amt);
+
+  u64_unix_ms_t tstamps[TOTAL_SHARDS] = {0};
+  for (int i=0; i < amt; ++i) {
+    int id = identifies[i].shard_id;
+    assert(id >= 0 && id < TOTAL_SHARDS);
+    assert(TOTAL_SHARDS == identifies[i].shard_total);
+    assert(0 == tstamps[id]); // once
+    tstamps[id] = identifies[i].tstamp;
+  }
+
+  for (int i=0; i < TOTAL_SHARDS; ++i) {
+    for (int j=i+1; j < TOTAL_SHARDS; ++j) {
+      u64_unix_ms_t delay = (tstamps[i] > tstamps[j]) ? tstamps[i] - tstamps[j]
+                                                      : tstamps[j] - tstamps[i];
+      fprintf(stderr, "Shards %d and %d IDENTIFY %"PRIu64" ms apart\n", i, j, delay);
+      if (i % MAX_CONCURRENCY == j % MAX_CONCURRENCY)
+        assert(delay >= DISCORD_SHARD_IDENTIFY_INTERVAL_MS);
+      else if (i / MAX_CONCURRENCY == j / MAX_CONCURRENCY) // same round
+        assert(delay < DISCORD_SHARD_IDENTIFY_INTERVAL_MS);
+    }
+  }
+
+  discord_cleanup(client);
+  stub_gateway_stop(&gateway);
+  discord_global_cleanup();
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/*
+ * Checks the inflating of zlib-stream Gateway payloads (compress=zlib-stream)
+ *
+ * A recorded capture of 4 payloads, compressed as a single zlib stream
+ *  with a Z_SYNC_FLUSH after each, is handed to on_binary_cb() as
+ *  binary messages split at different points: whole payloads, payloads
+ *  spanning several messages, and cuts through the 00 00 ff ff suffix.
+ *  The payloads must be dispatched once complete, and only then.
+ *
+ * discord-gateway.c is included to reach its static functions.
+ *
+ * Usage: ./test-discord-zlib.out
+ */
+#include "discord-gateway.c" /* defines _GNU_SOURCE, included first */
+
+#include <assert.h>
+
+#define AMT_PAYLOADS 4
+
+/* a HEARTBEAT_ACK then 3 MESSAGE_CREATE, the last repeating the first
+ *  (so it's inflated from the stream's earlier context) */
+static const unsigned char capture[] = {
+  0x78, 0x9c, 0xaa, 0x56, 0x2a, 0x51, 0xb2, 0xca, 0x2b, 0xcd, 0xc9, 0xd1,
+  0x51, 0x2a, 0x86, 0x31, 0xf2, 0x0b, 0x94, 0xac, 0x0c, 0x0d, 0x75, 0x94,
+  0x52, 0x20, 0x02, 0xb5, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x6c, 0x8f,
+  0x41, 0x6b, 0xc3, 0x30, 0x0c, 0x85, 0xff, 0xca, 0xd0, 0x39, 0x05, 0xd9,
+  0x71, 0x12, 0xe7, 0x58, 0x46, 0xd8, 0x69, 0x97, 0x76, 0xb7, 0x32, 0x8a,
+  0x9b, 0x68, 0xb3, 0xc1, 0xb1, 0xc1, 0x71, 0x4e, 0x25, 0xff, 0x7d, 0x72,
+  0xba, 0xed, 0xd4, 0x8b, 0x90, 0xde, 0xfb, 0xd0, 0x93, 0xee, 0x85, 0x81,
+  0xf7, 0xe1, 0x7c, 0x3e, 0xbe, 0x0d, 0xd7, 0xd7, 0xd3, 0x70, 0xfc, 0x18,
+  0x60, 0xe7, 0xc5, 0x03, 0xc6, 0x9d, 0xbd, 0x83, 0xe3, 0x0a, 0x5a, 0xf7,
+  0x4d, 0x27, 0xa5, 0xa8, 0x05, 0x4a, 0xdd, 0xb6, 0xaa, 0x13, 0xcc, 0x8e,
+  0xd6, 0x84, 0x40, 0xfe, 0xfa, 0x47, 0xd4, 0xad, 0x68, 0x85, 0x52, 0x8d,
+  0x90, 0x12, 0x95, 0x46, 0x26, 0xbe, 0x57, 0xe7, 0xa7, 0xe7, 0x7e, 0xd7,
+  0x97, 0x0d, 0x31, 0x64, 0x0a, 0xe5, 0x10, 0x4b, 0xde, 0xc7, 0x97, 0x6c,
+  0x29, 0x11, 0xeb, 0x66, 0xcd, 0x36, 0xa6, 0xff, 0xf4, 0x1a, 0xa5, 0x6c,
+  0x54, 0xa3, 0x10, 0x05, 0xea, 0xbe, 0x53, 0xa8, 0x99, 0x59, 0x17, 0x4a,
+  0xc1, 0xcc, 0xc4, 0x7e, 0x4c, 0xa3, 0x39, 0x94, 0x99, 0xe5, 0xc9, 0x2d,
+  0x63, 0x72, 0xb3, 0x0b, 0x26, 0x97, 0x0d, 0x80, 0x4a, 0x22, 0x6c, 0x15,
+  0xe4, 0xcc, 0xaf, 0x7d, 0x19, 0xbf, 0x50, 0x05, 0x33, 0x67, 0xba, 0x18,
+  0x58, 0xb8, 0x7c, 0x56, 0x40, 0xf3, 0x8d, 0xa6, 0xdf, 0xde, 0xe4, 0x6c,
+  0x46, 0x5b, 0xfc, 0x5d, 0xd8, 0xb6, 0x1f, 0x00, 0x00, 0x00, 0xff, 0xff,
+  0xcc, 0xd7, 0x49, 0x0a, 0xc2, 0x40, 0x10, 0x40, 0xd1, 0xab, 0xd4, 0x01,
+  0x5c, 0x58, 0x93, 0xc3, 0x71, 0x82, 0xb6, 0x31, 0x10, 0x13, 0x49, 0x22,
+  0x5e, 0xdf, 0xe0, 0x5e, 0xf0, 0x37, 0x2e, 0x5c, 0x37, 0x7f, 0x53, 0x8f,
+  0x9e, 0x3e, 0x8f, 0xc9, 0xbe, 0x19, 0x93, 0xfd, 0x78, 0x4c, 0x7d, 0x37,
+  0x14, 0xd9, 0xca, 0x78, 0x91, 0x46, 0xfa, 0x71, 0x68, 0xe5, 0x56, 0xe6,
+  0xb9, 0x69, 0xcb, 0x46, 0xa6, 0x72, 0x2f, 0xcd, 0x52, 0xce, 0xf2, 0xec,
+  0x96, 0xeb, 0xba, 0x7a, 0x1a, 0x1f, 0x6b, 0x34, 0xc9, 0xbb, 0x50, 0x5c,
+  0x18, 0x2e, 0x1c, 0x17, 0x81, 0x8b, 0xc4, 0xc5, 0x0e, 0x17, 0x7b, 0x5c,
+  0x1c, 0x70, 0x71, 0xe4, 0x82, 0x15, 0xe8, 0x5c, 0x5d, 0x39, 0xbb, 0x72,
+  0x77, 0xe5, 0xf0, 0xca, 0xe5, 0x95, 0xd3, 0x2b, 0xb7, 0x57, 0x8e, 0xaf,
+  0x5c, 0xdf, 0xb8, 0xbe, 0x55, 0xec, 0x79, 0xae, 0x6f, 0x5c, 0xdf, 0xb8,
+  0xbe, 0x71, 0x7d, 0xe3, 0xfa, 0xc6, 0xf5, 0x8d, 0xeb, 0x1b, 0xd7, 0x77,
+  0xae, 0xef, 0x5c, 0xdf, 0x2b, 0x8e, 0x7c, 0xae, 0xef, 0x5c, 0xdf, 0xb9,
+  0xbe, 0x73, 0x7d, 0xe7, 0xfa, 0xce, 0xf5, 0x9d, 0xeb, 0x07, 0xd7, 0x0f,
+  0xae, 0x1f, 0x5c, 0x3f, 0x2a, 0x6e, 0x7c, 0xae, 0x1f, 0x5c, 0x3f, 0xb8,
+  0x7e, 0x70, 0xfd, 0xe0, 0xfa, 0xc1, 0xf5, 0x93, 0xeb, 0x27, 0xd7, 0x4f,
+  0xae, 0x9f, 0x5c, 0x3f, 0x2b, 0x1e, 0x7c, 0x5c, 0x3f, 0xb9, 0x7e, 0x72,
+  0xfd, 0xe4, 0xfa, 0x49, 0xf4, 0xff, 0xea, 0x13, 0xf4, 0x02, 0x00, 0x00,
+  0xff, 0xff, 0xc2, 0xdd, 0x09, 0x32, 0x26, 0xa6, 0x13, 0x64, 0x3c, 0x42,
+  0xfa, 0x8a, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff
+};
+/* where each payload ends in the capture, after its suffix */
+static const size_t capture_ends[AMT_PAYLOADS] = { 34, 240, 458, 476 };
+/* their size once inflated */
+static const size_t payload_lens[AMT_PAYLOADS] = { 36, 295, 3333, 295 };
+
+static char long_content[4096];
+static const char *expected_contents[AMT_PAYLOADS - 1] = {
+  "hello there", long_content, "hello there"
+};
+
+static int amt_messages;
+
+static void
+check_message_create(struct discord *client, const struct discord_user *bot, const struct discord_message *msg)
+{
+  assert(amt_messages < AMT_PAYLOADS - 1);
+  assert(0 == strcmp(expected_contents[amt_messages], msg->content));
+  assert(889572213102866470ULL + amt_messages + 1 == msg->id);
+  assert(889361614451220480ULL == msg->channel_id);
+  assert(0 == strcmp("orca-user", msg->author->username));
+  ++amt_messages;
+}
+
+/* hand the capture to a new client's Gateway, cut at each of 'cuts' */
+static void
+deliver(const size_t cuts[], size_t amt_cuts)
+{
+  struct discord *client = discord_init("STUB-TOKEN");
+  discord_set_gateway_compress(client, true);
+  discord_set_on_message_create(client, &check_message_create);
+  struct discord_gateway *gw = &client->gw;
+  struct ws_info info = {0};
+
+  amt_messages = 0;
+  size_t start = 0;
+  for (size_t i=0; i <= amt_cuts; ++i) {
+    size_t end = (i < amt_cuts) ? cuts[i] : sizeof(capture);
+    if (end <= start) continue;
+    on_binary_cb(gw, gw->ws, &info, capture + start, end - start);
+    start = end;
+
+    // only the payloads received whole are dispatched
+    size_t amt_complete=0, amt_bytes=0;
+    while (amt_complete < AMT_PAYLOADS && capture_ends[amt_complete] <= end)
+      amt_bytes += payload_lens[amt_complete++];
+    assert(amt_complete == gw->compress->stats.amt_payloads);
+    assert(amt_bytes == gw->compress->stats.bytes_inflated);
+    assert(end == gw->compress->stats.bytes_received);
+    assert((amt_complete ? amt_complete - 1 : 0) == (size_t)amt_messages);
+  }
+  assert(AMT_PAYLOADS - 1 == amt_messages);
+  assert(3 == gw->payload->seq);
+
+  discord_cleanup(client);
+}
+
+int main(void)
+{
+  size_t len=0;
+  for (int i=0; i < 60; ++i)
+    len += snprintf(long_content + len, sizeof(long_content) - len,
+        "%sline %d of a long message, repeated with a counter", i ? " " : "", i);
+
+  discord_global_init();
+
+  // a binary message per payload
+  deliver(capture_ends, AMT_PAYLOADS);
+
+  // 7 bytes at a time, the payloads span messages ending without the suffix
+  size_t cuts[sizeof(capture) / 7 + AMT_PAYLOADS];
+  size_t amt_cuts=0, start=0;
+  for (int i=0; i < AMT_PAYLOADS; ++i) {
+    for (size_t offset=start + 7; offset < capture_ends[i]; offset += 7)
+      cuts[amt_cuts++] = offset;
+    cuts[amt_cuts++] = start = capture_ends[i];
+  }
+  deliver(cuts, amt_cuts);
+
+  // the suffix itself split across messages
+  const size_t suffix_cuts[] = { 32, 34, 100, 237, 238, 239, 240, 457, 458, 472, 474 };
+  deliver(suffix_cuts, sizeof(suffix_cuts) / sizeof(size_t));
+
+  discord_global_cleanup();
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/*
+ * Multi-threaded throughput benchmark for user-agent.c
+ *
+ * Spins a local HTTP stub server that answers every request after a
+ *  fixed latency, then performs requests from an increasing amount of
+ *  threads sharing the same user_agent. Requests per second should grow
+ *  with the thread count, as transfers are performed concurrently.
+ * Lastly, the same amount of requests are performed from a single
+ *  thread with ua_run_async(), first with an unbounded conn pool
+ *  then bounded to 8 conns.
+ *
+ * Usage: ./test-ua-throughput.out [latency_ms] [requests_per_thread]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "user-agent.h"
+#include "cee-utils.h"
+#include "stub-server.h"
+
+struct bench_thread {
+  struct user_agent *ua;
+  int amt; ///< amount of requests to perform
+  int failed;
+};
+
+static void*
+bench_thread_run(void *p_bench)
+{
+  struct bench_thread *bench = p_bench;
+  for (int i=0; i < bench->amt; ++i) {
+    if (ORCA_OK != ua_run(bench->ua, NULL, NULL, NULL, HTTP_GET, "/messages/%d", i))
+      ++bench->failed;
+  }
+  return NULL;
+}
+
+static void
+bench_async_done(struct user_agent *ua, struct ua_info *info, ORCAcode code, void *data)
+{
+  int *failed = data;
+  if (ORCA_OK != code) ++*failed;
+}
+
+int main(int argc, char *argv[])
+{
+  uint64_t latency_ms = (argc > 1) ? strtoull(argv[1], NULL, 10) : 20;
+  int amt = (argc > 2) ? atoi(argv[2]) : 25;
+
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  struct stub_server server = { .latency_ms = latency_ms };
+  stub_server_start(&server);
+
+  struct logconf conf;
+  logconf_setup(&conf, "UA_THROUGHPUT", NULL);
+
+  struct user_agent *ua = ua_init(&conf);
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%hu", server.port);
+  ua_set_url(ua, base_url);
+
+  fprintf(stderr, "Stub server at %s (latency: %"PRIu64" ms, %d requests per thread)\n",
+      base_url, latency_ms, amt);
+  fprintf(stderr, "%8s %10s %10s %12s\n", "threads", "requests", "time(ms)", "requests/s");
+
+  const int nthreads[] = { 1, 2, 4, 8, 16 };
+  double base_rps = 0;
+  for (size_t i=0; i < sizeof(nthreads)/sizeof(int); ++i) {
+    pthread_t tids[16];
+    struct bench_thread benches[16];
+
+    uint64_t start_ms = cee_timestamp_ms();
+    for (int j=0; j < nthreads[i]; ++j) {
+      benches[j] = (struct bench_thread){ .ua = ua, .amt = amt };
+      if (pthread_create(&tids[j], NULL, &bench_thread_run, &benches[j]))
+        ERR("Couldn't create thread");
+    }
+    int failed = 0;
+    for (int j=0; j < nthreads[i]; ++j) {
+      pthread_join(tids[j], NULL);
+      failed += benches[j].failed;
+    }
+    uint64_t elapsed_ms = cee_timestamp_ms() - start_ms;
+
+    int total = nthreads[i] * amt;
+    double rps = elapsed_ms ? (1000.0 * total) / elapsed_ms : 0;
+    if (!base_rps) base_rps = rps;
+    fprintf(stderr, "%8d %10d %10"PRIu64" %12.1f (x%.2f)\n",
+        nthreads[i], total, elapsed_ms, rps, rps / base_rps);
+    ASSERT_S(0 == failed, "Some requests failed");
+  }
+
+  // single thread, every request in flight at once
+  for (int max_conns=0; max_conns <= 8; max_conns += 8) {
+    ua_set_conn_limits(ua, max_conns, 0);
+
+    int failed = 0;
+    int total = 16 * amt;
+    uint64_t start_ms = cee_timestamp_ms();
+    for (int i=0; i < total; ++i)
+      ua_run_async(ua, NULL, NULL, &bench_async_done, &failed, HTTP_GET, "/messages/%d", i);
+    while (ua_async_perform(ua, 5))
+      continue;
+    uint64_t elapsed_ms = cee_timestamp_ms() - start_ms;
+
+    char label[32];
+    snprintf(label, sizeof(label), "async/%d", max_conns);
+    double rps = elapsed_ms ? (1000.0 * total) / elapsed_ms : 0;
+    fprintf(stderr, "%8s %10d %10"PRIu64" %12.1f (x%.2f)\n",
+        label, total, elapsed_ms, rps, rps / base_rps);
+    ASSERT_S(0 == failed, "Some requests failed");
+  }
+
+  struct ua_pool_stats stats;
+  ua_get_pool_stats(ua, &stats);
+  fprintf(stderr, "pool: %zu hits, %zu misses, %zu waits, %zu evictions, %zu conns (%zu idle)\n",
+      stats.hits, stats.misses, stats.waits, stats.evictions, stats.amt, stats.amt_idle);
+
+  ua_cleanup(ua);
+  stub_server_stop(&server);
+
+  curl_global_cleanup();
+
+  return EXIT_SUCCESS;
+}
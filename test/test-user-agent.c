@@ -0,0 +1,427 @@
+/*
+ * Behavior tests for user-agent.c, against the local stub server
+ *
+ * Each test starts its own stub server, so that the connections and
+ *  requests it counts belong to that test only.
+ *
+ * Usage: ./test-user-agent.out
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "user-agent.h"
+#include "cee-utils.h"
+#include "stub-server.h"
+
+static struct logconf conf;
+
+static struct user_agent*
+ua_init_stub(struct stub_server *server)
+{
+  struct user_agent *ua = ua_init(&conf);
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "http://127.0.0.1:%hu", server->port);
+  ua_set_url(ua, base_url);
+  return ua;
+}
+
+/* clones share the original's conn pool, and the DNS/TLS share joined
+ *  from any of them */
+static void
+test_clones_reuse_conns(void)
+{
+  struct stub_server server={0};
+  stub_server_start(&server);
+  struct user_agent *ua = ua_init_stub(&server);
+
+  struct user_agent *clones[4];
+  for (int i=0; i < 4; ++i)
+    clones[i] = ua_clone(ua);
+
+  struct ua_share *share = ua_share_init();
+  ua_set_share(clones[0], share); // joined by every handle
+
+  for (int i=0; i < 4; ++i) {
+    assert(ORCA_OK == ua_run(clones[i], NULL, NULL, NULL, HTTP_GET, "/clone/%d", i));
+    ua_cleanup(clones[i]);
+  }
+  assert(ORCA_OK == ua_run(ua, NULL, NULL, NULL, HTTP_GET, "/original"));
+
+  // every request went through the same connection
+  assert(5 == atomic_load(&server.amt_requests));
+  assert(1 == atomic_load(&server.amt_conns));
+  struct ua_pool_stats stats;
+  ua_get_pool_stats(ua, &stats);
+  assert(1 == stats.amt && 1 == stats.misses && 4 == stats.hits);
+
+  ua_cleanup(ua);
+  ua_share_cleanup(share);
+  stub_server_stop(&server);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+static int
+respond_multipart(void *data, struct stub_request *req, char resp[], size_t size)
+{
+  (void)data;
+  // the uploaded file content made it through
+  int httpcode = strstr(req->body, "multipart content") ? 200 : 400;
+  return stub_server_reply(resp, size, httpcode, "", STUB_SERVER_BODY);
+}
+
+static void
+count_done(struct user_agent *ua, struct ua_info *info, ORCAcode code, void *data)
+{
+  (void)ua;
+  (void)info;
+  if (ORCA_OK == code) ++*(int*)data;
+}
+
+/* async requests never block on a exhausted pool, not even multipart
+ *  uploads, and the pump evicts conns left idle */
+static void
+test_async_defers_and_evicts(void)
+{
+  struct stub_server server={ .latency_ms = 50, .respond_cb = &respond_multipart };
+  stub_server_start(&server);
+  struct user_agent *ua = ua_init_stub(&server);
+  ua_set_conn_limits(ua, 1, 100);
+
+  char path[] = "/tmp/test-user-agent-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  assert(sizeof("multipart content")-1 == write(fd, "multipart content", sizeof("multipart content")-1));
+  close(fd);
+
+  int amt_done=0;
+  for (int i=0; i < 3; ++i) {
+    struct ua_multipart multipart={0};
+    char name[16];
+    snprintf(name, sizeof(name), "file%d", i);
+    assert(ORCA_OK == ua_multipart_add_file(&multipart, name, "text/plain", path));
+    assert(ORCA_OK == ua_run_async(ua, NULL, UA_MULTIPART_BODY(&multipart), 
+                        &count_done, &amt_done, HTTP_MIMEPOST, "/upload/%d", i));
+    // deferred requests hold their own copy
+    ua_multipart_cleanup(&multipart);
+  }
+  unlink(path);
+
+  while (ua_async_perform(ua, 10))
+    continue;
+  assert(3 == amt_done);
+  assert(3 == atomic_load(&server.amt_requests));
+
+  struct ua_pool_stats stats;
+  ua_get_pool_stats(ua, &stats);
+  assert(1 == stats.amt && 1 == stats.amt_idle && 0 == stats.waits);
+
+  // nothing is released past this point, the pump alone evicts the conn
+  cee_sleep_ms(150);
+  ua_async_perform(ua, 0);
+  ua_get_pool_stats(ua, &stats);
+  assert(0 == stats.amt && 1 == stats.evictions);
+
+  ua_cleanup(ua);
+  stub_server_stop(&server);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+static ORCAcode
+get_with_overlay(struct user_agent *ua, struct ua_info *info, struct ua_reqheader_field overlay[], char endpoint[], ...)
+{
+  va_list args;
+  va_start(args, endpoint);
+  ORCAcode code = ua_vrun(ua, info, NULL, NULL, overlay, HTTP_GET, endpoint, args);
+  va_end(args);
+  return code;
+}
+
+struct concurrent_get {
+  struct user_agent *ua;
+  struct ua_reqheader_field *overlay;
+  uint64_t delay_ms; ///< delay before the request, so that it overlaps the first
+};
+
+static void*
+concurrent_get_run(void *p_get)
+{
+  struct concurrent_get *get = p_get;
+  cee_sleep_ms((int64_t)get->delay_ms);
+  struct ua_info info={0};
+  assert(ORCA_OK == get_with_overlay(get->ua, &info, get->overlay, "/coalesced"));
+  ua_info_cleanup(&info);
+  return NULL;
+}
+
+/* perform two overlapping identical GETs from different threads */
+static void
+run_concurrent_gets(struct user_agent *ua, struct ua_reqheader_field overlay1[], struct ua_reqheader_field overlay2[])
+{
+  struct concurrent_get gets[2] = {
+    { .ua = ua, .overlay = overlay1, .delay_ms = 0 },
+    { .ua = ua, .overlay = overlay2, .delay_ms = 50 }
+  };
+  pthread_t tids[2];
+  for (int i=0; i < 2; ++i)
+    assert(0 == pthread_create(&tids[i], NULL, &concurrent_get_run, &gets[i]));
+  for (int i=0; i < 2; ++i)
+    pthread_join(tids[i], NULL);
+}
+
+/* coalescing enabled from a clone applies to the original as well */
+static void
+test_coalescing_is_shared(void)
+{
+  struct stub_server server={ .latency_ms = 200 };
+  stub_server_start(&server);
+  struct user_agent *ua = ua_init_stub(&server);
+
+  struct user_agent *clone = ua_clone(ua);
+  ua_set_coalescing(clone, true);
+  ua_cleanup(clone);
+
+  run_concurrent_gets(ua, NULL, NULL);
+  assert(1 == atomic_load(&server.amt_requests));
+  assert(1 == ua_get_coalesced_count(ua));
+
+  ua_cleanup(ua);
+  stub_server_stop(&server);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+/* overlapping GETs that differ only on their header overlay aren't
+ *  coalesced, identical overlays still are */
+static void
+test_coalescing_keys_overlay(void)
+{
+  struct stub_server server={ .latency_ms = 200 };
+  stub_server_start(&server);
+  struct user_agent *ua = ua_init_stub(&server);
+  ua_set_coalescing(ua, true);
+
+  struct ua_reqheader_field reason1[] = {
+    { "X-Audit-Log-Reason", "first" }, { NULL, NULL }
+  };
+  struct ua_reqheader_field reason2[] = {
+    { "X-Audit-Log-Reason", "second" }, { NULL, NULL }
+  };
+  run_concurrent_gets(ua, reason1, reason2);
+  assert(2 == atomic_load(&server.amt_requests));
+  assert(0 == ua_get_coalesced_count(ua));
+
+  run_concurrent_gets(ua, NULL, reason1);
+  assert(4 == atomic_load(&server.amt_requests));
+  assert(0 == ua_get_coalesced_count(ua));
+
+  run_concurrent_gets(ua, reason1, reason1);
+  assert(5 == atomic_load(&server.amt_requests));
+  assert(1 == ua_get_coalesced_count(ua));
+
+  ua_cleanup(ua);
+  stub_server_stop(&server);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+/* malformed multipart bodies are refused before reaching the network */
+static void
+test_multipart_validation(void)
+{
+  struct stub_server server={0};
+  stub_server_start(&server);
+  struct user_agent *ua = ua_init_stub(&server);
+
+  struct ua_multipart multipart={0};
+  assert(ORCA_BAD_PARAMETER == ua_multipart_add_file(&multipart, "file", NULL, NULL));
+  assert(ORCA_BAD_PARAMETER == ua_multipart_add_file(&multipart, NULL, NULL, "/dev/null"));
+  assert(0 == multipart.amt);
+
+  // a part without content
+  ua_multipart_add_data(&multipart, "file", NULL, NULL, NULL, 0);
+  assert(ORCA_BAD_PARAMETER == ua_run(ua, NULL, NULL, UA_MULTIPART_BODY(&multipart), HTTP_MIMEPOST, "/upload"));
+  assert(ORCA_BAD_PARAMETER == ua_run_async(ua, NULL, UA_MULTIPART_BODY(&multipart), NULL, NULL, HTTP_MIMEPOST, "/upload"));
+  ua_multipart_cleanup(&multipart);
+
+  // a part without name
+  ua_multipart_add_data(&multipart, NULL, NULL, NULL, "content", sizeof("content")-1);
+  assert(ORCA_BAD_PARAMETER == ua_run(ua, NULL, NULL, UA_MULTIPART_BODY(&multipart), HTTP_MIMEPOST, "/upload"));
+  ua_multipart_cleanup(&multipart);
+
+  // a payload that isn't a UA_MULTIPART_BODY()
+  struct sized_buffer json = { "{\"content\":\"hi\"}", sizeof("{\"content\":\"hi\"}")-1 };
+  assert(ORCA_BAD_PARAMETER == ua_run(ua, NULL, NULL, &json, HTTP_MIMEPOST, "/upload"));
+
+  assert(0 == atomic_load(&server.amt_requests));
+
+  ua_cleanup(ua);
+  stub_server_stop(&server);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+static int
+respond_ratelimited(void *data, struct stub_request *req, char resp[], size_t size)
+{
+  atomic_int *p_count = data;
+  int n = atomic_fetch_add(p_count, 1);
+
+  char header[256], body[256];
+  if (strstr(req->path, "/limited")) {
+    snprintf(header, sizeof(header), 
+        "x-ratelimit-remaining: 0\r\n"
+        "x-ratelimit-reset-after: 0.500\r\n"
+        "x-ratelimit-bucket: limited\r\n");
+    return stub_server_reply(resp, size, 429, header, "{\"retry_after\":0.5,\"global\":false}");
+  }
+  snprintf(header, sizeof(header), 
+      "x-ratelimit-remaining: %d\r\n"
+      "x-ratelimit-reset-after: 0.250\r\n"
+      "x-ratelimit-bucket: b%d\r\n", 5 - n, n % 2);
+  snprintf(body, sizeof(body), "{\"path\":\"%s\",\"n\":%d}", req->path, n);
+  return stub_server_reply(resp, size, 200, header, body);
+}
+
+static const char *RATELIMIT_FIELDS[] = {
+  "x-ratelimit-remaining", "x-ratelimit-reset-after", "x-ratelimit-bucket"
+};
+#define AMT_RATELIMIT_FIELDS (sizeof(RATELIMIT_FIELDS)/sizeof(*RATELIMIT_FIELDS))
+
+struct tape_result {
+  ORCAcode code;
+  int httpcode;
+  char body[256];
+  char fields[AMT_RATELIMIT_FIELDS][64];
+};
+
+static void
+tape_result_fill(struct tape_result *result, ORCAcode code, struct ua_info *info)
+{
+  result->code = code;
+  result->httpcode = info->httpcode;
+  struct sized_buffer body = ua_info_get_resp_body(info);
+  snprintf(result->body, sizeof(result->body), "%.*s", (int)body.size, body.start);
+  for (size_t i=0; i < AMT_RATELIMIT_FIELDS; ++i) {
+    struct sized_buffer field = ua_info_respheader_field(info, (char*)RATELIMIT_FIELDS[i]);
+    snprintf(result->fields[i], sizeof(result->fields[i]), "%.*s", (int)field.size, field.start);
+  }
+}
+
+static void
+tape_result_assert_eq(struct tape_result *a, struct tape_result *b)
+{
+  assert(a->code == b->code);
+  assert(a->httpcode == b->httpcode);
+  assert(0 == strcmp(a->body, b->body));
+  for (size_t i=0; i < AMT_RATELIMIT_FIELDS; ++i)
+    assert(0 == strcmp(a->fields[i], b->fields[i]));
+}
+
+static struct {
+  enum http_method http_method;
+  char *path;
+} TAPE_REQUESTS[] = {
+  { HTTP_GET,  "/channels/1" },
+  { HTTP_GET,  "/channels/2" },
+  { HTTP_POST, "/channels/1" },
+  { HTTP_GET,  "/channels/1" }, // replayed its own response, not the first one's
+  { HTTP_GET,  "/limited" }
+};
+#define AMT_TAPE_REQUESTS (sizeof(TAPE_REQUESTS)/sizeof(*TAPE_REQUESTS))
+
+static void
+tape_async_done(struct user_agent *ua, struct ua_info *info, ORCAcode code, void *data)
+{
+  (void)ua;
+  tape_result_fill(data, code, info);
+}
+
+/* responses recorded against the stub server are replayed offline with
+ *  the same code, body and ratelimit headers, both sync and async */
+static void
+test_record_replay_roundtrip(void)
+{
+  atomic_int count=0;
+  struct stub_server server={ .respond_cb = &respond_ratelimited, .data = &count };
+  stub_server_start(&server);
+  struct user_agent *ua = ua_init_stub(&server);
+
+  char path[] = "/tmp/test-user-agent-tape-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+
+  struct tape_result recorded[AMT_TAPE_REQUESTS]={0}, replayed[AMT_TAPE_REQUESTS]={0};
+
+  assert(ORCA_OK == ua_set_record(ua, path));
+  for (size_t i=0; i < AMT_TAPE_REQUESTS; ++i) {
+    struct ua_info info={0};
+    ORCAcode code = ua_run(ua, &info, NULL, 
+                      HTTP_POST == TAPE_REQUESTS[i].http_method ? &(struct sized_buffer){ "{}", 2 } : NULL, 
+                      TAPE_REQUESTS[i].http_method, "%s", TAPE_REQUESTS[i].path);
+    tape_result_fill(&recorded[i], code, &info);
+    ua_info_cleanup(&info);
+  }
+  assert(ORCA_OK == ua_set_record(ua, NULL));
+  assert(AMT_TAPE_REQUESTS == atomic_load(&server.amt_requests));
+  assert(429 == recorded[AMT_TAPE_REQUESTS-1].httpcode);
+
+  // offline from here on
+  ua_cleanup(ua);
+  stub_server_stop(&server);
+  ua = ua_init_stub(&server);
+
+  assert(ORCA_OK == ua_set_replay(ua, path, 0));
+  for (size_t i=0; i < AMT_TAPE_REQUESTS; ++i) {
+    struct ua_info info={0};
+    ORCAcode code = ua_run(ua, &info, NULL, 
+                      HTTP_POST == TAPE_REQUESTS[i].http_method ? &(struct sized_buffer){ "{}", 2 } : NULL, 
+                      TAPE_REQUESTS[i].http_method, "%s", TAPE_REQUESTS[i].path);
+    tape_result_fill(&replayed[i], code, &info);
+    ua_info_cleanup(&info);
+    tape_result_assert_eq(&recorded[i], &replayed[i]);
+  }
+
+  // the async path replays from ua_async_perform()
+  assert(ORCA_OK == ua_set_replay(ua, path, 0));
+  memset(replayed, 0, sizeof(replayed));
+  for (size_t i=0; i < AMT_TAPE_REQUESTS; ++i) {
+    assert(ORCA_OK == ua_run_async(ua, NULL, 
+                        HTTP_POST == TAPE_REQUESTS[i].http_method ? &(struct sized_buffer){ "{}", 2 } : NULL, 
+                        &tape_async_done, &replayed[i],
+                        TAPE_REQUESTS[i].http_method, "%s", TAPE_REQUESTS[i].path));
+  }
+  while (ua_async_perform(ua, 10))
+    continue;
+  for (size_t i=0; i < AMT_TAPE_REQUESTS; ++i)
+    tape_result_assert_eq(&recorded[i], &replayed[i]);
+
+  assert(AMT_TAPE_REQUESTS == atomic_load(&server.amt_requests));
+
+  ua_cleanup(ua);
+  unlink(path);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+int main(void)
+{
+  curl_global_init(CURL_GLOBAL_ALL);
+  logconf_setup(&conf, "TEST_USER_AGENT", NULL);
+
+  test_clones_reuse_conns();
+  test_async_defers_and_evicts();
+  test_coalescing_is_shared();
+  test_coalescing_keys_overlay();
+  test_multipart_validation();
+  test_record_replay_roundtrip();
+
+  logconf_cleanup(&conf);
+  curl_global_cleanup();
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}
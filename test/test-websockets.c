@@ -0,0 +1,167 @@
+/*
+ * Behavior tests for websockets.c, against the local stub server
+ *
+ * Usage: ./test-websockets.out
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#include "websockets.h"
+#include "cee-utils.h"
+#include "stub-server.h"
+
+#define AMT_PRODUCERS 8
+#define AMT_PER_PRODUCER 5000
+
+static struct logconf conf;
+
+struct received {
+  pthread_mutex_t lock;
+  int next_seq[AMT_PRODUCERS]; ///< the sequence expected from each producer
+  size_t amt;                  ///< messages received in order
+  size_t amt_errors;           ///< messages lost or out of order
+};
+
+static void
+on_producer_message(void *data, struct stub_ws *ws, enum stub_ws_opcode opcode, const char msg[], size_t len)
+{
+  (void)ws;
+  (void)len;
+  struct received *received = data;
+
+  int producer=-1, seq=-1;
+  sscanf(msg, "%d:%d", &producer, &seq);
+
+  pthread_mutex_lock(&received->lock);
+  if (STUB_WS_TEXT != opcode || producer < 0 || producer >= AMT_PRODUCERS
+      || seq != received->next_seq[producer])
+  {
+    ++received->amt_errors;
+  }
+  else {
+    ++received->next_seq[producer];
+    ++received->amt;
+  }
+  pthread_mutex_unlock(&received->lock);
+}
+
+struct producer {
+  struct websockets *ws;
+  int id;
+  int amt_failed; ///< ws_send_text() that returned false
+};
+
+static void*
+producer_run(void *p_producer)
+{
+  struct producer *producer = p_producer;
+  char text[64];
+  for (int seq=0; seq < AMT_PER_PRODUCER; ++seq) {
+    int len = snprintf(text, sizeof(text), "%d:%d", producer->id, seq);
+    if (!ws_send_text(producer->ws, NULL, text, len))
+      ++producer->amt_failed;
+  }
+  return NULL;
+}
+
+/* open a connection to the stub server, driven from this thread */
+static struct websockets*
+ws_init_stub(struct stub_server *server, bool *is_running)
+{
+  struct websockets *ws = ws_init(&(struct ws_callbacks){ 0 }, &conf);
+  char base_url[64];
+  snprintf(base_url, sizeof(base_url), "ws://127.0.0.1:%hu", server->port);
+  ws_set_url(ws, base_url, NULL);
+
+  ws_start(ws);
+  uint64_t deadline = cee_timestamp_ms() + 5000;
+  do {
+    ws_perform(ws, is_running, 10);
+  } while (WS_CONNECTED != ws_get_status(ws) && cee_timestamp_ms() < deadline);
+  assert(WS_CONNECTED == ws_get_status(ws));
+  return ws;
+}
+
+static void
+ws_close_stub(struct websockets *ws, bool *is_running)
+{
+  ws_close(ws, WS_CLOSE_REASON_NORMAL, "", 0);
+  uint64_t deadline = cee_timestamp_ms() + 5000;
+  do {
+    ws_perform(ws, is_running, 10);
+  } while (*is_running && cee_timestamp_ms() < deadline);
+  assert(!*is_running);
+  ws_cleanup(ws);
+}
+
+/* messages sent concurrently from many threads go through the lock-free
+ *  queue: none is lost, and each producer's are sent in order */
+static void
+test_concurrent_producers(void)
+{
+  struct received received={0};
+  pthread_mutex_init(&received.lock, NULL);
+  struct stub_server server={ .ws_message_cb = &on_producer_message, .data = &received };
+  stub_server_start(&server);
+
+  bool is_running=false;
+  struct websockets *ws = ws_init_stub(&server, &is_running);
+  ws_set_queue_limit(ws, AMT_PRODUCERS * AMT_PER_PRODUCER); // never rejected
+
+  struct producer producers[AMT_PRODUCERS];
+  pthread_t tids[AMT_PRODUCERS];
+  for (int i=0; i < AMT_PRODUCERS; ++i) {
+    producers[i] = (struct producer){ .ws = ws, .id = i };
+    assert(0 == pthread_create(&tids[i], NULL, &producer_run, &producers[i]));
+  }
+
+  // drive the connection until everything has been received
+  const size_t total = AMT_PRODUCERS * AMT_PER_PRODUCER;
+  uint64_t deadline = cee_timestamp_ms() + 30000;
+  size_t amt=0, amt_errors=0;
+  do {
+    ws_perform(ws, &is_running, 10);
+    pthread_mutex_lock(&received.lock);
+    amt = received.amt;
+    amt_errors = received.amt_errors;
+    pthread_mutex_unlock(&received.lock);
+  } while (amt + amt_errors < total && cee_timestamp_ms() < deadline);
+
+  for (int i=0; i < AMT_PRODUCERS; ++i) {
+    pthread_join(tids[i], NULL);
+    assert(0 == producers[i].amt_failed);
+  }
+  assert(0 == amt_errors);
+  assert(total == amt);
+  for (int i=0; i < AMT_PRODUCERS; ++i)
+    assert(AMT_PER_PRODUCER == received.next_seq[i]);
+
+  struct ws_queue_stats stats;
+  ws_get_queue_stats(ws, &stats);
+  assert(total == stats.amt_queued && 0 == stats.amt_rejected && 0 == stats.depth);
+
+  ws_close_stub(ws, &is_running);
+  stub_server_stop(&server);
+  pthread_mutex_destroy(&received.lock);
+  fprintf(stderr, "%s: ok\n", __func__);
+}
+
+int main(void)
+{
+  curl_global_init(CURL_GLOBAL_ALL);
+  logconf_setup(&conf, "TEST_WEBSOCKETS", NULL);
+
+  test_concurrent_producers();
+
+  logconf_cleanup(&conf);
+  curl_global_cleanup();
+
+  fprintf(stderr, "\nSUCCESS\n");
+  return EXIT_SUCCESS;
+}